@@ -40,13 +40,19 @@
 static void flt_ot_vars_scope_dump(struct vars *vars, const char *scope)
 {
 	const struct var *var;
+	struct eb64_node *node;
+	int               i;
 
 	if (vars == NULL)
 		return;
 
 	vars_rdlock(vars);
-	list_for_each_entry(var, &(vars->head), l)
-		FLT_OT_DBG(2, "'%s.%016" PRIx64 "' -> '%.*s'", scope, var->name_hash, (int)b_data(&(var->data.u.str)), b_orig(&(var->data.u.str)));
+	for (i = 0; i < VAR_NAME_ROOTS; i++)
+		for (node = eb64_first(&(vars->name_root[i])); node != NULL; node = eb64_next(node)) {
+			var = eb64_entry(node, struct var, node);
+
+			FLT_OT_DBG(2, "'%s.%016" PRIx64 "' -> '%.*s'", scope, var->node.key, (int)b_data(&(var->data.u.str)), b_orig(&(var->data.u.str)));
+		}
 	vars_rdunlock(vars);
 }
 
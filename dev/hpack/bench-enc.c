@@ -0,0 +1,240 @@
+/*
+ * HPACK encoder benchmark. Encodes a series of synthetic API response header
+ * blocks, first without then with the encoder's dynamic table, and reports the
+ * number of bytes emitted and the encoding time per header. All blocks are then
+ * decoded again to make sure the decoder sees the original headers.
+ *
+ * Usage: bench-enc [-n blocks] [-r blocks_per_conn] [-s table_size]
+ *
+ * Build like this :
+ *    gcc -I../../include -O2 -fno-strict-aliasing -fwrapv \
+ *        -o bench-enc bench-enc.c
+ */
+
+#define HPACK_STANDALONE
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <haproxy/chunk.h>
+#include <haproxy/hpack-dec.h>
+#include <haproxy/hpack-enc.h>
+#include <haproxy/hpack-tbl.h>
+
+#define MAX_BLK_SIZE 16384
+#define MAX_HDR_NUM  64
+
+char trash_buf[MAX_BLK_SIZE];
+char tmp_buf[MAX_BLK_SIZE];
+char out_buf[MAX_BLK_SIZE];
+
+THREAD_LOCAL struct buffer trash = { .area = trash_buf, .data = 0, .size = sizeof(trash_buf) };
+struct buffer tmp = { .area = tmp_buf, .data = 0, .size = sizeof(tmp_buf) };
+
+#include "../src/hpack-huff.c"
+#include "../src/hpack-tbl.c"
+#include "../src/hpack-dec.c"
+#include "../src/hpack-enc.c"
+
+/* one synthetic response */
+struct blk {
+	int nbhdr;
+	struct http_hdr hdr[MAX_HDR_NUM];
+	char vals[4][64];
+};
+
+/* display the message and exit with the code */
+__attribute__((noreturn)) void die(int code, const char *format, ...)
+{
+	va_list args;
+
+	if (format) {
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+	exit(code);
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* fills <blk> with the headers of response number <n>. Some fields never
+ * change, some change from time to time and others are unique.
+ */
+static void make_blk(struct blk *blk, unsigned int n)
+{
+	int i = 0;
+
+	snprintf(blk->vals[0], sizeof(blk->vals[0]), "Fri, 16 Oct 2026 10:%02u:%02u GMT", (n / 3000) % 60, (n / 50) % 60);
+	snprintf(blk->vals[1], sizeof(blk->vals[1]), "%u", (n * 7919) % 20000);
+	snprintf(blk->vals[2], sizeof(blk->vals[2]), "%08x-%04x-%04x", n * 2654435761U, n & 0xffff, (n >> 4) & 0xffff);
+	snprintf(blk->vals[3], sizeof(blk->vals[3]), "sid=%08x; Path=/; Secure; HttpOnly", n / 10 * 40503U);
+
+	blk->hdr[i].n = ist("server");                           blk->hdr[i++].v = ist("nginx/1.25.3");
+	blk->hdr[i].n = ist("date");                             blk->hdr[i++].v = ist(blk->vals[0]);
+	blk->hdr[i].n = ist("content-type");                     blk->hdr[i++].v = ist("application/json; charset=utf-8");
+	blk->hdr[i].n = ist("content-length");                   blk->hdr[i++].v = ist(blk->vals[1]);
+	blk->hdr[i].n = ist("cache-control");                    blk->hdr[i++].v = ist("no-cache, no-store, must-revalidate");
+	blk->hdr[i].n = ist("vary");                             blk->hdr[i++].v = ist("Accept-Encoding, Origin");
+	blk->hdr[i].n = ist("strict-transport-security");        blk->hdr[i++].v = ist("max-age=63072000; includeSubDomains");
+	blk->hdr[i].n = ist("access-control-allow-origin");      blk->hdr[i++].v = ist("https://app.example.com");
+	blk->hdr[i].n = ist("x-content-type-options");           blk->hdr[i++].v = ist("nosniff");
+	blk->hdr[i].n = ist("x-frame-options");                  blk->hdr[i++].v = ist("DENY");
+	blk->hdr[i].n = ist("x-request-id");                     blk->hdr[i++].v = ist(blk->vals[2]);
+	if (n % 10 == 0) {
+		blk->hdr[i].n = ist("set-cookie");               blk->hdr[i++].v = ist(blk->vals[3]);
+	}
+	blk->nbhdr = i;
+}
+
+/* encodes <blk> with <enc> into <out>. Returns the number of bytes. */
+static int encode_blk(struct hpack_enc *enc, struct buffer *out, const struct blk *blk)
+{
+	int i;
+
+	out->data = 0;
+	if (!hpack_enc_begin(enc, out) || !hpack_encode_int_status(out, 200))
+		die(1, "output buffer full\n");
+
+	for (i = 0; i < blk->nbhdr; i++)
+		if (!hpack_enc_header(enc, out, blk->hdr[i].n, blk->hdr[i].v))
+			die(1, "output buffer full\n");
+
+	hpack_enc_commit(enc);
+	return out->data;
+}
+
+/* encodes then decodes all blocks, and compares the headers */
+static void check(int nbblk, int perconn, int size)
+{
+	struct http_hdr list[MAX_HDR_NUM];
+	struct buffer out = { .area = out_buf, .size = sizeof(out_buf) };
+	struct hpack_enc enc;
+	struct hpack_dht *dht = NULL;
+	struct blk blk;
+	int n, i, j, ret;
+
+	for (n = 0; n < nbblk; n++) {
+		if (n % perconn == 0) {
+			if (dht) {
+				hpack_enc_release(&enc);
+				hpack_dht_free(dht);
+			}
+			hpack_enc_init(&enc, size);
+			hpack_enc_set_max(&enc, size);
+			dht = hpack_dht_alloc();
+			if (!dht)
+				die(1, "cannot allocate the decoder's table\n");
+			hpack_dht_init(dht, size > HPACK_DFLT_TABLE_SIZE ? size : HPACK_DFLT_TABLE_SIZE);
+		}
+
+		make_blk(&blk, n);
+		encode_blk(&enc, &out, &blk);
+
+		ret = hpack_decode_frame(dht, (const uint8_t *)out.area, out.data, list,
+		                         sizeof(list) / sizeof(list[0]), &tmp);
+		if (ret <= 0)
+			die(1, "block %d: decoding failed: %d\n", n, ret);
+
+		/* skip :status, and the end marker */
+		for (i = 0, j = 0; i < ret - 1; i++) {
+			if (!list[i].n.ptr)
+				continue;
+			if (j >= blk.nbhdr || !isteq(list[i].n, blk.hdr[j].n) || !isteq(list[i].v, blk.hdr[j].v))
+				die(1, "block %d: header %d mismatch\n", n, j);
+			j++;
+		}
+		if (j != blk.nbhdr)
+			die(1, "block %d: %d headers decoded, %d expected\n", n, j, blk.nbhdr);
+	}
+
+	hpack_enc_release(&enc);
+	hpack_dht_free(dht);
+}
+
+/* runs the benchmark for table size <size> */
+static void bench(int nbblk, int perconn, int size)
+{
+	struct buffer out = { .area = out_buf, .size = sizeof(out_buf) };
+	struct hpack_enc enc;
+	static struct blk *blks;
+	unsigned long long bytes = 0, hdrs = 0, start = 0, total = 0;
+	int n;
+
+	if (!blks) {
+		blks = calloc(perconn, sizeof(*blks));
+		if (!blks)
+			die(1, "out of memory\n");
+	}
+
+	for (n = 0; n < nbblk; n++) {
+		if (n % perconn == 0) {
+			if (n)
+				hpack_enc_release(&enc);
+			hpack_enc_init(&enc, size);
+			hpack_enc_set_max(&enc, size);
+		}
+
+		/* the blocks are prepared per connection out of the measure */
+		if (n % perconn == 0) {
+			int i;
+
+			for (i = 0; i < perconn; i++)
+				make_blk(&blks[i], n + i);
+			start = now_ns();
+		}
+
+		bytes += encode_blk(&enc, &out, &blks[n % perconn]);
+		hdrs  += blks[n % perconn].nbhdr + 1;
+
+		if (n % perconn == perconn - 1 || n == nbblk - 1)
+			total += now_ns() - start;
+	}
+	hpack_enc_release(&enc);
+
+	printf("table=%-6d blocks=%d hdrs=%llu bytes=%llu (%.1f B/blk, %.2f B/hdr) enc=%.1f ns/hdr\n",
+	       size, nbblk, hdrs, bytes, (double)bytes / nbblk, (double)bytes / hdrs,
+	       (double)total / hdrs);
+}
+
+int main(int argc, char **argv)
+{
+	struct pool_head pool;
+	int nbblk = 100000;
+	int perconn = 100;
+	int size = HPACK_DFLT_TABLE_SIZE;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:s:")) != -1) {
+		switch (c) {
+		case 'n': nbblk = atoi(optarg); break;
+		case 'r': perconn = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		default:
+			die(1, "Usage: %s [-n blocks] [-r blocks_per_conn] [-s table_size]\n", argv[0]);
+		}
+	}
+
+	if (nbblk <= 0 || perconn <= 0 || size < 0 || size > 65536)
+		die(1, "invalid argument\n");
+
+	pool.size = size > HPACK_DFLT_TABLE_SIZE ? size : HPACK_DFLT_TABLE_SIZE;
+	pool_head_hpack_tbl = &pool;
+
+	bench(nbblk, perconn, 0);
+	bench(nbblk, perconn, size);
+
+	check(nbblk, perconn, 0);
+	check(nbblk, perconn, size);
+	printf("check: all %d blocks decoded correctly\n", nbblk);
+	return 0;
+}
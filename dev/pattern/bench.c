@@ -0,0 +1,254 @@
+/*
+ * Regex pattern lists benchmark. Builds a WAF-like rule set of a few thousand
+ * regex, then measures the time taken to look up a few requests, first by
+ * executing all regex one at a time as the list used to be evaluated, then
+ * with pat_match_reg() which only executes the regex whose literal was found
+ * in the input. Both must report the same first matching rule.
+ *
+ * Usage: bench [-l loops] [-n rules] [-i]
+ *
+ * Build like this :
+ *    make dev/pattern/bench
+ */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/chunk.h>
+#include <haproxy/global.h>
+#include <haproxy/pattern.h>
+#include <haproxy/regex.h>
+#include <haproxy/sample.h>
+#include <haproxy/tools.h>
+
+/* hand-written rules, the other ones are derived from the templates below */
+static const char *rules[] = {
+	"union[[:space:]]+(all[[:space:]]+)?select",
+	"select.+from[[:space:]]",
+	"insert[[:space:]]+into",
+	"drop[[:space:]]+table",
+	"information_schema",
+	"sleep\\([0-9]+\\)",
+	"benchmark\\(",
+	"waitfor[[:space:]]+delay",
+	"<script",
+	"javascript:",
+	"onerror[[:space:]]*=",
+	"onload[[:space:]]*=",
+	"document\\.cookie",
+	"\\.\\./\\.\\./",
+	"/etc/passwd",
+	"/proc/self/environ",
+	"cmd\\.exe",
+	"/bin/(ba)?sh",
+	"base64_decode\\(",
+	"eval\\(",
+	"\\$\\{jndi:",
+	"/\\.git/",
+	"/\\.env$",
+	"/wp-admin/",
+	"/wp-login\\.php",
+	"/xmlrpc\\.php",
+	"/phpmyadmin/",
+	"\\.(bak|old|sql|swp)$",
+	"^/cgi-bin/",
+	"%00",
+	"[?&](cmd|exec|command)=",
+	"^/[a-z]+/[0-9]+\\.php\\?",
+	"(sqlmap|nikto|nessus|masscan)",
+};
+
+/* templates of generated rules, taking an integer */
+static const char *templates[] = {
+	"^/api/v[0-9]+/tenant%d/(export|dump)",
+	"[?&]param%d=[^&]*(<|%%3[cC])",
+	"/static/build-%d/.*\\.map$",
+	"^/legacy/app%d/admin/",
+	"X-Debug-Token-%d",
+	"/internal/service%d/(health|metrics)",
+};
+
+/* the requests to look up, benign ones first */
+static const char *requests[] = {
+	"/static/js/app.3f9c2b1e.chunk.js?v=20261016",
+	"/api/v2/orders?customer=4812&status=open&page=3",
+	"/account/settings/profile",
+	"/images/products/large/8827361.jpg",
+	"/search?q=red+shoes&sort=price&order=asc",
+	"/api/v1/tenant1902/export?format=csv",
+	"/index.php?id=1 union select password from users",
+	"/download?file=../../../../etc/passwd",
+};
+
+/* Stubs for the functions the pattern and regex code refer to but which are
+ * not needed here.
+ */
+struct global global;
+struct activity activity[MAX_THREADS];
+struct thread_info ha_thread_info[MAX_THREADS];
+THREAD_LOCAL unsigned int tid;
+THREAD_LOCAL struct buffer trash = { };
+THREAD_LOCAL unsigned int now_ms;
+THREAD_LOCAL struct tgroup_ctx *tg_ctx;
+THREAD_LOCAL struct thread_ctx *th_ctx;
+struct pool_head *pool_head_task;
+__decl_aligned_rwlock(wq_lock);
+int stopping;
+sample_cast_fct sample_casts[SMP_TYPES][SMP_TYPES];
+const char *smp_to_type[SMP_TYPES];
+void *__pool_alloc(struct pool_head *pool, unsigned int flags) { return NULL; }
+void __pool_free(struct pool_head *pool, void *ptr) { }
+void __task_queue(struct task *task, struct eb_root *wq) { }
+int c_none(struct sample *smp) { return 1; }
+int chunk_appendf(struct buffer *chk, const char *fmt, ...) { return 0; }
+int chunk_printf(struct buffer *chk, const char *fmt, ...) { return 0; }
+int cidr2dotted(int cidr, struct in_addr *mask) { return 0; }
+void complain(int *counter, const char *msg, int taint) { }
+struct buffer *get_trash_chunk(void) { return NULL; }
+void ha_alert(const char *fmt, ...) { }
+void ha_warning(const char *fmt, ...) { }
+void ha_backtrace_to_stderr(void) { }
+uint64_t ha_random64(void) { return 0; }
+void hap_register_build_opts(const char *str, int must_free) { }
+void hap_register_post_check(int (*fct)()) { }
+void hap_register_post_deinit(void (*fct)()) { }
+void hap_register_per_thread_alloc(int (*fct)()) { }
+void hap_register_per_thread_free(void (*fct)()) { }
+int ishex(char s) { return 0; }
+void pool_flush(struct pool_head *pool) { }
+int parse_binary(const char *source, char **binstr, int *binstrlen, char **err) { return 0; }
+int smp_dup(struct sample *smp) { return 0; }
+int strlcpy2(char *dst, const char *src, int size) { return 0; }
+int str2net(const char *str, int resolve, struct in_addr *addr, struct in_addr *mask) { return 0; }
+int str62net(const char *str, struct in6_addr *addr, unsigned char *mask) { return 0; }
+int strl2llrc(const char *s, int len, long long *ret) { return 0; }
+int strl2llrc_dotted(const char *text, int len, long long *ret) { return 0; }
+void v4tov6(struct in6_addr *sin6_addr, struct in_addr *sin_addr) { }
+int v6tov4(struct in_addr *sin_addr, struct in6_addr *sin6_addr) { return 0; }
+
+char *memprintf(char **out, const char *format, ...)
+{
+	va_list args;
+
+	free(*out);
+	va_start(args, format);
+	if (vasprintf(out, format, args) < 0)
+		*out = NULL;
+	va_end(args);
+	return *out;
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* former lookup: executes all regex in the list order */
+static struct pattern *list_match(struct sample *smp, struct pattern_expr *expr)
+{
+	struct pattern_list *lst;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		if (regex_exec2(lst->pat.ptr.reg, smp->data.u.str.area, smp->data.u.str.data))
+			return &lst->pat;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[1024];
+	struct pattern_head head;
+	struct pattern_expr *expr;
+	struct pat_ref *ref;
+	struct pattern *p1, *p2;
+	struct sample smp;
+	unsigned long long start, t1, t2;
+	char rule[256];
+	char *err = NULL;
+	int loops = 10000, nbrules = 2000, icase = 0;
+	int c, i, l;
+
+	while ((c = getopt(argc, argv, "l:n:i")) != -1) {
+		switch (c) {
+		case 'l': loops = atoi(optarg); break;
+		case 'n': nbrules = atoi(optarg); break;
+		case 'i': icase = 1; break;
+		default:
+			fprintf(stderr, "Usage: %s [-l loops] [-n rules] [-i]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (loops <= 0 || nbrules <= 0) {
+		fprintf(stderr, "invalid argument\n");
+		exit(1);
+	}
+
+	pattern_init_head(&head);
+	head.parse  = pat_parse_fcts[PAT_MATCH_REG];
+	head.index  = pat_index_fcts[PAT_MATCH_REG];
+	head.prune  = pat_prune_fcts[PAT_MATCH_REG];
+	head.match  = pat_match_fcts[PAT_MATCH_REG];
+	head.expect_type = pat_match_types[PAT_MATCH_REG];
+
+	ref = pat_ref_new("bench", "bench rules", PAT_REF_ACL);
+	expr = ref ? pattern_new_expr(&head, ref, icase ? PAT_MF_IGNORE_CASE : 0, &err, NULL) : NULL;
+	if (!expr) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nbrules; i++) {
+		if (i < sizeof(rules) / sizeof(rules[0]))
+			snprintf(rule, sizeof(rule), "%s", rules[i]);
+		else
+			snprintf(rule, sizeof(rule), templates[i % (sizeof(templates) / sizeof(templates[0]))], i);
+
+		if (!pat_ref_add(ref, rule, NULL, &err)) {
+			fprintf(stderr, "rule '%s': %s\n", rule, err);
+			exit(1);
+		}
+	}
+	pat_ref_prepare(ref);
+
+	printf("rules=%d%s\n", nbrules, icase ? " (ignore case)" : "");
+	for (i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+		memset(&smp, 0, sizeof(smp));
+		smp.data.type = SMP_T_STR;
+		smp.data.u.str.area = buf;
+		smp.data.u.str.data = strlen(requests[i]);
+		smp.data.u.str.size = sizeof(buf);
+		memcpy(buf, requests[i], smp.data.u.str.data + 1);
+
+		p1 = list_match(&smp, expr);
+		p2 = pat_match_reg(&smp, expr, 0);
+
+		start = now_ns();
+		for (l = 0; l < loops; l++)
+			list_match(&smp, expr);
+		t1 = now_ns() - start;
+
+		start = now_ns();
+		for (l = 0; l < loops; l++)
+			pat_match_reg(&smp, expr, 0);
+		t2 = now_ns() - start;
+
+		printf("%-48s list: %9.1f ns  literals: %8.1f ns  %s%s\n",
+		       requests[i], (double)t1 / loops, (double)t2 / loops,
+		       p1 ? p1->ref->pattern : "no match",
+		       p1 != p2 ? " (mismatch!)" : "");
+	}
+	return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * IP networks lookup benchmark. Builds a routing-table-like list of random
+ * IPv4 or IPv6 networks, then measures the number of lookups per second of
+ * pat_match_ip() for random addresses, first using the expression's trees,
+ * then using the LPM tables enabled by tune.pattern.ip-lpm-threshold. Both must
+ * report the same network for each address.
+ *
+ * Usage: ipbench [-6] [-l lookups] [-n networks] [-s seed]
+ *
+ * Build like this :
+ *    make dev/pattern/ipbench
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/chunk.h>
+#include <haproxy/global.h>
+#include <haproxy/pattern.h>
+#include <haproxy/sample.h>
+#include <haproxy/tools.h>
+
+/* Stubs for the functions the pattern and regex code refer to but which are
+ * not needed here.
+ */
+struct global global;
+struct activity activity[MAX_THREADS];
+struct thread_info ha_thread_info[MAX_THREADS];
+THREAD_LOCAL unsigned int tid;
+THREAD_LOCAL struct buffer trash = { };
+THREAD_LOCAL unsigned int now_ms;
+THREAD_LOCAL struct tgroup_ctx *tg_ctx;
+THREAD_LOCAL struct thread_ctx *th_ctx;
+struct pool_head *pool_head_task;
+__decl_aligned_rwlock(wq_lock);
+int stopping;
+sample_cast_fct sample_casts[SMP_TYPES][SMP_TYPES];
+const char *smp_to_type[SMP_TYPES];
+void *__pool_alloc(struct pool_head *pool, unsigned int flags) { return NULL; }
+void __pool_free(struct pool_head *pool, void *ptr) { }
+void __task_queue(struct task *task, struct eb_root *wq) { }
+int c_none(struct sample *smp) { return 1; }
+int chunk_appendf(struct buffer *chk, const char *fmt, ...) { return 0; }
+int chunk_printf(struct buffer *chk, const char *fmt, ...) { return 0; }
+void complain(int *counter, const char *msg, int taint) { }
+struct buffer *get_trash_chunk(void) { return NULL; }
+void ha_alert(const char *fmt, ...) { }
+void ha_warning(const char *fmt, ...) { }
+void ha_backtrace_to_stderr(void) { }
+uint64_t ha_random64(void) { return 0; }
+void hap_register_build_opts(const char *str, int must_free) { }
+void hap_register_post_check(int (*fct)()) { }
+void hap_register_post_deinit(void (*fct)()) { }
+void hap_register_per_thread_alloc(int (*fct)()) { }
+void hap_register_per_thread_free(void (*fct)()) { }
+int ishex(char s) { return 0; }
+void pool_flush(struct pool_head *pool) { }
+int parse_binary(const char *source, char **binstr, int *binstrlen, char **err) { return 0; }
+int smp_dup(struct sample *smp) { return 0; }
+int strlcpy2(char *dst, const char *src, int size) { return 0; }
+int strl2llrc(const char *s, int len, long long *ret) { return 0; }
+int strl2llrc_dotted(const char *text, int len, long long *ret) { return 0; }
+void v4tov6(struct in6_addr *sin6_addr, struct in_addr *sin_addr) { memset(sin6_addr, 0, sizeof(*sin6_addr)); }
+int v6tov4(struct in_addr *sin_addr, struct in6_addr *sin6_addr) { return 0; }
+
+char *memprintf(char **out, const char *format, ...)
+{
+	va_list args;
+
+	free(*out);
+	va_start(args, format);
+	if (vasprintf(out, format, args) < 0)
+		*out = NULL;
+	va_end(args);
+	return *out;
+}
+
+int cidr2dotted(int cidr, struct in_addr *mask)
+{
+	mask->s_addr = cidr ? htonl(~0U << (32 - cidr)) : 0;
+	return 1;
+}
+
+/* simplified versions of the network parsers, only supporting <addr>/<len> */
+static int parse_net(const char *str, int family, void *addr, int *len)
+{
+	char buf[64];
+	const char *slash = strchr(str, '/');
+
+	snprintf(buf, sizeof(buf), "%.*s", slash ? (int)(slash - str) : (int)strlen(str), str);
+	*len = slash ? atoi(slash + 1) : (family == AF_INET ? 32 : 128);
+	return inet_pton(family, buf, addr) == 1;
+}
+
+int str2net(const char *str, int resolve, struct in_addr *addr, struct in_addr *mask)
+{
+	int len;
+
+	if (!parse_net(str, AF_INET, addr, &len))
+		return 0;
+	return cidr2dotted(len, mask);
+}
+
+int str62net(const char *str, struct in6_addr *addr, unsigned char *mask)
+{
+	int len;
+
+	if (!parse_net(str, AF_INET6, addr, &len))
+		return 0;
+	*mask = len;
+	return 1;
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t rnd_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rnd64()
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+/* returns a random prefix length resembling a full routing table */
+static int rnd_len(int v6)
+{
+	int r = rnd64() % 100;
+
+	if (v6)
+		return r < 50 ? 48 : r < 70 ? 32 + rnd64() % 16 : r < 90 ? 29 + rnd64() % 3 : 49 + rnd64() % 16;
+	return r < 60 ? 24 : r < 90 ? 16 + rnd64() % 8 : r < 95 ? 8 + rnd64() % 8 : 25 + rnd64() % 8;
+}
+
+/* sets <addr> to a random address of <alen> bytes, keeping only its <len>
+ * first bits.
+ */
+static void rnd_addr(uint8_t *addr, int alen, int len)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < alen; i++) {
+		if (!(i & 7))
+			r = rnd64();
+		addr[i] = r >> ((i & 7) * 8);
+		if (len - i * 8 < 8)
+			addr[i] &= len <= i * 8 ? 0 : 0xff << (8 - (len - i * 8));
+	}
+	if (alen == 16)
+		addr[0] = 0x20 | (addr[0] & 0x0f); /* 2000::/4 */
+}
+
+int main(int argc, char **argv)
+{
+	struct pattern_head head;
+	struct pattern_expr *expr;
+	struct pat_ref *ref;
+	struct pattern *pat;
+	struct pat_ref_elt **res;
+	struct sample *smp;
+	unsigned long long start, t1, t2, tb;
+	char net[INET6_ADDRSTRLEN + 8];
+	uint8_t addr[16];
+	char *err = NULL;
+	int nblookups = 1000000, nbnets = 500000, v6 = 0;
+	int alen, c, i, len, mismatches = 0, found = 0;
+
+	while ((c = getopt(argc, argv, "6l:n:s:")) != -1) {
+		switch (c) {
+		case '6': v6 = 1; break;
+		case 'l': nblookups = atoi(optarg); break;
+		case 'n': nbnets = atoi(optarg); break;
+		case 's': rnd_state = strtoull(optarg, NULL, 0) | 1; break;
+		default:
+			fprintf(stderr, "Usage: %s [-6] [-l lookups] [-n networks] [-s seed]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (nblookups <= 0 || nbnets <= 0) {
+		fprintf(stderr, "invalid argument\n");
+		exit(1);
+	}
+
+	alen = v6 ? 16 : 4;
+	pattern_init_head(&head);
+	head.parse  = pat_parse_fcts[PAT_MATCH_IP];
+	head.index  = pat_index_fcts[PAT_MATCH_IP];
+	head.prune  = pat_prune_fcts[PAT_MATCH_IP];
+	head.match  = pat_match_fcts[PAT_MATCH_IP];
+	head.expect_type = pat_match_types[PAT_MATCH_IP];
+
+	ref = pat_ref_new("bench", "bench networks", PAT_REF_ACL);
+	expr = ref ? pattern_new_expr(&head, ref, 0, &err, NULL) : NULL;
+	if (!expr) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nbnets; i++) {
+		len = rnd_len(v6);
+		rnd_addr(addr, alen, len);
+		inet_ntop(v6 ? AF_INET6 : AF_INET, addr, net, sizeof(net));
+		snprintf(net + strlen(net), 8, "/%d", len);
+		if (!pat_ref_add(ref, net, NULL, &err)) {
+			fprintf(stderr, "network '%s': %s\n", net, err);
+			exit(1);
+		}
+	}
+
+	/* addresses to look up, half of them within a network */
+	smp = calloc(nblookups, sizeof(*smp));
+	res = calloc(nblookups, sizeof(*res));
+	if (!smp || !res) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nblookups; i++) {
+		rnd_addr(addr, alen, alen * 8);
+		if (i & 1) {
+			/* reuse the beginning of a known network */
+			struct pat_ref_elt *elt = LIST_ELEM(ref->head.n, struct pat_ref_elt *, list);
+			int skip = rnd64() % 64;
+
+			while (skip-- && elt->list.n != &ref->head)
+				elt = LIST_ELEM(elt->list.n, struct pat_ref_elt *, list);
+			parse_net(elt->pattern, v6 ? AF_INET6 : AF_INET, net, &len);
+			memcpy(addr, net, len / 8);
+		}
+		smp[i].data.type = v6 ? SMP_T_IPV6 : SMP_T_IPV4;
+		memcpy(v6 ? (void *)&smp[i].data.u.ipv6 : (void *)&smp[i].data.u.ipv4, addr, alen);
+	}
+
+	global.tune.pattern_lpm = 0;
+	start = now_ns();
+	for (i = 0; i < nblookups; i++) {
+		pat = pat_match_ip(&smp[i], expr, 1);
+		res[i] = pat ? pat->ref : NULL;
+		found += !!pat;
+	}
+	t1 = now_ns() - start;
+
+	/* the tables are built as after a load */
+	global.tune.pattern_lpm = 1;
+	start = now_ns();
+	pat_ref_prepare(ref);
+	tb = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < nblookups; i++) {
+		pat = pat_match_ip(&smp[i], expr, 1);
+		mismatches += (pat ? pat->ref : NULL) != res[i];
+	}
+	t2 = now_ns() - start;
+
+	printf("%s networks=%d lookups=%d found=%d\n", v6 ? "IPv6" : "IPv4", nbnets, nblookups, found);
+	printf("tree: %8.2f M lookups/s\n", nblookups * 1000.0 / t1);
+	printf("lpm:  %8.2f M lookups/s (built in %.1f ms, %u nodes, %u leaves)%s\n",
+	       nblookups * 1000.0 / t2, tb / 1000000.0,
+	       expr->lpm ? (v6 ? expr->lpm->v6.nb_nodes : expr->lpm->v4.nb_nodes) : 0,
+	       expr->lpm ? (v6 ? expr->lpm->v6.nb_leaves : expr->lpm->v4.nb_leaves) : 0,
+	       mismatches ? " (mismatch!)" : "");
+	return !!mismatches;
+}
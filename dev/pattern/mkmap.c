@@ -0,0 +1,487 @@
+/*
+ * Map file compiler. Converts a text map file into a precompiled map file that
+ * haproxy maps read-only in memory and searches in place, instead of parsing
+ * and indexing every line at boot. The output is first written to a temporary
+ * file which then replaces <output>, so that running processes keep using the
+ * previous version until they are reloaded.
+ *
+ * With "-t str" (default), the keys are exact strings, sorted for a binary
+ * search ("map_str" and friends). With "-t ip", the keys are IPv4 or IPv6
+ * addresses or networks ("map_ip" and friends), which are flattened into
+ * non-overlapping ranges of addresses each pointing to the most specific
+ * network. As with text files, the first occurrence of a duplicate key wins.
+ *
+ * Usage: mkmap [-t str|ip] <input> <output>
+ *
+ * Build like this :
+ *    make dev/pattern/mkmap
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <haproxy/pattern-t.h>
+
+/* a key read from the input file */
+struct key {
+	uint32_t line;          /* line number, to keep the first duplicate */
+	uint32_t koff;          /* offset of the key in the keys area */
+	uint32_t voff;          /* offset of the value in the values area */
+	uint8_t from[16];       /* first address of the network */
+	uint8_t to[16];         /* last address of the network */
+	int cidr;               /* prefix length of the network */
+};
+
+/* an output range of addresses */
+struct range {
+	uint8_t from[16];
+	uint8_t to[16];
+	const struct key *k;
+};
+
+/* a growing area of zero-terminated strings */
+struct area {
+	char *buf;
+	size_t len, size;
+};
+
+static struct key *keys;
+static size_t nb_keys, sz_keys;
+static struct area key_area, val_area;
+
+/* hash table used to store each distinct value only once */
+static uint32_t *val_hash;
+static size_t val_hash_sz;
+
+static int alen; /* address length used by the sort and range functions */
+
+static void die(const char *msg, const char *arg)
+{
+	fprintf(stderr, "mkmap: %s%s%s\n", msg, arg ? " " : "", arg ? arg : "");
+	exit(1);
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		die("out of memory", NULL);
+	return ptr;
+}
+
+/* appends <str> to area <a> and returns its offset */
+static uint32_t area_add(struct area *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t ofs = a->len;
+
+	if (a->len + len > UINT32_MAX)
+		die("output file too large", NULL);
+
+	if (a->len + len > a->size) {
+		a->size = (a->len + len) * 2;
+		a->buf = xrealloc(a->buf, a->size);
+	}
+	memcpy(a->buf + a->len, str, len);
+	a->len += len;
+	return ofs;
+}
+
+static uint32_t hash_str(const char *str)
+{
+	uint32_t h = 2166136261U;
+
+	while (*str)
+		h = (h ^ (uint8_t)*str++) * 16777619U;
+	return h;
+}
+
+/* stores value <val> once and returns its offset in the values area */
+static uint32_t add_value(const char *val)
+{
+	size_t i, sz;
+	uint32_t *old;
+
+	if (val_hash_sz < 2 * (nb_keys + 1)) {
+		/* rehash */
+		old = val_hash;
+		sz = val_hash_sz;
+		val_hash_sz = val_hash_sz ? val_hash_sz * 2 : 1024;
+		val_hash = xrealloc(NULL, val_hash_sz * sizeof(*val_hash));
+		memset(val_hash, 0xff, val_hash_sz * sizeof(*val_hash));
+		for (i = 0; i < sz; i++) {
+			size_t h;
+
+			if (old[i] == UINT32_MAX)
+				continue;
+			h = hash_str(val_area.buf + old[i]) & (val_hash_sz - 1);
+			while (val_hash[h] != UINT32_MAX)
+				h = (h + 1) & (val_hash_sz - 1);
+			val_hash[h] = old[i];
+		}
+		free(old);
+	}
+
+	i = hash_str(val) & (val_hash_sz - 1);
+	while (val_hash[i] != UINT32_MAX) {
+		if (strcmp(val_area.buf + val_hash[i], val) == 0)
+			return val_hash[i];
+		i = (i + 1) & (val_hash_sz - 1);
+	}
+	val_hash[i] = area_add(&val_area, val);
+	return val_hash[i];
+}
+
+/* parses network <str> into <k>. Returns 4 for IPv4, 16 for IPv6, 0 if
+ * invalid. Like haproxy, accepts an optional prefix length, or a contiguous
+ * netmask for IPv4.
+ */
+static int parse_net(const char *str, struct key *k)
+{
+	char addr[INET6_ADDRSTRLEN + 1];
+	const char *slash = strchr(str, '/');
+	size_t len = slash ? (size_t)(slash - str) : strlen(str);
+	struct in_addr mask;
+	uint32_t m;
+	char *end;
+	int bits, i;
+
+	if (len >= sizeof(addr))
+		return 0;
+	memcpy(addr, str, len);
+	addr[len] = 0;
+
+	if (inet_pton(AF_INET, addr, k->from) == 1)
+		bits = 32;
+	else if (inet_pton(AF_INET6, addr, k->from) == 1)
+		bits = 128;
+	else
+		return 0;
+
+	k->cidr = bits;
+	if (slash) {
+		if (bits == 32 && strchr(slash + 1, '.')) {
+			if (inet_pton(AF_INET, slash + 1, &mask) != 1)
+				return 0;
+			m = ntohl(mask.s_addr);
+			if (m & (~m >> 1))
+				return 0; /* non-contiguous */
+			k->cidr = __builtin_popcount(m);
+		}
+		else {
+			k->cidr = strtol(slash + 1, &end, 10);
+			if (end == slash + 1 || *end || k->cidr < 0 || k->cidr > bits)
+				return 0;
+		}
+	}
+
+	for (i = 0; i < bits / 8; i++) {
+		int b = k->cidr - i * 8;
+		uint8_t msk = b >= 8 ? 0xff : b <= 0 ? 0 : (uint8_t)(0xff << (8 - b));
+
+		k->from[i] &= msk;
+		k->to[i] = k->from[i] | ~msk;
+	}
+	return bits / 8;
+}
+
+/* reads the text map file <name> the same way as haproxy does */
+static void read_file(const char *name, int type)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t size = 0;
+	uint32_t num = 0;
+	char *c, *key_beg, *key_end, *val_beg, *val_end;
+
+	f = fopen(name, "r");
+	if (!f)
+		die("cannot open", name);
+
+	while (getline(&line, &size, f) != -1) {
+		num++;
+		c = line;
+		if (*c == '#')
+			continue;
+		while (*c == ' ' || *c == '\t')
+			c++;
+		if (*c == '\0' || *c == '\r' || *c == '\n')
+			continue;
+
+		key_beg = c;
+		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+			c++;
+		key_end = c;
+		while (*c == ' ' || *c == '\t')
+			c++;
+		val_beg = c;
+		while (*c && *c != '\n' && *c != '\r')
+			c++;
+		val_end = c;
+		while (val_end > val_beg && (val_end[-1] == ' ' || val_end[-1] == '\t'))
+			val_end--;
+		*key_end = 0;
+		*val_end = 0;
+
+		if (nb_keys == sz_keys) {
+			sz_keys = sz_keys ? sz_keys * 2 : 1024;
+			keys = xrealloc(keys, sz_keys * sizeof(*keys));
+		}
+		memset(&keys[nb_keys], 0, sizeof(*keys));
+		keys[nb_keys].line = num;
+		if (type == PAT_IMG_IP && !parse_net(key_beg, &keys[nb_keys])) {
+			fprintf(stderr, "mkmap: %s:%u: invalid network '%s'\n", name, num, key_beg);
+			exit(1);
+		}
+		keys[nb_keys].koff = area_add(&key_area, key_beg);
+		keys[nb_keys].voff = add_value(val_beg);
+		nb_keys++;
+	}
+
+	if (ferror(f))
+		die("error while reading", name);
+	free(line);
+	fclose(f);
+}
+
+/* sorts string keys on their bytes, then on their line */
+static int cmp_str(const void *a, const void *b)
+{
+	const struct key *ka = a, *kb = b;
+	int ret = strcmp(key_area.buf + ka->koff, key_area.buf + kb->koff);
+
+	return ret ? ret : (ka->line > kb->line) - (ka->line < kb->line);
+}
+
+/* sorts networks on their first address, then on the largest one first, then
+ * on their line.
+ */
+static int cmp_net(const void *a, const void *b)
+{
+	const struct key *ka = a, *kb = b;
+	int ret = memcmp(ka->from, kb->from, alen);
+
+	if (!ret)
+		ret = (ka->cidr > kb->cidr) - (ka->cidr < kb->cidr);
+	return ret ? ret : (ka->line > kb->line) - (ka->line < kb->line);
+}
+
+/* sets <addr> to the address following <src>. Returns 0 on overflow. */
+static int addr_next(uint8_t *addr, const uint8_t *src)
+{
+	int i;
+
+	memcpy(addr, src, alen);
+	for (i = alen - 1; i >= 0; i--)
+		if (++addr[i])
+			return 1;
+	return 0;
+}
+
+/* sets <addr> to the address preceding <src>, which is never zero */
+static void addr_prev(uint8_t *addr, const uint8_t *src)
+{
+	int i;
+
+	memcpy(addr, src, alen);
+	for (i = alen - 1; i >= 0; i--)
+		if (addr[i]--)
+			break;
+}
+
+static struct range *ranges;
+static size_t nb_ranges, sz_ranges;
+
+static void add_range(const uint8_t *from, const uint8_t *to, const struct key *k)
+{
+	if (nb_ranges == sz_ranges) {
+		sz_ranges = sz_ranges ? sz_ranges * 2 : 1024;
+		ranges = xrealloc(ranges, sz_ranges * sizeof(*ranges));
+	}
+	memcpy(ranges[nb_ranges].from, from, alen);
+	memcpy(ranges[nb_ranges].to, to, alen);
+	ranges[nb_ranges].k = k;
+	nb_ranges++;
+}
+
+/* Flattens the <nb> sorted networks of <net> into non-overlapping ranges
+ * pointing to the most specific network. Networks are either disjoint or
+ * nested, so the enclosing ones are kept on a stack while the nested ones are
+ * processed.
+ */
+static void flatten(struct key *net, size_t nb)
+{
+	const struct key *stack[129];
+	uint8_t cur[16], end[16];
+	int sp = 0, cur_ok = 0;
+	size_t i;
+
+	nb_ranges = 0;
+	for (i = 0; i <= nb; i++) {
+		/* close the networks ending before this one */
+		while (sp && (i == nb || memcmp(stack[sp - 1]->to, net[i].from, alen) < 0)) {
+			const struct key *top = stack[--sp];
+
+			if (cur_ok && memcmp(cur, top->to, alen) <= 0)
+				add_range(cur, top->to, top);
+			cur_ok = addr_next(cur, top->to);
+		}
+
+		if (i == nb)
+			break;
+
+		/* skip duplicates, the first one was already pushed */
+		if (i && memcmp(net[i].from, net[i - 1].from, alen) == 0 && net[i].cidr == net[i - 1].cidr)
+			continue;
+
+		/* the enclosing network covers what precedes this one */
+		if (sp && cur_ok && memcmp(cur, net[i].from, alen) < 0) {
+			addr_prev(end, net[i].from);
+			add_range(cur, end, stack[sp - 1]);
+		}
+		stack[sp++] = &net[i];
+		memcpy(cur, net[i].from, alen);
+		cur_ok = 1;
+	}
+}
+
+/* writes <len> bytes from <buf> to <f> then pads to 8 bytes. Returns the
+ * offset where the data were written.
+ */
+static uint64_t put(FILE *f, const void *buf, size_t len)
+{
+	static const char zero[8];
+	uint64_t ofs = ftell(f);
+
+	if ((len && fwrite(buf, len, 1, f) != 1) ||
+	    ((len & 7) && fwrite(zero, 8 - (len & 7), 1, f) != 1))
+		die("error while writing", NULL);
+	return ofs;
+}
+
+int main(int argc, char **argv)
+{
+	struct pat_img_hdr hdr;
+	struct pat_img_str *str = NULL;
+	struct pat_img_ipv4 *ipv4 = NULL;
+	struct pat_img_ipv6 *ipv6 = NULL;
+	struct key *v6;
+	char *tmp;
+	size_t i, n, nb4;
+	int type = PAT_IMG_STR;
+	FILE *f;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:")) != -1) {
+		switch (c) {
+		case 't':
+			if (strcmp(optarg, "str") == 0)
+				type = PAT_IMG_STR;
+			else if (strcmp(optarg, "ip") == 0)
+				type = PAT_IMG_IP;
+			else
+				die("unknown type", optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t str|ip] <input> <output>\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (argc - optind != 2) {
+		fprintf(stderr, "Usage: %s [-t str|ip] <input> <output>\n", argv[0]);
+		exit(1);
+	}
+
+	read_file(argv[optind], type);
+	if (nb_keys > UINT32_MAX / 2)
+		die("too many keys", NULL);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PAT_IMG_MAGIC, sizeof(hdr.magic));
+	hdr.bom = PAT_IMG_BOM;
+	hdr.type = type;
+	hdr.nb_keys = nb_keys;
+
+	if (type == PAT_IMG_STR) {
+		qsort(keys, nb_keys, sizeof(*keys), cmp_str);
+		str = xrealloc(NULL, (nb_keys + 1) * sizeof(*str));
+		for (i = n = 0; i < nb_keys; i++) {
+			if (i && strcmp(key_area.buf + keys[i].koff, key_area.buf + keys[i - 1].koff) == 0)
+				continue;
+			str[n].key = keys[i].koff;
+			str[n].len = strlen(key_area.buf + keys[i].koff);
+			str[n].val = keys[i].voff;
+			n++;
+		}
+		hdr.nb_str = n;
+	}
+	else {
+		/* IPv4 networks first, then IPv6 ones */
+		for (i = nb4 = 0; i < nb_keys; i++) {
+			if (!strchr(key_area.buf + keys[i].koff, ':')) {
+				struct key k = keys[nb4];
+
+				keys[nb4++] = keys[i];
+				keys[i] = k;
+			}
+		}
+		v6 = keys + nb4;
+
+		alen = 4;
+		qsort(keys, nb4, sizeof(*keys), cmp_net);
+		flatten(keys, nb4);
+		ipv4 = xrealloc(NULL, (nb_ranges + 1) * sizeof(*ipv4));
+		for (i = 0; i < nb_ranges; i++) {
+			memcpy(ipv4[i].from, ranges[i].from, 4);
+			memcpy(ipv4[i].to, ranges[i].to, 4);
+			ipv4[i].key = ranges[i].k->koff;
+			ipv4[i].val = ranges[i].k->voff;
+		}
+		hdr.nb_ipv4 = nb_ranges;
+
+		alen = 16;
+		qsort(v6, nb_keys - nb4, sizeof(*keys), cmp_net);
+		flatten(v6, nb_keys - nb4);
+		ipv6 = xrealloc(NULL, (nb_ranges + 1) * sizeof(*ipv6));
+		for (i = 0; i < nb_ranges; i++) {
+			memcpy(ipv6[i].from, ranges[i].from, 16);
+			memcpy(ipv6[i].to, ranges[i].to, 16);
+			ipv6[i].key = ranges[i].k->koff;
+			ipv6[i].val = ranges[i].k->voff;
+		}
+		hdr.nb_ipv6 = nb_ranges;
+	}
+
+	n = strlen(argv[optind + 1]) + 5;
+	tmp = xrealloc(NULL, n);
+	snprintf(tmp, n, "%s.tmp", argv[optind + 1]);
+	f = fopen(tmp, "w");
+	if (!f)
+		die("cannot create", tmp);
+
+	/* the header is rewritten once the offsets are known */
+	put(f, &hdr, sizeof(hdr));
+	hdr.ofs_str  = put(f, str, hdr.nb_str * sizeof(*str));
+	hdr.ofs_ipv4 = put(f, ipv4, hdr.nb_ipv4 * sizeof(*ipv4));
+	hdr.ofs_ipv6 = put(f, ipv6, hdr.nb_ipv6 * sizeof(*ipv6));
+	hdr.ofs_keys = put(f, key_area.buf, key_area.len);
+	hdr.len_keys = key_area.len;
+	hdr.ofs_vals = put(f, val_area.buf, val_area.len);
+	hdr.len_vals = val_area.len;
+
+	if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fclose(f) != 0)
+		die("error while writing", tmp);
+
+	if (rename(tmp, argv[optind + 1]) != 0)
+		die("cannot rename", tmp);
+
+	printf("%zu keys, %u entries, %zu bytes of keys, %zu bytes of values\n",
+	       nb_keys, hdr.nb_str + hdr.nb_ipv4 + hdr.nb_ipv6, key_area.len, val_area.len);
+	return 0;
+}
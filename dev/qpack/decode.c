@@ -1,11 +1,20 @@
 /*
  * QPACK stream decoder. Decode a series of hex codes on stdin using one line
- * per H3 HEADERS frame. Silently skip spaces, tabs, CR, '-' and ','.
+ * per H3 HEADERS frame. Silently skip spaces, tabs, CR, '-' and ','. Lines
+ * starting with '>' are fed to the encoder stream instead, in order to fill
+ * the dynamic table whose maximum capacity may be set in argv[1] (0 by
+ * default).
  *
  * Compilation via Makefile
  *
  * Example run:
  *   echo 0000d1d7508b089d5c0b8170dc101a699fc15f5085ed6989397f | ./dev/qpack/decode
+ *
+ * Example run using the dynamic table (RFC 9204 B.2): the encoder sets the
+ * capacity to 220 and inserts two entries, then the field section references
+ * them:
+ *   printf '%s\n' '>3fbd01 c00f7777772e6578616d706c652e636f6d c10c2f73616d706c652f70617468' \
+ *                  '03811011' | ./dev/qpack/decode 220
  */
 
 #include <ctype.h>
@@ -23,6 +32,7 @@
 
 #include <haproxy/buf-t.h>
 #include <haproxy/http-hdr-t.h>
+#include <haproxy/pool-t.h>
 #include <haproxy/qpack-dec.h>
 #include <haproxy/qpack-tbl.h>
 
@@ -32,9 +42,18 @@ uint8_t bin[MAX_RQ_SIZE];
 char tmp_buf[MAX_RQ_SIZE];
 struct buffer buf   = { .area = tmp_buf,   .data = 0, .size = sizeof(tmp_buf)   };
 
+char enc_buf[MAX_RQ_SIZE];
+struct buffer enc   = { .area = enc_buf,   .data = 0, .size = sizeof(enc_buf)   };
+
+char trash_buf[2][MAX_RQ_SIZE];
+struct buffer trash_chunk[2];
+
+struct pool_head qpack_tbl_pool;
+
 #define DEBUG_QPACK
 #include "../src/hpack-huff.c"
 #include "../src/qpack-dec.c"
+#include "../src/qpack-enc.c"
 #include "../src/qpack-tbl.c"
 
 /* define to compile with BUG_ON/ABORT_NOW statements */
@@ -42,6 +61,27 @@ void ha_backtrace_to_stderr(void)
 {
 }
 
+void complain(int *counter, const char *msg, int taint)
+{
+	fputs(msg, stderr);
+}
+
+/* alternates between two trash chunks, as done in src/chunk.c */
+struct buffer *get_trash_chunk(void)
+{
+	static int idx;
+
+	idx ^= 1;
+	trash_chunk[idx] = (struct buffer){ .area = trash_buf[idx], .size = sizeof(trash_buf[idx]) };
+	return &trash_chunk[idx];
+}
+
+/* called by the encoder stream decoder on error */
+void qcc_set_error(struct qcc *qcc, int err, int app)
+{
+	fprintf(stderr, "QPACK encoder stream error: 0x%x\n", err);
+}
+
 /* taken from dev/hpack/decode.c */
 int hex2bin(const char *hex, uint8_t *bin, int size)
 {
@@ -137,17 +177,49 @@ void debug_hexdump(FILE *out, const char *pfx, const char *buf,
 int main(int argc, char **argv)
 {
 	struct http_hdr hdrs[MAX_HDR_NUM];
+	struct qpack_dec dec;
+	struct qcs qcs = { };
+	uint64_t ric, max_cap = 0;
 	int len, outlen, hdr_idx;
 
+	if (argc > 1)
+		max_cap = strtoull(argv[1], NULL, 10);
+
+	/* the dynamic table is only usable with a non-null capacity */
+	if (max_cap) {
+		qpack_tbl_pool.size = max_cap;
+		pool_head_qpack_tbl = &qpack_tbl_pool;
+	}
+	qpack_dec_init(&dec, max_cap);
+
 	do {
 		if (!fgets(line, sizeof(line), stdin))
 			break;
 
+		if (*line == '>') {
+			/* encoder stream instructions */
+			if ((len = hex2bin(line + 1, bin, MAX_RQ_SIZE)) < 0)
+				break;
+
+			if (len > b_room(&enc)) {
+				fprintf(stderr, "Encoder stream buffer full\n");
+				break;
+			}
+			b_putblk(&enc, (char *)bin, len);
+			outlen = qpack_decode_enc(&dec, &enc, 0, &qcs);
+			if (outlen < 0)
+				break;
+
+			fprintf(stderr, "<<< Encoder stream: %d bytes decoded, %d pending, insert count %llu\n",
+			        outlen, (int)b_data(&enc), (unsigned long long)dec.ic);
+			continue;
+		}
+
 		if ((len = hex2bin(line, bin, MAX_RQ_SIZE)) < 0)
 			break;
 
-		outlen = qpack_decode_fs(bin, len, &buf, hdrs,
-		                         sizeof(hdrs) / sizeof(hdrs[0]));
+		outlen = qpack_decode_fs(&dec, bin, len, &buf, hdrs,
+		                         sizeof(hdrs) / sizeof(hdrs[0]), &ric);
 		if (outlen < 0) {
 			fprintf(stderr, "QPACK decoding failed: %d\n", outlen);
 			continue;
@@ -0,0 +1,303 @@
+/*
+ * SLZ compression benchmark. Compresses a few payloads into the gzip format,
+ * either at once or in chunks the way the compression filter feeds them, and
+ * reports the input throughput in MB/s and the compression ratio. The CRC32
+ * throughput is reported separately. When built with USE_ZLIB, every output is
+ * decompressed and checked, and zlib at level 1 is measured for comparison.
+ *
+ * The encoder is built into this program from src/slz.c with the same options
+ * as haproxy, so that the vector match comparison is enabled when the compiler
+ * supports it (SSE2 by default on x86_64, AVX2 when building with
+ * CPU_CFLAGS="-O2 -mavx2", NEON on aarch64). Building it with
+ * DEFINE="-U__SSE2__ -U__AVX2__" uses the word-at-a-time comparison only. The
+ * carry-less multiply CRC32 is detected at run time and may be disabled with
+ * -c for comparison.
+ *
+ * Usage: bench [-c] [-l loops] [file...]
+ *
+ * Build like this :
+ *    make dev/slz/bench [USE_ZLIB=1]
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "../../src/slz.c"
+
+#define MAX_PAYLOADS 16
+
+struct payload {
+	const char *name;
+	unsigned char *data;
+	long len;
+};
+
+static struct payload payloads[MAX_PAYLOADS];
+static int nb_payloads;
+
+/* chunk sizes to feed the encoder with, 0 means at once */
+static const long chunks[] = { 0, 16384, 1024 };
+
+static unsigned int rnd_state = 2463534242U;
+
+static unsigned int rnd(unsigned int mod)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state % mod;
+}
+
+static const char *words[] = {
+	"account", "active", "address", "amount", "billing", "catalog",
+	"checkout", "city", "country", "created", "currency", "customer",
+	"delivery", "discount", "email", "enabled", "expires", "history",
+	"identifier", "inventory", "invoice", "label", "language", "order",
+	"payment", "preferences", "price", "product", "profile", "quantity",
+	"region", "settings", "shipping", "status", "subscription", "updated",
+};
+
+#define WORD() words[rnd(sizeof(words) / sizeof(words[0]))]
+
+/* appends formatted text to payload <p> whose allocated size is <size> */
+static void append(struct payload *p, long size, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	p->len += vsnprintf((char *)p->data + p->len, size - p->len, fmt, args);
+	va_end(args);
+	if (p->len >= size)
+		p->len = size - 1;
+}
+
+/* builds an HTML page of about <size> bytes */
+static void make_html(struct payload *p, long size)
+{
+	p->name = "HTML";
+	p->data = malloc(size + 4096);
+	p->len = 0;
+	append(p, size, "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n"
+	       "<meta charset=\"utf-8\">\n<title>Orders - Example Store</title>\n"
+	       "<link rel=\"stylesheet\" href=\"/static/css/main.8c1d7f.css\">\n"
+	       "</head>\n<body>\n<div class=\"container\">\n<table class=\"orders\">\n");
+	while (p->len < size - 512)
+		append(p, size + 4096,
+		       "<tr class=\"row %s\"><td class=\"id\"><a href=\"/orders/%u\">#%u</a></td>"
+		       "<td class=\"%s\">%s %s</td><td class=\"amount\">%u.%02u EUR</td>"
+		       "<td><span class=\"badge badge-%s\">%s</span></td></tr>\n",
+		       rnd(2) ? "odd" : "even", rnd(1000000), rnd(1000000), WORD(), WORD(),
+		       WORD(), rnd(1000), rnd(100), WORD(), WORD());
+	append(p, size + 4096, "</table>\n</div>\n<script src=\"/static/js/app.js\"></script>\n</body>\n</html>\n");
+}
+
+/* builds a JSON array of about <size> bytes */
+static void make_json(struct payload *p, long size)
+{
+	p->name = "JSON";
+	p->data = malloc(size + 4096);
+	p->len = 0;
+	append(p, size, "[");
+	while (p->len < size - 512)
+		append(p, size + 4096,
+		       "{\"id\":%u,\"%s\":\"%s\",\"%s\":%u,\"%s\":{\"%s\":\"%s-%u\",\"%s\":%s},"
+		       "\"tags\":[\"%s\",\"%s\"],\"updated\":\"2026-10-%02uT%02u:%02u:%02uZ\"},",
+		       rnd(10000000), WORD(), WORD(), WORD(), rnd(100000), WORD(), WORD(), WORD(),
+		       rnd(1000), WORD(), rnd(2) ? "true" : "false", WORD(), WORD(),
+		       rnd(31) + 1, rnd(24), rnd(60), rnd(60));
+	p->data[p->len - 1] = ']';
+}
+
+/* loads file <name> as a payload */
+static void load_file(struct payload *p, const char *name)
+{
+	FILE *f = fopen(name, "r");
+
+	if (!f || fseek(f, 0, SEEK_END) != 0 || (p->len = ftell(f)) <= 0) {
+		fprintf(stderr, "cannot load %s\n", name);
+		exit(1);
+	}
+	rewind(f);
+	p->name = name;
+	p->data = malloc(p->len);
+	if (fread(p->data, 1, p->len, f) != p->len) {
+		fprintf(stderr, "cannot read %s\n", name);
+		exit(1);
+	}
+	fclose(f);
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* compresses payload <p> into <out> in chunks of <chunk> bytes (0 = at once),
+ * and returns the output size.
+ */
+static long slz_compress(const struct payload *p, unsigned char *out, long chunk)
+{
+	struct slz_stream strm;
+	long pos, len, olen = 0;
+
+	slz_init(&strm, 1, SLZ_FMT_GZIP);
+	for (pos = 0; pos < p->len; pos += len) {
+		len = (chunk && p->len - pos > chunk) ? chunk : p->len - pos;
+		olen += slz_encode(&strm, out + olen, p->data + pos, len, 1);
+	}
+	olen += slz_finish(&strm, out + olen);
+	return olen;
+}
+
+#ifdef USE_ZLIB
+/* same as above using zlib at level 1 */
+static long zlib_compress(const struct payload *p, unsigned char *out, long osize, long chunk)
+{
+	z_stream strm;
+	long pos, len;
+
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, 1, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+	strm.next_out = out;
+	strm.avail_out = osize;
+	for (pos = 0; pos < p->len; pos += len) {
+		len = (chunk && p->len - pos > chunk) ? chunk : p->len - pos;
+		strm.next_in = p->data + pos;
+		strm.avail_in = len;
+		deflate(&strm, Z_NO_FLUSH);
+	}
+	deflate(&strm, Z_FINISH);
+	deflateEnd(&strm);
+	return strm.total_out;
+}
+
+/* decompresses <in> and compares it with payload <p>. Returns 0 on success. */
+static int check(const struct payload *p, unsigned char *in, long ilen)
+{
+	unsigned char *out = malloc(p->len + 1);
+	z_stream strm;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	inflateInit2(&strm, 31);
+	strm.next_in = in;
+	strm.avail_in = ilen;
+	strm.next_out = out;
+	strm.avail_out = p->len + 1;
+	ret = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+	ret = (ret != Z_STREAM_END || strm.total_out != p->len || memcmp(out, p->data, p->len) != 0);
+	free(out);
+	return ret;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	unsigned long long start, ns;
+	unsigned char *out;
+	uint32_t crc = 0;
+	int loops = 200;
+	int c, i, l, ch;
+	long olen = 0, osize;
+
+	while ((c = getopt(argc, argv, "cl:")) != -1) {
+		switch (c) {
+		case 'c':
+#if defined(SLZ_CRC32_CLMUL) && !defined(__PCLMUL__)
+			slz_have_clmul = 0;
+#endif
+			break;
+		case 'l': loops = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Usage: %s [-c] [-l loops] [file...]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (loops <= 0) {
+		fprintf(stderr, "invalid argument\n");
+		exit(1);
+	}
+
+	if (optind < argc) {
+		for (; optind < argc && nb_payloads < MAX_PAYLOADS; optind++)
+			load_file(&payloads[nb_payloads++], argv[optind]);
+	} else {
+		make_html(&payloads[nb_payloads++], 256 * 1024);
+		make_json(&payloads[nb_payloads++], 256 * 1024);
+	}
+
+#if defined(__AVX2__)
+	printf("match: AVX2 vectors, ");
+#elif defined(__SSE2__)
+	printf("match: SSE2 vectors, ");
+#elif defined(__ARM_NEON) && defined(__ARM_ARCH_ISA_A64)
+	printf("match: NEON vectors, ");
+#else
+	printf("match: word-at-a-time, ");
+#endif
+#if defined(SLZ_CRC32_CLMUL)
+	printf("crc32: %s\n", slz_have_clmul ? "carry-less multiply" : "tables");
+#elif defined(__ARM_FEATURE_CRC32)
+	printf("crc32: ARMv8 CRC32\n");
+#else
+	printf("crc32: tables\n");
+#endif
+
+	for (i = 0; i < nb_payloads; i++) {
+		const struct payload *p = &payloads[i];
+
+		osize = p->len + p->len / 8 + 1024;
+		out = malloc(osize);
+
+		start = now_ns();
+		for (l = 0; l < loops * 10; l++)
+			crc = update_crc(crc, p->data, p->len);
+		ns = now_ns() - start;
+		printf("%-10s %8ld bytes: crc32 %8.1f MB/s\n",
+		       p->name, p->len, (double)p->len * loops * 10 * 1000 / ns);
+
+		for (ch = 0; ch < sizeof(chunks) / sizeof(chunks[0]); ch++) {
+			start = now_ns();
+			for (l = 0; l < loops; l++)
+				olen = slz_compress(p, out, chunks[ch]);
+			ns = now_ns() - start;
+#ifdef USE_ZLIB
+			if (check(p, out, olen) != 0) {
+				fprintf(stderr, "%s: slz output does not decompress\n", p->name);
+				exit(1);
+			}
+#endif
+			printf("%-10s %8ld bytes: slz  chunk %6ld: %8.1f MB/s ratio %5.1f%%\n",
+			       p->name, p->len, chunks[ch] ? chunks[ch] : p->len,
+			       (double)p->len * loops * 1000 / ns, olen * 100.0 / p->len);
+
+#ifdef USE_ZLIB
+			start = now_ns();
+			for (l = 0; l < loops; l++)
+				olen = zlib_compress(p, out, osize, chunks[ch]);
+			ns = now_ns() - start;
+			printf("%-10s %8ld bytes: zlib chunk %6ld: %8.1f MB/s ratio %5.1f%%\n",
+			       p->name, p->len, chunks[ch] ? chunks[ch] : p->len,
+			       (double)p->len * loops * 1000 / ns, olen * 100.0 / p->len);
+#endif
+		}
+		free(out);
+	}
+	/* prevents the CRC loop from being optimized away */
+	return crc == 0x12345678;
+}
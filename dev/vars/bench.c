@@ -0,0 +1,187 @@
+/*
+ * Variables storage benchmark. For scopes holding 10, 100 and 1000 variables,
+ * measures the time taken to create the variables then to look them all up,
+ * first with the former linked list, then with the trees indexed on the name
+ * hash used by vars.c.
+ *
+ * Usage: bench [-l loops]
+ *
+ * Build like this :
+ *    make dev/vars/bench
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <import/eb64tree.h>
+#include <haproxy/list.h>
+#include <haproxy/sample-t.h>
+#include <haproxy/vars-t.h>
+#include <haproxy/xxhash.h>
+
+/* a variable as it used to be stored, in a list */
+struct lvar {
+	struct list l;
+	uint64_t name_hash;
+	uint flags;
+	struct sample_data data;
+};
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* former lookup: linear scan of the list */
+static struct lvar *lvar_get(struct list *head, uint64_t name_hash)
+{
+	struct lvar *var;
+
+	list_for_each_entry(var, head, l)
+		if (var->name_hash == name_hash)
+			return var;
+	return NULL;
+}
+
+/* creates or updates the variable <name_hash> in list <head> */
+static void lvar_set(struct list *head, uint64_t name_hash, struct lvar *pool, int *used)
+{
+	struct lvar *var = lvar_get(head, name_hash);
+
+	if (!var) {
+		var = &pool[(*used)++];
+		LIST_APPEND(head, &var->l);
+		var->name_hash = name_hash;
+		var->flags = 0;
+	}
+	var->data.type = SMP_T_SINT;
+	var->data.u.sint = name_hash;
+}
+
+/* current lookup, same as var_get() */
+static struct var *tvar_get(struct vars *vars, uint64_t name_hash)
+{
+	struct eb64_node *node;
+
+	node = eb64_lookup(&vars->name_root[name_hash % VAR_NAME_ROOTS], name_hash);
+	if (!node)
+		return NULL;
+	return eb64_entry(node, struct var, node);
+}
+
+/* creates or updates the variable <name_hash> in <vars> */
+static void tvar_set(struct vars *vars, uint64_t name_hash, struct var *pool, int *used)
+{
+	struct var *var = tvar_get(vars, name_hash);
+
+	if (!var) {
+		var = &pool[(*used)++];
+		var->node.key = name_hash;
+		eb64_insert(&vars->name_root[name_hash % VAR_NAME_ROOTS], &var->node);
+		var->flags = 0;
+	}
+	var->data.type = SMP_T_SINT;
+	var->data.u.sint = name_hash;
+}
+
+/* runs the benchmark for <nbvars> variables */
+static void bench(int nbvars, int loops)
+{
+	uint64_t *hashes;
+	struct lvar *lpool, *lvar;
+	struct var *tpool, *tvar;
+	struct list head;
+	struct vars vars;
+	unsigned long long lset = 0, lget = 0, tset = 0, tget = 0, start;
+	uint64_t sum = 0; /* sums of the values read, must be zero */
+	char name[32];
+	int loop, used, i, j;
+
+	hashes = calloc(nbvars, sizeof(*hashes));
+	lpool = calloc(nbvars, sizeof(*lpool));
+	tpool = calloc(nbvars, sizeof(*tpool));
+	if (!hashes || !lpool || !tpool) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nbvars; i++) {
+		snprintf(name, sizeof(name), "txn.var%d", i);
+		hashes[i] = XXH3(name, strlen(name), 0);
+	}
+
+	for (loop = 0; loop < loops; loop++) {
+		/* the former list */
+		LIST_INIT(&head);
+		used = 0;
+		start = now_ns();
+		for (i = 0; i < nbvars; i++)
+			lvar_set(&head, hashes[i], lpool, &used);
+		lset += now_ns() - start;
+
+		start = now_ns();
+		for (j = 0; j < 10; j++)
+			for (i = 0; i < nbvars; i++)
+				if ((lvar = lvar_get(&head, hashes[i])))
+					sum += lvar->data.u.sint;
+		lget += now_ns() - start;
+
+		/* the trees */
+		for (i = 0; i < VAR_NAME_ROOTS; i++)
+			vars.name_root[i] = EB_ROOT;
+		used = 0;
+		start = now_ns();
+		for (i = 0; i < nbvars; i++)
+			tvar_set(&vars, hashes[i], tpool, &used);
+		tset += now_ns() - start;
+
+		start = now_ns();
+		for (j = 0; j < 10; j++)
+			for (i = 0; i < nbvars; i++)
+				if ((tvar = tvar_get(&vars, hashes[i])))
+					sum -= tvar->data.u.sint;
+		tget += now_ns() - start;
+	}
+
+	printf("vars=%-5d list: set=%7.1f ns get=%7.1f ns   tree: set=%7.1f ns get=%7.1f ns%s\n",
+	       nbvars,
+	       (double)lset / loops / nbvars, (double)lget / loops / nbvars / 10,
+	       (double)tset / loops / nbvars, (double)tget / loops / nbvars / 10,
+	       sum ? " (mismatch!)" : "");
+
+	free(hashes);
+	free(lpool);
+	free(tpool);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 1000;
+	int c;
+
+	while ((c = getopt(argc, argv, "l:")) != -1) {
+		switch (c) {
+		case 'l': loops = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Usage: %s [-l loops]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (loops <= 0) {
+		fprintf(stderr, "invalid argument\n");
+		exit(1);
+	}
+
+	bench(10, loops * 100);
+	bench(100, loops * 10);
+	bench(1000, loops);
+	return 0;
+}
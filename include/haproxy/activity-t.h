@@ -102,6 +102,8 @@ struct activity {
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
 	unsigned int check_started;// number of times a check was started on this thread
+	unsigned int log_batches;  // number of batches of log messages sent
+	unsigned int log_batched;  // log messages sent by batches
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
@@ -341,6 +341,11 @@ enum mux_sctl_type {
 #define MUX_SCTL_DBG_STR_L_SOCK  0x00000010  // info from socket layer (quic_conn as well)
 
 
+/* capabilities which may be queried using xprt->get_capability() */
+enum xprt_capabilities {
+	XPRT_CAN_SPLICE,     /* Returns non-zero if data may currently be sent using snd_pipe() */
+};
+
 /* response for ctl MUX_STATUS */
 #define MUX_STATUS_READY (1 << 0)
 
@@ -405,6 +410,7 @@ struct xprt_ops {
 	struct ssl_sock_ctx *(*get_ssl_sock_ctx)(struct connection *); /* retrieve the ssl_sock_ctx in use, or NULL if none */
 	int (*show_fd)(struct buffer *, const struct connection *, const void *ctx); /* append some data about xprt for "show fd"; returns non-zero if suspicious */
 	void (*dump_info)(struct buffer *, const struct connection *);
+	int (*get_capability)(const struct connection *conn, void *xprt_ctx, enum xprt_capabilities cap); /* Returns non-zero if <cap> is currently supported */
 };
 
 /* mux_ops describes the mux operations, which are to be performed at the
@@ -119,6 +119,18 @@ static inline int conn_ctrl_ready(const struct connection *conn)
 	return (conn->flags & CO_FL_CTRL_READY);
 }
 
+/* Returns true if the transport layer is currently able to send data from a
+ * pipe. When a transport layer provides snd_pipe() without get_capability(),
+ * it is always able to.
+ */
+static inline int conn_xprt_can_snd_pipe(const struct connection *conn)
+{
+	if (!conn->xprt->snd_pipe)
+		return 0;
+	return !conn->xprt->get_capability ||
+		conn->xprt->get_capability(conn, conn->xprt_ctx, XPRT_CAN_SPLICE);
+}
+
 /*
  * Calls the start() function of the transport layer, if needed.
  * Returns < 0 in case of error.
@@ -23,18 +23,21 @@
 #ifndef _HAPROXY_COUNTERS_T_H
 #define _HAPROXY_COUNTERS_T_H
 
+#include <haproxy/defaults.h>
 #include <haproxy/freq_ctr-t.h>
 
-/* counters used by listeners and frontends */
-struct fe_counters {
-	unsigned int conn_max;                  /* max # of active sessions */
+/* Cumulative frontend counters. These ones are only ever incremented on the
+ * data path, so in order to limit cache line sharing between threads, there
+ * are up to COUNTERS_SHARDS copies of them, each thread only writes to the
+ * one designated by its ti->ctr_shard, and readers have to sum all of them
+ * (see COUNTERS_SHARED_TOTAL()). Only "long long" fields are permitted
+ * here since the whole struct may be processed as an array of such values.
+ */
+struct fe_counters_shard {
 	long long    cum_conn;                  /* cumulated number of received connections */
 	long long    cum_sess;                  /* cumulated number of accepted connections */
 	long long    cum_sess_ver[3];           /* cumulated number of h1/h2/h3 sessions */
 
-	unsigned int cps_max;                   /* maximum of new connections received per second */
-	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
-
 	long long bytes_in;                     /* number of bytes transferred from the client to the server */
 	long long bytes_out;                    /* number of bytes transferred from the server to the client */
 
@@ -59,12 +62,39 @@ struct fe_counters {
 		struct {
 			long long cum_req[4];   /* cumulated number of processed other/h1/h2/h3 requests */
 			long long comp_rsp;     /* number of compressed responses */
-			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
 			long long rsp[6];       /* http response codes */
 			long long cache_lookups;/* cache lookups */
 			long long cache_hits;   /* cache hits */
 		} http;
 	} p;                                    /* protocol-specific stats */
+};
+
+/* Sharded frontend counters. All entries of <shard> point to <local> until
+ * counters_fe_shared_prepare() is called, after which they point to distinct
+ * cache-aligned entries located in <area>. <nb_shards> is the number of
+ * distinct entries to be summed by readers.
+ */
+struct fe_counters_shared {
+	struct fe_counters_shard *shard[COUNTERS_SHARDS];
+	struct fe_counters_shard local;         /* storage used until sharded */
+	void *area;                             /* allocated storage for sharded entries */
+	int nb_shards;                          /* number of distinct entries in shard[] */
+};
+
+/* counters used by listeners and frontends */
+struct fe_counters {
+	struct fe_counters_shared shared;       /* sharded cumulated counters */
+
+	unsigned int conn_max;                  /* max # of active sessions */
+
+	unsigned int cps_max;                   /* maximum of new connections received per second */
+	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
+
+	union {
+		struct {
+			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
+		} http;
+	} p;                                    /* protocol-specific stats */
 
 	struct freq_ctr sess_per_sec;           /* sessions per second on this server */
 	struct freq_ctr req_per_sec;            /* HTTP requests per second on the frontend */
@@ -73,17 +103,13 @@ struct fe_counters {
 	unsigned long last_change;              /* last time, when the state was changed */
 };
 
-/* counters used by servers and backends */
-struct be_counters {
-	unsigned int conn_max;                  /* max # of active sessions */
+/* Cumulative backend/server counters, one copy per shard. Same rules as for
+ * fe_counters_shard above apply.
+ */
+struct be_counters_shard {
 	long long    cum_sess;                  /* cumulated number of accepted connections */
 	long long  cum_lbconn;                  /* cumulated number of sessions processed by load balancing (BE only) */
 
-	unsigned int cps_max;                   /* maximum of new connections received per second */
-	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
-	unsigned int nbpend_max;                /* max number of pending connections with no server assigned yet */
-	unsigned int cur_sess_max;		/* max number of currently active sessions */
-
 	long long bytes_in;                     /* number of bytes transferred from the client to the server */
 	long long bytes_out;                    /* number of bytes transferred from the server to the client */
 
@@ -109,19 +135,44 @@ struct be_counters {
 	long long failed_checks, failed_hana;	/* failed health checks and health analyses for servers */
 	long long down_trans;			/* up->down transitions */
 
-	unsigned int q_time, c_time, d_time, t_time; /* sums of conn_time, queue_time, data_time, total_time */
-	unsigned int qtime_max, ctime_max, dtime_max, ttime_max; /* maximum of conn_time, queue_time, data_time, total_time observed */
-
 	union {
 		struct {
 			long long cum_req;      /* cumulated number of processed HTTP requests */
 			long long comp_rsp;     /* number of compressed responses */
-			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
 			long long rsp[6];       /* http response codes */
 			long long cache_lookups;/* cache lookups */
 			long long cache_hits;   /* cache hits */
 		} http;
 	} p;                                    /* protocol-specific stats */
+};
+
+/* Sharded backend/server counters, see fe_counters_shared above. */
+struct be_counters_shared {
+	struct be_counters_shard *shard[COUNTERS_SHARDS];
+	struct be_counters_shard local;         /* storage used until sharded */
+	void *area;                             /* allocated storage for sharded entries */
+	int nb_shards;                          /* number of distinct entries in shard[] */
+};
+
+/* counters used by servers and backends */
+struct be_counters {
+	struct be_counters_shared shared;       /* sharded cumulated counters */
+
+	unsigned int conn_max;                  /* max # of active sessions */
+
+	unsigned int cps_max;                   /* maximum of new connections received per second */
+	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
+	unsigned int nbpend_max;                /* max number of pending connections with no server assigned yet */
+	unsigned int cur_sess_max;		/* max number of currently active sessions */
+
+	unsigned int q_time, c_time, d_time, t_time; /* sums of conn_time, queue_time, data_time, total_time */
+	unsigned int qtime_max, ctime_max, dtime_max, ttime_max; /* maximum of conn_time, queue_time, data_time, total_time observed */
+
+	union {
+		struct {
+			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
+		} http;
+	} p;                                    /* protocol-specific stats */
 
 	struct freq_ctr sess_per_sec;           /* sessions per second on this server */
 
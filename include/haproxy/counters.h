@@ -0,0 +1,66 @@
+/*
+ * include/haproxy/counters.h
+ * This file contains functions and macros to manipulate statistics counters.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_COUNTERS_H
+#define _HAPROXY_COUNTERS_H
+
+#include <haproxy/atomic.h>
+#include <haproxy/counters-t.h>
+
+int counters_nb_shards(void);
+uint counters_thread_shard(int thr);
+void counters_fe_shared_init(struct fe_counters_shared *shared);
+void counters_be_shared_init(struct be_counters_shared *shared);
+int counters_fe_shared_prepare(struct fe_counters_shared *shared);
+int counters_be_shared_prepare(struct be_counters_shared *shared);
+void counters_fe_shared_drop(struct fe_counters_shared *shared);
+void counters_be_shared_drop(struct be_counters_shared *shared);
+void counters_fe_reset(struct fe_counters *counters);
+void counters_be_reset(struct be_counters *counters);
+
+/* Returns the sum of <field> over all shards of shared counters
+ * <scounters> (struct fe_counters_shared or be_counters_shared).
+ */
+#define COUNTERS_SHARED_TOTAL(scounters, field) ({                        \
+	long long __ret = 0;                                              \
+	int __it;                                                         \
+	for (__it = 0; __it < (scounters).nb_shards; __it++)              \
+		__ret += HA_ATOMIC_LOAD(&(scounters).shard[__it]->field); \
+	__ret;                                                            \
+})
+
+/* Same as COUNTERS_SHARED_TOTAL() but for the long long counter located at
+ * <offset> bytes from the beginning of each shard.
+ */
+#define COUNTERS_SHARED_TOTAL_OFFSET(scounters, offset) ({                \
+	long long __ret = 0;                                              \
+	int __it;                                                         \
+	for (__it = 0; __it < (scounters).nb_shards; __it++)              \
+		__ret += HA_ATOMIC_LOAD((long long *)((char *)(scounters).shard[__it] + (offset))); \
+	__ret;                                                            \
+})
+
+#endif /* _HAPROXY_COUNTERS_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
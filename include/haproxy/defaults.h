@@ -567,6 +567,21 @@
 # endif
 #endif
 
+/* maximum number of copies of the cumulated proxy, server and listener
+ * counters. Threads are evenly spread over them. Each copy of a server's
+ * counters takes a few hundred bytes, so this mostly matters with many
+ * servers.
+ */
+#ifndef COUNTERS_SHARDS
+# if defined(USE_THREAD) && MAX_THREADS >= 16
+#  define COUNTERS_SHARDS   16
+# elif defined(USE_THREAD)
+#  define COUNTERS_SHARDS   MAX_THREADS
+# else
+#  define COUNTERS_SHARDS   1
+# endif
+#endif
+
 /* it has been found that 6 queues was optimal on various archs at various
  * thread counts, so let's use that by default.
  */
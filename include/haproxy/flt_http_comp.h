@@ -24,5 +24,6 @@
 #include <haproxy/proxy-t.h>
 
 int check_implicit_http_comp_flt(struct proxy *proxy);
+int http_comp_limited(void);
 
 #endif // _HAPROXY_FLT_HTTP_COMP_H
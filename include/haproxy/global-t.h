@@ -66,7 +66,7 @@
 #define GTUNE_USE_SYSTEMD        (1<<10)
 
 #define GTUNE_BUSY_POLLING       (1<<11)
-/* (1<<12) unused */
+#define GTUNE_USE_URING          (1<<12)
 #define GTUNE_SET_DUMPABLE       (1<<13)
 #define GTUNE_USE_EVPORTS        (1<<14)
 #define GTUNE_STRICT_LIMITS      (1<<15)
@@ -182,6 +182,7 @@ struct global {
 		int requri_len;    /* max len of request URI, use REQURI_LEN if zero */
 		int cookie_len;    /* max length of cookie captures */
 		int pattern_cache; /* max number of entries in the pattern cache. */
+		int pattern_lpm;   /* min number of entries of "ip" expressions using LPM tables, 0=never */
 		int sslcachesize;  /* SSL cache size in session, defaults to 20000 */
 		int comp_maxlevel;    /* max HTTP compression level */
 		int pool_low_ratio;   /* max ratio of FDs used before we stop using new idle connections */
@@ -195,6 +196,7 @@ struct global {
 		int default_shards; /* default shards for listeners, or -1 (by-thread) or -2 (by-group) */
 		uint max_checks_per_thread; /* if >0, no more than this concurrent checks per thread */
 		uint ring_queues;   /* if >0, #ring queues, otherwise equals #thread groups */
+		uint log_batch;     /* if >1, max log messages sent at once to datagram targets */
 #ifdef USE_QUIC
 		unsigned int quic_backend_max_idle_timeout;
 		unsigned int quic_frontend_max_idle_timeout;
@@ -205,6 +207,7 @@ struct global {
 		unsigned int quic_reorder_ratio;
 		unsigned int quic_max_frame_loss;
 		unsigned int quic_cubic_loss_tol;
+		unsigned int quic_rx_batch;
 #endif /* USE_QUIC */
 	} tune;
 	struct {
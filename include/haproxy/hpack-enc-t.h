@@ -0,0 +1,59 @@
+/*
+ * HPACK compressor (RFC7541) - type definitions
+ *
+ * Copyright (C) 2014-2020 Willy Tarreau <willy@haproxy.org>
+ * Copyright (C) 2017 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _HAPROXY_HPACK_ENC_T_H
+#define _HAPROXY_HPACK_ENC_T_H
+
+#include <inttypes.h>
+#include <haproxy/hpack-tbl-t.h>
+
+/* initial dynamic table size known by both ends (RFC7541#4.2) */
+#define HPACK_DFLT_TABLE_SIZE   4096
+
+#define HPACK_ENC_NO_DTSU       0xffffffffU /* no dynamic table size update pending */
+#define HPACK_ENC_MAX_PEND      16   /* max number of insertions per header block */
+#define HPACK_ENC_MAX_LOOKUP    64   /* max number of table entries looked up per field */
+#define HPACK_ENC_SEEN          16   /* number of recently missed fields remembered, power of two */
+
+/* HPACK encoder state. The dynamic table is only allocated once the first
+ * header field is indexed. A field is only inserted when it is seen again
+ * while still among the last HPACK_ENC_SEEN fields which were not found in the
+ * table, so that frequent fields get indexed while unique values (dates, IDs,
+ * lengths) do not evict them. Insertions decided while building a header block
+ * are only applied to the table once the block is committed, so that an
+ * aborted block leaves the table in sync with the peer's decoder.
+ */
+struct hpack_enc {
+	struct hpack_dht *dht;   /* dynamic table, NULL if not allocated */
+	uint32_t limit;          /* local max table size, 0 = no dynamic table */
+	uint32_t size;           /* current max table size, as known by the decoder */
+	uint32_t dtsu;           /* max table size to announce, or HPACK_ENC_NO_DTSU */
+	uint32_t dtsu_min;       /* smallest max table size announced by the peer since last DTSU */
+	uint32_t seen_pos;       /* next position in seen[] */
+	uint32_t seen[HPACK_ENC_SEEN]; /* hashes of the recently missed fields */
+};
+
+#endif /* _HAPROXY_HPACK_ENC_T_H */
@@ -32,10 +32,18 @@
 #include <import/ist.h>
 #include <haproxy/api.h>
 #include <haproxy/buf-t.h>
+#include <haproxy/hpack-enc-t.h>
 #include <haproxy/http-t.h>
 
 int hpack_encode_header(struct buffer *out, const struct ist n,
 			const struct ist v);
+void hpack_enc_init(struct hpack_enc *enc, uint32_t limit);
+void hpack_enc_release(struct hpack_enc *enc);
+void hpack_enc_set_max(struct hpack_enc *enc, uint32_t max);
+int hpack_enc_begin(struct hpack_enc *enc, struct buffer *out);
+void hpack_enc_commit(struct hpack_enc *enc);
+int hpack_enc_header(struct hpack_enc *enc, struct buffer *out,
+		     const struct ist n, const struct ist v);
 
 /* Returns the number of bytes required to encode the string length <len>. The
  * number of usable bits is an integral multiple of 7 plus 6 for the last byte.
@@ -79,19 +87,56 @@ static inline int hpack_encode_len(char *out, int pos, int len)
 	return pos;
 }
 
+/* Returns the number of bytes required to encode integer <v> using a <bits>
+ * bits prefix (7541#5.1).
+ */
+static inline int hpack_int_to_bytes(uint32_t v, int bits)
+{
+	int ret = 1;
+
+	if (v < (1U << bits) - 1)
+		return ret;
+
+	for (v -= (1U << bits) - 1; v >= 128; v >>= 7)
+		ret++;
+	return ret + 1;
+}
+
+/* Encodes integer <v> into <out>+<pos> using a <bits> bits prefix, the upper
+ * bits of the first byte being set to <code>, and returns the new position.
+ * The caller is responsible for checking for available room using
+ * hpack_int_to_bytes() first.
+ */
+static inline int hpack_encode_int(char *out, int pos, uint8_t code, int bits, uint32_t v)
+{
+	uint32_t max = (1U << bits) - 1;
+
+	if (v < max) {
+		out[pos++] = code | v;
+		return pos;
+	}
+
+	out[pos++] = code | max;
+	for (v -= max; v >= 128; v >>= 7)
+		out[pos++] = v | 128;
+	out[pos++] = v;
+	return pos;
+}
+
 /* Tries to encode header field index <idx> with short value <val> into the
  * aligned buffer <out>. Returns non-zero on success, 0 on failure (buffer
  * full). The caller is responsible for ensuring that the length of <val> is
- * strictly lower than 127, and that <idx> is lower than 64 (static list only),
- * and that the buffer is aligned (head==0).
+ * strictly lower than 127, and that <idx> is lower than 15 (static list only),
+ * and that the buffer is aligned (head==0). The field is not indexed so that
+ * the peer's dynamic table is not affected.
  */
 static inline int hpack_encode_short_idx(struct buffer *out, int idx, struct ist val)
 {
 	if (out->data + 2 + val.len > out->size)
 		return 0;
 
-	/* literal header field with incremental indexing */
-	out->area[out->data++] = idx | 0x40;
+	/* literal header field without indexing */
+	out->area[out->data++] = idx;
 	out->area[out->data++] = val.len;
 	ist2bin(&out->area[out->data], val);
 	out->data += val.len;
@@ -100,8 +145,9 @@ static inline int hpack_encode_short_idx(struct buffer *out, int idx, struct ist
 
 /* Tries to encode header field index <idx> with long value <val> into the
  * aligned buffer <out>. Returns non-zero on success, 0 on failure (buffer
- * full). The caller is responsible for ensuring <idx> is lower than 64 (static
- * list only), and that the buffer is aligned (head==0).
+ * full). The caller is responsible for ensuring <idx> is lower than 15 (static
+ * list only), and that the buffer is aligned (head==0). The field is not
+ * indexed so that the peer's dynamic table is not affected.
  */
 static inline int hpack_encode_long_idx(struct buffer *out, int idx, struct ist val)
 {
@@ -111,10 +157,10 @@ static inline int hpack_encode_long_idx(struct buffer *out, int idx, struct ist
 	    1 + len + hpack_len_to_bytes(val.len) + val.len > out->size)
 		return 0;
 
-	/* emit literal with indexing (7541#6.2.1) :
-	 * [ 0 | 1 | Index (6+) ]
+	/* emit literal without indexing (7541#6.2.2) :
+	 * [ 0 | 0 | 0 | 0 | Index (4+) ]
 	 */
-	out->area[len++] = idx | 0x40;
+	out->area[len++] = idx;
 	len = hpack_encode_len(out->area, len, val.len);
 	memcpy(out->area + len, val.ptr, val.len);
 	len += val.len;
@@ -164,7 +210,7 @@ static inline int hpack_encode_int_status(struct buffer *out, unsigned int statu
 		goto fail;
 
 	/* basic encoding of the status code */
-	out->area[len - 5] = 0x48; // indexed name -- name=":status" (idx 8)
+	out->area[len - 5] = 0x08; // indexed name, not indexed -- name=":status" (idx 8)
 	out->area[len - 4] = 0x03; // 3 bytes status
 	out->area[len - 3] = '0' + status / 100;
 	out->area[len - 2] = '0' + status / 10 % 10;
@@ -76,6 +76,8 @@
 #define TX_L7_RETRY     0x00080000      /* The transaction may attempt L7 retries */
 #define TX_D_L7_RETRY   0x00100000      /* Disable L7 retries on this transaction, even if configured to do it */
 
+#define TX_CACHE_FETCH  0x00200000      /* other requests for the same object wait for this transaction's response */
+
 /* This function is used to report flags in debugging tools. Please reflect
  * below any single-bit flag addition above in the same order via the
  * __APPEND_FLAG and __APPEND_ENUM macros. The new end of the buffer is
@@ -90,7 +92,7 @@ static forceinline char *txn_show_flags(char *buf, size_t len, const char *delim
 	/* flags & enums */
 	_(TX_SCK_PRESENT, _(TX_CACHEABLE, _(TX_CACHE_COOK, _(TX_CACHE_IGNORE,
 	_(TX_CON_WANT_TUN, _(TX_CACHE_HAS_SEC_KEY, _(TX_USE_PX_CONN,
-	_(TX_NOT_FIRST, _(TX_L7_RETRY, _(TX_D_L7_RETRY))))))))));
+	_(TX_NOT_FIRST, _(TX_L7_RETRY, _(TX_D_L7_RETRY, _(TX_CACHE_FETCH)))))))))));
 
 	_e(TX_SCK_MASK, TX_SCK_FOUND,     _e(TX_SCK_MASK, TX_SCK_DELETED,
 	_e(TX_SCK_MASK, TX_SCK_INSERTED,  _e(TX_SCK_MASK, TX_SCK_REPLACED,
@@ -132,6 +134,8 @@ static forceinline char *txn_show_flags(char *buf, size_t len, const char *delim
 
 #define HTTP_MSGF_EXPECT_CHECKED 0x00000100  /* Expect header was already handled, if any */
 
+#define HTTP_MSGF_COMPRESSIBLE 0x00000200  /* not compressed, but would be for another request */
+
 /* This function is used to report flags in debugging tools. Please reflect
  * below any single-bit flag addition above in the same order via the
  * __APPEND_FLAG macro. The new end of the buffer is returned.
@@ -144,7 +148,8 @@ static forceinline char *hmsg_show_flags(char *buf, size_t len, const char *deli
 	/* flags */
 	_(HTTP_MSGF_CNT_LEN, _(HTTP_MSGF_TE_CHNK, _(HTTP_MSGF_XFER_LEN,
 	_(HTTP_MSGF_VER_11, _(HTTP_MSGF_SOFT_RW, _(HTTP_MSGF_COMPRESSING,
-	_(HTTP_MSGF_BODYLESS, _(HTTP_MSGF_CONN_UPG, _(HTTP_MSGF_EXPECT_CHECKED)))))))));
+	_(HTTP_MSGF_BODYLESS, _(HTTP_MSGF_CONN_UPG, _(HTTP_MSGF_EXPECT_CHECKED,
+	_(HTTP_MSGF_COMPRESSIBLE))))))))));
 	/* epilogue */
 	_(~0U);
 	return buf;
@@ -245,6 +250,7 @@ struct http_txn {
 	struct buffer l7_buffer;        /* To store the data, in case we have to retry */
 	char cache_hash[20];               /* Store the cache hash  */
 	char cache_secondary_hash[HTTP_CACHE_SEC_KEY_LEN]; /* Optional cache secondary key. */
+	int cache_wait_exp;             /* date (ticks) after which the cache stops waiting for another request's response */
 	char *uri;                      /* first line if log needed, NULL otherwise */
 	char *cli_cookie;               /* cookie presented by the client, in capture mode */
 	char *srv_cookie;               /* cookie presented by the server, in capture mode */
@@ -37,6 +37,16 @@
 #define SYSLOG_PORT             514
 #define UNIQUEID_LEN            128
 
+/* Maximum number of messages sent to datagram log targets by a single system
+ * call (see "tune.log.batch").
+ */
+#define LOG_MAX_BATCH           64
+
+/* sendmmsg() is used to send log messages by batches to datagram targets. */
+#if defined(__linux__)
+#define LOG_HAVE_SENDMMSG
+#endif
+
 /* flags used in logformat_node->options */
 #define LOG_OPT_NONE            0x00000000
 #define LOG_OPT_HEXA            0x00000001
@@ -65,6 +65,9 @@ void syslog_fd_handler(int fd);
 int init_log_buffers(void);
 void deinit_log_buffers(void);
 
+/* Send the log messages batched by the current thread */
+void log_flush_batch(void);
+
 const char *log_orig_to_str(enum log_orig orig);
 
 void lf_expr_init(struct lf_expr *expr);
@@ -123,6 +123,25 @@
 #define HAVE_SSL_0RTT_QUIC
 #endif
 
+/* kTLS requires OpenSSL >= 3.0 built with ktls support, which passes the
+ * negotiated keys to the BIO. Only Linux is supported for now.
+ */
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) && \
+    !defined(LIBRESSL_VERSION_NUMBER) && !defined(USE_OPENSSL_WOLFSSL) && !defined(OPENSSL_IS_AWSLC)
+#define HAVE_SSL_KTLS
+
+/* these BIO controls are only defined in OpenSSL's internal headers */
+#ifndef BIO_CTRL_SET_KTLS
+#define BIO_CTRL_SET_KTLS                    72
+#endif
+#ifndef BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG
+#define BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG   74
+#endif
+#ifndef BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG
+#define BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG      75
+#endif
+#endif
+
 
 #if (defined(SSL_CTX_set_security_level) || HA_OPENSSL_VERSION_NUMBER >= 0x1010100fL) && !defined(OPENSSL_IS_AWSLC)
 #define HAVE_SSL_SET_SECURITY_LEVEL
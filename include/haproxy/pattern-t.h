@@ -98,6 +98,61 @@ enum {
 #define PAT_REF_FILE 0x08 /* Set if the reference was loaded from a file */
 #define PAT_REF_ID   0x10 /* Set if the reference is only an ID (not loaded from a file) */
 
+/* Precompiled map files (images) are built by dev/pattern/mkmap and mapped
+ * read-only by all processes. They start with this header, followed by the
+ * sorted arrays of entries and the areas holding the keys and values as
+ * zero-terminated strings. Integers are in the builder's byte order, addresses
+ * in network byte order. Array offsets are relative to the beginning of the
+ * file, string offsets to the beginning of their area.
+ */
+#define PAT_IMG_MAGIC "HAPMAP1\n"
+#define PAT_IMG_BOM   0x01020304
+
+#define PAT_IMG_STR   1 /* exact string keys */
+#define PAT_IMG_IP    2 /* IPv4/IPv6 networks, flattened into ranges */
+
+struct pat_img_hdr {
+	char magic[8];        /* PAT_IMG_MAGIC */
+	uint32_t bom;         /* PAT_IMG_BOM, to detect another byte order */
+	uint32_t type;        /* PAT_IMG_* */
+	uint32_t nb_str;      /* number of entries in the str array */
+	uint32_t nb_ipv4;     /* number of entries in the ipv4 array */
+	uint32_t nb_ipv6;     /* number of entries in the ipv6 array */
+	uint32_t nb_keys;     /* number of keys found in the source file */
+	uint64_t ofs_str;     /* offset of the str array */
+	uint64_t ofs_ipv4;    /* offset of the ipv4 array */
+	uint64_t ofs_ipv6;    /* offset of the ipv6 array */
+	uint64_t ofs_keys;    /* offset of the keys area */
+	uint64_t len_keys;    /* length of the keys area */
+	uint64_t ofs_vals;    /* offset of the values area */
+	uint64_t len_vals;    /* length of the values area */
+};
+
+/* string key, sorted on the key's bytes then on its length */
+struct pat_img_str {
+	uint32_t key;         /* offset of the key */
+	uint32_t len;         /* length of the key */
+	uint32_t val;         /* offset of the value */
+};
+
+/* range of IPv4 addresses covered by the most specific network <key>. The
+ * ranges are sorted and do not overlap.
+ */
+struct pat_img_ipv4 {
+	uint8_t from[4];      /* first address of the range */
+	uint8_t to[4];        /* last address of the range */
+	uint32_t key;         /* offset of the network's key */
+	uint32_t val;         /* offset of the value */
+};
+
+/* same for IPv6 */
+struct pat_img_ipv6 {
+	uint8_t from[16];
+	uint8_t to[16];
+	uint32_t key;
+	uint32_t val;
+};
+
 /* This struct contain a list of reference strings for dunamically
  * updatable patterns.
  */
@@ -114,6 +169,10 @@ struct pat_ref {
 	int unique_id; /* Each pattern reference have unique id. */
 	unsigned long long revision; /* updated for each update */
 	unsigned long long entry_cnt; /* the total number of entries */
+	unsigned long long next_rank; /* rank of the next appended element */
+	const struct pat_img_hdr *img; /* precompiled map file, or NULL */
+	size_t img_size; /* size of the mapping of <img> */
+	unsigned int img_gen; /* generation the entries of <img> belong to */
 	THREAD_ALIGN(64);
 	__decl_thread(HA_RWLOCK_T lock); /* Lock used to protect pat ref elements */
 };
@@ -130,6 +189,7 @@ struct pat_ref_elt {
 	char *sample;
 	unsigned int gen_id; /* generation of pat_ref this was made for */
 	int line;
+	unsigned long long rank; /* position in the reference's list, lower first */
 	struct ebmb_node node; /* Node to attach this element to its <pat_ref> ebtree. */
 	const char pattern[0]; // const only to make sure nobody tries to free it.
 };
@@ -190,6 +250,89 @@ struct pattern_list {
 	struct pattern_expr *expr;
 };
 
+/* Samples replaced by pat_ref_set() which may still be read by other threads.
+ * They are released once all threads have gone through their polling loop.
+ */
+struct pat_gc {
+	struct list list;                /* chaining in the pending or waiting list */
+	char *sample;                    /* former value of the pat_ref_elt */
+	int nb_data;                     /* number of entries in <data> */
+	struct sample_data *data[VAR_ARRAY]; /* former samples of the patterns */
+};
+
+/* A node of the Aho-Corasick automaton used to look up substrings. Nodes are
+ * designated by their index in the automaton's array, the root being node 0.
+ * They are stored in breadth-first order, so that the children of a node are
+ * contiguous and ordered on their byte.
+ */
+struct pat_ac_node {
+	uint32_t child;    /* first child node */
+	uint32_t fail;     /* node for the longest proper suffix of this one */
+	uint32_t out;      /* next node in the fail chain ending patterns, 0 if none */
+	uint32_t ent;      /* first entry of patterns ending here, 0 if none */
+	uint16_t nb_child; /* number of children */
+	unsigned char c;   /* byte leading from the parent to this node */
+};
+
+/* A pattern ending on a node. Entries are allocated in the order of the
+ * expression's pattern list, so that comparing their index gives the order in
+ * which the patterns must be evaluated. Entry 0 is unused.
+ */
+struct pat_ac_ent {
+	struct pattern_list *patl; /* the pattern, NULL once deleted */
+	uint32_t next;             /* next entry on the same node, 0 if none */
+	uint32_t nokey;            /* no key, the pattern is always evaluated */
+};
+
+/* Aho-Corasick automaton built from the keys of the patterns of a "sub" or
+ * "reg" expression. It covers all patterns of the list up to <last>, those
+ * indexed after the build are looked up one at a time, until there are enough
+ * of them to justify a rebuild upon next load or commit.
+ */
+struct pat_ac {
+	struct pat_ac_node *nodes;
+	struct pat_ac_ent *ents;
+	uint32_t nb_nodes;
+	uint32_t nb_ents;
+	uint32_t nb_tail;          /* number of patterns indexed after <last> */
+	int icase;                 /* patterns and input are compared lower case */
+	int (*key)(const struct pattern_list *, const char **); /* returns a pattern's key */
+	struct list *last;         /* last pattern_list element covered */
+	uint32_t root[256];        /* transitions from the root, 0 if none */
+};
+
+/* Longest prefix match tables built from the IPv4 or IPv6 tree of an "ip"
+ * expression (poptrie). The first 16 bits of the address index <direct>, whose
+ * entries are either a leaf, with PAT_LPM_LEAF set, or a node. Each node then
+ * consumes 6 bits of the address, and its children are designated by their
+ * rank among the bits set in <vector> (internal nodes) or <leafvec> (leaves).
+ * Consecutive identical leaves are stored only once. Leaves are indexes in the
+ * pat_lpm's <elts> array.
+ */
+#define PAT_LPM_LEAF 0x80000000U
+
+struct pat_lpm_node {
+	uint64_t vector;           /* children which are internal nodes */
+	uint64_t leafvec;          /* children starting a new run of leaves */
+	uint32_t base1;            /* first internal child in <nodes> */
+	uint32_t base0;            /* first leaf in <leaves> */
+};
+
+struct pat_lpm_tab {
+	uint32_t *direct;          /* 65536 entries, NULL if no network */
+	struct pat_lpm_node *nodes;
+	uint32_t *leaves;
+	uint32_t nb_nodes;
+	uint32_t nb_leaves;
+};
+
+struct pat_lpm {
+	struct pat_lpm_tab v4;
+	struct pat_lpm_tab v6;
+	struct pattern_tree **elts; /* networks, entry 0 is NULL (no match) */
+	unsigned int gen;          /* generation the tables were built for */
+};
+
 /* Description of a pattern expression.
  * It contains pointers to the parse and match functions, and a list or tree of
  * patterns to test against. The structure is organized so that the hot parts
@@ -207,6 +350,9 @@ struct pattern_expr {
 	struct eb_root pattern_tree;  /* may be used for lookup in large datasets */
 	struct eb_root pattern_tree_2;  /* may be used for different types */
 	int mflags;                     /* flags relative to the parsing or matching method. */
+	struct pat_ac *ac;              /* automaton for substring/regex lookups, built on load/commit */
+	struct pat_lpm *lpm;            /* LPM tables for large "ip" expressions, built on load/commit */
+	unsigned int rev;               /* changed with each pattern added or removed, under the write lock */
 	__decl_thread(HA_RWLOCK_T lock);               /* lock used to protect patterns */
 };
 
@@ -69,11 +69,14 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 int pat_idx_list_val(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_list_ptr(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err);
+int pat_idx_list_sub(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_list_reg(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_list_regm(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_tree_str(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err);
+int pat_idx_tree_sfx(struct pattern_expr *expr, struct pattern *pat, char **err);
+int pat_idx_tree_dom(struct pattern_expr *expr, struct pattern *pat, char **err);
 
 /*
  *
@@ -196,6 +199,7 @@ int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt);
 int pat_ref_prune(struct pat_ref *ref);
 int pat_ref_commit_elt(struct pat_ref *ref, struct pat_ref_elt *elt, char **err);
 int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget);
+void pat_ref_prepare(struct pat_ref *ref);
 
 /* Create a new generation number for next pattern updates and returns it. This
  * must be used to atomically insert new patterns that will atomically replace
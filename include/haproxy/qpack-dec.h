@@ -25,6 +25,8 @@
 
 struct buffer;
 struct http_hdr;
+struct qpack_dht;
+struct qpack_enc;
 
 /* Internal QPACK processing errors.
  *Nothing to see with the RFC.
@@ -37,19 +39,33 @@ enum {
 	QPACK_RET_TRUNCATED, /* truncated stream */
 	QPACK_RET_HUFFMAN,   /* huffman decoding error */
 	QPACK_RET_TOO_LARGE, /* decoded request/response is too large */
+	QPACK_RET_BLOCKED,   /* field section references entries not received yet */
 };
 
 struct qpack_dec {
+	/* Dynamic table, only allocated once the encoder sets its capacity */
+	struct qpack_dht *dht;
+	/* Maximum table capacity announced in SETTINGS */
+	uint64_t max_cap;
 	/* Insert count */
 	uint64_t ic;
-	/* Known received count */
+	/* Known received count, as reported to the encoder */
 	uint64_t krc;
+	/* Number of streams blocked on the encoder stream */
+	uint64_t blocked;
 };
 
-int qpack_decode_fs(const unsigned char *buf, uint64_t len, struct buffer *tmp,
-                    struct http_hdr *list, int list_size);
-int qpack_decode_enc(struct buffer *buf, int fin, void *ctx);
-int qpack_decode_dec(struct buffer *buf, int fin, void *ctx);
+void qpack_dec_init(struct qpack_dec *dec, uint64_t max_cap);
+void qpack_dec_release(struct qpack_dec *dec);
+int qpack_decode_fs(struct qpack_dec *dec, const unsigned char *buf, uint64_t len,
+                    struct buffer *tmp, struct http_hdr *list, int list_size,
+                    uint64_t *ric);
+int qpack_decode_enc(struct qpack_dec *dec, struct buffer *buf, int fin, void *ctx);
+int qpack_decode_dec(struct qpack_enc *enc, struct buffer *buf, int fin, void *ctx);
+int qpack_dec_encode_ici(struct qpack_dec *dec, struct buffer *out);
+int qpack_dec_encode_sack(struct qpack_dec *dec, struct buffer *out,
+                          uint64_t id, uint64_t ric);
+int qpack_dec_encode_sccl(struct buffer *out, uint64_t id);
 
 int qpack_err_decode(const int value);
 
@@ -1,12 +1,69 @@
 #ifndef QPACK_ENC_H_
 #define QPACK_ENC_H_
 
+#include <inttypes.h>
 #include <haproxy/istbuf.h>
 
 struct buffer;
+struct qpack_dht;
 
+#define QPACK_ENC_MAX_SECT    16   /* max number of unacknowledged field sections */
+#define QPACK_ENC_MAX_LOOKUP  64   /* max number of table entries looked up per field */
+#define QPACK_ENC_SEEN        16   /* number of recently missed fields remembered, power of two */
+#define QPACK_ENC_PFX_MAX_SZ  16   /* max size of an encoded field section prefix */
+
+/* A field section referencing the dynamic table, not acknowledged yet */
+struct qpack_enc_sect {
+	uint64_t id;             /* stream the section was sent on */
+	uint64_t ric;            /* required insert count of the section */
+	uint64_t min_ref;        /* absolute index of the oldest referenced entry */
+};
+
+/* QPACK encoder state for one connection. Fields are inserted into the
+ * dynamic table on the encoder stream once they were seen at least twice, as
+ * long as this does not evict entries which may still be referenced by the
+ * peer's decoder (RFC 9204 2.1.1).
+ */
+struct qpack_enc {
+	struct qpack_dht *dht;   /* dynamic table, allocated on first insertion */
+	uint64_t limit;          /* local limit on the table capacity */
+	uint64_t max_cap;        /* peer's SETTINGS_QPACK_MAX_TABLE_CAPACITY */
+	uint64_t max_blocked;    /* peer's SETTINGS_QPACK_BLOCKED_STREAMS */
+	uint64_t cap;            /* capacity in use, 0 until announced */
+	uint64_t ic;             /* insert count */
+	uint64_t krc;            /* known received count */
+
+	/* field section being encoded */
+	uint64_t id;             /* stream ID */
+	uint64_t base;           /* base of the section (insert count at start) */
+	uint64_t ric;            /* required insert count of the section */
+	uint64_t min_ref;        /* oldest entry referenced by the section */
+	uint64_t pin;            /* entries at or above this index may not be evicted */
+	int may_ref;             /* non-zero if the dynamic table may be referenced */
+	int may_block;           /* non-zero if unacknowledged entries may be referenced */
+
+	int nb_sect;             /* number of unacknowledged sections */
+	struct qpack_enc_sect sect[QPACK_ENC_MAX_SECT];
+
+	uint32_t seen_pos;       /* next position in <seen> */
+	uint32_t seen[QPACK_ENC_SEEN]; /* hashes of the recently missed fields */
+};
+
+int qpack_encode_prefix_integer(struct buffer *out, uint64_t i,
+                                int prefix_size, unsigned char before_prefix);
 int qpack_encode_field_section_line(struct buffer *out);
 int qpack_encode_int_status(struct buffer *out, unsigned int status);
 int qpack_encode_header(struct buffer *out, const struct ist n, const struct ist v);
 
+void qpack_enc_init(struct qpack_enc *enc, uint64_t limit);
+void qpack_enc_release(struct qpack_enc *enc);
+void qpack_enc_set_max(struct qpack_enc *enc, uint64_t max_cap, uint64_t max_blocked);
+void qpack_enc_begin(struct qpack_enc *enc, uint64_t id);
+int qpack_enc_header(struct qpack_enc *enc, struct buffer *out, struct buffer *ins,
+                     const struct ist n, const struct ist v);
+int qpack_enc_end(struct qpack_enc *enc, struct buffer *pfx);
+int qpack_enc_section_ack(struct qpack_enc *enc, uint64_t id);
+void qpack_enc_stream_cancel(struct qpack_enc *enc, uint64_t id);
+int qpack_enc_insert_count_inc(struct qpack_enc *enc, uint64_t inc);
+
 #endif /* QPACK_ENC_H_ */
@@ -29,13 +29,17 @@
 #include <inttypes.h>
 #include <stddef.h> /* size_t */
 
+#include <haproxy/api-t.h>
 #include <haproxy/buf-t.h>
 #include <haproxy/quic_loss-t.h>
 
 #define QUIC_CC_INFINITE_SSTHESH ((uint32_t)-1)
+/* Minimum number of datagrams which may be emitted during a pacing slot. */
+#define QUIC_PACING_MIN_BURST    2
 
 extern struct quic_cc_algo quic_cc_algo_nr;
 extern struct quic_cc_algo quic_cc_algo_cubic;
+extern struct quic_cc_algo quic_cc_algo_bbr;
 extern struct quic_cc_algo *default_quic_cc_algo;
 
 /* Fake algorithm with its fixed window */
@@ -63,6 +67,17 @@ enum quic_cc_event_type {
 	QUIC_CC_EVT_ECN_CE,
 };
 
+/* Delivery rate sample, computed for each newly acknowledged in flight packet
+ * (see draft-cheng-iccrg-delivery-rate-estimation).
+ */
+struct quic_cc_rs {
+	uint64_t delivered;       /* bytes delivered during the sampling interval */
+	uint64_t prior_delivered; /* path <delivered> value when the packet was sent */
+	uint64_t interval;        /* sampling interval (us), 0 if not usable */
+	uint32_t rtt;             /* RTT sample for this packet (us) */
+	int is_app_limited;       /* packet sent while the application was limiting */
+};
+
 struct quic_cc_event {
 	enum quic_cc_event_type type;
 	union {
@@ -70,10 +85,12 @@ struct quic_cc_event {
 			uint64_t acked;
 			uint64_t pn;
 			unsigned int time_sent;
+			const struct quic_cc_rs *rs; /* NULL if no rate sample */
 		} ack;
 		struct loss {
 			unsigned int time_sent;
 			unsigned int count; // #pkt lost for this event
+			uint64_t lost_bytes; /* in flight bytes lost for this event */
 		} loss;
 	};
 };
@@ -82,13 +99,14 @@ enum quic_cc_algo_type {
 	QUIC_CC_ALGO_TP_NEWRENO,
 	QUIC_CC_ALGO_TP_CUBIC,
 	QUIC_CC_ALGO_TP_NOCC,
+	QUIC_CC_ALGO_TP_BBR,
 };
 
 struct quic_cc {
 	/* <conn> is there only for debugging purpose. */
 	struct quic_conn *qc;
 	struct quic_cc_algo *algo;
-	uint32_t priv[20];
+	uint32_t priv[24] ALIGNED(8);
 };
 
 struct quic_cc_path {
@@ -113,6 +131,16 @@ struct quic_cc_path {
 	uint64_t in_flight;
 	/* Number of in flight ack-eliciting packets. */
 	uint64_t ifae_pkts;
+
+	/* Delivery rate estimation. */
+	uint64_t delivered;       /* total of acknowledged in flight bytes */
+	ullong delivered_ts;      /* date of the last delivery (ns) */
+	ullong first_sent_ts;     /* emission date of the first packet of the current flight (ns) */
+	uint64_t app_limited;     /* <delivered> value ending the app-limited phase, 0 if none */
+
+	/* Pacing, only used if the algorithm reports a pacing rate. */
+	uint64_t pacing_credit;   /* bytes which may still be prepared during the current slot */
+	unsigned int pacing_next; /* tick at which the next pacing slot starts */
 };
 
 struct quic_cc_algo {
@@ -123,6 +151,8 @@ struct quic_cc_algo {
 	void (*state_trace)(struct buffer *buf, const struct quic_cc *cc);
 	void (*state_cli)(struct buffer *buf, const struct quic_cc_path *path);
 	void (*hystart_start_round)(struct quic_cc *cc, uint64_t pn);
+	/* Optional pacing rate in bytes per second, 0 to disable pacing. */
+	uint64_t (*pacing_rate)(const struct quic_cc *cc);
 };
 
 #endif /* USE_QUIC */
@@ -36,6 +36,10 @@
 void quic_cc_init(struct quic_cc *cc, struct quic_cc_algo *algo, struct quic_conn *qc);
 void quic_cc_event(struct quic_cc *cc, struct quic_cc_event *ev);
 void quic_cc_state_trace(struct buffer *buf, const struct quic_cc *cc);
+void quic_cc_path_on_sent(struct quic_cc_path *path, struct quic_tx_packet *pkt);
+void quic_cc_path_on_acked(struct quic_cc_path *path, struct quic_tx_packet *pkt,
+                           struct quic_cc_rs *rs);
+int quic_pacing_may_send(struct quic_cc_path *path);
 
 static inline const char *quic_cc_state_str(enum quic_cc_algo_state_type state)
 {
@@ -92,6 +96,11 @@ static inline void quic_cc_path_init(struct quic_cc_path *path, int ipv4, unsign
 	path->prep_in_flight = 0;
 	path->in_flight = 0;
 	path->ifae_pkts = 0;
+	path->delivered = 0;
+	path->delivered_ts = path->first_sent_ts = 0;
+	path->app_limited = 0;
+	path->pacing_credit = 0;
+	path->pacing_next = TICK_ETERNITY;
 	quic_cc_init(&path->cc, algo, qc);
 }
 
@@ -107,6 +116,28 @@ static inline size_t quic_cc_path_prep_data(struct quic_cc_path *path)
 	return path->cwnd - path->prep_in_flight;
 }
 
+/* Mark <path> as application limited: the data currently in flight do not
+ * fill the congestion window, so the next delivery rate samples only provide
+ * a lower bound of the available bandwidth.
+ */
+static inline void quic_cc_path_set_app_limited(struct quic_cc_path *path)
+{
+	path->app_limited = QUIC_MAX(path->delivered + path->in_flight, (uint64_t)1);
+}
+
+/* Returns true if <path> emission is currently delayed by pacing. */
+static inline int quic_pacing_blocked(const struct quic_cc_path *path)
+{
+	return path->cc.algo->pacing_rate && !path->pacing_credit &&
+	       tick_isset(path->pacing_next) && !tick_is_expired(path->pacing_next, now_ms);
+}
+
+/* Consume <len> bytes of <path> pacing credit for the current slot. */
+static inline void quic_pacing_consume(struct quic_cc_path *path, size_t len)
+{
+	path->pacing_credit = len < path->pacing_credit ? path->pacing_credit - len : 0;
+}
+
 
 #endif /* USE_QUIC */
 #endif /* _PROTO_QUIC_CC_H */
@@ -11,6 +11,17 @@ enum quic_sock_mode {
 	QUIC_SOCK_MODE_LSTNR, /* Multiplex connections over listener socket. */
 };
 
+/* Maximum number of datagrams retrieved by a single system call on a listener
+ * socket, and the default value for "tune.quic.rx-batch".
+ */
+#define QUIC_MAX_RX_BATCH     64
+#define QUIC_DFLT_RX_BATCH    32
+
+/* recvmmsg() is used to receive datagrams by batches on listener sockets. */
+#if defined(__linux__)
+#define QUIC_HAVE_RECVMMSG
+#endif
+
 /* QUIC connection accept queue. One per thread. */
 struct quic_accept_queue {
 	struct mt_list listeners; /* QUIC listeners with at least one connection ready to be accepted on this queue */
@@ -52,6 +52,9 @@ enum {
 	QUIC_ST_STREAM_DATA_BLOCKED,
 	QUIC_ST_STREAMS_BLOCKED_BIDI,
 	QUIC_ST_STREAMS_BLOCKED_UNI,
+	/* Reception syscalls on listener sockets */
+	QUIC_ST_RX_CALLS,
+	QUIC_ST_RX_DGRAMS,
 	QUIC_STATS_COUNT /* must be the last */
 };
 
@@ -99,6 +102,9 @@ struct quic_counters {
 	long long stream_data_blocked;       /* total number of times STREAM_DATA_BLOCKED frame was received */
 	long long streams_blocked_bidi;      /* total number of times STREAMS_BLOCKED_BIDI frame was received */
 	long long streams_blocked_uni;       /* total number of times STREAMS_BLOCKED_UNI frame was received */
+	/* Reception syscalls on listener sockets */
+	long long rx_calls;          /* total number of successful reception syscalls on listener sockets */
+	long long rx_dgrams;         /* total number of datagrams received on listener sockets */
 };
 
 #endif /* USE_QUIC */
@@ -6,6 +6,7 @@
 #define QUIC_MAX_CC_BUFSIZE (2 * (QUIC_MIN_CC_PKTSIZE + QUIC_DGRAM_HEADLEN))
 
 #include <import/eb64tree.h>
+#include <haproxy/api-t.h>
 #include <haproxy/list-t.h>
 
 extern struct pool_head *pool_head_quic_tx_packet;
@@ -25,6 +26,8 @@ extern struct pool_head *pool_head_quic_cc_buf;
 #define QUIC_FL_TX_PACKET_COALESCED     (1UL << 4)
 /* Flag a sent packet as being probing with old data */
 #define QUIC_FL_TX_PACKET_PROBE_WITH_OLD_DATA (1UL << 5)
+/* Packet sent while the application was not able to fill the congestion window */
+#define QUIC_FL_TX_PACKET_APP_LIMITED   (1UL << 6)
 
 /* Structure to store enough information about TX QUIC packets. */
 struct quic_tx_packet {
@@ -53,6 +56,12 @@ struct quic_tx_packet {
 	struct quic_tx_packet *prev;
 	/* Largest acknowledged packet number if this packet contains an ACK frame */
 	int64_t largest_acked_pn;
+	/* Delivery rate estimation state of the path when this packet was sent. */
+	uint64_t delivered;
+	ullong delivered_ts;
+	ullong first_sent_ts;
+	/* The time this packet was sent (ns). */
+	ullong time_sent_ns;
 	unsigned char type;
 };
 
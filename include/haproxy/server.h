@@ -181,7 +181,7 @@ const struct mux_ops *srv_get_ws_proto(struct server *srv);
 /* increase the number of cumulated streams on the designated server */
 static inline void srv_inc_sess_ctr(struct server *s)
 {
-	_HA_ATOMIC_INC(&s->counters.cum_sess);
+	_HA_ATOMIC_INC(&s->counters.shared.shard[ti->ctr_shard]->cum_sess);
 	HA_ATOMIC_UPDATE_MAX(&s->counters.sps_max,
 	                     update_freq_ctr(&s->counters.sess_per_sec, 1));
 }
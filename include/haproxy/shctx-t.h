@@ -45,15 +45,28 @@ struct shared_block {
 	unsigned char data[VAR_ARRAY];
 };
 
-struct shared_context {
+/* The blocks of a shared context are split into arenas, each with its own lock
+ * and list of available blocks, so that threads of different groups do not
+ * serialize on the same lock when reserving blocks. All the blocks of a row
+ * belong to the same arena.
+ */
+struct shctx_arena {
 	__decl_thread(HA_RWLOCK_T lock);
 	struct list avail;  /* list for active and free blocks */
 	unsigned int nbav;  /* number of available blocks */
+	ALWAYS_ALIGN(64);
+};
+
+struct shared_context {
 	unsigned int max_obj_size;   /* maximum object size (in bytes). */
 	void (*free_block)(struct shared_block *first, void *data);
 	void (*reserve_finish)(struct shared_context *shctx);
 	void *cb_data;
 	short int block_size;
+	int nb_arenas;               /* number of arenas in use */
+	unsigned int arena_blocks;   /* number of blocks per arena, except the last one */
+	void *blocks;                /* first block of the first arena */
+	struct shctx_arena arenas[MAX_TGROUPS];
 	ALWAYS_ALIGN(64);  /* The following member needs to be aligned to 64 in the
 			      cache's case because the cache struct contains an explicitly
 			      aligned member (struct cache_tree). */
@@ -21,7 +21,7 @@
 
 int shctx_init(struct shared_context **orig_shctx,
                int maxblocks, int blocksize, unsigned int maxobjsz,
-               int extra, __maybe_unused const char *name);
+               int extra, int arenas, __maybe_unused const char *name);
 struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
                                            struct shared_block *last, int data_len);
 void shctx_row_detach(struct shared_context *shctx, struct shared_block *first);
@@ -33,23 +33,68 @@ int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
                        unsigned char *dst, int offset, int len);
 
 
-/* Lock functions */
+/* Returns the arena of <shctx> which block <block> belongs to */
+static inline struct shctx_arena *shctx_block_arena(struct shared_context *shctx,
+                                                    const struct shared_block *block)
+{
+	size_t idx = ((const char *)block - (const char *)shctx->blocks) /
+	             (sizeof(struct shared_block) + shctx->block_size);
+
+	idx /= shctx->arena_blocks;
+	return &shctx->arenas[MIN(idx, shctx->nb_arenas - 1)];
+}
+
+/* Returns the number of available blocks of <shctx>, which must be locked */
+static inline unsigned int shctx_avail(const struct shared_context *shctx)
+{
+	unsigned int nbav = 0;
+	int i;
+
+	for (i = 0; i < shctx->nb_arenas; i++)
+		nbav += shctx->arenas[i].nbav;
+	return nbav;
+}
+
+/* Lock functions. The ones working on the whole context lock all the arenas,
+ * the row ones only lock the arena of the row starting at <first>, which is
+ * enough to detach or reattach it.
+ */
 
 static inline void shctx_rdlock(struct shared_context *shctx)
 {
-	HA_RWLOCK_RDLOCK(SHCTX_LOCK, &shctx->lock);
+	int i;
+
+	for (i = 0; i < shctx->nb_arenas; i++)
+		HA_RWLOCK_RDLOCK(SHCTX_LOCK, &shctx->arenas[i].lock);
 }
 static inline void shctx_rdunlock(struct shared_context *shctx)
 {
-	HA_RWLOCK_RDUNLOCK(SHCTX_LOCK, &shctx->lock);
+	int i;
+
+	for (i = shctx->nb_arenas - 1; i >= 0; i--)
+		HA_RWLOCK_RDUNLOCK(SHCTX_LOCK, &shctx->arenas[i].lock);
 }
 static inline void shctx_wrlock(struct shared_context *shctx)
 {
-	HA_RWLOCK_WRLOCK(SHCTX_LOCK, &shctx->lock);
+	int i;
+
+	for (i = 0; i < shctx->nb_arenas; i++)
+		HA_RWLOCK_WRLOCK(SHCTX_LOCK, &shctx->arenas[i].lock);
 }
 static inline void shctx_wrunlock(struct shared_context *shctx)
 {
-	HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &shctx->lock);
+	int i;
+
+	for (i = shctx->nb_arenas - 1; i >= 0; i--)
+		HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &shctx->arenas[i].lock);
+}
+static inline void shctx_row_wrlock(struct shared_context *shctx, struct shared_block *first)
+{
+	HA_RWLOCK_WRLOCK(SHCTX_LOCK, &shctx_block_arena(shctx, first)->lock);
+}
+static inline void shctx_row_wrunlock(struct shared_context *shctx, struct shared_block *first)
+{
+	HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &shctx_block_arena(shctx, first)->lock);
 }
 
 /* List Macros */
@@ -58,19 +103,19 @@ static inline void shctx_wrunlock(struct shared_context *shctx)
  * Insert <s> block after <head> which is not necessarily the head of a list,
  * so between <head> and the next element after <head>.
  */
-static inline void shctx_block_append_hot(struct shared_context *shctx,
+static inline void shctx_block_append_hot(struct shctx_arena *arena,
                                           struct shared_block *first,
                                           struct shared_block *s)
 {
-	shctx->nbav--;
+	arena->nbav--;
 	LIST_DELETE(&s->list);
 	LIST_APPEND(&first->list, &s->list);
 }
 
-static inline struct shared_block *shctx_block_detach(struct shared_context *shctx,
+static inline struct shared_block *shctx_block_detach(struct shctx_arena *arena,
 						      struct shared_block *s)
 {
-	shctx->nbav--;
+	arena->nbav--;
 	LIST_DELETE(&s->list);
 	LIST_INIT(&s->list);
 	return s;
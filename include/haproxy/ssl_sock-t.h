@@ -50,6 +50,7 @@
 #define SSL_SOCK_SEND_UNLIMITED     0x00000004
 #define SSL_SOCK_RECV_HEARTBEAT     0x00000008
 #define SSL_SOCK_SEND_MORE          0x00000010  /* set MSG_MORE at lower levels */
+#define SSL_SOCK_KTLS_SEND          0x00000020  /* the kernel encrypts the data we send (kTLS) */
 
 /* bits 0xFFFFFF00 are reserved to store verify errors.
  * The CA en CRT error codes will be stored on 7 bits each
@@ -254,6 +255,7 @@ struct ssl_sock_ctx {
 	unsigned long error_code;     /* last error code of the error stack */
 	struct buffer early_buf;      /* buffer to store the early data received */
 	int sent_early_data;          /* Amount of early data we sent so far */
+	int ktls_ctrl_msg;            /* record type of the next kTLS write if not application data, or 0 */
 
 #ifdef USE_QUIC
 	struct quic_conn *qc;
@@ -201,6 +201,11 @@ struct stktable {
 	struct {
 		struct eb_root keys;      /* head of sticky session tree */
 		struct eb_root exps;      /* head of sticky session expiration tree */
+		/* <keys> is read under the R lock and modified under the W
+		 * lock. <exps> is only used by writers and expiration, which
+		 * walk and requeue it under the S lock and only upgrade it to
+		 * W to unlink entries.
+		 */
 		__decl_thread(HA_RWLOCK_T sh_lock); /* for the trees above */
 	} shards[CONFIG_HAP_TBL_BUCKETS];
 
@@ -278,6 +278,25 @@ static inline void stkctr_clr_flags(struct stkctr *stkctr, unsigned int flags)
 	stkctr->entry = caddr_clr_flags(stkctr->entry, flags);
 }
 
+/* Atomically decrements the unsigned counter pointed to by <ptr> (usually the
+ * conn_cur data of a stick-table entry) unless it's already zero.
+ */
+static inline void stktable_data_dec_uint(void *ptr)
+{
+	uint old = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
+
+	while (old && !HA_ATOMIC_CAS(&stktable_data_cast(ptr, std_t_uint), &old, old - 1))
+		__ha_cpu_relax();
+}
+
+/* Note: the stkctr_inc_*() functions below are called for every tracked
+ * request. They only perform atomic operations on the entry's counters and
+ * do not take the entry's lock, which is only needed to read or write several
+ * fields at once or non-counter data. Since the lock doesn't serialize against
+ * them, every other writer of the integer counters must use atomic operations
+ * as well, even with the entry's lock held.
+ */
+
 /* Increase the number of cumulated HTTP requests in the tracked counter
  * <stkctr>. It returns 0 if the entry pointer does not exist and nothing is
  * performed. Otherwise it returns 1.
@@ -291,19 +310,15 @@ static inline int stkctr_inc_http_req_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_REQ_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_uint)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, std_t_uint));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_REQ_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -323,19 +338,15 @@ static inline int stkctr_inc_http_err_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_ERR_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_uint)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, std_t_uint));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_ERR_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -355,19 +366,15 @@ static inline int stkctr_inc_http_fail_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_FAIL_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_uint)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, std_t_uint));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_FAIL_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -387,17 +394,14 @@ static inline int stkctr_inc_bytes_in_ctr(struct stkctr *stkctr, unsigned long l
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_IN_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_ull) += bytes;
+		HA_ATOMIC_ADD(&stktable_data_cast(ptr1, std_t_ull), bytes);
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_IN_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u, bytes);
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
@@ -418,17 +422,14 @@ static inline int stkctr_inc_bytes_out_ctr(struct stkctr *stkctr, unsigned long
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_OUT_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_ull) += bytes;
+		HA_ATOMIC_ADD(&stktable_data_cast(ptr1, std_t_ull), bytes);
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_OUT_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u, bytes);
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
@@ -449,19 +450,15 @@ static inline int stkctr_add_glitch_ctr(struct stkctr *stkctr, uint inc)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GLITCH_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, std_t_uint) += inc;
+		HA_ATOMIC_ADD(&stktable_data_cast(ptr1, std_t_uint), inc);
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GLITCH_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, std_t_frqp),
 				       stkctr->table->data_arg[STKTABLE_DT_GLITCH_RATE].u, inc);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
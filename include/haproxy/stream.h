@@ -129,12 +129,7 @@ static inline void stream_store_counters(struct stream *s)
 
 		ptr = stktable_data_ptr(s->stkctr[i].table, ts, STKTABLE_DT_CONN_CUR);
 		if (ptr) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-			if (stktable_data_cast(ptr, std_t_uint) > 0)
-				stktable_data_cast(ptr, std_t_uint)--;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_data_dec_uint(ptr);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(s->stkctr[i].table, ts, 0);
@@ -171,12 +166,7 @@ static inline void stream_stop_content_counters(struct stream *s)
 
 		ptr = stktable_data_ptr(s->stkctr[i].table, ts, STKTABLE_DT_CONN_CUR);
 		if (ptr) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-			if (stktable_data_cast(ptr, std_t_uint) > 0)
-				stktable_data_cast(ptr, std_t_uint)--;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_data_dec_uint(ptr);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(s->stkctr[i].table, ts, 0);
@@ -194,24 +184,20 @@ static inline void stream_start_counters(struct stktable *t, struct stksess *ts)
 {
 	void *ptr;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_CUR);
 	if (ptr)
-		stktable_data_cast(ptr, std_t_uint)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr, std_t_uint));
 
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_CNT);
 	if (ptr)
-		stktable_data_cast(ptr, std_t_uint)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr, std_t_uint));
 
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_RATE);
 	if (ptr)
 		update_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
 				       t->data_arg[STKTABLE_DT_CONN_RATE].u, 1);
 	if (tick_isset(t->expire))
-		ts->expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
-
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+		HA_ATOMIC_STORE(&ts->expire, tick_add(now_ms, MS_TO_TICKS(t->expire)));
 
 	/* If data was modified, we need to touch to re-schedule sync */
 	stktable_touch_local(t, ts, 0);
@@ -362,8 +348,8 @@ static inline void stream_choose_redispatch(struct stream *s)
 		s->scb->state = SC_ST_REQ;
 	} else {
 		if (objt_server(s->target))
-			_HA_ATOMIC_INC(&__objt_server(s->target)->counters.retries);
-		_HA_ATOMIC_INC(&s->be->be_counters.retries);
+			_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->retries);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->retries);
 		s->scb->state = SC_ST_ASS;
 	}
 
@@ -113,6 +113,7 @@ struct thread_info {
 	ulong ltid_bit;                   /* bit masks for the tid/ltid */
 	uint tgid;                        /* ID of the thread group this thread belongs to (starts at 1; 0=unset) */
 	uint ring_queue;                  /* queue number for the rings */
+	uint ctr_shard;                   /* shard of the proxy/server counters to update */
 
 	ullong pth_id;                    /* the pthread_t cast to a ullong */
 	void *stack_top;                  /* the top of the stack when entering the thread */
@@ -22,6 +22,8 @@
 #ifndef _HAPROXY_VARS_T_H
 #define _HAPROXY_VARS_T_H
 
+#include <import/ebtree-t.h>
+
 #include <haproxy/sample_data-t.h>
 #include <haproxy/thread-t.h>
 
@@ -47,8 +49,14 @@ enum vars_scope {
 	SCOPE_CHECK,
 };
 
+/* number of trees the variables of a scope are spread over (power of 2). A few
+ * small trees are shallower than a large one and the choice is almost free
+ * since the name hashes are already evenly distributed.
+ */
+#define VAR_NAME_ROOTS 4
+
 struct vars {
-	struct list head;
+	struct eb_root name_root[VAR_NAME_ROOTS]; /* variables indexed by name hash */
 	enum vars_scope scope;
 	unsigned int size;
 	__decl_thread(HA_RWLOCK_T rwlock);
@@ -64,8 +72,7 @@ struct var_desc {
 };
 
 struct var {
-	struct list l; /* Used for chaining vars. */
-	uint64_t name_hash;      /* XXH3() of the variable's name */
+	struct eb64_node node;   /* key is the XXH3() of the variable's name */
 	uint flags;       // VF_*
 	/* 32-bit hole here */
 	struct sample_data data; /* data storage. */
@@ -22,6 +22,8 @@
 #ifndef _HAPROXY_VARS_H
 #define _HAPROXY_VARS_H
 
+#include <import/eb64tree.h>
+
 #include <haproxy/api-t.h>
 #include <haproxy/session-t.h>
 #include <haproxy/stream-t.h>
@@ -46,6 +48,18 @@ int vars_unset_by_name_ifexist(const char *name, size_t len, struct sample *smp)
 int vars_get_by_desc(const struct var_desc *var_desc, struct sample *smp, const struct buffer *def);
 int vars_check_arg(struct arg *arg, char **err);
 
+/* returns non-zero if no variable is stored in <vars> */
+static inline int vars_is_empty(const struct vars *vars)
+{
+	int i;
+
+	for (i = 0; i < VAR_NAME_ROOTS; i++) {
+		if (!eb_is_empty(&vars->name_root[i]))
+			return 0;
+	}
+	return 1;
+}
+
 /* locks the <vars> for writes if it's in a shared scope */
 static inline void vars_wrlock(struct vars *vars)
 {
@@ -824,8 +824,8 @@ int assign_server(struct stream *s)
 			goto out;
 		}
 		else if (srv != prev_srv) {
-			_HA_ATOMIC_INC(&s->be->be_counters.cum_lbconn);
-			_HA_ATOMIC_INC(&srv->counters.cum_lbconn);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cum_lbconn);
+			_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->cum_lbconn);
 		}
 		s->target = &srv->obj_type;
 	}
@@ -992,11 +992,11 @@ int assign_server_and_queue(struct stream *s)
 					s->txn->flags |= TX_CK_DOWN;
 				}
 				s->flags |= SF_REDISP;
-				_HA_ATOMIC_INC(&prev_srv->counters.redispatches);
-				_HA_ATOMIC_INC(&s->be->be_counters.redispatches);
+				_HA_ATOMIC_INC(&prev_srv->counters.shared.shard[ti->ctr_shard]->redispatches);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->redispatches);
 			} else {
-				_HA_ATOMIC_INC(&prev_srv->counters.retries);
-				_HA_ATOMIC_INC(&s->be->be_counters.retries);
+				_HA_ATOMIC_INC(&prev_srv->counters.shared.shard[ti->ctr_shard]->retries);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->retries);
 			}
 		}
 	}
@@ -1784,13 +1784,13 @@ int connect_server(struct stream *s)
 		s->scb->flags |= SC_FL_NOLINGER;
 
 	if (s->flags & SF_SRV_REUSED) {
-		_HA_ATOMIC_INC(&s->be->be_counters.reuse);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->reuse);
 		if (srv)
-			_HA_ATOMIC_INC(&srv->counters.reuse);
+			_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->reuse);
 	} else {
-		_HA_ATOMIC_INC(&s->be->be_counters.connect);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->connect);
 		if (srv)
-			_HA_ATOMIC_INC(&srv->counters.connect);
+			_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->connect);
 	}
 
 	err = do_connect_server(s, srv_conn);
@@ -1976,8 +1976,8 @@ int srv_redispatch_connect(struct stream *s)
 			s->conn_err_type = STRM_ET_QUEUE_ERR;
 		}
 
-		_HA_ATOMIC_INC(&srv->counters.failed_conns);
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+		_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->failed_conns);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 		return 1;
 
 	case SRV_STATUS_NOSRV:
@@ -1986,7 +1986,7 @@ int srv_redispatch_connect(struct stream *s)
 			s->conn_err_type = STRM_ET_CONN_ERR;
 		}
 
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 		return 1;
 
 	case SRV_STATUS_QUEUED:
@@ -2015,8 +2015,8 @@ int srv_redispatch_connect(struct stream *s)
 		if (srv)
 			srv_set_sess_last(srv);
 		if (srv)
-			_HA_ATOMIC_INC(&srv->counters.failed_conns);
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+			_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->failed_conns);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 
 		/* release other streams waiting for this server */
 		if (may_dequeue_tasks(srv, s->be))
@@ -2090,8 +2090,8 @@ void back_try_conn_req(struct stream *s)
 			if (srv)
 				srv_set_sess_last(srv);
 			if (srv)
-				_HA_ATOMIC_INC(&srv->counters.failed_conns);
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+				_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->failed_conns);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 
 			/* release other streams waiting for this server */
 			sess_change_server(s, NULL);
@@ -2157,8 +2157,8 @@ void back_try_conn_req(struct stream *s)
 			pendconn_cond_unlink(s->pend_pos);
 
 			if (srv)
-				_HA_ATOMIC_INC(&srv->counters.failed_conns);
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+				_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->failed_conns);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 			sc_abort(sc);
 			sc_shutdown(sc);
 			req->flags |= CF_WRITE_TIMEOUT;
@@ -2413,8 +2413,8 @@ void back_handle_st_cer(struct stream *s)
 		}
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_INC(&objt_server(s->target)->counters.failed_conns);
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_conns);
+			_HA_ATOMIC_INC(&objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_conns);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_conns);
 		sess_change_server(s, NULL);
 		if (may_dequeue_tasks(objt_server(s->target), s->be))
 			process_srv_queue(objt_server(s->target));
@@ -2446,8 +2446,8 @@ void back_handle_st_cer(struct stream *s)
 			s->conn_err_type = STRM_ET_CONN_OTHER;
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_INC(&objt_server(s->target)->counters.internal_errors);
-		_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+			_HA_ATOMIC_INC(&objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 		sess_change_server(s, NULL);
 		if (may_dequeue_tasks(objt_server(s->target), s->be))
 			process_srv_queue(objt_server(s->target));
@@ -2585,7 +2585,7 @@ void back_handle_st_rdy(struct stream *s)
 void set_backend_down(struct proxy *be)
 {
 	be->be_counters.last_change = ns_to_sec(now_ns);
-	_HA_ATOMIC_INC(&be->be_counters.down_trans);
+	_HA_ATOMIC_INC(&be->be_counters.shared.shard[ti->ctr_shard]->down_trans);
 
 	if (!(global.mode & MODE_STARTING)) {
 		ha_alert("%s '%s' has no server available!\n", proxy_type_str(be), be->id);
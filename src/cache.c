@@ -10,17 +10,25 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
 #include <import/eb32tree.h>
 #include <import/sha1.h>
 
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
+#include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
 #include <haproxy/errors.h>
 #include <haproxy/filters.h>
+#include <haproxy/flt_http_comp.h>
 #include <haproxy/hash.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana.h>
@@ -40,6 +48,7 @@
 #define CACHE_FLT_F_IMPLICIT_DECL  0x00000001 /* The cache filtre was implicitly declared (ie without
 					       * the filter keyword) */
 #define CACHE_FLT_INIT             0x00000002 /* Whether the cache name was freed. */
+#define CACHE_FLT_F_STORE          0x00000004 /* A cache-store rule uses this filter */
 
 static uint64_t cache_hash_seed = 0;
 
@@ -51,12 +60,37 @@ struct flt_ops cache_ops;
 
 struct cache_tree {
 	struct eb_root entries;  /* head of cache entries based on keys */
+	struct eb_root fetches;  /* pending fetches (struct cache_fetch) based on keys */
 	__decl_thread(HA_RWLOCK_T lock);
 
 	struct list cleanup_list;
 	__decl_thread(HA_SPINLOCK_T cleanup_lock);
 } ALIGNED(64);
 
+/* disk tier of a cache: a file used as a circular log of records, each of
+ * them holding a cache_entry followed by the serialized HTX blocks of the
+ * object, exactly as in a row of the memory tier. The index only lives in
+ * memory. The file is only read and written by a dedicated I/O thread.
+ */
+struct cache_disk {
+	__decl_thread(HA_RWLOCK_T lock);
+	struct eb_root entries;  /* records indexed on the primary hash */
+	struct list fifo;        /* records in the order they were written */
+	uint64_t wpos;           /* next write position in the file */
+	uint64_t used;           /* bytes used by the records in <fifo> */
+	unsigned int objects;    /* number of indexed records */
+	int fd;                  /* file descriptor of the file */
+	unsigned long long io_pending;       /* bytes queued for writing and not written yet */
+#ifdef USE_THREAD
+	pthread_t io_thread;     /* the I/O thread, valid if <io_running> is set */
+	pthread_mutex_t io_lock; /* protects the fields below */
+	pthread_cond_t io_cond;  /* signaled when a request is queued or on stop */
+	struct list io_queue;    /* requests waiting for the I/O thread */
+	unsigned int io_running; /* the I/O thread was started */
+	unsigned int io_stop;    /* the I/O thread must stop */
+#endif
+};
+
 struct cache {
 	struct cache_tree trees[CACHE_TREE_NUM];
 	struct list list;        /* cache linked list */
@@ -65,7 +99,16 @@ struct cache {
 	unsigned int maxobjsz;   /* max-object-size (in bytes) */
 	unsigned int max_secondary_entries;  /* maximum number of secondary entries with the same primary hash */
 	uint8_t vary_processing_enabled;     /* boolean : manage Vary header (disabled by default) */
+	uint8_t range_fill_enabled;          /* boolean : fetch whole objects on range misses (disabled by default) */
+	unsigned int max_stale;  /* max-stale (in seconds) */
+	unsigned int collapse_timeout;       /* collapse-timeout (in ms) */
 	char id[33];             /* cache name */
+	char *disk_file;         /* disk-file, NULL if there is no disk tier */
+	unsigned long long disk_size;        /* disk-max-size (in bytes) */
+	unsigned int disk_maxobjsz;          /* disk-max-object-size (in bytes) */
+	struct cache_disk *disk; /* disk tier, NULL if not configured */
+	unsigned long long mem_hits;         /* hits served from the memory tier */
+	unsigned long long disk_hits;        /* hits served from the disk tier */
 };
 
 /* the appctx context of a cache applet, stored in appctx->svcctx */
@@ -76,9 +119,16 @@ struct cache_appctx {
 	unsigned int offset;             /* start offset of remaining data relative to beginning of the next block */
 	unsigned int rem_data;           /* Remaining bytes for the last data block (HTX only, 0 means process next block) */
 	unsigned int send_notmodified:1; /* In case of conditional request, we might want to send a "304 Not Modified" response instead of the stored data. */
-	unsigned int unused:31;
+	unsigned int disk_error:1;       /* A read from the disk tier failed */
+	unsigned int range:1;            /* Only the range below must be sent, with a "206 Partial Content" status */
+	unsigned int unused:29;
 	/* 4 bytes hole here */
 	struct shared_block *next;       /* The next block of data to be sent for this cache entry. */
+	struct cache_disk_entry *disk;   /* Record to be sent from the disk tier instead of <entry>'s row, if any. */
+	struct cache_disk_io *io;        /* Read request loading the part of <disk> being sent, if any. */
+	unsigned int skip;               /* Bytes of the payload of <disk> still to be skipped before a range */
+	unsigned int range_first;        /* Offset in the payload of the first byte of the range */
+	unsigned int range_len;          /* Length of the range, 0 if it is not satisfiable */
 };
 
 /* cache config for filters */
@@ -150,6 +200,9 @@ static int default_normalizer(struct htx *htx, struct ist hdr_name,
 
 static int accept_encoding_bitmap_cmp(const void *ref, const void *new, unsigned int len);
 
+static int cache_store_headers(struct cache *cache, struct shared_block *first, struct htx *htx);
+static unsigned int get_secondary_key_encoding(const char *secondary_key);
+
 /* Warning : do not forget to update HTTP_CACHE_SEC_KEY_LEN when new items are
  * added to this array. */
 const struct vary_hashing_information vary_information[] = {
@@ -185,14 +238,29 @@ static inline void cache_wrunlock(struct cache_tree *cache)
 struct cache_st {
 	struct shared_block *first_block;
 	struct list detached_head;
+	struct cache_disk_entry *disk;   /* record being written to the disk tier, if any */
+	unsigned int disk_pos;           /* write position in this record */
+	unsigned int flags;              /* CACHE_ST_F_* */
+	struct list fetch_wait;          /* position in the waiters of a fetch, if any */
+	struct task *task;               /* stream task woken up when the fetch ends */
 };
 
+/* cache_st flags, the compression ones being only set when the compression is
+ * evaluated before the cache
+ */
+#define CACHE_ST_F_COMPRESSED    0x00000001 /* the response is stored compressed */
+#define CACHE_ST_F_COMPRESSIBLE  0x00000002 /* the response would be compressed for other clients */
+#define CACHE_ST_F_HDRS_PENDING  0x00000004 /* headers to be stored once rewritten by the compression */
+#define CACHE_ST_F_FETCH         0x00000008 /* the stream's fetch ends once the object is stored */
+
 #define DEFAULT_MAX_SECONDARY_ENTRY 10
 
 struct cache_entry {
 	unsigned int complete;    /* An entry won't be valid until complete is not null. */
 	unsigned int latest_validation;     /* latest validation date */
 	unsigned int expire;      /* expiration date (wall clock time) */
+	unsigned int stale_revalidate;      /* time after <expire> during which it is served while being refreshed */
+	unsigned int stale_if_error;        /* time after <expire> during which it is served if no server is usable */
 	unsigned int age;         /* Origin server "Age" header value */
 	unsigned int body_size;         /* Size of the body */
 	int refcount;
@@ -210,6 +278,7 @@ struct cache_entry {
 
 	unsigned int etag_length; /* Length of the ETag value (if one was found in the response). */
 	unsigned int etag_offset; /* Offset of the ETag value in the data buffer. */
+	unsigned int compressible; /* Identity variant of a response the compression may encode. */
 
 	time_t last_modified; /* Origin server "Last-Modified" header value converted in
 			       * seconds since epoch. If no "Last-Modified"
@@ -221,26 +290,126 @@ struct cache_entry {
 	unsigned char data[0];
 };
 
+/* A request forwarded to a server for an object which is not in the cache or
+ * must be refreshed. The requests for the same object received in the meantime
+ * may wait for the object to be stored, or get the stale one, instead of being
+ * forwarded too.
+ */
+struct cache_fetch {
+	struct eb32_node eb;     /* ebtree node used to hold the fetch in its cache tree */
+	char hash[20];
+	unsigned int pass;       /* the response was not stored, do not wait until <expire> */
+	unsigned int owner;      /* uniq_id of the stream fetching the object */
+	int expire;              /* date (ticks) after which the fetch is forgotten */
+	struct list waiters;     /* requests waiting for the object (cache_st) */
+};
+
+/* results of cache_fetch_start() */
+enum cache_fetch_res {
+	CACHE_FETCH_OWN = 0,     /* the request is forwarded, others will wait for it */
+	CACHE_FETCH_PASS,        /* the request is forwarded, others will not wait for it */
+	CACHE_FETCH_WAIT,        /* the request must wait for another one */
+};
+
+#define CACHE_FETCH_TIMEOUT 10000  /* ms during which a fetch is remembered without collapse-timeout */
+
 #define CACHE_BLOCKSIZE 1024
 #define CACHE_ENTRY_MAX_AGE 2147483648U
+#define CACHE_DISK_MAX_OBJSZ 0xfffffffU /* max length of a serialized DATA block */
+
+/* a record of the disk tier */
+struct cache_disk_entry {
+	struct eb32_node eb;     /* indexed on the primary hash */
+	struct list list;        /* position in the disk's fifo */
+	struct cache_entry hdr;  /* copy of the entry stored at the beginning of the record */
+	uint64_t ofs;            /* offset of the record in the file */
+	unsigned int len;        /* length of the record, including <hdr> */
+	unsigned int complete;   /* the record was entirely written */
+	unsigned int promoting;  /* the record is being read to be moved to the memory tier */
+	unsigned int io_error;   /* set by the I/O thread when a write fails */
+	unsigned int fetching;   /* the fetch of <fetch_owner> ends once the record is written */
+	unsigned int fetch_owner; /* uniq_id of the stream which fetched the object */
+	int refcount;            /* number of users reading or writing the record */
+	char *etag;              /* copy of the object's ETag, NULL if it has none */
+};
+
+/* disk tier I/O request types */
+#define CACHE_DISK_IO_READ     0 /* read a part of a record for a cache applet */
+#define CACHE_DISK_IO_PROMOTE  1 /* read a whole record to move it to the memory tier */
+#define CACHE_DISK_IO_WRITE    2 /* write a part of a record */
+
+/* disk tier I/O request flags */
+#define CACHE_DISK_IO_F_LAST   0x00000001 /* last write of the record, completes it */
+#define CACHE_DISK_IO_F_ABORT  0x00000002 /* the record must be discarded once completed */
+
+/* an I/O request processed by the I/O thread of a disk tier. This thread only
+ * reads or writes <len> bytes at <ofs> and wakes <tl> up on the thread which
+ * queued the request, where everything else is done. Only this thread may
+ * touch the request while <queued> is set.
+ */
+struct cache_disk_io {
+	struct list list;        /* position in the queue of the I/O thread */
+	struct cache *cache;
+	struct tasklet *tl;      /* tasklet woken up once the I/O is done */
+	struct cache_disk_entry *d; /* record read or written, retained */
+	struct appctx *appctx;   /* cache applet waiting for a read, NULL once released */
+	uint64_t ofs;            /* position in the file */
+	unsigned int pos;        /* position of <buf> in the record */
+	unsigned int len;        /* bytes to read or write */
+	unsigned int type;       /* CACHE_DISK_IO_* */
+	unsigned int flags;      /* CACHE_DISK_IO_F_* */
+	unsigned int queued;     /* the request was queued and its tasklet did not run yet */
+	int ret;                 /* set by the I/O thread: 1 on success, 0 on error */
+	char *buf;               /* data to write or read */
+	void *area;              /* allocated area to free with the request, if any */
+};
+
+/* Limits of the bytes copied from the rows evicted from the memory tier during
+ * a single reservation, under the lock of the arena, and of the bytes waiting
+ * to be written to a disk tier. Objects exceeding them are not kept.
+ */
+#define CACHE_DISK_SPILL_MAX   (1024 * 1024)
+#define CACHE_DISK_QUEUE_MAX   (64 * 1024 * 1024)
+
+/* a row copied upon eviction from the memory tier, waiting to be written to
+ * the disk tier once the shared context is unlocked.
+ */
+struct cache_spill {
+	struct cache_spill *next;
+	struct cache *cache;
+	unsigned int len;
+	unsigned char data[VAR_ARRAY];
+};
+
+static THREAD_LOCAL struct cache_spill *cache_spills;
+static THREAD_LOCAL unsigned int cache_spills_size; /* bytes held by <cache_spills> */
 
 static struct list caches = LIST_HEAD_INIT(caches);
 static struct list caches_config = LIST_HEAD_INIT(caches_config); /* cache config to init */
 static struct cache *tmp_cache_config = NULL;
 
 DECLARE_STATIC_POOL(pool_head_cache_st, "cache_st", sizeof(struct cache_st));
+DECLARE_STATIC_POOL(pool_head_cache_fetch, "cache_fetch", sizeof(struct cache_fetch));
+DECLARE_STATIC_POOL(pool_head_cache_disk_io, "cache_disk_io", sizeof(struct cache_disk_io));
 
 static struct eb32_node *insert_entry(struct cache *cache, struct cache_tree *tree, struct cache_entry *new_entry);
 static void delete_entry(struct cache_entry *del_entry);
 static inline void release_entry_locked(struct cache_tree *cache, struct cache_entry *entry);
 static inline void release_entry_unlocked(struct cache_tree *cache, struct cache_entry *entry);
 
+/* Returns the date after which <entry> cannot be served anymore, even stale. */
+static inline unsigned int entry_stale_end(const struct cache_entry *entry)
+{
+	return entry->expire + MAX(entry->stale_revalidate, entry->stale_if_error);
+}
+
 /*
  * Find a cache_entry in the <cache>'s tree that has the hash <hash>.
  * If <delete_expired> is 0 then the entry is left untouched if it is found but
  * is already expired, and NULL is returned. Otherwise, the expired entry is
  * removed from the tree and NULL is returned.
- * Returns a valid (not expired) cache_tree pointer.
+ * Returns a valid (not expired) cache_tree pointer. An entry which may still
+ * be served stale is not considered expired, the caller has to check it.
  * The returned entry is not retained, it should be explicitly retained only
  * when necessary.
  *
@@ -262,7 +431,7 @@ struct cache_entry *get_entry(struct cache_tree *cache_tree, char *hash, int del
 	if (memcmp(entry->hash, hash, sizeof(entry->hash)))
 		return NULL;
 
-	if (entry->expire > date.tv_sec) {
+	if (entry_stale_end(entry) > date.tv_sec) {
 		return entry;
 	} else if (delete_expired) {
 		release_entry_locked(cache_tree, entry);
@@ -387,15 +556,33 @@ struct cache_entry *get_secondary_entry(struct cache_tree *cache, struct cache_e
 		 * when we find them. Calling delete_entry would be too costly
 		 * so we simply call eb32_delete. The secondary_entry count will
 		 * be updated when we try to insert a new entry to this list. */
-		if (entry->expire <= date.tv_sec && delete_expired) {
+		if (entry_stale_end(entry) <= date.tv_sec && delete_expired) {
 			release_entry_locked(cache, entry);
 		}
 
 		entry = node ? eb32_entry(node, struct cache_entry, eb) : NULL;
 	}
 
+	/* An identity variant stored next to a compressed one may be found
+	 * first. The compressed one is preferred for a lookup when the client
+	 * accepts it.
+	 */
+	if (entry && !delete_expired && get_secondary_key_encoding(entry->secondary_key) == VARY_ENCODING_IDENTITY) {
+		struct cache_entry *variant;
+
+		for (node = eb32_next_dup(node); node; node = eb32_next_dup(node)) {
+			variant = eb32_entry(node, struct cache_entry, eb);
+			if (variant->complete && entry_stale_end(variant) > date.tv_sec &&
+			    memcmp(variant->hash, entry->hash, sizeof(entry->hash)) == 0 &&
+			    secondary_key_cmp(variant->secondary_key, secondary_key) == 0) {
+				entry = variant;
+				break;
+			}
+		}
+	}
+
 	/* Expired entry */
-	if (entry && entry->expire <= date.tv_sec) {
+	if (entry && entry_stale_end(entry) <= date.tv_sec) {
 		if (delete_expired) {
 			release_entry_locked(cache, entry);
 		}
@@ -413,6 +600,162 @@ static inline struct cache_tree *get_cache_tree_from_hash(struct cache *cache, u
 	return &cache->trees[hash % CACHE_TREE_NUM];
 }
 
+/* Wakes up the requests waiting for <fetch>, which look the object up again.
+ *
+ * This function must be called under a cache write lock.
+ */
+static void cache_fetch_wake(struct cache_fetch *fetch)
+{
+	struct cache_st *st, *back;
+
+	list_for_each_entry_safe(st, back, &fetch->waiters, fetch_wait) {
+		LIST_DEL_INIT(&st->fetch_wait);
+		task_wakeup(st->task, TASK_WOKEN_MSG);
+	}
+}
+
+/* Removes <fetch> from its tree and wakes up the requests waiting for it.
+ *
+ * This function must be called under a cache write lock.
+ */
+static void cache_fetch_free(struct cache_fetch *fetch)
+{
+	cache_fetch_wake(fetch);
+	eb32_delete(&fetch->eb);
+	pool_free(pool_head_cache_fetch, fetch);
+}
+
+/* Returns the pending fetch of the object whose primary hash is <hash> in
+ * <tree>, or NULL if there is none. The expired fetches found on the way are
+ * removed.
+ *
+ * This function must be called under a cache write lock.
+ */
+static struct cache_fetch *cache_fetch_lookup(struct cache_tree *tree, const char *hash)
+{
+	struct eb32_node *node, *next;
+	struct cache_fetch *fetch;
+
+	for (node = eb32_lookup(&tree->fetches, read_u32(hash)); node; node = next) {
+		next = eb32_next_dup(node);
+		fetch = eb32_entry(node, struct cache_fetch, eb);
+		if (tick_is_expired(fetch->expire, now_ms))
+			cache_fetch_free(fetch);
+		else if (memcmp(fetch->hash, hash, sizeof(fetch->hash)) == 0)
+			return fetch;
+	}
+	return NULL;
+}
+
+/* Registers the request of stream <s> as the one fetching its object from a
+ * server, unless another request already does it, in which case the request
+ * should wait for it. The TX_CACHE_FETCH flag is set on the transaction if it
+ * becomes the one fetching the object. If <st> is not NULL, it is queued to
+ * be woken up once the request may stop waiting.
+ */
+static enum cache_fetch_res cache_fetch_start(struct cache *cache, struct cache_tree *tree,
+                                              struct stream *s, struct cache_st *st)
+{
+	struct http_txn *txn = s->txn;
+	struct cache_fetch *fetch;
+	enum cache_fetch_res ret = CACHE_FETCH_OWN;
+
+	cache_wrlock(tree);
+	fetch = cache_fetch_lookup(tree, txn->cache_hash);
+	if (fetch && fetch->pass)
+		ret = CACHE_FETCH_PASS;
+	else if (fetch) {
+		ret = CACHE_FETCH_WAIT;
+		if (st && !LIST_INLIST(&st->fetch_wait)) {
+			st->task = s->task;
+			LIST_APPEND(&fetch->waiters, &st->fetch_wait);
+		}
+	}
+	else if ((fetch = pool_alloc(pool_head_cache_fetch)) != NULL) {
+		fetch->eb.key = read_u32(txn->cache_hash);
+		memcpy(fetch->hash, txn->cache_hash, sizeof(fetch->hash));
+		fetch->pass = 0;
+		fetch->owner = s->uniq_id;
+		fetch->expire = tick_add(now_ms, MS_TO_TICKS(cache->collapse_timeout ?
+		                                             cache->collapse_timeout : CACHE_FETCH_TIMEOUT));
+		LIST_INIT(&fetch->waiters);
+		eb32_insert(&tree->fetches, &fetch->eb);
+		txn->flags |= TX_CACHE_FETCH;
+	}
+	else
+		ret = CACHE_FETCH_PASS;
+	cache_wrunlock(tree);
+	return ret;
+}
+
+/* Stops the wait of <st> in <tree> for a fetch, if it still waits */
+static void cache_fetch_unwait(struct cache_tree *tree, struct cache_st *st)
+{
+	if (!st || !LIST_INLIST(&st->fetch_wait))
+		return;
+
+	cache_wrlock(tree);
+	LIST_DEL_INIT(&st->fetch_wait);
+	cache_wrunlock(tree);
+}
+
+/* Ends the fetch of the object whose primary hash is <hash> in <cache> by the
+ * stream whose uniq_id is <owner>, if it is still pending, and wakes up the
+ * requests waiting for it. If <pass> is 0, its object was stored or must be
+ * fetched again, and the fetch is removed. Otherwise the object will not be
+ * stored and the next requests are forwarded without waiting for a while.
+ */
+static void cache_fetch_end(struct cache *cache, const char *hash, unsigned int owner, int pass)
+{
+	struct cache_tree *tree = get_cache_tree_from_hash(cache, read_u32(hash));
+	struct cache_fetch *fetch;
+
+	cache_wrlock(tree);
+	fetch = cache_fetch_lookup(tree, hash);
+	if (fetch && fetch->owner == owner && !pass)
+		cache_fetch_free(fetch);
+	else if (fetch && fetch->owner == owner) {
+		fetch->pass = 1;
+		fetch->expire = tick_add(now_ms, MS_TO_TICKS(cache->collapse_timeout ?
+		                                             cache->collapse_timeout : CACHE_FETCH_TIMEOUT));
+		cache_fetch_wake(fetch);
+	}
+	cache_wrunlock(tree);
+}
+
+/* Reports that the request of stream <s> does not need to be waited for
+ * anymore if it is the one fetching its object, as done by cache_fetch_end().
+ */
+static void cache_fetch_done(struct cache *cache, struct stream *s, int pass)
+{
+	if (!(s->txn->flags & TX_CACHE_FETCH))
+		return;
+	s->txn->flags &= ~TX_CACHE_FETCH;
+	cache_fetch_end(cache, s->txn->cache_hash, s->uniq_id, pass);
+}
+
+/* Makes the fetch of the request of stream <s>, if it is the one fetching its
+ * object, end once the object being stored for filter context <st> is.
+ */
+static inline void cache_st_fetch_keep(struct stream *s, struct cache_st *st)
+{
+	if (!(s->txn->flags & TX_CACHE_FETCH))
+		return;
+	s->txn->flags &= ~TX_CACHE_FETCH;
+	st->flags |= CACHE_ST_F_FETCH;
+}
+
+/* Ends the fetch kept by cache_st_fetch_keep() for filter context <st> of
+ * stream <s>, if any, as done by cache_fetch_end().
+ */
+static void cache_st_fetch_end(struct cache *cache, struct stream *s, struct cache_st *st, int pass)
+{
+	if (!(st->flags & CACHE_ST_F_FETCH))
+		return;
+	st->flags &= ~CACHE_ST_F_FETCH;
+	cache_fetch_end(cache, s->txn->cache_hash, s->uniq_id, pass);
+}
+
 
 /*
  * Remove all expired entries from a list of duplicates.
@@ -431,7 +774,7 @@ static unsigned int clear_expired_duplicates(struct cache_tree *cache, struct eb
 	while (prev) {
 		entry = container_of(prev, struct cache_entry, eb);
 		prev = eb32_prev_dup(prev);
-		if (entry->expire <= date.tv_sec) {
+		if (entry_stale_end(entry) <= date.tv_sec) {
 			release_entry_locked(cache, entry);
 		}
 		else {
@@ -568,181 +911,895 @@ static inline struct shared_block *block_ptr(struct cache_entry *entry)
 }
 
 
+/*
+ * Disk tier functions
+ */
 
-static int
-cache_store_init(struct proxy *px, struct flt_conf *fconf)
+/* Looks up the record of the object whose primary hash is <hash> in <disk>,
+ * whether it is complete or not. Must be called under the disk lock.
+ */
+static struct cache_disk_entry *cache_disk_lookup(struct cache_disk *disk, const char *hash)
 {
-	fconf->flags |= FLT_CFG_FL_HTX;
-	return 0;
+	struct cache_disk_entry *d;
+	struct eb32_node *node;
+
+	for (node = eb32_lookup(&disk->entries, read_u32(hash)); node; node = eb32_next_dup(node)) {
+		d = container_of(node, struct cache_disk_entry, eb);
+		if (memcmp(d->hdr.hash, hash, sizeof(d->hdr.hash)) == 0)
+			return d;
+	}
+	return NULL;
 }
 
-static void
-cache_store_deinit(struct proxy *px, struct flt_conf *fconf)
+/* Removes record <d> from the index of <disk>, if it still is. Its space will
+ * be reused once the writer reaches it. Must be called under the disk write
+ * lock.
+ */
+static void cache_disk_unlink(struct cache_disk *disk, struct cache_disk_entry *d)
 {
-	struct cache_flt_conf *cconf = fconf->conf;
+	if (!d->eb.node.leaf_p)
+		return;
+	eb32_delete(&d->eb);
+	disk->objects--;
+}
 
-	if (!(cconf->flags & CACHE_FLT_INIT))
-		free(cconf->c.name);
-	free(cconf);
+/* Frees record <d> of <disk> unless it is still in use. Returns 0 if it is.
+ * Must be called under the disk write lock.
+ */
+static int cache_disk_evict(struct cache_disk *disk, struct cache_disk_entry *d)
+{
+	if (HA_ATOMIC_LOAD(&d->refcount))
+		return 0;
+	cache_disk_unlink(disk, d);
+	LIST_DELETE(&d->list);
+	disk->used -= d->len;
+	free(d->etag);
+	free(d);
+	return 1;
 }
 
-static int
-cache_store_check(struct proxy *px, struct flt_conf *fconf)
+/* Allocates a record of <len> bytes in the disk tier of <cache> for the object
+ * described by <hdr>, overwriting the oldest records in the way. <etag> points
+ * to the object's ETag if it has one, which is kept in memory. The record
+ * replaces any other one of the same object in the index, but is not usable
+ * until cache_disk_complete() is called. It is returned retained. Returns NULL
+ * on memory allocation failure or if one of the records in the way is still
+ * in use.
+ */
+static struct cache_disk_entry *cache_disk_alloc(struct cache *cache, const struct cache_entry *hdr,
+                                                 unsigned int len, const char *etag)
 {
-	struct cache_flt_conf *cconf = fconf->conf;
-	struct flt_conf *f;
-	struct cache *cache;
-	int comp = 0;
+	struct cache_disk *disk = cache->disk;
+	struct cache_disk_entry *d, *old;
 
-	/* Find the cache corresponding to the name in the filter config.  The
-	*  cache will not be referenced now in the filter config because it is
-	*  not fully allocated. This step will be performed during the cache
-	*  post_check.
-	*/
-	list_for_each_entry(cache, &caches_config, list) {
-		if (strcmp(cache->id, cconf->c.name) == 0)
-			goto found;
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return NULL;
+
+	if (etag) {
+		d->etag = malloc(hdr->etag_length);
+		if (!d->etag) {
+			free(d);
+			return NULL;
+		}
+		memcpy(d->etag, etag, hdr->etag_length);
 	}
 
-	ha_alert("config: %s '%s': unable to find the cache '%s' referenced by the filter 'cache'.\n",
-		 proxy_type_str(px), px->id, (char *)cconf->c.name);
-	return 1;
+	memcpy(&d->hdr, hdr, sizeof(d->hdr));
+	d->eb.key = read_u32(hdr->hash);
+	d->len = len;
+	d->refcount = 1;
 
-  found:
-	/* Here <cache> points on the cache the filter must use and <cconf>
-	 * points on the cache filter configuration. */
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
 
-	/* Check all filters for proxy <px> to know if the compression is
-	 * enabled and if it is after the cache. When the compression is before
-	 * the cache, an error is returned. Also check if the cache filter must
-	 * be explicitly declaired or not. */
-	list_for_each_entry(f, &px->filter_configs, list) {
-		if (f == fconf) {
-			/* The compression filter must be evaluated after the cache. */
-			if (comp) {
-				ha_alert("config: %s '%s': unable to enable the compression filter before "
-					 "the cache '%s'.\n", proxy_type_str(px), px->id, cache->id);
-				return 1;
-			}
-		}
-		else if (f->id == http_comp_flt_id)
-			comp = 1;
-		else if (f->id == fcgi_flt_id)
-			continue;
-		else if ((f->id != fconf->id) && (cconf->flags & CACHE_FLT_F_IMPLICIT_DECL)) {
-			/* Implicit declaration is only allowed with the
-			 * compression and fcgi. For other filters, an implicit
-			 * declaration is required. */
-			ha_alert("config: %s '%s': require an explicit filter declaration "
-				 "to use the cache '%s'.\n", proxy_type_str(px), px->id, cache->id);
-			return 1;
+	if (disk->wpos + len > cache->disk_size) {
+		/* the records at the end of the file are lost when wrapping */
+		while (!LIST_ISEMPTY(&disk->fifo)) {
+			old = LIST_NEXT(&disk->fifo, struct cache_disk_entry *, list);
+			if (old->ofs < disk->wpos)
+				break;
+			if (!cache_disk_evict(disk, old))
+				goto fail;
 		}
+		disk->wpos = 0;
+	}
 
+	/* the records of the previous lap are the oldest ones, all located
+	 * after the write position.
+	 */
+	while (!LIST_ISEMPTY(&disk->fifo)) {
+		old = LIST_NEXT(&disk->fifo, struct cache_disk_entry *, list);
+		if (old->ofs < disk->wpos || old->ofs >= disk->wpos + len)
+			break;
+		if (!cache_disk_evict(disk, old))
+			goto fail;
 	}
-	return 0;
+
+	d->ofs = disk->wpos;
+	disk->wpos += (len + 7) & ~7U;
+	disk->used += len;
+	LIST_APPEND(&disk->fifo, &d->list);
+
+	old = cache_disk_lookup(disk, hdr->hash);
+	if (old)
+		cache_disk_unlink(disk, old);
+	eb32_insert(&disk->entries, &d->eb);
+	disk->objects++;
+
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+	return d;
+
+  fail:
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+	free(d->etag);
+	free(d);
+	return NULL;
 }
 
-static int
-cache_store_strm_init(struct stream *s, struct filter *filter)
+/* Releases record <d> of the disk tier of <cache> which was just written, and
+ * makes it usable if <success> is non-zero, otherwise removes it. The fetch
+ * of the object which ends with the record, if any, is ended too.
+ */
+static void cache_disk_complete(struct cache *cache, struct cache_disk_entry *d, int success)
 {
-	struct cache_st *st;
+	struct cache_disk *disk = cache->disk;
+	int fetching = d->fetching;
+	unsigned int owner = d->fetch_owner;
+	char hash[20];
 
-	st = pool_alloc(pool_head_cache_st);
-	if (st == NULL)
-		return -1;
+	/* the record may be evicted once released */
+	memcpy(hash, d->hdr.hash, sizeof(hash));
 
-	st->first_block = NULL;
-	filter->ctx     = st;
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
+	if (success)
+		d->complete = 1;
+	else
+		cache_disk_unlink(disk, d);
+	HA_ATOMIC_DEC(&d->refcount);
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
 
-	/* Register post-analyzer on AN_RES_WAIT_HTTP */
-	filter->post_analyzers |= AN_RES_WAIT_HTTP;
-	return 1;
+	/* the requests waiting for the object may now look it up again */
+	if (fetching)
+		cache_fetch_end(cache, hash, owner, !success);
 }
 
-static void
-cache_store_strm_deinit(struct stream *s, struct filter *filter)
+/* Returns the complete and not expired record of the object whose primary
+ * hash is <hash> from the disk tier of <cache>, or NULL if there is none. The
+ * record is retained and must be released with cache_disk_release().
+ */
+static struct cache_disk_entry *cache_disk_get(struct cache *cache, const char *hash)
 {
-	struct cache_st *st = filter->ctx;
-	struct cache_flt_conf *cconf = FLT_CONF(filter);
-	struct cache *cache = cconf->c.cache;
-	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_disk *disk = cache->disk;
+	struct cache_disk_entry *d;
+
+	HA_RWLOCK_RDLOCK(CACHE_LOCK, &disk->lock);
+	d = cache_disk_lookup(disk, hash);
+	if (d && (!d->complete || d->hdr.expire <= date.tv_sec))
+		d = NULL;
+	if (d)
+		HA_ATOMIC_INC(&d->refcount);
+	HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &disk->lock);
+	return d;
+}
 
-	/* Everything should be released in the http_end filter, but we need to do it
-	 * there too, in case of errors */
-	if (st && st->first_block) {
-		struct cache_entry *object = (struct cache_entry *)st->first_block->data;
-		if (!object->complete) {
-			/* The stream was closed but the 'complete' flag was not
-			 * set which means that cache_store_http_end was not
-			 * called. The stream must have been closed before we
-			 * could store the full answer in the cache.
-			 */
-			release_entry_unlocked(&cache->trees[object->eb.key % CACHE_TREE_NUM], object);
-		}
-		shctx_wrlock(shctx);
-		shctx_row_reattach(shctx, st->first_block);
-		shctx_wrunlock(shctx);
-	}
-	if (st) {
-		pool_free(pool_head_cache_st, st);
-		filter->ctx = NULL;
-	}
+static inline void cache_disk_release(struct cache_disk_entry *d)
+{
+	HA_ATOMIC_DEC(&d->refcount);
 }
 
-static int
-cache_store_post_analyze(struct stream *s, struct filter *filter, struct channel *chn,
-			 unsigned an_bit)
+/* Removes the record of the object whose primary hash is <hash> from the index
+ * of the disk tier of <cache>, if any.
+ */
+static void cache_disk_invalidate(struct cache *cache, const char *hash)
 {
-	struct http_txn *txn = s->txn;
-	struct http_msg *msg = &txn->rsp;
-	struct cache_st *st = filter->ctx;
+	struct cache_disk *disk = cache->disk;
+	struct cache_disk_entry *d;
+
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
+	d = cache_disk_lookup(disk, hash);
+	if (d)
+		cache_disk_unlink(disk, d);
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+}
 
-	if (an_bit != AN_RES_WAIT_HTTP)
-		goto end;
+/* Performs the read or write of request <io> on file descriptor <fd>. Returns
+ * 0 on error.
+ */
+static int cache_disk_pio(int fd, struct cache_disk_io *io)
+{
+	char *buf = io->buf;
+	uint64_t ofs = io->ofs;
+	size_t len = io->len;
+	ssize_t ret;
 
-	/* Here we need to check if any compression filter precedes the cache
-	 * filter. This is only possible when the compression is configured in
-	 * the frontend while the cache filter is configured on the
-	 * backend. This case cannot be detected during HAProxy startup. So in
-	 * such cases, the cache is disabled.
-	 */
-	if (st && (msg->flags & HTTP_MSGF_COMPRESSING)) {
-		pool_free(pool_head_cache_st, st);
-		filter->ctx = NULL;
+	while (len) {
+		if (io->type == CACHE_DISK_IO_WRITE)
+			ret = pwrite(fd, buf, len, ofs);
+		else
+			ret = pread(fd, buf, len, ofs);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return 0;
+		buf += ret;
+		len -= ret;
+		ofs += ret;
 	}
-
-  end:
 	return 1;
 }
 
-static int
-cache_store_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+/* Processes request <io> for disk tier <disk>, then wakes its tasklet up. The
+ * request must not be touched anymore after this.
+ */
+static void cache_disk_io_process(struct cache_disk *disk, struct cache_disk_io *io)
 {
-	struct cache_st *st = filter->ctx;
+	io->ret = cache_disk_pio(disk->fd, io);
+	if (!io->ret && io->type == CACHE_DISK_IO_WRITE)
+		HA_ATOMIC_STORE(&io->d->io_error, 1);
+	tasklet_wakeup(io->tl);
+}
 
-	if (!(msg->chn->flags & CF_ISRESP) || !st)
-		return 1;
+#ifdef USE_THREAD
+/* The I/O thread of disk tier <arg>: processes the queued requests in their
+ * order until it is asked to stop.
+ */
+static void *cache_disk_io_thread(void *arg)
+{
+	struct cache_disk *disk = arg;
+	struct cache_disk_io *io;
 
-	if (st->first_block)
-		register_data_filter(s, msg->chn, filter);
-	return 1;
+	pthread_mutex_lock(&disk->io_lock);
+	while (!disk->io_stop) {
+		if (LIST_ISEMPTY(&disk->io_queue)) {
+			pthread_cond_wait(&disk->io_cond, &disk->io_lock);
+			continue;
+		}
+		io = LIST_NEXT(&disk->io_queue, struct cache_disk_io *, list);
+		LIST_DELETE(&io->list);
+		pthread_mutex_unlock(&disk->io_lock);
+
+		cache_disk_io_process(disk, io);
+
+		pthread_mutex_lock(&disk->io_lock);
+	}
+	pthread_mutex_unlock(&disk->io_lock);
+	return NULL;
 }
+#endif
 
-static inline void disable_cache_entry(struct cache_st *st,
-                                       struct filter *filter, struct shared_context *shctx)
-{
-	struct cache_entry *object;
-	struct cache *cache = (struct cache*)shctx->data;
+static struct task *cache_disk_io_done(struct task *t, void *context, unsigned int state);
+
+/* Allocates an I/O request of type <type> for record <d> of the disk tier of
+ * <cache>, which the request retains. Its completion is handled on the
+ * current thread. Returns NULL on memory allocation failure.
+ */
+static struct cache_disk_io *cache_disk_io_new(struct cache *cache, struct cache_disk_entry *d,
+                                               unsigned int type)
+{
+	struct cache_disk_io *io;
+
+	io = pool_zalloc(pool_head_cache_disk_io);
+	if (!io)
+		return NULL;
+
+	io->tl = tasklet_new();
+	if (!io->tl) {
+		pool_free(pool_head_cache_disk_io, io);
+		return NULL;
+	}
+	io->tl->process = cache_disk_io_done;
+	io->tl->context = io;
+	io->tl->tid = tid;
+
+	LIST_INIT(&io->list);
+	io->cache = cache;
+	io->type = type;
+	io->d = d;
+	HA_ATOMIC_INC(&d->refcount);
+	return io;
+}
+
+/* Releases I/O request <io>, which must not be queued */
+static void cache_disk_io_free(struct cache_disk_io *io)
+{
+	HA_ATOMIC_DEC(&io->d->refcount);
+	tasklet_free(io->tl);
+	free(io->area);
+	pool_free(pool_head_cache_disk_io, io);
+}
+
+/* Queues I/O request <io> for the I/O thread of the disk tier of its cache,
+ * after setting its file position from its position in its record.
+ */
+static void cache_disk_io_submit(struct cache_disk_io *io)
+{
+	struct cache_disk *disk = io->cache->disk;
+
+	io->ofs = io->d->ofs + io->pos;
+	io->queued = 1;
+	if (io->type == CACHE_DISK_IO_WRITE)
+		HA_ATOMIC_ADD(&disk->io_pending, io->len);
+
+#ifdef USE_THREAD
+	pthread_mutex_lock(&disk->io_lock);
+	LIST_APPEND(&disk->io_queue, &io->list);
+	pthread_cond_signal(&disk->io_cond);
+	pthread_mutex_unlock(&disk->io_lock);
+#else
+	cache_disk_io_process(disk, io);
+#endif
+}
+
+/* Queues the write of <len> bytes from <buf> at position <pos> of record <d>
+ * of the disk tier of <cache>, with CACHE_DISK_IO_F_* flags <flags>. <area>
+ * is freed once written, or immediately on failure. Writes with the LAST flag
+ * complete the record once all the previous writes are done. Returns 0 on
+ * failure, in which case a LAST write is immediately completed as aborted.
+ */
+static int cache_disk_queue_write(struct cache *cache, struct cache_disk_entry *d, unsigned int pos,
+                                  void *area, const void *buf, unsigned int len, unsigned int flags)
+{
+	struct cache_disk_io *io;
+
+	io = cache_disk_io_new(cache, d, CACHE_DISK_IO_WRITE);
+	if (!io) {
+		free(area);
+		if (flags & CACHE_DISK_IO_F_LAST)
+			cache_disk_complete(cache, d, 0);
+		return 0;
+	}
+
+	io->area = area;
+	io->buf = (char *)buf;
+	io->pos = pos;
+	io->len = len;
+	io->flags = flags;
+	cache_disk_io_submit(io);
+	return 1;
+}
+
+/* Moves the object of record <d> of the disk tier of <cache>, loaded in <buf>,
+ * back to the memory tier and removes the record from the index, unless the
+ * record was removed or replaced in the mean time or the object is already
+ * in the memory tier.
+ */
+static void cache_disk_promote(struct cache *cache, struct cache_disk_entry *d, const char *buf)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_tree *cache_tree = get_cache_tree_from_hash(cache, d->eb.key);
+	struct shared_block *first;
+	struct cache_entry *object, *old;
+	int indexed;
+
+	HA_RWLOCK_RDLOCK(CACHE_LOCK, &cache->disk->lock);
+	indexed = !!d->eb.node.leaf_p;
+	HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &cache->disk->lock);
+	if (!indexed)
+		return;
+
+	first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
+	if (!first)
+		return;
+
+	object = (struct cache_entry *)first->data;
+	memcpy(object, &d->hdr, sizeof(*object));
+	object->complete = 0;
+	object->eb.key = d->eb.key;
+
+	cache_wrlock(cache_tree);
+	old = get_entry(cache_tree, object->hash, 1);
+	if (old || insert_entry(cache, cache_tree, object) != &object->eb) {
+		object->eb.key = 0;
+		cache_wrunlock(cache_tree);
+		goto out;
+	}
+	cache_wrunlock(cache_tree);
+
+	first->len = sizeof(struct cache_entry);
+	first->last_append = NULL;
+
+	if (!shctx_row_reserve_hot(shctx, first, d->len - sizeof(struct cache_entry)) ||
+	    shctx_row_data_append(shctx, first, (unsigned char *)buf + sizeof(struct cache_entry),
+	                          d->len - sizeof(struct cache_entry)) < 0)
+		goto out;
+
+	shctx_row_wrlock(shctx, first);
+	object->complete = 1;
+	shctx_row_reattach(shctx, first);
+	shctx_row_wrunlock(shctx, first);
+
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &cache->disk->lock);
+	cache_disk_unlink(cache->disk, d);
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &cache->disk->lock);
+	return;
+
+  out:
+	first->len = 0;
+	if (object->eb.key)
+		release_entry_unlocked(cache_tree, object);
+	shctx_row_wrlock(shctx, first);
+	shctx_row_reattach(shctx, first);
+	shctx_row_wrunlock(shctx, first);
+}
+
+/* Starts to read record <d> of the disk tier of <cache> to move it back to the
+ * memory tier, unless it is already being read.
+ */
+static void cache_disk_start_promote(struct cache *cache, struct cache_disk_entry *d)
+{
+	struct cache_disk_io *io;
+
+	if (HA_ATOMIC_XCHG(&d->promoting, 1))
+		return;
+
+	io = cache_disk_io_new(cache, d, CACHE_DISK_IO_PROMOTE);
+	if (!io)
+		goto fail;
+
+	io->area = io->buf = malloc(d->len);
+	if (!io->buf) {
+		cache_disk_io_free(io);
+		goto fail;
+	}
+	io->len = d->len;
+	cache_disk_io_submit(io);
+	return;
+
+  fail:
+	HA_ATOMIC_STORE(&d->promoting, 0);
+}
+
+/* Completion of a disk tier I/O request, called on the thread which queued it */
+static struct task *cache_disk_io_done(struct task *t, void *context, unsigned int state)
+{
+	struct cache_disk_io *io = context;
+	struct cache *cache = io->cache;
+	struct cache_disk_entry *d = io->d;
+
+	io->queued = 0;
+	switch (io->type) {
+	case CACHE_DISK_IO_READ:
+		/* the request belongs to the applet, unless it was released */
+		if (io->appctx) {
+			appctx_wakeup(io->appctx);
+			return t;
+		}
+		break;
+
+	case CACHE_DISK_IO_PROMOTE:
+		if (io->ret)
+			cache_disk_promote(cache, d, io->buf);
+		HA_ATOMIC_STORE(&d->promoting, 0);
+		break;
+
+	case CACHE_DISK_IO_WRITE:
+		HA_ATOMIC_SUB(&cache->disk->io_pending, io->len);
+		if (io->flags & CACHE_DISK_IO_F_LAST)
+			cache_disk_complete(cache, d, !(io->flags & CACHE_DISK_IO_F_ABORT) &&
+			                    !HA_ATOMIC_LOAD(&d->io_error));
+		break;
+	}
+
+	cache_disk_io_free(io);
+	return NULL;
+}
+
+/* Copies the row starting at <first> which is being evicted from the memory
+ * tier of <cache>, so that it is written to the disk tier by the next call to
+ * cache_disk_flush_spills(). Only complete and unexpired objects without
+ * secondary key are kept, as long as the bytes copied during the current
+ * reservation and those waiting to be written stay within their limits. It is
+ * called from the free_block callback, under the lock of the row's arena, when
+ * the row is still intact.
+ */
+static void cache_disk_spill(struct cache *cache, struct shared_block *first)
+{
+	struct cache_entry *object = (struct cache_entry *)first->data;
+	struct cache_spill *spill;
+
+	if (!object->complete || object->secondary_key_signature ||
+	    object->expire <= date.tv_sec || first->len > cache->disk_maxobjsz)
+		return;
+
+	if (cache_spills_size + first->len > CACHE_DISK_SPILL_MAX ||
+	    HA_ATOMIC_LOAD(&cache->disk->io_pending) + cache_spills_size + first->len > CACHE_DISK_QUEUE_MAX)
+		return;
+
+	spill = malloc(sizeof(*spill) + first->len);
+	if (!spill)
+		return;
+
+	if (shctx_row_data_get(shctx_ptr(cache), first, spill->data, 0, first->len) != 0) {
+		free(spill);
+		return;
+	}
+	spill->cache = cache;
+	spill->len = first->len;
+	spill->next = cache_spills;
+	cache_spills = spill;
+	cache_spills_size += first->len;
+}
+
+/* Queues the writes of the rows copied by cache_disk_spill() to their disk tier */
+static void cache_disk_flush_spills(void)
+{
+	struct cache_spill *spill;
+	struct cache_disk_entry *d;
+	struct cache_entry *object;
+
+	while ((spill = cache_spills)) {
+		cache_spills = spill->next;
+		object = (struct cache_entry *)spill->data;
+		d = cache_disk_alloc(spill->cache, object, spill->len,
+		                     object->etag_length ? (char *)spill->data + object->etag_offset : NULL);
+		if (!d) {
+			free(spill);
+			continue;
+		}
+		cache_disk_queue_write(spill->cache, d, 0, spill, spill->data, spill->len, CACHE_DISK_IO_F_LAST);
+	}
+	cache_spills_size = 0;
+}
+
+/* Returns non-zero if the object whose primary hash is <hash> is being written
+ * to the disk tier of <cache>.
+ */
+static int cache_disk_storing(struct cache *cache, const char *hash)
+{
+	struct cache_disk_entry *d;
+	int ret;
+
+	HA_RWLOCK_RDLOCK(CACHE_LOCK, &cache->disk->lock);
+	d = cache_disk_lookup(cache->disk, hash);
+	ret = d && !d->complete;
+	HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &cache->disk->lock);
+	return ret;
+}
+
+/* Starts to store an object directly to the disk tier of <cache> for filter
+ * context <st>. <object> describes the object and <hdrs> contains its
+ * serialized headers. The payload of <body_len> bytes is stored as a single
+ * DATA block filled by cache_store_http_payload(). Returns 0 on failure.
+ */
+static int cache_disk_store_start(struct cache *cache, struct cache_st *st, struct cache_entry *object,
+                                  const struct buffer *hdrs, unsigned int body_len)
+{
+	struct cache_disk_entry *d;
+	unsigned int len, pos;
+	uint32_t info;
+	char *buf;
+
+	len = sizeof(*object) + b_data(hdrs);
+	if (body_len)
+		len += sizeof(info) + body_len;
+	if (len > cache->disk_maxobjsz ||
+	    HA_ATOMIC_LOAD(&cache->disk->io_pending) + len > CACHE_DISK_QUEUE_MAX)
+		return 0;
+
+	/* another stream is already storing this object */
+	if (cache_disk_storing(cache, object->hash))
+		return 0;
+
+	pos = sizeof(*object) + b_data(hdrs);
+	buf = malloc(pos + sizeof(info));
+	if (!buf)
+		return 0;
+
+	object->body_size = body_len;
+	memcpy(buf, object, sizeof(*object));
+	memcpy(buf + sizeof(*object), b_orig(hdrs), b_data(hdrs));
+	if (body_len) {
+		info = (HTX_BLK_DATA << 28) + body_len;
+		memcpy(buf + pos, &info, sizeof(info));
+		pos += sizeof(info);
+	}
+
+	d = cache_disk_alloc(cache, object, len, object->etag_length ? buf + object->etag_offset : NULL);
+	if (!d) {
+		free(buf);
+		return 0;
+	}
+
+	if (!cache_disk_queue_write(cache, d, 0, buf, buf, pos, 0)) {
+		cache_disk_complete(cache, d, 0);
+		return 0;
+	}
+
+	st->disk_pos = pos;
+	st->disk = d;
+	return 1;
+}
+
+
+
+static int
+cache_store_init(struct proxy *px, struct flt_conf *fconf)
+{
+	fconf->flags |= FLT_CFG_FL_HTX;
+	return 0;
+}
+
+static void
+cache_store_deinit(struct proxy *px, struct flt_conf *fconf)
+{
+	struct cache_flt_conf *cconf = fconf->conf;
+
+	if (!(cconf->flags & CACHE_FLT_INIT))
+		free(cconf->c.name);
+	free(cconf);
+}
+
+static int
+cache_store_check(struct proxy *px, struct flt_conf *fconf)
+{
+	struct cache_flt_conf *cconf = fconf->conf;
+	struct flt_conf *f;
+	struct cache *cache;
+	int comp = 0;
+
+	/* Find the cache corresponding to the name in the filter config.  The
+	*  cache will not be referenced now in the filter config because it is
+	*  not fully allocated. This step will be performed during the cache
+	*  post_check.
+	*/
+	list_for_each_entry(cache, &caches_config, list) {
+		if (strcmp(cache->id, cconf->c.name) == 0)
+			goto found;
+	}
+
+	ha_alert("config: %s '%s': unable to find the cache '%s' referenced by the filter 'cache'.\n",
+		 proxy_type_str(px), px->id, (char *)cconf->c.name);
+	return 1;
+
+  found:
+	/* Here <cache> points on the cache the filter must use and <cconf>
+	 * points on the cache filter configuration. */
+
+	/* Check all filters for proxy <px> to know if the compression is
+	 * enabled and if it is after the cache. When the compression is before
+	 * the cache, an error is returned unless the cache processes the Vary
+	 * header, in which case the compressed responses are stored as
+	 * variants. Also check if the cache filter must be explicitly declaired
+	 * or not. */
+	list_for_each_entry(f, &px->filter_configs, list) {
+		if (f == fconf) {
+			/* The compression filter must be evaluated after the cache,
+			 * unless the compressed variants may be stored.
+			 */
+			if (comp && !cache->vary_processing_enabled) {
+				ha_alert("config: %s '%s': unable to enable the compression filter before "
+					 "the cache '%s' without 'process-vary on'.\n", proxy_type_str(px), px->id, cache->id);
+				return 1;
+			}
+		}
+		else if (f->id == http_comp_flt_id)
+			comp = 1;
+		else if (f->id == fcgi_flt_id)
+			continue;
+		else if ((f->id != fconf->id) && (cconf->flags & CACHE_FLT_F_IMPLICIT_DECL)) {
+			/* Implicit declaration is only allowed with the
+			 * compression and fcgi. For other filters, an implicit
+			 * declaration is required. */
+			ha_alert("config: %s '%s': require an explicit filter declaration "
+				 "to use the cache '%s'.\n", proxy_type_str(px), px->id, cache->id);
+			return 1;
+		}
+
+	}
+	return 0;
+}
+
+static int
+cache_store_strm_init(struct stream *s, struct filter *filter)
+{
+	struct cache_st *st;
+
+	st = pool_alloc(pool_head_cache_st);
+	if (st == NULL)
+		return -1;
+
+	st->first_block = NULL;
+	st->disk        = NULL;
+	st->flags       = 0;
+	st->task        = NULL;
+	LIST_INIT(&st->fetch_wait);
+	filter->ctx     = st;
+
+	/* Register post-analyzers on AN_RES_WAIT_HTTP and once the response
+	 * rules were evaluated.
+	 */
+	filter->post_analyzers |= AN_RES_WAIT_HTTP | AN_RES_HTTP_PROCESS_BE;
+	return 1;
+}
+
+static void
+cache_store_strm_deinit(struct stream *s, struct filter *filter)
+{
+	struct cache_st *st = filter->ctx;
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+	struct cache *cache = cconf->c.cache;
+	struct shared_context *shctx = shctx_ptr(cache);
+
+	/* Everything should be released in the http_end filter, but we need to do it
+	 * there too, in case of errors */
+	if (st && st->first_block) {
+		struct cache_entry *object = (struct cache_entry *)st->first_block->data;
+		if (!object->complete) {
+			/* The stream was closed but the 'complete' flag was not
+			 * set which means that cache_store_http_end was not
+			 * called. The stream must have been closed before we
+			 * could store the full answer in the cache.
+			 */
+			release_entry_unlocked(&cache->trees[object->eb.key % CACHE_TREE_NUM], object);
+		}
+		shctx_row_wrlock(shctx, st->first_block);
+		shctx_row_reattach(shctx, st->first_block);
+		shctx_row_wrunlock(shctx, st->first_block);
+	}
+	if (st && st->disk) {
+		/* the payload was not entirely written */
+		cache_disk_complete(cache, st->disk, 0);
+	}
+	if (st && s->txn) {
+		cache_fetch_unwait(get_cache_tree_from_hash(cache, read_u32(s->txn->cache_hash)), st);
+		/* the object was not entirely stored, let another request
+		 * fetch it
+		 */
+		cache_st_fetch_end(cache, s, st, 0);
+	}
+	if (s->txn) {
+		/* no response was received, let another request fetch the object */
+		cache_fetch_done(cache, s, 0);
+	}
+	if (st) {
+		pool_free(pool_head_cache_st, st);
+		filter->ctx = NULL;
+	}
+}
+
+static int
+cache_store_post_analyze(struct stream *s, struct filter *filter, struct channel *chn,
+			 unsigned an_bit)
+{
+	struct http_txn *txn = s->txn;
+	struct http_msg *msg = &txn->rsp;
+	struct cache_st *st = filter->ctx;
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+
+	/* the request is still registered as the one fetching its object if
+	 * no cache-store rule processed the response, which will not be
+	 * stored.
+	 */
+	if (an_bit == AN_RES_HTTP_PROCESS_BE) {
+		cache_fetch_done(cconf->c.cache, s, 1);
+		goto end;
+	}
+
+	if (an_bit != AN_RES_WAIT_HTTP || !st)
+		goto end;
+
+	/* Here we need to check if any compression filter precedes the cache
+	 * filter, since it already decided to compress the response or not.
+	 * The compressed responses may only be stored as variants of the
+	 * response when the Vary header is processed. Otherwise the cache is
+	 * disabled. This last case is only possible when the compression is
+	 * configured in the frontend while the cache filter is configured on
+	 * the backend, and cannot be detected during HAProxy startup.
+	 */
+	if (msg->flags & HTTP_MSGF_COMPRESSING) {
+		if (!cconf->c.cache->vary_processing_enabled) {
+			pool_free(pool_head_cache_st, st);
+			filter->ctx = NULL;
+		}
+		else
+			st->flags |= CACHE_ST_F_COMPRESSED;
+	}
+	else if ((msg->flags & HTTP_MSGF_COMPRESSIBLE) && cconf->c.cache->vary_processing_enabled)
+		st->flags |= CACHE_ST_F_COMPRESSIBLE;
+
+  end:
+	return 1;
+}
+
+static inline void disable_cache_entry(struct cache_st *st,
+                                       struct filter *filter, struct shared_context *shctx)
+{
+	struct cache_entry *object;
+	struct cache *cache = (struct cache*)shctx->data;
 
 	object = (struct cache_entry *)st->first_block->data;
 	filter->ctx = NULL; /* disable cache  */
 	release_entry_unlocked(&cache->trees[object->eb.key % CACHE_TREE_NUM], object);
-	shctx_wrlock(shctx);
+	shctx_row_wrlock(shctx, st->first_block);
 	shctx_row_reattach(shctx, st->first_block);
-	shctx_wrunlock(shctx);
+	shctx_row_wrunlock(shctx, st->first_block);
 	pool_free(pool_head_cache_st, st);
 }
 
+static int
+cache_store_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_st *st = filter->ctx;
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+
+	if (!(msg->chn->flags & CF_ISRESP) || !st)
+		return 1;
+
+	/* the headers of a compressed response are only final now */
+	if ((st->flags & CACHE_ST_F_HDRS_PENDING) && st->first_block) {
+		st->flags &= ~CACHE_ST_F_HDRS_PENDING;
+		if (cache_store_headers(cconf->c.cache, st->first_block, htxbuf(&msg->chn->buf)) < 0) {
+			cache_st_fetch_end(cconf->c.cache, s, st, 1);
+			disable_cache_entry(st, filter, shctx);
+			return 1;
+		}
+	}
+
+	if (st->first_block || st->disk)
+		register_data_filter(s, msg->chn, filter);
+	return 1;
+}
+
+
+/* Writes the payload of the object being stored directly to the disk tier.
+ * Only DATA blocks are expected since the object has a known length.
+ */
+static int
+cache_store_disk_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
+			 unsigned int offset, unsigned int len)
+{
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+	struct cache *cache = cconf->c.cache;
+	struct cache_st *st = filter->ctx;
+	struct htx *htx = htxbuf(&msg->chn->buf);
+	struct htx_blk *blk;
+	struct htx_ret htxret;
+	unsigned int orig_len = len;
+	char *buf;
+
+	htxret = htx_find_offset(htx, offset);
+	blk = htxret.blk;
+	offset = htxret.ret;
+	for (; blk && len; blk = htx_get_next_blk(htx, blk)) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist v;
+
+		if (type == HTX_BLK_UNUSED)
+			continue;
+		if (type != HTX_BLK_DATA)
+			goto no_cache;
+
+		v = htx_get_blk_value(htx, blk);
+		v = istadv(v, offset);
+		v = isttrim(v, len);
+		if (st->disk_pos + v.len > st->disk->len ||
+		    HA_ATOMIC_LOAD(&cache->disk->io_pending) + v.len > CACHE_DISK_QUEUE_MAX)
+			goto no_cache;
+
+		/* the data are written by the I/O thread from a copy */
+		buf = malloc(v.len);
+		if (!buf)
+			goto no_cache;
+		memcpy(buf, v.ptr, v.len);
+		if (!cache_disk_queue_write(cache, st->disk, st->disk_pos, buf, buf, v.len, 0))
+			goto no_cache;
+
+		st->disk_pos += v.len;
+		len -= v.len;
+		offset = 0;
+	}
+	return orig_len;
+
+  no_cache:
+	cache_disk_complete(cache, st->disk, 0);
+	cache_st_fetch_end(cache, s, st, 1);
+	filter->ctx = NULL;
+	pool_free(pool_head_cache_st, st);
+	unregister_data_filter(s, msg->chn, filter);
+	return orig_len;
+}
+
 static int
 cache_store_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 			 unsigned int offset, unsigned int len)
@@ -761,6 +1818,9 @@ cache_store_http_payload(struct stream *s, struct filter *filter, struct http_ms
 	if (!len)
 		return len;
 
+	if (st->disk)
+		return cache_store_disk_payload(s, filter, msg, offset, len);
+
 	if (!st->first_block) {
 		unregister_data_filter(s, msg->chn, filter);
 		return len;
@@ -830,6 +1890,7 @@ cache_store_http_payload(struct stream *s, struct filter *filter, struct http_ms
 	return to_forward;
 
   no_cache:
+	cache_st_fetch_end(cconf->c.cache, s, st, 1);
 	disable_cache_entry(st, filter, shctx);
 	unregister_data_filter(s, msg->chn, filter);
 	return orig_len;
@@ -852,13 +1913,28 @@ cache_store_http_end(struct stream *s, struct filter *filter,
 
 		object = (struct cache_entry *)st->first_block->data;
 
-		shctx_wrlock(shctx);
+		shctx_row_wrlock(shctx, st->first_block);
 		/* The whole payload was cached, the entry can now be used. */
 		object->complete = 1;
 		/* remove from the hotlist */
 		shctx_row_reattach(shctx, st->first_block);
-		shctx_wrunlock(shctx);
+		shctx_row_wrunlock(shctx, st->first_block);
 
+		cache_st_fetch_end(cache, s, st, 0);
+	}
+	if (st && st->disk) {
+		/* the record is usable once the whole payload is written, the
+		 * fetch ends at the same time.
+		 */
+		if (st->flags & CACHE_ST_F_FETCH) {
+			st->flags &= ~CACHE_ST_F_FETCH;
+			st->disk->fetch_owner = s->uniq_id;
+			st->disk->fetching = 1;
+		}
+		cache_disk_queue_write(cache, st->disk, st->disk_pos, NULL, NULL, 0,
+		                       CACHE_DISK_IO_F_LAST |
+		                       (st->disk_pos == st->disk->len ? 0 : CACHE_DISK_IO_F_ABORT));
+		st->disk = NULL;
 	}
 	if (st) {
 		pool_free(pool_head_cache_st, st);
@@ -1011,6 +2087,42 @@ int http_calc_maxage(struct stream *s, struct cache *cache, int *true_maxage)
 }
 
 
+/* Sets the periods during which <object> may be served stale once expired,
+ * from the "stale-while-revalidate" and "stale-if-error" Cache-Control
+ * directives of the response (see RFC 5861), limited to the cache's
+ * "max-stale". A response which must be revalidated is never served stale.
+ */
+static void http_calc_stale(struct stream *s, struct cache *cache, struct cache_entry *object)
+{
+	struct htx *htx = htxbuf(&s->res.buf);
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	unsigned long long revalidate = 0, if_error = 0;
+	const char *value, *end;
+
+	object->stale_revalidate = object->stale_if_error = 0;
+	if (!cache->max_stale)
+		return;
+
+	while (http_find_header(htx, ist("cache-control"), &ctx, 0)) {
+		if (isteqi(ctx.value, ist("must-revalidate")) ||
+		    isteqi(ctx.value, ist("proxy-revalidate")))
+			return;
+
+		end = istend(ctx.value);
+		if ((value = directive_value(ctx.value.ptr, ctx.value.len, "stale-while-revalidate", 22))) {
+			value += (value < end && *value == '"');
+			revalidate = read_uint64(&value, end);
+		}
+		else if ((value = directive_value(ctx.value.ptr, ctx.value.len, "stale-if-error", 14))) {
+			value += (value < end && *value == '"');
+			if_error = read_uint64(&value, end);
+		}
+	}
+
+	object->stale_revalidate = MIN(revalidate, cache->max_stale);
+	object->stale_if_error = MIN(if_error, cache->max_stale);
+}
+
 static void cache_free_blocks(struct shared_block *first, void *data)
 {
 	struct cache_entry *object = (struct cache_entry *)first->data;
@@ -1018,6 +2130,8 @@ static void cache_free_blocks(struct shared_block *first, void *data)
 	struct cache_tree *cache_tree;
 
 	if (object->eb.key) {
+		if (cache->disk)
+			cache_disk_spill(cache, first);
 		object->complete = 0;
 		cache_tree = &cache->trees[object->eb.key % CACHE_TREE_NUM];
 		retain_entry(object);
@@ -1061,6 +2175,10 @@ static void cache_reserve_finish(struct shared_context *shctx)
 		HA_SPIN_UNLOCK(CACHE_LOCK, &cache_tree->cleanup_lock);
 		cache_wrunlock(cache_tree);
 	}
+
+	/* the evicted objects may now be written to the disk tier */
+	if (cache_spills)
+		cache_disk_flush_spills();
 }
 
 
@@ -1123,58 +2241,213 @@ static int http_check_vary_header(struct htx *htx, unsigned int *vary_signature)
 				break;
 			}
 		}
-		retval = (vary_idx < vary_info_count);
+		retval = (vary_idx < vary_info_count);
+	}
+
+	return retval;
+}
+
+
+/*
+ * Look for the accept-encoding part of the secondary_key and replace the
+ * encoding bitmap part of the hash with the actual encoding of the response,
+ * extracted from the content-encoding header value.
+ * Responses that have an unknown encoding will not be cached if they also
+ * "vary" on the accept-encoding value.
+ * Returns 0 if we found a known encoding in the response, -1 otherwise.
+ */
+static int set_secondary_key_encoding(struct htx *htx, unsigned int vary_signature, char *secondary_key)
+{
+	unsigned int resp_encoding_bitmap = 0;
+	const struct vary_hashing_information *info = vary_information;
+	unsigned int offset = 0;
+	unsigned int count = 0;
+	unsigned int hash_info_count = sizeof(vary_information)/sizeof(*vary_information);
+	unsigned int encoding_value;
+	struct http_hdr_ctx ctx = { .blk = NULL };
+
+	/* We must not set the accept encoding part of the secondary signature
+	 * if the response does not vary on 'Accept Encoding'. */
+	if (!(vary_signature & VARY_ACCEPT_ENCODING))
+		return 0;
+
+	/* Look for the accept-encoding part of the secondary_key. */
+	while (count < hash_info_count && info->value != VARY_ACCEPT_ENCODING) {
+		offset += info->hash_length;
+		++info;
+		++count;
+	}
+
+	if (count == hash_info_count)
+		return -1;
+
+	while (http_find_header(htx, ist("content-encoding"), &ctx, 0)) {
+		if (parse_encoding_value(ctx.value, &encoding_value, NULL))
+			return -1; /* Do not store responses with an unknown encoding */
+		resp_encoding_bitmap |= encoding_value;
+	}
+
+	if (!resp_encoding_bitmap)
+		resp_encoding_bitmap |= VARY_ENCODING_IDENTITY;
+
+	/* Rewrite the bitmap part of the hash with the new bitmap that only
+	 * corresponds the the response's encoding. */
+	write_u32(secondary_key + offset, resp_encoding_bitmap);
+
+	return 0;
+}
+
+/* Returns the encoding bitmap stored in the accept-encoding part of secondary
+ * key <secondary_key>. It is the one of the client for a key built from a
+ * request, and the one of the response for a key stored in a cache entry.
+ */
+static unsigned int get_secondary_key_encoding(const char *secondary_key)
+{
+	const struct vary_hashing_information *info;
+	unsigned int offset = 0;
+	size_t idx;
+
+	for (idx = 0; idx < sizeof(vary_information)/sizeof(*vary_information); ++idx) {
+		info = &vary_information[idx];
+		if (info->value == VARY_ACCEPT_ENCODING)
+			return read_u32(secondary_key + offset);
+		offset += info->hash_length;
+	}
+	return 0;
+}
+
+/* Returns non-zero if the client of stream <s>, whose secondary key was built,
+ * accepts an encoding that the response compression of its proxies produces,
+ * and if the compression is not currently limited. This indicates that an
+ * identity variant of a response is not worth delivering to this client. The
+ * compression is never used for a request without Accept-Encoding header.
+ */
+static int cache_comp_wanted(struct stream *s)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct comp_algo *algo = NULL;
+	unsigned int produced = 0;
+	unsigned int encoding;
+
+	if (!http_find_header(htxbuf(&s->req.buf), ist("Accept-Encoding"), &ctx, 0))
+		return 0;
+
+	if (s->be->comp && (s->be->comp->flags & COMP_FL_DIR_RES))
+		algo = s->be->comp->algos_res;
+	if (!algo && strm_fe(s)->comp && (strm_fe(s)->comp->flags & COMP_FL_DIR_RES))
+		algo = strm_fe(s)->comp->algos_res;
+
+	for (; algo; algo = algo->next) {
+		if (!parse_encoding_value(ist2(algo->ua_name, algo->ua_name_len), &encoding, NULL))
+			produced |= encoding;
+	}
+	produced &= ~VARY_ENCODING_IDENTITY;
+
+	return (get_secondary_key_encoding(s->txn->cache_secondary_hash) & produced) && !http_comp_limited();
+}
+
+/* Serializes the headers of the response in <htx> into the trash buffer, to
+ * be stored after object <object>, whose ETag position is set. The encoding
+ * part of its secondary key is also set. Returns 0 on success or -1 if the
+ * response must not be stored.
+ */
+static int cache_build_headers(struct cache *cache, struct cache_entry *object, struct htx *htx)
+{
+	size_t hdrs_len = 0;
+	int32_t pos;
+
+	chunk_reset(&trash);
+	for (pos = htx_get_first(htx); pos != -1; pos = htx_get_next(htx, pos)) {
+		struct htx_blk *blk = htx_get_blk(htx, pos);
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		uint32_t sz = htx_get_blksz(blk);
+
+		hdrs_len += sizeof(*blk) + sz;
+		chunk_memcat(&trash, (char *)&blk->info, sizeof(blk->info));
+		chunk_memcat(&trash, htx_get_blk_ptr(htx, blk), sz);
+
+		/* Look for optional ETag header.
+		 * We need to store the offset of the ETag value in order for
+		 * future conditional requests to be able to perform ETag
+		 * comparisons. */
+		if (type == HTX_BLK_HDR) {
+			struct ist header_name = htx_get_blk_name(htx, blk);
+			if (isteq(header_name, ist("etag"))) {
+				object->etag_length = sz - istlen(header_name);
+				object->etag_offset = sizeof(struct cache_entry) + b_data(&trash) - sz + istlen(header_name);
+			}
+		}
+		if (type == HTX_BLK_EOH)
+			break;
 	}
 
-	return retval;
-}
+	/* Do not cache objects if the headers are too big. */
+	if (hdrs_len > htx->size - global.tune.maxrewrite)
+		return -1;
 
+	/* If the response has a secondary_key, fill its key part related to
+	 * encodings with the actual encoding of the response. This way any
+	 * subsequent request having the same primary key will have its accepted
+	 * encodings tested upon the cached response's one.
+	 * We will not cache a response that has an unknown encoding (not
+	 * explicitly supported in parse_encoding_value function). */
+	if (cache->vary_processing_enabled && object->secondary_key_signature)
+		if (set_secondary_key_encoding(htx, object->secondary_key_signature, object->secondary_key))
+			return -1;
 
-/*
- * Look for the accept-encoding part of the secondary_key and replace the
- * encoding bitmap part of the hash with the actual encoding of the response,
- * extracted from the content-encoding header value.
- * Responses that have an unknown encoding will not be cached if they also
- * "vary" on the accept-encoding value.
- * Returns 0 if we found a known encoding in the response, -1 otherwise.
+	return 0;
+}
+
+/* Removes from <tree> the complete entries having the same primary and
+ * secondary keys as <object>, which is a variant of a response going through
+ * the compression. Its actual encoding is only known once its headers are
+ * final, so they could not be looked up before. Returns -1 if such an entry is
+ * still being stored, in which case <object> must not be stored, otherwise 0.
  */
-static int set_secondary_key_encoding(struct htx *htx, unsigned int vary_signature, char *secondary_key)
+static int cache_replace_variant(struct cache_tree *tree, struct cache_entry *object)
 {
-	unsigned int resp_encoding_bitmap = 0;
-	const struct vary_hashing_information *info = vary_information;
-	unsigned int offset = 0;
-	unsigned int count = 0;
-	unsigned int hash_info_count = sizeof(vary_information)/sizeof(*vary_information);
-	unsigned int encoding_value;
-	struct http_hdr_ctx ctx = { .blk = NULL };
-
-	/* We must not set the accept encoding part of the secondary signature
-	 * if the response does not vary on 'Accept Encoding'. */
-	if (!(vary_signature & VARY_ACCEPT_ENCODING))
-		return 0;
+	struct eb32_node *node, *next;
+	struct cache_entry *entry;
+	int ret = 0;
 
-	/* Look for the accept-encoding part of the secondary_key. */
-	while (count < hash_info_count && info->value != VARY_ACCEPT_ENCODING) {
-		offset += info->hash_length;
-		++info;
-		++count;
-	}
+	cache_wrlock(tree);
+	for (node = eb32_lookup(&tree->entries, object->eb.key); node; node = next) {
+		next = eb32_next_dup(node);
+		entry = eb32_entry(node, struct cache_entry, eb);
 
-	if (count == hash_info_count)
-		return -1;
+		if (entry == object ||
+		    memcmp(entry->hash, object->hash, sizeof(entry->hash)) != 0 ||
+		    entry->secondary_key_signature != object->secondary_key_signature ||
+		    memcmp(entry->secondary_key, object->secondary_key, HTTP_CACHE_SEC_KEY_LEN) != 0)
+			continue;
 
-	while (http_find_header(htx, ist("content-encoding"), &ctx, 0)) {
-		if (parse_encoding_value(ctx.value, &encoding_value, NULL))
-			return -1; /* Do not store responses with an unknown encoding */
-		resp_encoding_bitmap |= encoding_value;
+		if (!entry->complete) {
+			ret = -1;
+			break;
+		}
+		release_entry_locked(tree, entry);
 	}
+	cache_wrunlock(tree);
+	return ret;
+}
 
-	if (!resp_encoding_bitmap)
-		resp_encoding_bitmap |= VARY_ENCODING_IDENTITY;
+/* Stores the headers of the response in <htx> in the row starting at block
+ * <first>, for a response going through the compression. The variant of the
+ * response with the same encoding is replaced. Returns 0 on success or -1 if
+ * the response must not be stored.
+ */
+static int cache_store_headers(struct cache *cache, struct shared_block *first, struct htx *htx)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_entry *object = (struct cache_entry *)first->data;
 
-	/* Rewrite the bitmap part of the hash with the new bitmap that only
-	 * corresponds the the response's encoding. */
-	write_u32(secondary_key + offset, resp_encoding_bitmap);
+	if (cache_build_headers(cache, object, htx) < 0 ||
+	    cache_replace_variant(&cache->trees[object->eb.key % CACHE_TREE_NUM], object) < 0)
+		return -1;
+
+	if (!shctx_row_reserve_hot(shctx, first, trash.data) ||
+	    shctx_row_data_append(shctx, first, (unsigned char *)trash.area, trash.data) < 0)
+		return -1;
 
 	return 0;
 }
@@ -1201,10 +2474,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	unsigned int key = read_u32(txn->cache_hash);
 	struct htx *htx;
 	struct http_hdr_ctx ctx;
-	size_t hdrs_len = 0;
-	int32_t pos;
 	unsigned int vary_signature = 0;
 	struct cache_tree *cache_tree = NULL;
+	struct cache_entry disk_object;
+	long long body_len = 0;
+	int to_disk = 0;
 
 	/* Don't cache if the response came from a cache */
 	if ((obj_type(s->target) == OBJ_TYPE_APPLET) &&
@@ -1241,6 +2515,9 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 				if (old)
 					release_entry_locked(cache_tree, old);
 				cache_wrunlock(cache_tree);
+
+				if (cache->disk)
+					cache_disk_invalidate(cache, txn->cache_hash);
 			}
 		}
 		goto out;
@@ -1268,10 +2545,18 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	/* from there, cache_ctx is always defined */
 	htx = htxbuf(&s->res.buf);
 
-	/* Do not cache too big objects. */
+	/* Do not cache too big objects, unless they fit in the disk tier in
+	 * which case they are directly stored there.
+	 */
 	if ((msg->flags & HTTP_MSGF_CNT_LEN) && shctx->max_obj_size > 0 &&
-	    htx->data + htx->extra > shctx->max_obj_size)
-		goto out;
+	    htx->data + htx->extra > shctx->max_obj_size) {
+		ctx.blk = NULL;
+		if (!cache->disk || !http_find_header(htx, ist("Content-Length"), &ctx, 0) ||
+		    strl2llrc(ctx.value.ptr, ctx.value.len, &body_len) ||
+		    body_len < 0 || body_len > cache->disk_maxobjsz)
+			goto out;
+		to_disk = 1;
+	}
 
 	/* Only a subset of headers are supported in our Vary implementation. If
 	 * any other header is present in the Vary header value, we won't be
@@ -1281,6 +2566,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (cache->vary_processing_enabled) {
 		if (!http_check_vary_header(htx, &vary_signature))
 			goto out;
+		/* The responses going through the compression vary on the
+		 * accepted encodings, even when it did not compress them.
+		 */
+		if (cache_ctx && (cache_ctx->flags & (CACHE_ST_F_COMPRESSED|CACHE_ST_F_COMPRESSIBLE)))
+			vary_signature |= VARY_ACCEPT_ENCODING;
 		if (vary_signature) {
 			/* If something went wrong during the secondary key
 			 * building, do not store the response. */
@@ -1293,6 +2583,10 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		goto out;
 	}
 
+	/* the disk tier does not support secondary keys */
+	if (to_disk && vary_signature)
+		goto out;
+
 	http_check_response_for_cacheability(s, &s->res);
 
 	if (!(txn->flags & TX_CACHEABLE) || !(txn->flags & TX_CACHE_COOK))
@@ -1300,6 +2594,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 
 	cache_wrlock(cache_tree);
 	old = get_entry(cache_tree, txn->cache_hash, 1);
+	/* a variant going through the compression only replaces the one with
+	 * the same encoding, which is known once its headers are stored.
+	 */
+	if (cache_ctx && (cache_ctx->flags & (CACHE_ST_F_COMPRESSED|CACHE_ST_F_COMPRESSIBLE)))
+		old = NULL;
 	if (old) {
 		if (vary_signature)
 			old = get_secondary_entry(cache_tree, old,
@@ -1317,15 +2616,23 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	}
 	cache_wrunlock(cache_tree);
 
-	first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
-	if (!first) {
-		goto out;
+	if (to_disk) {
+		/* the object only lives in the disk tier, it is described
+		 * here until its record is allocated.
+		 */
+		object = &disk_object;
 	}
+	else {
+		first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
+		if (!first) {
+			goto out;
+		}
 
-	/* the received memory is not initialized, we need at least to mark
-	 * the object as not indexed yet.
-	 */
-	object = (struct cache_entry *)first->data;
+		/* the received memory is not initialized, we need at least to
+		 * mark the object as not indexed yet.
+		 */
+		object = (struct cache_entry *)first->data;
+	}
 	memset(object, 0, sizeof(*object));
 	object->eb.key = key;
 	object->secondary_key_signature = vary_signature;
@@ -1339,23 +2646,26 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (vary_signature)
 		memcpy(object->secondary_key, txn->cache_secondary_hash, HTTP_CACHE_SEC_KEY_LEN);
 
-	cache_wrlock(cache_tree);
-	/* Insert the entry in the tree even if the payload is not cached yet. */
-	if (insert_entry(cache, cache_tree, object) != &object->eb) {
-		object->eb.key = 0;
+	if (!to_disk) {
+		cache_wrlock(cache_tree);
+		/* Insert the entry in the tree even if the payload is not cached yet. */
+		if (insert_entry(cache, cache_tree, object) != &object->eb) {
+			object->eb.key = 0;
+			cache_wrunlock(cache_tree);
+			goto out;
+		}
 		cache_wrunlock(cache_tree);
-		goto out;
-	}
-	cache_wrunlock(cache_tree);
 
-	/* reserve space for the cache_entry structure */
-	first->len = sizeof(struct cache_entry);
-	first->last_append = NULL;
+		/* reserve space for the cache_entry structure */
+		first->len = sizeof(struct cache_entry);
+		first->last_append = NULL;
+	}
 
 	/* Determine the entry's maximum age (taking into account the cache's
 	 * configuration) as well as the response's explicit max age (extracted
 	 * from cache-control directives or the expires header). */
 	effective_maxage = http_calc_maxage(s, cache, &true_maxage);
+	http_calc_stale(s, cache, object);
 
 	ctx.blk = NULL;
 	if (http_find_header(htx, ist("Age"), &ctx, 0)) {
@@ -1378,44 +2688,33 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	 * compared to a future If-Modified-Since client header. */
 	object->last_modified = get_last_modified_time(htx);
 
-	chunk_reset(&trash);
-	for (pos = htx_get_first(htx); pos != -1; pos = htx_get_next(htx, pos)) {
-		struct htx_blk *blk = htx_get_blk(htx, pos);
-		enum htx_blk_type type = htx_get_blk_type(blk);
-		uint32_t sz = htx_get_blksz(blk);
-
-		hdrs_len += sizeof(*blk) + sz;
-		chunk_memcat(&trash, (char *)&blk->info, sizeof(blk->info));
-		chunk_memcat(&trash, htx_get_blk_ptr(htx, blk), sz);
+	if (cache_ctx && (cache_ctx->flags & CACHE_ST_F_COMPRESSED)) {
+		/* The compression rewrites the headers after this action, so
+		 * they are stored by the filter once it is done.
+		 */
+		cache_ctx->flags |= CACHE_ST_F_HDRS_PENDING;
+		goto register_filter;
+	}
 
-		/* Look for optional ETag header.
-		 * We need to store the offset of the ETag value in order for
-		 * future conditional requests to be able to perform ETag
-		 * comparisons. */
-		if (type == HTX_BLK_HDR) {
-			struct ist header_name = htx_get_blk_name(htx, blk);
-			if (isteq(header_name, ist("etag"))) {
-				object->etag_length = sz - istlen(header_name);
-				object->etag_offset = sizeof(struct cache_entry) + b_data(&trash) - sz + istlen(header_name);
-			}
-		}
-		if (type == HTX_BLK_EOH)
-			break;
+	if (cache_ctx && (cache_ctx->flags & CACHE_ST_F_COMPRESSIBLE)) {
+		object->compressible = 1;
+		if (cache_store_headers(cache, first, htx) < 0)
+			goto out;
+		goto register_filter;
 	}
 
-	/* Do not cache objects if the headers are too big. */
-	if (hdrs_len > htx->size - global.tune.maxrewrite)
+	if (cache_build_headers(cache, object, htx) < 0)
 		goto out;
 
-	/* If the response has a secondary_key, fill its key part related to
-	 * encodings with the actual encoding of the response. This way any
-	 * subsequent request having the same primary key will have its accepted
-	 * encodings tested upon the cached response's one.
-	 * We will not cache a response that has an unknown encoding (not
-	 * explicitly supported in parse_encoding_value function). */
-	if (cache->vary_processing_enabled && vary_signature)
-		if (set_secondary_key_encoding(htx, vary_signature, object->secondary_key))
-		    goto out;
+	if (to_disk) {
+		object->latest_validation = date.tv_sec;
+		object->expire = date.tv_sec + effective_maxage;
+		if (cache_ctx && cache_disk_store_start(cache, cache_ctx, object, &trash, body_len)) {
+			cache_st_fetch_keep(s, cache_ctx);
+			return ACT_RET_CONT;
+		}
+		goto out;
+	}
 
 	if (!shctx_row_reserve_hot(shctx, first, trash.data)) {
 		goto out;
@@ -1431,6 +2730,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (shctx_row_data_append(shctx, first, (unsigned char *)trash.area, trash.data) < 0)
 		goto out;
 
+  register_filter:
 	/* register the buffer in the filter ctx for filling it with data*/
 	if (cache_ctx) {
 		cache_ctx->first_block = first;
@@ -1438,19 +2738,21 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		/* store latest value and expiration time */
 		object->latest_validation = date.tv_sec;
 		object->expire = date.tv_sec + effective_maxage;
+		cache_st_fetch_keep(s, cache_ctx);
 		return ACT_RET_CONT;
 	}
 
 out:
 	/* if does not cache */
+	cache_fetch_done(cache, s, 1);
 	if (first) {
 		first->len = 0;
 		if (object->eb.key) {
 			release_entry_unlocked(cache_tree, object);
 		}
-		shctx_wrlock(shctx);
+		shctx_row_wrlock(shctx, first);
 		shctx_row_reattach(shctx, first);
-		shctx_wrunlock(shctx);
+		shctx_row_wrunlock(shctx, first);
 	}
 
 	return ACT_RET_CONT;
@@ -1471,11 +2773,21 @@ static void http_cache_applet_release(struct appctx *appctx)
 	struct shared_context *shctx = shctx_ptr(cache);
 	struct shared_block *first = block_ptr(cache_ptr);
 
+	if (ctx->disk) {
+		/* a pending read is released once done */
+		if (ctx->io && ctx->io->queued)
+			ctx->io->appctx = NULL;
+		else if (ctx->io)
+			cache_disk_io_free(ctx->io);
+		cache_disk_release(ctx->disk);
+		return;
+	}
+
 	release_entry(ctx->cache_tree, cache_ptr, 1);
 
-	shctx_wrlock(shctx);
+	shctx_row_wrlock(shctx, first);
 	shctx_row_reattach(shctx, first);
-	shctx_wrunlock(shctx);
+	shctx_row_wrunlock(shctx, first);
 }
 
 
@@ -1534,6 +2846,8 @@ static unsigned int htx_cache_dump_data_blk(struct appctx *appctx, struct htx *h
 	uint32_t blksz;
 
 	max = htx_free_data_space(htx);
+	if (ctx->range)
+		max = MIN(max, appctx->to_forward);
 	if (!max)
 		return 0;
 
@@ -1577,6 +2891,173 @@ static unsigned int htx_cache_dump_data_blk(struct appctx *appctx, struct htx *h
 	return total;
 }
 
+/* Returns the address of the <need> bytes at position <pos> of the record of
+ * the disk tier sent by <appctx> if they were loaded. Otherwise a read of as
+ * many bytes as a buffer may hold is started from <pos> and NULL is returned,
+ * with <disk_error> set on failure. The applet is woken up once the read is
+ * done. <need> may not exceed the size of a buffer.
+ */
+static const char *cache_disk_peek(struct appctx *appctx, unsigned int pos, unsigned int need)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct cache_disk_io *io = ctx->io;
+
+	if (io && io->queued)
+		return NULL;
+
+	if (io && io->ret && pos >= io->pos && pos + need <= io->pos + io->len)
+		return io->buf + pos - io->pos;
+
+	if (io && !io->ret && io->len)
+		goto error;
+
+	if (!io) {
+		io = cache_disk_io_new(cconf->c.cache, ctx->disk, CACHE_DISK_IO_READ);
+		if (!io)
+			goto error;
+		io->area = io->buf = malloc(global.tune.bufsize);
+		if (!io->buf) {
+			cache_disk_io_free(io);
+			goto error;
+		}
+		io->appctx = appctx;
+		ctx->io = io;
+	}
+
+	if (pos + need > ctx->disk->len || need > global.tune.bufsize)
+		goto error;
+
+	io->pos = pos;
+	io->len = MIN(ctx->disk->len - pos, global.tune.bufsize);
+	cache_disk_io_submit(io);
+	return NULL;
+
+  error:
+	ctx->disk_error = 1;
+	return NULL;
+}
+
+/* Skips the <skip> first bytes of the payload of the record of the disk tier
+ * sent by <appctx>, whose headers were already sent. Returns 0 while waiting
+ * for a read, or on error with <disk_error> set.
+ */
+static int htx_cache_disk_skip_payload(struct appctx *appctx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	const char *p;
+	unsigned int n;
+	uint32_t info;
+
+	while (ctx->skip) {
+		if (!ctx->rem_data) {
+			p = cache_disk_peek(appctx, sizeof(struct cache_entry) + ctx->sent, sizeof(info));
+			if (!p)
+				return 0;
+			memcpy(&info, p, sizeof(info));
+			if ((info >> 28) != HTX_BLK_DATA) {
+				ctx->disk_error = 1;
+				return 0;
+			}
+			n = sizeof(info);
+			ctx->rem_data = info & 0xfffffff;
+		}
+		else {
+			n = MIN(ctx->skip, ctx->rem_data);
+			ctx->rem_data -= n;
+			ctx->skip -= n;
+		}
+		ctx->sent += n;
+	}
+	return 1;
+}
+
+/* Same as htx_cache_dump_msg() for a record of the disk tier. The blocks are
+ * read at the position following the <sent> bytes already sent, from the part
+ * of the record loaded by cache_disk_peek(). It stops when this part must be
+ * read, until the applet is woken up. On read error, <disk_error> is set.
+ */
+static size_t htx_cache_disk_dump_msg(struct appctx *appctx, struct htx *htx, unsigned int len,
+				      enum htx_blk_type mark)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct htx_blk *blk;
+	unsigned int pos, ret, total = 0;
+	uint32_t info, blksz, max, sz;
+	enum htx_blk_type type;
+	const char *p;
+
+	if (ctx->skip && !htx_cache_disk_skip_payload(appctx))
+		return 0;
+
+	while (len) {
+		/* nothing is sent after a range */
+		if (ctx->range && !appctx->to_forward && appctx->st0 == HTX_CACHE_DATA)
+			break;
+
+		/* <pos> is the position of the next block, or of the remaining
+		 * data of the current one.
+		 */
+		pos = sizeof(struct cache_entry) + ctx->sent;
+		if (ctx->rem_data) {
+			type = HTX_BLK_DATA;
+			blksz = ctx->rem_data;
+			ret = 0;
+		}
+		else {
+			p = cache_disk_peek(appctx, pos, sizeof(info));
+			if (!p)
+				break;
+			memcpy(&info, p, sizeof(info));
+			type = (info >> 28);
+			blksz = ((type == HTX_BLK_HDR || type == HTX_BLK_TLR)
+				 ? (info & 0xff) + ((info >> 8) & 0xfffff)
+				 : info & 0xfffffff);
+			ret = sizeof(info);
+		}
+
+		max = htx_free_data_space(htx);
+		if (type != HTX_BLK_DATA) {
+			if (!max || blksz > max)
+				break;
+			p = cache_disk_peek(appctx, pos, ret + blksz);
+			if (!p)
+				break;
+			blk = htx_add_blk(htx, type, blksz);
+			if (!blk)
+				break;
+			memcpy(htx_get_blk_ptr(htx, blk), p + ret, blksz);
+			blk->info = info;
+			ret += blksz;
+		}
+		else if (blksz) {
+			sz = MIN(blksz, max);
+			if (ctx->range)
+				sz = MIN(sz, appctx->to_forward);
+			if (!sz)
+				break;
+			p = cache_disk_peek(appctx, pos, ret + 1);
+			if (!p)
+				break;
+			sz = MIN(sz, ctx->io->pos + ctx->io->len - pos - ret);
+			sz = htx_add_data(htx, ist2(p + ret, sz));
+			if (!sz)
+				break;
+			ctx->rem_data = blksz - sz;
+			appctx->to_forward -= sz;
+			ret += sz;
+		}
+
+		ctx->sent += ret;
+		total += ret;
+		len -= ret;
+
+		if (type == mark)
+			break;
+	}
+	return total;
+}
+
 static size_t htx_cache_dump_msg(struct appctx *appctx, struct htx *htx, unsigned int len,
 				 enum htx_blk_type mark)
 {
@@ -1587,10 +3068,17 @@ static size_t htx_cache_dump_msg(struct appctx *appctx, struct htx *htx, unsigne
 	unsigned int offset, sz;
 	unsigned int ret, total = 0;
 
+	if (ctx->disk)
+		return htx_cache_disk_dump_msg(appctx, htx, len, mark);
+
 	while (len) {
 		enum htx_blk_type type;
 		uint32_t info;
 
+		/* nothing is sent after a range */
+		if (ctx->range && !appctx->to_forward && appctx->st0 == HTX_CACHE_DATA)
+			break;
+
 		shblk  = ctx->next;
 		offset = ctx->offset;
 		if (ctx->rem_data) {
@@ -1732,6 +3220,100 @@ static size_t ff_cache_dump_msg(struct appctx *appctx, struct buffer *buf, unsig
 	return total;
 }
 
+/* Skips the <skip> first bytes of the payload of the entry sent by <appctx>,
+ * whose headers were already sent. Returns 0 if the payload is shorter.
+ * Records of the disk tier are skipped by htx_cache_disk_skip_payload().
+ */
+static int htx_cache_skip_payload(struct appctx *appctx, unsigned int skip)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	unsigned int n, sz;
+	uint32_t info;
+
+	while (skip) {
+		if (!ctx->rem_data) {
+			/* Get info of the next HTX block. May be split on 2 shblk */
+			sz = MIN(4, shctx->block_size - ctx->offset);
+			memcpy((char *)&info, (const char *)ctx->next->data + ctx->offset, sz);
+			if (sz < 4)
+				memcpy(((char *)&info) + sz,
+				       (const char *)LIST_NEXT(&ctx->next->list, typeof(ctx->next), list)->data,
+				       4 - sz);
+			if ((info >> 28) != HTX_BLK_DATA)
+				return 0;
+			n = sizeof(info);
+			ctx->rem_data = info & 0xfffffff;
+		}
+		else {
+			n = MIN(skip, ctx->rem_data);
+			ctx->rem_data -= n;
+			skip -= n;
+		}
+
+		ctx->sent += n;
+		ctx->offset += n;
+		while (ctx->offset >= shctx->block_size) {
+			ctx->next = LIST_NEXT(&ctx->next->list, typeof(ctx->next), list);
+			ctx->offset -= shctx->block_size;
+		}
+	}
+	return 1;
+}
+
+/* Turns the response headers in <htx> into the ones of a "206 Partial Content"
+ * response for the range to send, or of a "416 Range Not Satisfiable" one if
+ * it is empty. Returns 0 on failure.
+ */
+static int htx_cache_set_range_hdrs(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct http_hdr_ctx hdr = { .blk = NULL };
+	struct htx_sl *sl;
+	char *end;
+
+	if (ctx->range_len) {
+		if (!http_replace_res_status(htx, ist("206"), ist("Partial Content")))
+			return 0;
+		chunk_printf(&trash, "bytes %u-%u/%u", ctx->range_first,
+		             ctx->range_first + ctx->range_len - 1, ctx->entry->body_size);
+	}
+	else {
+		if (!http_replace_res_status(htx, ist("416"), ist("Range Not Satisfiable")))
+			return 0;
+		chunk_printf(&trash, "bytes */%u", ctx->entry->body_size);
+	}
+	if (!http_add_header(htx, ist("Content-Range"), ist2(b_orig(&trash), b_data(&trash))))
+		return 0;
+
+	/* the payload length changes, and is now always known */
+	while (http_find_header(htx, ist("Content-Length"), &hdr, 1))
+		http_remove_header(htx, &hdr);
+	hdr.blk = NULL;
+	while (http_find_header(htx, ist("Transfer-Encoding"), &hdr, 1))
+		http_remove_header(htx, &hdr);
+
+	end = ultoa_o(ctx->range_len, b_orig(&trash), b_size(&trash));
+	if (!http_add_header(htx, ist("Content-Length"), ist2(b_orig(&trash), end - b_orig(&trash))))
+		return 0;
+
+	sl = http_get_stline(htx);
+	sl->flags &= ~(HTX_SL_F_XFER_ENC | HTX_SL_F_CHNK);
+	sl->flags |= HTX_SL_F_XFER_LEN | HTX_SL_F_CLEN;
+	return 1;
+}
+
+/* Returns the number of bytes of the serialized message of the entry being sent
+ * which were not sent yet.
+ */
+static inline unsigned int cache_appctx_remaining(const struct cache_appctx *ctx)
+{
+	unsigned int len = ctx->disk ? ctx->disk->len : block_ptr(ctx->entry)->len;
+
+	return len - sizeof(struct cache_entry) - ctx->sent;
+}
+
 static int htx_cache_add_age_hdr(struct appctx *appctx, struct htx *htx)
 {
 	struct cache_appctx *ctx = appctx->svcctx;
@@ -1777,7 +3359,6 @@ static void http_cache_io_handler(struct appctx *appctx)
 {
 	struct cache_appctx *ctx = appctx->svcctx;
 	struct cache_entry *cache_ptr = ctx->entry;
-	struct shared_block *first = block_ptr(cache_ptr);
 	struct htx *res_htx = NULL;
 	struct buffer *errmsg;
 	unsigned int len;
@@ -1799,11 +3380,11 @@ static void http_cache_io_handler(struct appctx *appctx)
 
 	res_htx = htx_from_buf(&appctx->outbuf);
 
-	len = first->len - sizeof(*cache_ptr) - ctx->sent;
+	len = cache_appctx_remaining(ctx);
 	res_htx = htx_from_buf(&appctx->outbuf);
 
 	if (appctx->st0 == HTX_CACHE_INIT) {
-		ctx->next = block_ptr(cache_ptr);
+		ctx->next = ctx->disk ? NULL : block_ptr(cache_ptr);
 		ctx->offset = sizeof(*cache_ptr);
 		ctx->sent = 0;
 		ctx->rem_data = 0;
@@ -1817,6 +3398,17 @@ static void http_cache_io_handler(struct appctx *appctx)
 			goto exit;
 		}
 
+		/* The headers of a record of the disk tier are sent once
+		 * loaded, which takes a single read. The request is kept until
+		 * then.
+		 */
+		if (ctx->disk && !cache_disk_peek(appctx, sizeof(*cache_ptr), sizeof(uint32_t))) {
+			if (ctx->disk_error)
+				goto error;
+			htx_to_buf(res_htx, &appctx->outbuf);
+			return;
+		}
+
 		/* Headers must be dump at once. Otherwise it is an error */
 		ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_EOH);
 		if (!ret || (htx_get_tail_type(res_htx) != HTX_BLK_EOH) ||
@@ -1830,19 +3422,39 @@ static void http_cache_io_handler(struct appctx *appctx)
 				/* If replacing the status code fails we need to send the full response. */
 				ctx->send_notmodified = 0;
 			}
+			else
+				ctx->range = 0;
 		}
 
+		if (ctx->range && !htx_cache_set_range_hdrs(appctx, res_htx))
+			goto error;
+
 		/* Skip response body for HEAD requests or in case of "304 Not
-		 * Modified" response. */
+		 * Modified" or "416 Range Not Satisfiable" response. */
 		meth = htx_sl_req_meth(http_get_stline(htxbuf(&appctx->inbuf)));
-		if (find_http_meth(istptr(meth), istlen(meth)) == HTTP_METH_HEAD || ctx->send_notmodified)
+		if (find_http_meth(istptr(meth), istlen(meth)) == HTTP_METH_HEAD || ctx->send_notmodified ||
+		    (ctx->range && !ctx->range_len))
 			appctx->st0 = HTX_CACHE_EOM;
+		else if (ctx->range) {
+			/* only the range is sent, without the trailers. The
+			 * disk tier skips the payload while sending it.
+			 */
+			if (ctx->disk)
+				ctx->skip = ctx->range_first;
+			else if (!htx_cache_skip_payload(appctx, ctx->range_first))
+				goto error;
+			appctx->to_forward = ctx->range_len;
+			len = cache_appctx_remaining(ctx);
+			appctx->st0 = HTX_CACHE_DATA;
+		}
 		else {
-			if (!(global.tune.no_zero_copy_fwd & NO_ZERO_COPY_FWD_APPLET))
+			/* records of the disk tier are only read through the
+			 * HTX path */
+			if (!ctx->disk && !(global.tune.no_zero_copy_fwd & NO_ZERO_COPY_FWD_APPLET))
 				se_fl_set(appctx->sedesc, SE_FL_MAY_FASTFWD_PROD);
 
 			appctx->to_forward = cache_ptr->body_size;
-			len = first->len - sizeof(*cache_ptr) - ctx->sent;
+			len = cache_appctx_remaining(ctx);
 			appctx->st0 = HTX_CACHE_DATA;
 		}
 	}
@@ -1850,7 +3462,12 @@ static void http_cache_io_handler(struct appctx *appctx)
 	if (appctx->st0 == HTX_CACHE_DATA) {
 		if (len) {
 			ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_UNUSED);
-			if (ret < len) {
+			if (ret < len && !(ctx->range && !appctx->to_forward)) {
+				if (ctx->disk_error)
+					goto abort;
+				/* woken up by the end of the read */
+				if (ctx->io && ctx->io->queued)
+					goto out;
 				applet_fl_set(appctx, APPCTX_FL_OUTBLK_FULL);
 				goto out;
 			}
@@ -1896,6 +3513,13 @@ static void http_cache_io_handler(struct appctx *appctx)
 	applet_set_error(appctx);
 	appctx->st0 = HTX_CACHE_END;
 	goto end;
+
+  abort:
+	/* the headers were already sent, the response can only be aborted */
+	applet_set_eos(appctx);
+	applet_set_error(appctx);
+	appctx->st0 = HTX_CACHE_END;
+	goto out;
 }
 
 
@@ -1961,6 +3585,7 @@ enum act_parse_ret parse_cache_store(const char **args, int *orig_arg, struct pr
 
 	if (!parse_cache_rule(proxy, args[*orig_arg], rule, err))
 		return ACT_RET_PRS_ERR;
+	((struct cache_flt_conf *)rule->arg.act.p[0])->flags |= CACHE_FLT_F_STORE;
 
 	(*orig_arg)++;
 	return ACT_RET_PRS_OK;
@@ -2016,6 +3641,29 @@ int sha1_hosturi(struct stream *s)
 	return 1;
 }
 
+/* Copies the ETag of <entry> into <buf> and returns it, or IST_NULL if it
+ * could not be found. <disk> is the entry's record if it is sent from the disk
+ * tier, NULL otherwise.
+ */
+static struct ist cache_entry_get_etag(struct cache *cache, struct cache_entry *entry,
+                                       struct cache_disk_entry *disk, struct buffer *buf)
+{
+	if (entry->etag_length > b_size(buf))
+		return IST_NULL;
+
+	if (disk) {
+		/* the ETag of a record is kept in memory */
+		if (!disk->etag)
+			return IST_NULL;
+		memcpy(b_orig(buf), disk->etag, entry->etag_length);
+	}
+	else if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry), (unsigned char *)b_orig(buf),
+	                            entry->etag_offset, entry->etag_length) != 0)
+		return IST_NULL;
+
+	return ist2(b_orig(buf), entry->etag_length);
+}
+
 /* Looks for "If-None-Match" headers in the request and compares their value
  * with the one that might have been stored in the cache_entry. If any of them
  * matches, a "304 Not Modified" response should be sent instead of the cached
@@ -2031,7 +3679,7 @@ int sha1_hosturi(struct stream *s)
  * Returns 1 if "304 Not Modified" should be sent, 0 otherwise.
  */
 static int should_send_notmodified_response(struct cache *cache, struct htx *htx,
-                                            struct cache_entry *entry)
+                                            struct cache_entry *entry, struct cache_disk_entry *disk)
 {
 	int retval = 0;
 
@@ -2063,11 +3711,8 @@ static int should_send_notmodified_response(struct cache *cache, struct htx *htx
 		if (etag_buffer == NULL) {
 			etag_buffer = get_trash_chunk();
 
-			if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
-					       (unsigned char*)b_orig(etag_buffer),
-					       entry->etag_offset, entry->etag_length) == 0) {
-				cache_entry_etag = ist2(b_orig(etag_buffer), entry->etag_length);
-			} else {
+			cache_entry_etag = cache_entry_get_etag(cache, entry, disk, etag_buffer);
+			if (!isttest(cache_entry_etag)) {
 				/* We could not rebuild the ETag in one go, we
 				 * won't send a "304 Not Modified" response. */
 				break;
@@ -2100,6 +3745,172 @@ static int should_send_notmodified_response(struct cache *cache, struct htx *htx
 	return retval;
 }
 
+/* Parses the decimal number at the beginning of <v>, saturating it, and skips
+ * it. Returns 0 if <v> does not start with a digit.
+ */
+static int cache_parse_range_num(struct ist *v, unsigned long long *ret)
+{
+	unsigned long long n = 0;
+	size_t i;
+
+	for (i = 0; i < istlen(*v) && isdigit((unsigned char)v->ptr[i]); i++)
+		n = (n > (ULLONG_MAX - 9) / 10) ? ULLONG_MAX : n * 10 + v->ptr[i] - '0';
+	if (!i)
+		return 0;
+	*v = istadv(*v, i);
+	*ret = n;
+	return 1;
+}
+
+/* Returns non-zero if the validator <value> of an "If-Range" header matches
+ * <entry>, which requires a strong comparison for ETags (see RFC 9110#13.1.5).
+ * <disk> is the entry's record if it is sent from the disk tier.
+ */
+static int cache_if_range_match(struct cache *cache, struct cache_entry *entry,
+                                struct cache_disk_entry *disk, struct ist value)
+{
+	struct ist etag;
+	struct tm tm = {};
+
+	switch (http_get_etag_type(value)) {
+	case ETAG_STRONG:
+		if (!entry->etag_length)
+			return 0;
+		etag = cache_entry_get_etag(cache, entry, disk, get_trash_chunk());
+		return isttest(etag) && http_get_etag_type(etag) == ETAG_STRONG && isteq(etag, value);
+	case ETAG_WEAK:
+		return 0;
+	default:
+		if (!parse_http_date(istptr(value), istlen(value), &tm))
+			return 0;
+		return my_timegm(&tm) == entry->last_modified;
+	}
+}
+
+/* Looks for a "Range" header in GET request <htx> which would apply to the
+ * cached <entry>, <disk> being the entry's record if it is sent from the disk
+ * tier. Only a single range of bytes is supported, other requests are served
+ * the whole object as permitted by RFC 9110#14.2. If a range must be sent, it
+ * is set in <ctx>, with a null length if it is not satisfiable, and 1 is
+ * returned. Otherwise 0 is returned.
+ */
+static int cache_parse_range(struct cache *cache, struct htx *htx, struct cache_entry *entry,
+                             struct cache_disk_entry *disk, struct cache_appctx *ctx)
+{
+	struct http_hdr_ctx hdr = { .blk = NULL };
+	unsigned long long first, last;
+	unsigned int size = entry->body_size;
+	struct ist v;
+
+	if (!http_find_header(htx, ist("Range"), &hdr, 1))
+		return 0;
+	v = hdr.value;
+	if (http_find_header(htx, ist("Range"), &hdr, 1))
+		return 0;
+
+	if (!istmatchi(v, ist("bytes=")) || istchr(v, ','))
+		return 0;
+
+	/* the range is ignored if the representation changed */
+	hdr.blk = NULL;
+	if (http_find_header(htx, ist("If-Range"), &hdr, 1) &&
+	    !cache_if_range_match(cache, entry, disk, hdr.value))
+		return 0;
+
+	v = http_trim_trailing_spht(http_trim_leading_spht(istadv(v, 6)));
+
+	if (istlen(v) && *istptr(v) == '-') {
+		/* suffix range */
+		v = istnext(v);
+		if (!cache_parse_range_num(&v, &last) || istlen(v))
+			return 0;
+		if (!last || !size)
+			goto not_satisfiable;
+		first = (last >= size) ? 0 : size - last;
+		last = size - 1;
+	}
+	else {
+		if (!cache_parse_range_num(&v, &first) || !istlen(v) || *istptr(v) != '-')
+			return 0;
+		v = istnext(v);
+		if (!istlen(v))
+			last = ULLONG_MAX;
+		else if (!cache_parse_range_num(&v, &last) || istlen(v) || last < first)
+			return 0;
+		if (first >= size)
+			goto not_satisfiable;
+		if (last >= size)
+			last = size - 1;
+	}
+
+	ctx->range_first = first;
+	ctx->range_len = last - first + 1;
+	return 1;
+
+  not_satisfiable:
+	ctx->range_first = 0;
+	ctx->range_len = 0;
+	return 1;
+}
+
+/* Returns non-zero if the expired <entry> may be served to stream <s>. This is
+ * the case during its stale-if-error period if the backend has no usable
+ * server, or during its stale-while-revalidate period if another request is
+ * already refreshing it. Otherwise <s> may become the request refreshing it.
+ * Errors met once the request was forwarded (5xx, connection failures) never
+ * lead to the stale object being served since it is only decided here.
+ */
+static int cache_use_stale(struct cache *cache, struct cache_tree *tree,
+                           struct stream *s, struct cache_entry *entry)
+{
+	if (date.tv_sec < entry->expire + entry->stale_if_error &&
+	    (s->be->cap & PR_CAP_BE) && !be_usable_srv(s->be))
+		return 1;
+
+	if (date.tv_sec < entry->expire + entry->stale_revalidate &&
+	    !(s->txn->flags & TX_CACHE_FETCH) &&
+	    cache_fetch_start(cache, tree, s, NULL) == CACHE_FETCH_WAIT)
+		return 1;
+
+	return 0;
+}
+
+/* Returns non-zero if the range request of stream <s>, which was not found in
+ * <cache>, may be turned into a full request so that the whole object is
+ * stored through filter <cconf>, whose context is <st>. This is only done if the
+ * object may be stored: there must be a cache-store rule for this cache, the
+ * requested range must not start beyond the largest storable object, the
+ * request must be the one fetching the object and the last fetch of this
+ * object must not have been found uncacheable.
+ */
+static int cache_range_fill_allowed(struct cache *cache, struct cache_tree *tree,
+                                    struct stream *s, struct cache_flt_conf *cconf,
+                                    struct cache_st *st)
+{
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct http_hdr_ctx hdr = { .blk = NULL };
+	unsigned long long first;
+	unsigned int maxsz = cache->maxobjsz;
+	struct ist v;
+
+	if (!st || !(cconf->flags & CACHE_FLT_F_STORE) ||
+	    !http_find_header(htx, ist("Range"), &hdr, 1))
+		return 0;
+
+	if (cache->disk && cache->disk_maxobjsz > maxsz)
+		maxsz = cache->disk_maxobjsz;
+
+	v = hdr.value;
+	if (istmatchi(v, ist("bytes="))) {
+		v = http_trim_leading_spht(istadv(v, 6));
+		if (cache_parse_range_num(&v, &first) && first >= maxsz)
+			return 0;
+	}
+
+	return (s->txn->flags & TX_CACHE_FETCH) ||
+	       cache_fetch_start(cache, tree, s, NULL) == CACHE_FETCH_OWN;
+}
+
 enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *px,
                                          struct session *sess, struct stream *s, int flags)
 {
@@ -2110,6 +3921,10 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	struct cache *cache = cconf->c.cache;
 	struct shared_context *shctx = shctx_ptr(cache);
 	struct shared_block *entry_block;
+	struct cache_disk_entry *disk;
+	struct cache_st *st = NULL;
+	struct filter *filter;
+	int pending = 0;
 
 	struct cache_tree *cache_tree = NULL;
 
@@ -2131,10 +3946,13 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	if (s->txn->flags & TX_CACHE_IGNORE)
 		return ACT_RET_CONT;
 
-	if (px == strm_fe(s))
-		_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_lookups);
+	/* the lookup is only accounted for once if it has to wait */
+	if (!(flags & ACT_OPT_FIRST))
+		;
+	else if (px == strm_fe(s))
+		_HA_ATOMIC_INC(&px->fe_counters.shared.shard[ti->ctr_shard]->p.http.cache_lookups);
 	else
-		_HA_ATOMIC_INC(&px->be_counters.p.http.cache_lookups);
+		_HA_ATOMIC_INC(&px->be_counters.shared.shard[ti->ctr_shard]->p.http.cache_lookups);
 
 	cache_tree = get_cache_tree_from_hash(cache, read_u32(s->txn->cache_hash));
 
@@ -2153,15 +3971,17 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		retain_entry(res);
 
 		entry_block = block_ptr(res);
-		shctx_wrlock(shctx);
+		shctx_row_wrlock(shctx, entry_block);
 		if (res->complete) {
 			shctx_row_detach(shctx, entry_block);
 			detached = 1;
 		} else {
+			/* the object is being stored by another request */
 			release_entry(cache_tree, res, 0);
 			res = NULL;
+			pending = 1;
 		}
-		shctx_wrunlock(shctx);
+		shctx_row_wrunlock(shctx, entry_block);
 		cache_rdunlock(cache_tree);
 
 		/* In case of Vary, we could have multiple entries with the same
@@ -2176,12 +3996,15 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 					/* The wrong row was added to the hot list. */
 					release_entry(cache_tree, res, 0);
 					retain_entry(sec_entry);
-					shctx_wrlock(shctx);
-					if (detached)
+					if (detached) {
+						shctx_row_wrlock(shctx, entry_block);
 						shctx_row_reattach(shctx, entry_block);
+						shctx_row_wrunlock(shctx, entry_block);
+					}
 					entry_block = block_ptr(sec_entry);
+					shctx_row_wrlock(shctx, entry_block);
 					shctx_row_detach(shctx, entry_block);
-					shctx_wrunlock(shctx);
+					shctx_row_wrunlock(shctx, entry_block);
 				}
 				res = sec_entry;
 				cache_rdunlock(cache_tree);
@@ -2190,9 +4013,9 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 				release_entry(cache_tree, res, 1);
 
 				res = NULL;
-				shctx_wrlock(shctx);
+				shctx_row_wrlock(shctx, entry_block);
 				shctx_row_reattach(shctx, entry_block);
-				shctx_wrunlock(shctx);
+				shctx_row_wrunlock(shctx, entry_block);
 			}
 		}
 
@@ -2201,10 +4024,40 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		 * can't use the cache's entry and must forward the request to
 		 * the server. */
 		if (!res) {
-			return ACT_RET_CONT;
+			if (!pending)
+				return ACT_RET_CONT;
+			goto miss;
 		} else if (!res->complete) {
+			/* the object is being stored by another request */
 			release_entry(cache_tree, res, 1);
-			return ACT_RET_CONT;
+			res = NULL;
+			pending = 1;
+			goto miss;
+		}
+
+		/* An identity variant stored because the compression was
+		 * limited is not delivered to a client which may now get a
+		 * compressed one, the request is forwarded to store it.
+		 */
+		if (res->compressible && cache_comp_wanted(s)) {
+			release_entry(cache_tree, res, 1);
+			res = NULL;
+			shctx_row_wrlock(shctx, entry_block);
+			shctx_row_reattach(shctx, entry_block);
+			shctx_row_wrunlock(shctx, entry_block);
+			goto miss;
+		}
+
+		/* An expired entry may only be served under some conditions,
+		 * otherwise the request is forwarded to refresh it.
+		 */
+		if (res->expire <= date.tv_sec && !cache_use_stale(cache, cache_tree, s, res)) {
+			release_entry(cache_tree, res, 1);
+			res = NULL;
+			shctx_row_wrlock(shctx, entry_block);
+			shctx_row_reattach(shctx, entry_block);
+			shctx_row_wrunlock(shctx, entry_block);
+			goto miss;
 		}
 
 		s->target = &http_cache_applet.obj_type;
@@ -2215,27 +4068,112 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 			appctx->rule = rule;
 			ctx->cache_tree = cache_tree;
 			ctx->entry = res;
+			ctx->disk = NULL;
+			ctx->disk_error = 0;
 			ctx->next = NULL;
 			ctx->sent = 0;
 			ctx->send_notmodified =
-                                should_send_notmodified_response(cache, htxbuf(&s->req.buf), res);
+                                should_send_notmodified_response(cache, htxbuf(&s->req.buf), res, NULL);
+			ctx->range = !ctx->send_notmodified && txn->meth == HTTP_METH_GET &&
+				cache_parse_range(cache, htxbuf(&s->req.buf), res, NULL, ctx);
 
 			if (px == strm_fe(s))
-				_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
+				_HA_ATOMIC_INC(&px->fe_counters.shared.shard[ti->ctr_shard]->p.http.cache_hits);
 			else
-				_HA_ATOMIC_INC(&px->be_counters.p.http.cache_hits);
+				_HA_ATOMIC_INC(&px->be_counters.shared.shard[ti->ctr_shard]->p.http.cache_hits);
+			_HA_ATOMIC_INC(&cache->mem_hits);
 			return ACT_RET_CONT;
 		} else {
 			s->target = NULL;
 			release_entry(cache_tree, res, 1);
-			shctx_wrlock(shctx);
+			shctx_row_wrlock(shctx, entry_block);
 			shctx_row_reattach(shctx, entry_block);
-			shctx_wrunlock(shctx);
+			shctx_row_wrunlock(shctx, entry_block);
 			return ACT_RET_CONT;
 		}
 	}
 	cache_rdunlock(cache_tree);
 
+	/* Look for the object in the disk tier. It is sent from the disk, and
+	 * moved back to the memory tier in the background if it fits there.
+	 */
+	if (cache->disk && (disk = cache_disk_get(cache, s->txn->cache_hash))) {
+		struct appctx *appctx;
+
+		if (disk->len <= shctx->max_obj_size)
+			cache_disk_start_promote(cache, disk);
+
+		s->target = &http_cache_applet.obj_type;
+		if ((appctx = sc_applet_create(s->scb, objt_applet(s->target)))) {
+			struct cache_appctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+
+			appctx->st0 = HTX_CACHE_INIT;
+			appctx->rule = rule;
+			ctx->cache_tree = cache_tree;
+			ctx->entry = &disk->hdr;
+			ctx->disk = disk;
+			ctx->io = NULL;
+			ctx->skip = 0;
+			ctx->disk_error = 0;
+			ctx->next = NULL;
+			ctx->sent = 0;
+			ctx->send_notmodified =
+				should_send_notmodified_response(cache, htxbuf(&s->req.buf), &disk->hdr, disk);
+			ctx->range = !ctx->send_notmodified && txn->meth == HTTP_METH_GET &&
+				cache_parse_range(cache, htxbuf(&s->req.buf), &disk->hdr, disk, ctx);
+
+			if (px == strm_fe(s))
+				_HA_ATOMIC_INC(&px->fe_counters.shared.shard[ti->ctr_shard]->p.http.cache_hits);
+			else
+				_HA_ATOMIC_INC(&px->be_counters.shared.shard[ti->ctr_shard]->p.http.cache_hits);
+			_HA_ATOMIC_INC(&cache->disk_hits);
+			return ACT_RET_CONT;
+		}
+		s->target = NULL;
+		cache_disk_release(disk);
+		return ACT_RET_CONT;
+	}
+
+  miss:
+	list_for_each_entry(filter, &s->strm_flt.filters, list) {
+		if (FLT_ID(filter) == cache_store_flt_id && FLT_CONF(filter) == cconf) {
+			st = filter->ctx;
+			break;
+		}
+	}
+
+	/* Unless this request is the one fetching the object, it waits while
+	 * the object is being fetched or stored by another one. It is queued
+	 * on the fetch to be woken up once it ends, or when collapse-timeout
+	 * strikes.
+	 */
+	if (cache->collapse_timeout && !(txn->flags & TX_CACHE_FETCH)) {
+		if (cache_fetch_start(cache, cache_tree, s, st) == CACHE_FETCH_WAIT) {
+			if (!tick_isset(txn->cache_wait_exp))
+				txn->cache_wait_exp = tick_add(now_ms, MS_TO_TICKS(cache->collapse_timeout));
+			if (st && !(flags & ACT_OPT_FINAL) && !tick_is_expired(txn->cache_wait_exp, now_ms)) {
+				s->req.analyse_exp = txn->cache_wait_exp;
+				return ACT_RET_YIELD;
+			}
+			cache_fetch_unwait(cache_tree, st);
+		}
+	}
+
+	/* On a miss, a range request is turned into a full one so that the
+	 * whole object may be stored and serve the next range requests.
+	 */
+	if (!res && cache->range_fill_enabled && txn->meth == HTTP_METH_GET &&
+	    cache_range_fill_allowed(cache, cache_tree, s, cconf, st)) {
+		struct htx *htx = htxbuf(&s->req.buf);
+		struct http_hdr_ctx hdr = { .blk = NULL };
+
+		while (http_find_header(htx, ist("Range"), &hdr, 1))
+			http_remove_header(htx, &hdr);
+		hdr.blk = NULL;
+		while (http_find_header(htx, ist("If-Range"), &hdr, 1))
+			http_remove_header(htx, &hdr);
+	}
+
 	/* Shared context does not need to be locked while we calculate the
 	 * secondary hash. */
 	if (!res && cache->vary_processing_enabled) {
@@ -2392,6 +4330,74 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 				   file, linenum, args[0]);
 			err_code |= ERR_WARN;
 		}
+	} else if (strcmp(args[0], "range-fill") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (strcmp(args[1], "on") == 0)
+			tmp_cache_config->range_fill_enabled = 1;
+		else if (strcmp(args[1], "off") == 0)
+			tmp_cache_config->range_fill_enabled = 0;
+		else {
+			ha_warning("parsing [%s:%d]: '%s' expects \"on\" or \"off\" (enable or disable range fill).\n",
+				   file, linenum, args[0]);
+			err_code |= ERR_WARN;
+		}
+	} else if (strcmp(args[0], "max-stale") == 0) {
+		unsigned long int maxstale;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		maxstale = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || maxstale >= CACHE_ENTRY_MAX_AGE) {
+			ha_warning("parsing [%s:%d]: max-stale wrong value '%s'\n",
+			           file, linenum, args[1]);
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->max_stale = maxstale;
+	} else if (strcmp(args[0], "collapse-timeout") == 0) {
+		const char *res;
+		unsigned int timeout;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a delay in milliseconds.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &timeout, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d]: unsupported character '%c' in '%s' (wants an integer delay).\n",
+			         file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		tmp_cache_config->collapse_timeout = timeout;
 	} else if (strcmp(args[0], "max-secondary-entries") == 0) {
 		unsigned int max_sec_entries;
 		char *err;
@@ -2415,6 +4421,69 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 		tmp_cache_config->max_secondary_entries = max_sec_entries;
+	} else if (strcmp(args[0], "disk-file") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a file path.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		free(tmp_cache_config->disk_file);
+		tmp_cache_config->disk_file = strdup(args[1]);
+		if (!tmp_cache_config->disk_file) {
+			ha_alert("parsing [%s:%d]: out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+	} else if (strcmp(args[0], "disk-max-size") == 0) {
+		unsigned long int maxsize;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		maxsize = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || !maxsize) {
+			ha_warning("parsing [%s:%d]: disk-max-size wrong value '%s'\n",
+			           file, linenum, args[1]);
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		/* size in megabytes */
+		tmp_cache_config->disk_size = (unsigned long long)maxsize << 20;
+	} else if (strcmp(args[0], "disk-max-object-size") == 0) {
+		unsigned long int maxobjsz;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		maxobjsz = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || !maxobjsz) {
+			ha_warning("parsing [%s:%d]: disk-max-object-size wrong value '%s'\n",
+			           file, linenum, args[1]);
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (maxobjsz > CACHE_DISK_MAX_OBJSZ) {
+			ha_warning("parsing [%s:%d]: \"disk-max-object-size\" (%s) must not be greater than %u\n",
+			           file, linenum, args[1], CACHE_DISK_MAX_OBJSZ);
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->disk_maxobjsz = maxobjsz;
 	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in 'cache' section\n", file, linenum, args[0]);
@@ -2450,6 +4519,32 @@ int cfg_post_parse_section_cache()
 			goto out;
 		}
 
+		if (tmp_cache_config->disk_file) {
+			if (!tmp_cache_config->disk_size) {
+				/* Default disk size is 8 times the cache size. */
+				tmp_cache_config->disk_size =
+					(unsigned long long)tmp_cache_config->maxblocks * CACHE_BLOCKSIZE * 8;
+			}
+
+			if (!tmp_cache_config->disk_maxobjsz) {
+				/* Default max. file size is a 256th of the disk size,
+				 * and at least the memory one.
+				 */
+				tmp_cache_config->disk_maxobjsz =
+					MIN(MAX(tmp_cache_config->disk_size >> 8, tmp_cache_config->maxobjsz),
+					    CACHE_DISK_MAX_OBJSZ);
+			}
+			if (tmp_cache_config->disk_maxobjsz > tmp_cache_config->disk_size / 2) {
+				ha_alert("\"disk-max-object-size\" is limited to an half of \"disk-max-size\" => %llu\n", tmp_cache_config->disk_size / 2);
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+		}
+		else if (tmp_cache_config->disk_size || tmp_cache_config->disk_maxobjsz) {
+			ha_warning("\"disk-max-size\" and \"disk-max-object-size\" are ignored without \"disk-file\" in cache '%s'\n", tmp_cache_config->id);
+			err_code |= ERR_WARN;
+		}
+
 		/* add to the list of cache to init and reinit tmp_cache_config
 		 * for next cache section, if any.
 		 */
@@ -2458,6 +4553,8 @@ int cfg_post_parse_section_cache()
 		return err_code;
 	}
 out:
+	if (tmp_cache_config)
+		ha_free(&tmp_cache_config->disk_file);
 	ha_free(&tmp_cache_config);
 	return err_code;
 
@@ -2475,7 +4572,8 @@ int post_check_cache()
 	list_for_each_entry_safe(cache_config, back, &caches_config, list) {
 
 		ret_shctx = shctx_init(&shctx, cache_config->maxblocks, CACHE_BLOCKSIZE,
-		                       cache_config->maxobjsz, sizeof(struct cache), cache_config->id);
+		                       cache_config->maxobjsz, sizeof(struct cache), global.nbtgroups,
+		                       cache_config->id);
 
 		if (ret_shctx <= 0) {
 			if (ret_shctx == SHCTX_E_INIT_LOCK)
@@ -2499,12 +4597,50 @@ int post_check_cache()
 		free(cache_config);
 		for (i = 0; i < CACHE_TREE_NUM; ++i) {
 			cache->trees[i].entries = EB_ROOT;
+			cache->trees[i].fetches = EB_ROOT;
 			HA_RWLOCK_INIT(&cache->trees[i].lock);
 
 			LIST_INIT(&cache->trees[i].cleanup_list);
 			HA_SPIN_INIT(&cache->trees[i].cleanup_lock);
 		}
 
+		if (cache->disk_file) {
+			struct cache_disk *disk;
+
+			disk = calloc(1, sizeof(*disk));
+			if (!disk) {
+				ha_alert("Unable to allocate the disk tier of cache '%s'.\n", cache->id);
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+
+			/* The file is removed once open so that it is never
+			 * shared with another process, e.g. after a reload. Its
+			 * contents are lost anyway when the process stops.
+			 */
+			disk->fd = open(cache->disk_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+			if (disk->fd < 0 || unlink(cache->disk_file) < 0 ||
+			    ftruncate(disk->fd, cache->disk_size) < 0) {
+				ha_alert("Unable to create the disk file '%s' of cache '%s' (%s).\n",
+				         cache->disk_file, cache->id, strerror(errno));
+				if (disk->fd >= 0)
+					close(disk->fd);
+				free(disk);
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+
+			HA_RWLOCK_INIT(&disk->lock);
+			disk->entries = EB_ROOT;
+			LIST_INIT(&disk->fifo);
+#ifdef USE_THREAD
+			pthread_mutex_init(&disk->io_lock, NULL);
+			pthread_cond_init(&disk->io_cond, NULL);
+			LIST_INIT(&disk->io_queue);
+#endif
+			cache->disk = disk;
+		}
+
 		/* Find all references for this cache in the existing filters
 		 * (over all proxies) and reference it in matching filters.
 		 */
@@ -2996,8 +5132,17 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 		next_key = ctx->next_key;
 		if (!next_key) {
 			shctx_rdlock(shctx);
-			chunk_printf(buf, "%p: %s (shctx:%p, available blocks:%d)\n", cache, cache->id, shctx_ptr(cache), shctx_ptr(cache)->nbav);
+			chunk_printf(buf, "%p: %s (shctx:%p, available blocks:%d)\n", cache, cache->id, shctx_ptr(cache), shctx_avail(shctx));
 			shctx_rdunlock(shctx);
+			chunk_appendf(buf, "  hits: memory:%llu disk:%llu\n",
+			              HA_ATOMIC_LOAD(&cache->mem_hits), HA_ATOMIC_LOAD(&cache->disk_hits));
+			if (cache->disk) {
+				HA_RWLOCK_RDLOCK(CACHE_LOCK, &cache->disk->lock);
+				chunk_appendf(buf, "  disk: %s (objects:%u, used:%llu/%llu bytes)\n",
+				              cache->disk_file, cache->disk->objects,
+				              (unsigned long long)cache->disk->used, cache->disk_size);
+				HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &cache->disk->lock);
+			}
 			if (applet_putchk(appctx, buf) == -1) {
 				goto yield;
 			}
@@ -3024,7 +5169,7 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 				entry = container_of(node, struct cache_entry, eb);
 				next_key = node->key + 1;
 
-				if (entry->expire > date.tv_sec) {
+				if (entry_stale_end(entry) > date.tv_sec) {
 					chunk_printf(buf, "%p hash:%u vary:0x", entry, read_u32(entry->hash));
 					for (i = 0; i < HTTP_CACHE_SEC_KEY_LEN; ++i)
 						chunk_appendf(buf, "%02x", (unsigned char)entry->secondary_key[i]);
@@ -3100,6 +5245,59 @@ smp_fetch_res_cache_name(const struct arg *args, struct sample *smp,
 }
 
 
+#ifdef USE_THREAD
+/* Starts the I/O threads of the disk tiers, once in the worker process */
+static int cache_disk_start_threads()
+{
+	struct cache *cache;
+	sigset_t blocked_sig, old_sig;
+	int ret = 1;
+
+	if (tid != 0)
+		return 1;
+
+	/* the signals are only handled by the haproxy threads */
+	sigfillset(&blocked_sig);
+	pthread_sigmask(SIG_SETMASK, &blocked_sig, &old_sig);
+
+	list_for_each_entry(cache, &caches, list) {
+		if (!cache->disk)
+			continue;
+		if (pthread_create(&cache->disk->io_thread, NULL, cache_disk_io_thread, cache->disk) != 0) {
+			ha_alert("Unable to start the disk I/O thread of cache '%s'.\n", cache->id);
+			ret = 0;
+			break;
+		}
+		cache->disk->io_running = 1;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_sig, NULL);
+	return ret;
+}
+
+/* Stops the I/O threads of the disk tiers. The requests still queued are
+ * dropped.
+ */
+static void cache_disk_stop_threads()
+{
+	struct cache *cache;
+
+	list_for_each_entry(cache, &caches, list) {
+		if (!cache->disk || !cache->disk->io_running)
+			continue;
+		pthread_mutex_lock(&cache->disk->io_lock);
+		cache->disk->io_stop = 1;
+		pthread_cond_signal(&cache->disk->io_cond);
+		pthread_mutex_unlock(&cache->disk->io_lock);
+		pthread_join(cache->disk->io_thread, NULL);
+		cache->disk->io_running = 0;
+	}
+}
+
+REGISTER_PER_THREAD_INIT(cache_disk_start_threads);
+REGISTER_POST_DEINIT(cache_disk_stop_threads);
+#endif
+
 /* early boot initialization */
 static void cache_init()
 {
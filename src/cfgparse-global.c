@@ -1102,6 +1102,9 @@ static int cfg_parse_global_disable_poller(char **args, int section_type,
 	if (strcmp(args[0], "noepoll") == 0) {
 		global.tune.options &= ~GTUNE_USE_EPOLL;
 
+	} else if (strcmp(args[0], "nouring") == 0) {
+		global.tune.options &= ~GTUNE_USE_URING;
+
 	} else if (strcmp(args[0], "nokqueue") == 0) {
 		global.tune.options &= ~GTUNE_USE_KQUEUE;
 
@@ -1407,6 +1410,17 @@ static int cfg_parse_global_tune_opts(char **args, int section_type,
 			return -1;
 		}
 	}
+	else if (strcmp(args[0], "tune.pattern.ip-lpm-threshold") == 0) {
+		if (*(args[1]) == 0) {
+			memprintf(err, "'%s' expects a positive numeric value", args[0]);
+			return -1;
+		}
+		global.tune.pattern_lpm = atoi(args[1]);
+		if (global.tune.pattern_lpm < 0) {
+			memprintf(err, "'%s' expects a positive numeric value", args[0]);
+			return -1;
+		}
+	}
 	else {
 		BUG_ON(1, "Triggered in cfg_parse_global_tune_opts() by unsupported keyword.\n");
 		return -1;
@@ -1471,6 +1485,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "quiet", cfg_parse_global_mode },
 	{ CFG_GLOBAL, "zero-warning", cfg_parse_global_mode },
 	{ CFG_GLOBAL, "noepoll", cfg_parse_global_disable_poller },
+	{ CFG_GLOBAL, "nouring", cfg_parse_global_disable_poller },
 	{ CFG_GLOBAL, "nokqueue", cfg_parse_global_disable_poller },
 	{ CFG_GLOBAL, "noevports", cfg_parse_global_disable_poller },
 	{ CFG_GLOBAL, "nopoll", cfg_parse_global_disable_poller },
@@ -1494,6 +1509,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.http.maxhdr", cfg_parse_global_tune_opts },
 	{ CFG_GLOBAL, "tune.comp.maxlevel", cfg_parse_global_tune_opts },
 	{ CFG_GLOBAL, "tune.pattern.cache-size", cfg_parse_global_tune_opts },
+	{ CFG_GLOBAL, "tune.pattern.ip-lpm-threshold", cfg_parse_global_tune_opts },
 	{ CFG_GLOBAL, "tune.disable-fast-forward", cfg_parse_global_tune_forward_opts },
 	{ CFG_GLOBAL, "tune.disable-zero-copy-forwarding", cfg_parse_global_tune_forward_opts },
 	{ CFG_GLOBAL, "tune.chksize", cfg_parse_global_unsupported_opts },
@@ -18,6 +18,7 @@
 #define QUIC_CC_NEWRENO_STR "newreno"
 #define QUIC_CC_CUBIC_STR   "cubic"
 #define QUIC_CC_NO_CC_STR   "nocc"
+#define QUIC_CC_BBR_STR     "bbr"
 
 static int bind_parse_quic_force_retry(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -105,6 +106,18 @@ static int bind_parse_quic_cc_algo(char **args, int cur_arg, struct proxy *px,
 		cc_algo = &quic_cc_algo_nocc;
 		arg += strlen(QUIC_CC_NO_CC_STR);
 	}
+	else if (strncmp(arg, QUIC_CC_BBR_STR, strlen(QUIC_CC_BBR_STR)) == 0) {
+		/* bbr */
+		if (!experimental_directives_allowed) {
+			ha_alert("'%s' algo is experimental, must be allowed via a global "
+			         "'expose-experimental-directives'\n", arg);
+			goto fail;
+		}
+
+		algo = QUIC_CC_BBR_STR;
+		cc_algo = &quic_cc_algo_bbr;
+		arg += strlen(QUIC_CC_BBR_STR);
+	}
 	else {
 		memprintf(err, "'%s' : unknown control congestion algorithm", args[cur_arg + 1]);
 		goto fail;
@@ -297,6 +310,15 @@ static int cfg_parse_quic_tune_setting(char **args, int section_type,
 	}
 	else if (strcmp(suffix, "retry-threshold") == 0)
 		global.tune.quic_retry_threshold = arg;
+	else if (strcmp(suffix, "rx-batch") == 0) {
+		if (arg > QUIC_MAX_RX_BATCH) {
+			memprintf(err, "'%s' expects an integer argument between 1 and %d.",
+			          args[0], QUIC_MAX_RX_BATCH);
+			return -1;
+		}
+
+		global.tune.quic_rx_batch = arg;
+	}
 	else {
 		memprintf(err, "'%s' keyword not unhandled (please report this bug).", args[0]);
 		return -1;
@@ -379,6 +401,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.quic.max-frame-loss", cfg_parse_quic_tune_setting },
 	{ CFG_GLOBAL, "tune.quic.reorder-ratio", cfg_parse_quic_tune_setting },
 	{ CFG_GLOBAL, "tune.quic.retry-threshold", cfg_parse_quic_tune_setting },
+	{ CFG_GLOBAL, "tune.quic.rx-batch", cfg_parse_quic_tune_setting },
 	{ CFG_GLOBAL, "tune.quic.disable-udp-gso", cfg_parse_quic_tune_setting0 },
 	{ CFG_GLOBAL, "tune.quic.zero-copy-fwd-send", cfg_parse_quic_tune_on_off },
 	{ 0, NULL, NULL }
@@ -53,6 +53,7 @@
 #include <haproxy/cpuset.h>
 #endif
 #include <haproxy/connection.h>
+#include <haproxy/counters.h>
 #include <haproxy/errors.h>
 #include <haproxy/filters.h>
 #include <haproxy/frontend.h>
@@ -4325,6 +4326,14 @@ int check_config_validity()
 			/* enable separate counters */
 			if (curproxy->options2 & PR_O2_SOCKSTAT) {
 				listener->counters = calloc(1, sizeof(*listener->counters));
+				if (listener->counters) {
+					counters_fe_shared_init(&listener->counters->shared);
+					if (!counters_fe_shared_prepare(&listener->counters->shared)) {
+						ha_alert("Proxy '%s': out of memory while allocating counters for listener '%s'.\n",
+							 curproxy->id, listener->name ? listener->name : "");
+						cfgerr++;
+					}
+				}
 				if (!listener->name)
 					memprintf(&listener->name, "sock-%d", listener->luid);
 			}
@@ -4362,6 +4371,22 @@ int check_config_validity()
 				bind_conf->xprt->destroy_bind_conf(bind_conf);
 		}
 
+		/* give threads their own copies of the cumulated counters */
+		if (!counters_fe_shared_prepare(&curproxy->fe_counters.shared) ||
+		    !counters_be_shared_prepare(&curproxy->be_counters.shared)) {
+			ha_alert("Proxy '%s': out of memory while allocating sharded counters.\n",
+				 curproxy->id);
+			cfgerr++;
+		}
+
+		for (newsrv = curproxy->srv; newsrv; newsrv = newsrv->next) {
+			if (!counters_be_shared_prepare(&newsrv->counters.shared)) {
+				ha_alert("Proxy '%s': out of memory while allocating sharded counters for server '%s'.\n",
+					 curproxy->id, newsrv->id);
+				cfgerr++;
+			}
+		}
+
 		/* create the task associated with the proxy */
 		curproxy->task = task_new_anywhere();
 		if (curproxy->task) {
@@ -514,7 +514,7 @@ void set_server_check_status(struct check *check, short status, const char *desc
 		if ((!(check->state & CHK_ST_AGENT) ||
 		    (check->status >= HCHK_STATUS_L57DATA)) &&
 		    (check->health > 0)) {
-			_HA_ATOMIC_INC(&s->counters.failed_checks);
+			_HA_ATOMIC_INC(&s->counters.shared.shard[ti->ctr_shard]->failed_checks);
 			report = 1;
 			check->health--;
 			if (check->health < check->rise)
@@ -742,7 +742,7 @@ void __health_adjust(struct server *s, short status)
 	HA_SPIN_UNLOCK(SERVER_LOCK, &s->lock);
 
 	HA_ATOMIC_STORE(&s->consecutive_errors, 0);
-	_HA_ATOMIC_INC(&s->counters.failed_hana);
+	_HA_ATOMIC_INC(&s->counters.shared.shard[ti->ctr_shard]->failed_hana);
 
 	if (s->check.fastinter) {
 		/* timer might need to be advanced, it might also already be
@@ -90,6 +90,32 @@ static int deflate_end(struct comp_ctx **comp_ctx);
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_BROTLI)
+
+static int brotli_init(struct comp_ctx **comp_ctx, int level);
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_BROTLI */
+
+#if defined(USE_ZSTD)
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level);
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_ZSTD */
+
+/* Window sizes (log2) of the brotli and zstd encoders. They are kept small so
+ * that a compressed stream does not require more than a few hundreds of kB.
+ */
+#define COMP_BROTLI_LGWIN  18
+#define COMP_ZSTD_WLOG     18
+
 
 const struct comp_algo comp_algos[] =
 {
@@ -103,6 +129,12 @@ const struct comp_algo comp_algos[] =
 	{ "raw-deflate", 11, "deflate",  7, raw_def_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 	{ "gzip",         4, "gzip",     4, gzip_init,     deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 #endif /* USE_ZLIB */
+#if defined(USE_BROTLI)
+	{ "br",           2, "br",       2, brotli_init,   brotli_add_data,   brotli_flush,   brotli_finish,   brotli_end },
+#endif
+#if defined(USE_ZSTD)
+	{ "zstd",         4, "zstd",     4, zstd_init,     zstd_add_data,     zstd_flush,     zstd_finish,     zstd_end },
+#endif
 	{ NULL,       0, NULL,          0, NULL ,         NULL,              NULL,           NULL,           NULL }
 };
 
@@ -148,7 +180,7 @@ int comp_append_algo(struct comp_algo **algos, const char *algo)
 	return -1;
 }
 
-#if defined(USE_ZLIB) || defined(USE_SLZ)
+#if defined(USE_ZLIB) || defined(USE_SLZ) || defined(USE_BROTLI) || defined(USE_ZSTD)
 DECLARE_STATIC_POOL(pool_comp_ctx, "comp_ctx", sizeof(struct comp_ctx));
 
 /*
@@ -178,6 +210,12 @@ static inline int init_comp_ctx(struct comp_ctx **comp_ctx)
 	strm->zalloc = alloc_zlib;
 	strm->zfree = free_zlib;
 	strm->opaque = *comp_ctx;
+#endif
+#if defined(USE_BROTLI)
+	(*comp_ctx)->br = NULL;
+#endif
+#if defined(USE_ZSTD)
+	(*comp_ctx)->zstd = NULL;
 #endif
 	return 0;
 }
@@ -704,6 +742,220 @@ static int zlib_parse_global_windowsize(char **args, int section_type, struct pr
 #endif /* USE_ZLIB */
 
 
+#if defined(USE_BROTLI) || defined(USE_ZSTD)
+
+/* Returns non-zero if the compression must be made cheaper, because of the
+ * compression rate limit or of the lack of idle CPU.
+ */
+static inline int comp_must_slow_down(void)
+{
+	return ((global.comp_rate_lim > 0 && (read_freq_ctr(&global.comp_bps_out) > global.comp_rate_lim)) ||  /* rate */
+	        (th_ctx->idle_pct < compress_min_idle));                                                         /* idle */
+}
+
+#endif
+
+#if defined(USE_BROTLI)
+
+/**************************
+****  brotli algorithm ****
+***************************/
+
+/* The brotli quality (0 to 11) follows the compression level. It cannot be
+ * changed once the compression started, so it is only adjusted here, and the
+ * lowest non-null one is used if the compression must be made cheaper.
+ * Returns < 0 on error.
+ */
+static int brotli_init(struct comp_ctx **comp_ctx, int level)
+{
+	BrotliEncoderState *br;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	br = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+	if (!br) {
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	if (level < 1 || comp_must_slow_down())
+		level = 1;
+
+	if (!BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, level) ||
+	    !BrotliEncoderSetParameter(br, BROTLI_PARAM_LGWIN, COMP_BROTLI_LGWIN) ||
+	    !BrotliEncoderSetParameter(br, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT)) {
+		BrotliEncoderDestroyInstance(br);
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	(*comp_ctx)->br = br;
+	(*comp_ctx)->cur_lvl = level;
+	return 0;
+}
+
+/* Runs the brotli encoder of <comp_ctx> on <in_len> bytes from <in_data> with
+ * operation <op>, and appends the produced data to <out>. All the input data
+ * must be consumed, and all the output produced in case of flush or finish.
+ * Returns the number of bytes consumed for a process operation, otherwise the
+ * number of bytes emitted, or -1 on error or if there is no more room in <out>.
+ */
+static int brotli_process(struct comp_ctx *comp_ctx, BrotliEncoderOperation op,
+                          const char *in_data, int in_len, struct buffer *out)
+{
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	uint8_t *next_out = (uint8_t *)b_tail(out);
+	size_t avail_in = in_len;
+	size_t avail_out = b_room(out);
+	size_t room = avail_out;
+
+	while (1) {
+		if (!BrotliEncoderCompressStream(comp_ctx->br, op, &avail_in, &next_in,
+		                                 &avail_out, &next_out, NULL))
+			return -1;
+
+		if (!avail_in && !BrotliEncoderHasMoreOutput(comp_ctx->br) &&
+		    (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(comp_ctx->br)))
+			break;
+
+		if (!avail_out)
+			return -1;
+	}
+
+	b_add(out, room - avail_out);
+	return (op == BROTLI_OPERATION_PROCESS) ? in_len : room - avail_out;
+}
+
+/* Return the size of consumed data or -1 */
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	if (in_len <= 0)
+		return 0;
+
+	return brotli_process(comp_ctx, BROTLI_OPERATION_PROCESS, in_data, in_len, out);
+}
+
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_process(comp_ctx, BROTLI_OPERATION_FLUSH, NULL, 0, out);
+}
+
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_process(comp_ctx, BROTLI_OPERATION_FINISH, NULL, 0, out);
+}
+
+static int brotli_end(struct comp_ctx **comp_ctx)
+{
+	if ((*comp_ctx)->br)
+		BrotliEncoderDestroyInstance((*comp_ctx)->br);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+#endif /* USE_BROTLI */
+
+#if defined(USE_ZSTD)
+
+/**************************
+****   zstd algorithm   ****
+***************************/
+
+/* The zstd level follows the compression level, starting at 1 since level 0
+ * means the library's default one. As with brotli, it is not applied in the
+ * middle of a frame by the single-threaded library, so it is only adjusted
+ * here, and the lowest one is used if the compression must be made cheaper.
+ * Returns < 0 on error.
+ */
+static int zstd_init(struct comp_ctx **comp_ctx, int level)
+{
+	ZSTD_CCtx *zstd;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	zstd = ZSTD_createCCtx();
+	if (!zstd) {
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	if (level < 1 || comp_must_slow_down())
+		level = 1;
+
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, level)) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_windowLog, COMP_ZSTD_WLOG))) {
+		ZSTD_freeCCtx(zstd);
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	(*comp_ctx)->zstd = zstd;
+	(*comp_ctx)->cur_lvl = level;
+	return 0;
+}
+
+/* Runs the zstd compressor of <comp_ctx> on <in_len> bytes from <in_data> with
+ * directive <mode>, and appends the produced data to <out>. All the input data
+ * must be consumed, and all the output produced in case of flush or end.
+ * Returns the number of bytes consumed for ZSTD_e_continue, otherwise the
+ * number of bytes emitted, or -1 on error or if there is no more room in <out>.
+ */
+static int zstd_process(struct comp_ctx *comp_ctx, ZSTD_EndDirective mode,
+                        const char *in_data, int in_len, struct buffer *out)
+{
+	ZSTD_inBuffer in = { .src = in_data, .size = in_len, .pos = 0 };
+	ZSTD_outBuffer res = { .dst = b_tail(out), .size = b_room(out), .pos = 0 };
+	size_t ret;
+
+	while (1) {
+		ret = ZSTD_compressStream2(comp_ctx->zstd, &res, &in, mode);
+		if (ZSTD_isError(ret))
+			return -1;
+
+		/* for flush and end, a null value means the output is complete */
+		if (mode == ZSTD_e_continue ? in.pos == in.size : !ret)
+			break;
+
+		if (res.pos == res.size)
+			return -1;
+	}
+
+	b_add(out, res.pos);
+	return (mode == ZSTD_e_continue) ? in.pos : res.pos;
+}
+
+/* Return the size of consumed data or -1 */
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	if (in_len <= 0)
+		return 0;
+
+	return zstd_process(comp_ctx, ZSTD_e_continue, in_data, in_len, out);
+}
+
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_process(comp_ctx, ZSTD_e_flush, NULL, 0, out);
+}
+
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_process(comp_ctx, ZSTD_e_end, NULL, 0, out);
+}
+
+static int zstd_end(struct comp_ctx **comp_ctx)
+{
+	if ((*comp_ctx)->zstd)
+		ZSTD_freeCCtx((*comp_ctx)->zstd);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+#endif /* USE_ZSTD */
+
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 #ifdef USE_ZLIB
@@ -727,6 +979,15 @@ static void comp_register_build_opts(void)
 	memprintf(&ptr, "Built with libslz for stateless compression.");
 #else
 	memprintf(&ptr, "Built without compression support (neither USE_ZLIB nor USE_SLZ are set).");
+#endif
+#ifdef USE_BROTLI
+	memprintf(&ptr, "%s\nRunning on brotli encoder version : %u.%u.%u", ptr,
+	          BrotliEncoderVersion() >> 24, (BrotliEncoderVersion() >> 12) & 0xfff,
+	          BrotliEncoderVersion() & 0xfff);
+#endif
+#ifdef USE_ZSTD
+	memprintf(&ptr, "%s\nBuilt with zstd version : " ZSTD_VERSION_STRING, ptr);
+	memprintf(&ptr, "%s\nRunning on zstd version : %s", ptr, ZSTD_versionString());
 #endif
 	memprintf(&ptr, "%s\nCompression algorithms supported :", ptr);
 
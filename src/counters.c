@@ -0,0 +1,198 @@
+/*
+ * Sharded statistics counters management
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/counters.h>
+#include <haproxy/global.h>
+
+/* Each shard is rounded up to a multiple of this size and
+ * aligned on it so that two shards never share a cache line.
+ */
+#define COUNTERS_SHARED_ALIGN 64
+#define COUNTERS_SHARED_STRIDE(size) (((size) + COUNTERS_SHARED_ALIGN - 1) & -(size_t)COUNTERS_SHARED_ALIGN)
+
+/* Allocates a zeroed area large enough to store <nb> cache-aligned entries of
+ * <size> bytes each. The pointer to the first aligned entry is stored into
+ * <base>. The area to be passed to free() is returned, or NULL on allocation
+ * failure.
+ */
+static void *counters_shared_alloc(int nb, size_t size, char **base)
+{
+	void *area;
+
+	area = calloc(1, nb * COUNTERS_SHARED_STRIDE(size) + COUNTERS_SHARED_ALIGN);
+	if (area)
+		*base = (char *)(((size_t)area + COUNTERS_SHARED_ALIGN - 1) & -(size_t)COUNTERS_SHARED_ALIGN);
+	return area;
+}
+
+/* Returns the number of shards of the cumulated counters: one per thread, up
+ * to COUNTERS_SHARDS.
+ */
+int counters_nb_shards(void)
+{
+	return MIN(global.nbthread, COUNTERS_SHARDS);
+}
+
+/* Returns the shard of the cumulated counters thread <thr> must update.
+ * Consecutive threads share the same shard so that threads of a same group,
+ * hence usually close to each other, are the ones sharing a cache line.
+ */
+uint counters_thread_shard(int thr)
+{
+	return (uint)thr * counters_nb_shards() / global.nbthread;
+}
+
+/* Adds the <size> bytes of counters at <src> to those at <dst>. Both are
+ * shards which only contain long long counters.
+ */
+static void counters_shared_add(void *dst, const void *src, size_t size)
+{
+	const long long *s = src;
+	long long *d = dst;
+	size_t i;
+
+	for (i = 0; i < size / sizeof(long long); i++)
+		d[i] += s[i];
+}
+
+/* Initializes frontend counters <shared> so that all shards use its
+ * local storage. This never fails and must be called before any use of the
+ * counters.
+ */
+void counters_fe_shared_init(struct fe_counters_shared *shared)
+{
+	int it;
+
+	memset(&shared->local, 0, sizeof(shared->local));
+	for (it = 0; it < COUNTERS_SHARDS; it++)
+		shared->shard[it] = &shared->local;
+	shared->area = NULL;
+	shared->nb_shards = 1;
+}
+
+/* Same as counters_fe_shared_init() for backend/server counters */
+void counters_be_shared_init(struct be_counters_shared *shared)
+{
+	int it;
+
+	memset(&shared->local, 0, sizeof(shared->local));
+	for (it = 0; it < COUNTERS_SHARDS; it++)
+		shared->shard[it] = &shared->local;
+	shared->area = NULL;
+	shared->nb_shards = 1;
+}
+
+/* Allocates counters_nb_shards() cache-aligned shards for frontend counters
+ * <shared>, preserving the values accumulated so far. It must only be called
+ * once the number of threads is known, and either before threads are started
+ * or under thread isolation. Nothing is done when running with a single
+ * thread or if already done. Returns 1 on success, 0 on allocation failure,
+ * in which case the counters remain usable but are not sharded.
+ */
+int counters_fe_shared_prepare(struct fe_counters_shared *shared)
+{
+	struct fe_counters_shard *shard[COUNTERS_SHARDS];
+	char *base = NULL;
+	void *area;
+	int nb = counters_nb_shards();
+	int it;
+
+	if (nb <= 1 || shared->area)
+		return 1;
+
+	area = counters_shared_alloc(nb, sizeof(*shard[0]), &base);
+	if (!area)
+		return 0;
+
+	for (it = 0; it < COUNTERS_SHARDS; it++)
+		shard[it] = (void *)(base + (it % nb) * COUNTERS_SHARED_STRIDE(sizeof(*shard[0])));
+
+	counters_shared_add(shard[0], &shared->local, sizeof(shared->local));
+	memset(&shared->local, 0, sizeof(shared->local));
+	memcpy(shared->shard, shard, sizeof(shard));
+	shared->area = area;
+	shared->nb_shards = nb;
+	return 1;
+}
+
+/* Same as counters_fe_shared_prepare() for backend/server counters */
+int counters_be_shared_prepare(struct be_counters_shared *shared)
+{
+	struct be_counters_shard *shard[COUNTERS_SHARDS];
+	char *base = NULL;
+	void *area;
+	int nb = counters_nb_shards();
+	int it;
+
+	if (nb <= 1 || shared->area)
+		return 1;
+
+	area = counters_shared_alloc(nb, sizeof(*shard[0]), &base);
+	if (!area)
+		return 0;
+
+	for (it = 0; it < COUNTERS_SHARDS; it++)
+		shard[it] = (void *)(base + (it % nb) * COUNTERS_SHARED_STRIDE(sizeof(*shard[0])));
+
+	counters_shared_add(shard[0], &shared->local, sizeof(shared->local));
+	memset(&shared->local, 0, sizeof(shared->local));
+	memcpy(shared->shard, shard, sizeof(shard));
+	shared->area = area;
+	shared->nb_shards = nb;
+	return 1;
+}
+
+/* Releases the shards of frontend counters <shared>, which must not be used
+ * anymore afterwards.
+ */
+void counters_fe_shared_drop(struct fe_counters_shared *shared)
+{
+	ha_free(&shared->area);
+	counters_fe_shared_init(shared);
+}
+
+/* Same as counters_fe_shared_drop() for backend/server counters */
+void counters_be_shared_drop(struct be_counters_shared *shared)
+{
+	ha_free(&shared->area);
+	counters_be_shared_init(shared);
+}
+
+/* Resets all frontend <counters> to zero, including the ones of all shards,
+ * while preserving their storage.
+ */
+void counters_fe_reset(struct fe_counters *counters)
+{
+	struct fe_counters_shared shared = counters->shared;
+	int it;
+
+	memset(counters, 0, sizeof(*counters));
+	counters->shared = shared;
+	for (it = 0; it < counters->shared.nb_shards; it++)
+		memset(counters->shared.shard[it], 0, sizeof(*counters->shared.shard[it]));
+}
+
+/* Resets all backend/server <counters> to zero, including the ones of all
+ * shards, while preserving their storage.
+ */
+void counters_be_reset(struct be_counters *counters)
+{
+	struct be_counters_shared shared = counters->shared;
+	int it;
+
+	memset(counters, 0, sizeof(*counters));
+	counters->shared = shared;
+	for (it = 0; it < counters->shared.nb_shards; it++)
+		memset(counters->shared.shard[it], 0, sizeof(*counters->shared.shard[it]));
+}
@@ -0,0 +1,835 @@
+/*
+ * FD polling functions for Linux io_uring
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The poller relies on IORING_OP_POLL_ADD requests and only talks to the
+ * kernel through the raw system calls, so it doesn't need liburing. Each
+ * thread has its own ring. Poll requests are one-shot by default, which
+ * provides the same level-triggered semantics as the other pollers: once a
+ * request completes, the thread's bits are removed from polled_mask and an
+ * update is scheduled so that the next loop re-arms it if still needed. FDs
+ * which support edge-triggered polling use a multishot request instead, which
+ * remains armed until it is cancelled. The updates and the poll wait are
+ * submitted together by a single io_uring_enter() call per loop.
+ *
+ * Each thread has at most one armed request per FD, identified by a sequence
+ * number which changes every time a request is added or removed. Completions
+ * carrying another sequence number belong to a replaced request and are
+ * dropped, so that they cannot change the polling state of the current one.
+ *
+ * Contrary to epoll, an armed poll request holds a reference on the file, so
+ * closing the FD is not sufficient to release it: each FD close must cancel
+ * the pending requests, including the ones registered by other threads of
+ * the group, which are notified via their cancel list. If a cancel request
+ * cannot be allocated, the thread is asked to rebuild its ring instead, which
+ * releases all of its requests at once.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/clock.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/list.h>
+#include <haproxy/pool.h>
+#include <haproxy/signal.h>
+#include <haproxy/ticks.h>
+#include <haproxy/task.h>
+#include <haproxy/tools.h>
+
+
+#ifndef POLLRDHUP
+/* POLLRDHUP was defined late in libc, and it appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+/* The user_data of poll requests is made of the FD in the lower 32 bits, of
+ * the thread's request sequence number for this FD in the next 16 bits, and
+ * of the FD's generation number in the upper ones, so that completions
+ * belonging to a replaced request or to an FD which was closed in between can
+ * be recognized and dropped. Other requests (poll removals) are marked with
+ * URING_UDATA_INTERNAL and their completions are simply ignored.
+ */
+#define URING_UDATA_INTERNAL  (1ULL << 63)
+#define URING_GEN_MASK        0x7fffU
+#define URING_GEN_SHIFT       48
+#define URING_SEQ_MASK        0xffffU
+#define URING_SEQ_SHIFT       32
+
+/* one ring per thread, only manipulated by its owner */
+struct uring {
+	int fd;                       /* ring's fd, -1 if not set */
+	unsigned int sq_entries;      /* number of SQ entries */
+	unsigned int sq_tail;         /* local SQ tail, published upon submit */
+	unsigned int *sq_khead;       /* kernel's SQ head */
+	unsigned int *sq_ktail;       /* kernel's SQ tail */
+	unsigned int *sq_kmask;       /* SQ ring mask */
+	unsigned int *cq_khead;       /* kernel's CQ head */
+	unsigned int *cq_ktail;       /* kernel's CQ tail */
+	unsigned int *cq_kmask;       /* CQ ring mask */
+	struct io_uring_sqe *sqes;    /* SQE array */
+	struct io_uring_cqe *cqes;    /* CQE array */
+	void *sq_ring;                /* SQ ring mapping */
+	size_t sq_ring_sz;
+	void *cq_ring;                /* CQ ring mapping, may be sq_ring */
+	size_t cq_ring_sz;
+	size_t sqes_sz;               /* size of the SQE array mapping */
+};
+
+/* poll requests from another thread that must be cancelled by the owner */
+struct uring_cancel {
+	struct mt_list list;
+	int fd;
+	uint gen;                     /* FD's generation before the close */
+};
+
+/* private data */
+static struct uring urings[MAX_THREADS] __read_mostly;     // per-thread rings
+static struct mt_list uring_cancel_list[MAX_THREADS];       // per-thread cancel requests
+static ushort *uring_seq[MAX_THREADS] __read_mostly;        // per-thread per-FD request sequence
+static uint uring_rebuild[MAX_THREADS];                     // non-zero if the ring must be rebuilt
+static uint *uring_fd_gen __read_mostly = NULL;             // per-FD generation
+static int uring_multishot __read_mostly = 1;               // 0 once the kernel refused it
+
+DECLARE_STATIC_POOL(pool_head_uring_cancel, "uring_cancel", sizeof(struct uring_cancel));
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                                     unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* returns the user_data of this thread's request on <fd> for generation <gen> */
+static inline __u64 uring_udata(int fd, uint gen)
+{
+	return ((__u64)(gen & URING_GEN_MASK) << URING_GEN_SHIFT) |
+	       ((__u64)uring_seq[tid][fd] << URING_SEQ_SHIFT) | (uint)fd;
+}
+
+/* releases the mappings and the fd of ring <r>, which may be partially set */
+static void uring_release(struct uring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ring && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	if (r->sq_ring)
+		munmap(r->sq_ring, r->sq_ring_sz);
+	if (r->fd >= 0)
+		close(r->fd);
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+/* Creates ring <r> with at least <entries> SQ entries. The setup flags which
+ * reduce the completion overhead are only tried first since they depend on
+ * the kernel version. Returns 1 on success, 0 on failure.
+ */
+static int uring_setup(struct uring *r, unsigned int entries)
+{
+	static const unsigned int setup_flags[] = {
+		IORING_SETUP_CLAMP | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+		IORING_SETUP_CLAMP,
+	};
+	struct io_uring_params p;
+	unsigned int i;
+	int fd = -1;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+
+	for (i = 0; i < sizeof(setup_flags) / sizeof(setup_flags[0]); i++) {
+		memset(&p, 0, sizeof(p));
+		p.flags = setup_flags[i];
+		fd = sys_io_uring_setup(entries, &p);
+		if (fd >= 0)
+			break;
+	}
+
+	if (fd < 0)
+		return 0;
+
+	r->fd = fd;
+
+	/* we need the CQ to never lose events, and to be able to wait with a
+	 * timeout without having to queue a timeout request.
+	 */
+	if (!(p.features & IORING_FEAT_NODROP) || !(p.features & IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_sz > r->sq_ring_sz)
+			r->sq_ring_sz = r->cq_ring_sz;
+		r->cq_ring_sz = r->sq_ring_sz;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) {
+		r->sq_ring = NULL;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else {
+		r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+		                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) {
+			r->cq_ring = NULL;
+			goto fail;
+		}
+	}
+
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		goto fail;
+	}
+
+	r->sq_entries = p.sq_entries;
+	r->sq_khead = r->sq_ring + p.sq_off.head;
+	r->sq_ktail = r->sq_ring + p.sq_off.tail;
+	r->sq_kmask = r->sq_ring + p.sq_off.ring_mask;
+	r->cq_khead = r->cq_ring + p.cq_off.head;
+	r->cq_ktail = r->cq_ring + p.cq_off.tail;
+	r->cq_kmask = r->cq_ring + p.cq_off.ring_mask;
+	r->cqes     = r->cq_ring + p.cq_off.cqes;
+	r->sq_tail  = *r->sq_ktail;
+
+	/* SQEs are always used in order, so the indirection array is set
+	 * once for all.
+	 */
+	for (i = 0; i < p.sq_entries; i++)
+		((unsigned int *)(r->sq_ring + p.sq_off.array))[i] = i;
+
+	return 1;
+ fail:
+	uring_release(r);
+	return 0;
+}
+
+/* Publishes the pending SQEs of ring <r> and calls io_uring_enter(). If
+ * <wait> is non-null, it waits for at least one completion for at most <ts>.
+ * Returns the io_uring_enter() status.
+ */
+static int uring_enter(struct uring *r, int wait, struct timespec *ts)
+{
+	struct io_uring_getevents_arg arg = {
+		.sigmask    = 0,
+		.sigmask_sz = _NSIG / 8,
+		.ts         = (__u64)(ulong)ts,
+	};
+	unsigned int to_submit;
+
+	__atomic_store_n(r->sq_ktail, r->sq_tail, __ATOMIC_RELEASE);
+	to_submit = r->sq_tail - __atomic_load_n(r->sq_khead, __ATOMIC_ACQUIRE);
+
+	return sys_io_uring_enter(r->fd, to_submit, wait ? 1 : 0,
+	                          IORING_ENTER_GETEVENTS | (ts ? IORING_ENTER_EXT_ARG : 0),
+	                          ts ? &arg : NULL, ts ? sizeof(arg) : 0);
+}
+
+/* Returns a zeroed SQE from ring <r>, flushing the SQ to the kernel first if
+ * it is full. The SQE will only be submitted upon next call to uring_enter().
+ */
+static struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	while (r->sq_tail - __atomic_load_n(r->sq_khead, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+		if (uring_enter(r, 0, NULL) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			return NULL;
+	}
+
+	sqe = &r->sqes[r->sq_tail & *r->sq_kmask];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_tail++;
+	return sqe;
+}
+
+/* queues a poll request for <events> on <fd>, multishot if <multi> is set. If
+ * the request cannot be queued, the ring is rebuilt by the next poll loop,
+ * which re-arms all FDs.
+ */
+static void uring_poll_add(int fd, uint events, int multi)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&urings[tid]);
+
+	if (!sqe) {
+		HA_ATOMIC_STORE(&uring_rebuild[tid], 1);
+		return;
+	}
+
+	uring_seq[tid][fd]++;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->len = multi ? IORING_POLL_ADD_MULTI : 0;
+	sqe->user_data = uring_udata(fd, _HA_ATOMIC_LOAD(&uring_fd_gen[fd]));
+}
+
+/* Queues the removal of this thread's poll request on <fd> for generation
+ * <gen>. The sequence number is changed so that a completion which was
+ * already posted for this request gets ignored. If the removal cannot be
+ * queued, the ring is rebuilt by the next poll loop since the pending request
+ * holds a reference on the file.
+ */
+static void uring_poll_remove(int fd, uint gen)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&urings[tid]);
+
+	if (sqe) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = uring_udata(fd, gen);
+		sqe->user_data = URING_UDATA_INTERNAL;
+	}
+	else
+		HA_ATOMIC_STORE(&uring_rebuild[tid], 1);
+	uring_seq[tid][fd]++;
+}
+
+/* Forgets about all the requests registered by the current thread and marks
+ * all of its FDs as updated so that the poller re-arms those still needed.
+ */
+static void uring_reset_fds()
+{
+	int fd;
+
+	for (fd = 0; fd < fd_highest; fd++) {
+		if (!fdtab[fd].owner || !fd_grab_tgid(fd, tgid))
+			continue;
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+		fd_drop_tgid(fd);
+	}
+	fd_reregister_all(tgid, ti->ltid_bit);
+}
+
+/* Replaces the current thread's ring with a new one. Closing the old ring
+ * cancels all of its requests, which is used when a request could not be
+ * cancelled individually. Returns 1 on success, 0 on failure, in which case
+ * the old ring is kept.
+ */
+static int uring_rebuild_ring()
+{
+	struct uring r;
+
+	if (!uring_setup(&r, urings[tid].sq_entries))
+		return 0;
+
+	uring_release(&urings[tid]);
+	urings[tid] = r;
+	uring_reset_fds();
+	return 1;
+}
+
+/*
+ * Cancel all poll requests pending on <fd> before it gets closed, since they
+ * hold a reference on the file. The local thread's request is cancelled with
+ * the next submission. Other threads' ones are queued to these threads which
+ * are woken up to perform the removal themselves since a ring may only be
+ * used by its owner. If the cancel request cannot be allocated, the thread
+ * is asked to rebuild its ring. The FD's generation is then changed so that
+ * completions that were already queued for it are ignored.
+ */
+static void __fd_clo(int fd)
+{
+	unsigned long m = _HA_ATOMIC_LOAD(&polled_mask[fd].poll_recv) | _HA_ATOMIC_LOAD(&polled_mask[fd].poll_send);
+	int tgrp = fd_tgid(fd);
+	uint gen;
+	int i;
+
+	if (m) {
+		gen = _HA_ATOMIC_LOAD(&uring_fd_gen[fd]);
+
+		/* FDs may only be shared per group and are only closed once
+		 * entirely reset, except when stopping from the wrong thread
+		 * or during startup.
+		 */
+		if (unlikely(!(global.mode & MODE_STARTING))) {
+			CHECK_IF(tgid != tgrp && !thread_isolated());
+		}
+
+		for (i = ha_tgroup_info[tgrp-1].base; i < ha_tgroup_info[tgrp-1].base + ha_tgroup_info[tgrp-1].count; i++) {
+			struct uring_cancel *cancel;
+
+			if (!(m & ha_thread_info[i].ltid_bit))
+				continue;
+
+			if (i == tid && urings[tid].fd >= 0 && uring_seq[tid]) {
+				uring_poll_remove(fd, gen);
+				continue;
+			}
+
+			cancel = pool_alloc(pool_head_uring_cancel);
+			if (cancel) {
+				cancel->fd = fd;
+				cancel->gen = gen;
+				MT_LIST_APPEND(&uring_cancel_list[i], &cancel->list);
+			}
+			else
+				HA_ATOMIC_STORE(&uring_rebuild[i], 1);
+			wake_thread(i);
+		}
+	}
+
+	_HA_ATOMIC_INC(&uring_fd_gen[fd]);
+}
+
+static void _update_fd(int fd)
+{
+	uint en, events;
+	ulong pr, ps;
+
+	en = fdtab[fd].state;
+	pr = _HA_ATOMIC_LOAD(&polled_mask[fd].poll_recv);
+	ps = _HA_ATOMIC_LOAD(&polled_mask[fd].poll_send);
+
+	/* Use a multishot request on FDs that support edge-triggered events */
+	if ((fdtab[fd].state & FD_ET_POSSIBLE) && uring_multishot) {
+		/* already done ? */
+		if (pr & ps & ti->ltid_bit)
+			return;
+
+		if ((pr | ps) & ti->ltid_bit)
+			uring_poll_remove(fd, _HA_ATOMIC_LOAD(&uring_fd_gen[fd]));
+
+		/* enable polling in both directions */
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, ti->ltid_bit);
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_send, ti->ltid_bit);
+		uring_poll_add(fd, POLLIN | POLLRDHUP | POLLOUT, 1);
+		return;
+	}
+
+	/* if we're already polling or are going to poll for this FD and it's
+	 * neither active nor ready, force it to be active so that we don't
+	 * needlessly unsubscribe then re-subscribe it.
+	 */
+	if (!(en & (FD_EV_READY_R | FD_EV_SHUT_R | FD_EV_ERR_RW | FD_POLL_ERR)) &&
+	    ((en & FD_EV_ACTIVE_W) || ((ps | pr) & ti->ltid_bit)))
+		en |= FD_EV_ACTIVE_R;
+
+	if ((ps | pr) & ti->ltid_bit) {
+		if (!(fdtab[fd].thread_mask & ti->ltid_bit) || !(en & FD_EV_ACTIVE_RW)) {
+			/* fd removed from poll list */
+			if (pr & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+			if (ps & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+			uring_poll_remove(fd, _HA_ATOMIC_LOAD(&uring_fd_gen[fd]));
+			return;
+		}
+
+		if (((en & FD_EV_ACTIVE_R) != 0) == ((pr & ti->ltid_bit) != 0) &&
+		    ((en & FD_EV_ACTIVE_W) != 0) == ((ps & ti->ltid_bit) != 0))
+			return;
+
+		/* fd status changed: the pending request is replaced. Its
+		 * completion, if any, will be ignored.
+		 */
+		uring_poll_remove(fd, _HA_ATOMIC_LOAD(&uring_fd_gen[fd]));
+	}
+	else if (!(fdtab[fd].thread_mask & ti->ltid_bit) || !(en & FD_EV_ACTIVE_RW))
+		return;
+
+	/* new or changed fd in the poll list */
+	if (en & FD_EV_ACTIVE_R) {
+		if (!(pr & ti->ltid_bit))
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, ti->ltid_bit);
+	} else {
+		if (pr & ti->ltid_bit)
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+	}
+	if (en & FD_EV_ACTIVE_W) {
+		if (!(ps & ti->ltid_bit))
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_send, ti->ltid_bit);
+	} else {
+		if (ps & ti->ltid_bit)
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+	}
+
+	/* construct the poll events based on new state */
+	events = 0;
+	if (en & FD_EV_ACTIVE_R)
+		events |= POLLIN | POLLRDHUP;
+
+	if (en & FD_EV_ACTIVE_W)
+		events |= POLLOUT;
+
+	uring_poll_add(fd, events, 0);
+}
+
+/*
+ * Linux io_uring() poller
+ */
+static void _do_poll(struct poller *p, int exp, int wake)
+{
+	struct uring *r = &urings[tid];
+	struct uring_cancel *cancel;
+	struct timespec ts;
+	unsigned int head, tail;
+	int status;
+	int fd;
+	int updt_idx;
+	int wait_time;
+	int old_fd;
+
+	/* first, remove the requests on FDs closed by other threads. If one
+	 * of them could not be notified, all requests are released by
+	 * replacing the ring, which is retried until it succeeds.
+	 */
+	if (HA_ATOMIC_LOAD(&uring_rebuild[tid])) {
+		HA_ATOMIC_STORE(&uring_rebuild[tid], 0);
+		if (!uring_rebuild_ring())
+			HA_ATOMIC_STORE(&uring_rebuild[tid], 1);
+	}
+
+	while ((cancel = MT_LIST_POP(&uring_cancel_list[tid], struct uring_cancel *, list))) {
+		uring_poll_remove(cancel->fd, cancel->gen);
+		pool_free(pool_head_uring_cancel, cancel);
+	}
+
+	/* then scan the update list to find polling changes */
+	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
+		fd = fd_updt[updt_idx];
+
+		if (!fd_grab_tgid(fd, tgid)) {
+			/* was reassigned */
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~ti->ltid_bit);
+
+		if (fdtab[fd].owner)
+			_update_fd(fd);
+		else
+			activity[tid].poll_drop_fd++;
+
+		fd_drop_tgid(fd);
+	}
+	fd_nbupdt = 0;
+
+	/* Scan the shared update list */
+	for (old_fd = fd = update_list[tgid - 1].first; fd != -1; fd = fdtab[fd].update.next) {
+		if (fd == -2) {
+			fd = old_fd;
+			continue;
+		}
+		else if (fd <= -3)
+			fd = -fd -4;
+		if (fd == -1)
+			break;
+
+		if (!fd_grab_tgid(fd, tgid)) {
+			/* was reassigned */
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		if (!(fdtab[fd].update_mask & ti->ltid_bit)) {
+			fd_drop_tgid(fd);
+			continue;
+		}
+
+		done_update_polling(fd);
+
+		if (fdtab[fd].owner)
+			_update_fd(fd);
+		else
+			activity[tid].poll_drop_fd++;
+
+		fd_drop_tgid(fd);
+	}
+
+	thread_idle_now();
+	thread_harmless_now();
+
+	/* Now let's submit the changes and wait for polled events. Don't
+	 * wait if a request could not be queued, the ring must be rebuilt.
+	 */
+	wait_time = (wake || HA_ATOMIC_LOAD(&uring_rebuild[tid])) ? 0 : compute_poll_timeout(exp);
+	clock_entering_poll();
+
+	do {
+		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+
+		ts.tv_sec  = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		status = uring_enter(r, !!timeout, &ts);
+
+		/* only the number of available completions matters here */
+		status = __atomic_load_n(r->cq_ktail, __ATOMIC_ACQUIRE) - *r->cq_khead;
+		clock_update_local_date(timeout, status);
+
+		if (status) {
+			activity[tid].poll_io++;
+			break;
+		}
+		if (timeout || !wait_time)
+			break;
+		if (tick_isset(exp) && tick_is_expired(exp, now_ms))
+			break;
+	} while (1);
+
+	clock_update_global_date();
+	fd_leaving_poll(wait_time, status);
+
+	/* process polled events. All available completions are consumed so
+	 * that a completion from a replaced request cannot be processed after
+	 * the next update of the same FD.
+	 */
+	head = *r->cq_khead;
+	tail = __atomic_load_n(r->cq_ktail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_kmask];
+		__u64 udata = cqe->user_data;
+		int res = cqe->res;
+		int rearm = 0;
+		unsigned int n, e;
+
+		if (udata & URING_UDATA_INTERNAL)
+			continue;
+
+		fd = (uint)udata;
+		if ((uint)fd >= (uint)global.maxsock ||
+		    ((udata >> URING_GEN_SHIFT) & URING_GEN_MASK) != (_HA_ATOMIC_LOAD(&uring_fd_gen[fd]) & URING_GEN_MASK)) {
+			/* FD was closed since the request was made */
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		/* replaced request */
+		if (((udata >> URING_SEQ_SHIFT) & URING_SEQ_MASK) != uring_seq[tid][fd] || res == -ECANCELED)
+			continue;
+
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			/* the request is terminated, let the next update
+			 * re-arm it if still needed.
+			 */
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+			rearm = 1;
+		}
+
+		if (res < 0) {
+			/* multishot is not supported by this kernel */
+			if (res == -EINVAL && uring_multishot)
+				uring_multishot = 0;
+			e = 0;
+		}
+		else
+			e = res;
+
+		if ((e & POLLRDHUP) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
+			_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
+
+		if (e) {
+#ifdef DEBUG_FD
+			_HA_ATOMIC_INC(&fdtab[fd].event_count);
+#endif
+			n = ((e & POLLIN)    ? FD_EV_READY_R : 0) |
+			    ((e & POLLOUT)   ? FD_EV_READY_W : 0) |
+			    ((e & POLLRDHUP) ? FD_EV_SHUT_R  : 0) |
+			    ((e & POLLHUP)   ? FD_EV_SHUT_RW : 0) |
+			    ((e & POLLERR)   ? FD_EV_ERR_RW  : 0);
+
+			fd_update_events(fd, n);
+		}
+
+		if (rearm)
+			updt_fd_polling(fd);
+	}
+	__atomic_store_n(r->cq_khead, head, __ATOMIC_RELEASE);
+	/* the caller will take care of cached events */
+}
+
+/* returns the number of SQ entries to allocate for each ring */
+static unsigned int uring_entries()
+{
+	unsigned int entries = 64;
+
+	while (entries < global.tune.maxpollevents && entries < 32768)
+		entries <<= 1;
+	return entries;
+}
+
+static int init_uring_per_thread()
+{
+	if (MAX_THREADS > 1 && tid) {
+		uring_seq[tid] = calloc(global.maxsock, sizeof(*uring_seq[tid]));
+		if (!uring_seq[tid])
+			return 0;
+		if (!uring_setup(&urings[tid], uring_entries()))
+			return 0;
+	}
+
+	/* The requests that may have been registered before the ring was
+	 * created or recreated are not known to it. Let's forget about them
+	 * and mark all FDs as updated, the poller will do the rest.
+	 */
+	uring_reset_fds();
+	return 1;
+}
+
+static void deinit_uring_per_thread()
+{
+	struct uring_cancel *cancel;
+
+	if (MAX_THREADS > 1 && tid) {
+		uring_release(&urings[tid]);
+		ha_free(&uring_seq[tid]);
+	}
+
+	while ((cancel = MT_LIST_POP(&uring_cancel_list[tid], struct uring_cancel *, list)))
+		pool_free(pool_head_uring_cancel, cancel);
+}
+
+/*
+ * Initialization of the io_uring() poller.
+ * Returns 0 in case of failure, non-zero in case of success. If it fails, it
+ * disables the poller by setting its pref to 0.
+ */
+static int _do_init(struct poller *p)
+{
+	p->private = NULL;
+
+	uring_fd_gen = calloc(global.maxsock, sizeof(*uring_fd_gen));
+	if (!uring_fd_gen)
+		goto fail_gen;
+
+	uring_seq[tid] = calloc(global.maxsock, sizeof(*uring_seq[tid]));
+	if (!uring_seq[tid])
+		goto fail_seq;
+
+	if (!uring_setup(&urings[tid], uring_entries()))
+		goto fail_ring;
+
+	hap_register_per_thread_init(init_uring_per_thread);
+	hap_register_per_thread_deinit(deinit_uring_per_thread);
+
+	return 1;
+
+ fail_ring:
+	ha_free(&uring_seq[tid]);
+ fail_seq:
+	ha_free(&uring_fd_gen);
+ fail_gen:
+	p->pref = 0;
+	return 0;
+}
+
+/*
+ * Termination of the io_uring() poller.
+ * Memory is released and the poller is marked as unselectable.
+ */
+static void _do_term(struct poller *p)
+{
+	if (urings[tid].fd >= 0)
+		uring_release(&urings[tid]);
+
+	ha_free(&uring_seq[tid]);
+	ha_free(&uring_fd_gen);
+	p->private = NULL;
+	p->pref = 0;
+}
+
+/*
+ * Check that the poller works, which requires a ring with the features we
+ * depend on.
+ * Returns 1 if OK, otherwise 0.
+ */
+static int _do_test(struct poller *p)
+{
+	struct uring r;
+
+	if (!uring_setup(&r, 8))
+		return 0;
+	uring_release(&r);
+	return 1;
+}
+
+/*
+ * Recreate the ring after a fork(). Returns 1 if OK, otherwise 0. The ring
+ * must not be shared with the parent, whose requests would otherwise be
+ * reported to us.
+ */
+static int _do_fork(struct poller *p)
+{
+	if (urings[tid].fd >= 0)
+		uring_release(&urings[tid]);
+	return uring_setup(&urings[tid], uring_entries());
+}
+
+/*
+ * Registers the poller.
+ */
+static void _do_register(void)
+{
+	struct poller *p;
+	int i;
+
+	if (nbpollers >= MAX_POLLERS)
+		return;
+
+	for (i = 0; i < MAX_THREADS; i++) {
+		urings[i].fd = -1;
+		MT_LIST_INIT(&uring_cancel_list[i]);
+	}
+
+	p = &pollers[nbpollers++];
+
+	p->name = "uring";
+	p->pref = 250; /* below epoll, only used with "noepoll" */
+	p->flags = HAP_POLL_F_ERRHUP; // note: RDHUP might be dynamically added
+	p->private = NULL;
+
+	p->clo  = __fd_clo;
+	p->test = _do_test;
+	p->init = _do_init;
+	p->term = _do_term;
+	p->poll = _do_poll;
+	p->fork = _do_fork;
+}
+
+INITCALL0(STG_REGISTER, _do_register);
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -11,18 +11,24 @@
  */
 
 #include <haproxy/api.h>
+#include <haproxy/applet.h>
 #include <haproxy/cfgparse.h>
+#include <haproxy/cli.h>
+#include <haproxy/clock.h>
 #include <haproxy/compression.h>
 #include <haproxy/dynbuf.h>
 #include <haproxy/filters.h>
+#include <haproxy/flt_http_comp.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana-t.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/htx.h>
+#include <haproxy/istbuf.h>
 #include <haproxy/list.h>
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
 #include <haproxy/stream.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 
 #define COMP_STATE_PROCESSING 0x01
@@ -31,6 +37,30 @@ const char *http_comp_flt_id = "compression filter";
 
 struct flt_ops comp_ops;
 
+/* An asynchronous compression job. It compresses a copy of the DATA blocks
+ * found at the beginning of the payload, in a heavy tasklet running on another
+ * thread, while the stream waits for it. There is at most one job per stream
+ * and direction since it uses the compression context of the stream. The
+ * state indicates which side owns the job.
+ */
+#define COMP_JOB_IDLE     0 /* nothing pending, owned by the stream */
+#define COMP_JOB_RUNNING  1 /* being compressed, owned by the tasklet */
+#define COMP_JOB_WAKING   2 /* done, the tasklet is waking the stream up */
+#define COMP_JOB_DONE     3 /* done, owned by the stream */
+#define COMP_JOB_ORPHAN   4 /* the stream is gone, owned by the tasklet */
+
+struct comp_job {
+	struct comp_algo *algo;  /* compression algorithm of the stream */
+	struct comp_ctx  *ctx;   /* compression context of the stream */
+	struct task      *owner; /* stream task to wake up once done */
+	struct buffer     in;    /* copy of the data to compress */
+	struct buffer     out;   /* compressed data */
+	uint64_t          date;  /* submission date, in ns */
+	int               last;  /* non-zero if the data end the message */
+	int               ret;   /* 0 on success or -1 on error */
+	unsigned int      state; /* COMP_JOB_* */
+};
+
 struct comp_state {
 	/*
 	 * For both comp_ctx and comp_algo, COMP_DIR_REQ is the index
@@ -38,11 +68,32 @@ struct comp_state {
 	 */
 	struct comp_ctx  *comp_ctx[2];   /* compression context */
 	struct comp_algo *comp_algo[2];  /* compression algorithm if not NULL */
+	struct comp_job  *job[2];        /* asynchronous compression job if not NULL */
 	unsigned int      flags;      /* COMP_STATE_* */
 };
 
-/* Pools used to allocate comp_state structs */
+/* Latency histograms, per thread. Bucket <n> counts the durations lower than
+ * 2^n microseconds and not lower than 2^(n-1), the last one counts all the
+ * longer ones.
+ */
+#define COMP_LAT_BUCKETS 20
+
+struct comp_lat {
+	unsigned int run[COMP_LAT_BUCKETS];  /* time spent compressing per call on this thread */
+	unsigned int wait[COMP_LAT_BUCKETS]; /* delay of the jobs offloaded by this thread */
+	unsigned int inline_calls;           /* compression calls made by the streams */
+	unsigned int jobs_sent;              /* jobs offloaded by this thread */
+	unsigned int jobs_run;               /* jobs processed by this thread */
+};
+
+static struct comp_lat comp_lat[MAX_THREADS] __attribute__((aligned(64)));
+
+/* minimum payload size to compress asynchronously, 0 = disabled */
+static unsigned int comp_async_min_size = 0;
+
+/* Pools used to allocate comp_state and comp_job structs */
 DECLARE_STATIC_POOL(pool_head_comp_state, "comp_state", sizeof(struct comp_state));
+DECLARE_STATIC_POOL(pool_head_comp_job, "comp_job", sizeof(struct comp_job));
 
 static THREAD_LOCAL struct buffer tmpbuf;
 static THREAD_LOCAL struct buffer zbuf;
@@ -62,6 +113,23 @@ static int htx_compression_buffer_add_data(struct comp_state *st, const char *da
 					    struct buffer *out, int dir);
 static int htx_compression_buffer_end(struct comp_state *st, struct buffer *out, int end, int dir);
 
+static void comp_job_release(struct comp_state *st, int dir);
+static int comp_job_start(struct comp_state *st, struct stream *s, struct htx *htx,
+			  struct htx_blk *blk, unsigned int offset, unsigned int len, int dir);
+static int comp_job_inject(struct comp_job *job, struct htx *htx, unsigned int offset, unsigned int len);
+static unsigned int comp_job_state(struct comp_job *job);
+
+/* Accounts <ns> nanoseconds in latency histogram <hist> */
+static inline void comp_lat_add(unsigned int *hist, uint64_t ns)
+{
+	unsigned long us = ns / 1000;
+	unsigned int bucket = us ? my_flsl(us) : 0;
+
+	if (bucket >= COMP_LAT_BUCKETS)
+		bucket = COMP_LAT_BUCKETS - 1;
+	hist[bucket]++;
+}
+
 /***********************************************************************/
 static int
 comp_flt_init(struct proxy *px, struct flt_conf *fconf)
@@ -102,6 +170,8 @@ comp_strm_init(struct stream *s, struct filter *filter)
 	st->comp_algo[COMP_DIR_RES] = NULL;
 	st->comp_ctx[COMP_DIR_REQ]  = NULL;
 	st->comp_ctx[COMP_DIR_RES] = NULL;
+	st->job[COMP_DIR_REQ] = NULL;
+	st->job[COMP_DIR_RES] = NULL;
 	st->flags     = 0;
 	filter->ctx   = st;
 
@@ -121,6 +191,11 @@ comp_strm_deinit(struct stream *s, struct filter *filter)
 	if (!st)
 		return;
 
+	/* release any possible compression job, a running one keeps the
+	 * compression context until it is done */
+	comp_job_release(st, COMP_DIR_REQ);
+	comp_job_release(st, COMP_DIR_RES);
+
 	/* release any possible compression context */
 	if (st->comp_algo[COMP_DIR_REQ])
 		st->comp_algo[COMP_DIR_REQ]->end(&st->comp_ctx[COMP_DIR_REQ]);
@@ -275,9 +350,10 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 {
 	struct comp_state *st = filter->ctx;
 	struct htx *htx = htxbuf(&msg->chn->buf);
-	struct htx_ret htxret = htx_find_offset(htx, offset);
+	struct htx_ret htxret;
 	struct htx_blk *blk, *next;
 	int ret, consumed = 0, to_forward = 0, last = 0;
+	uint64_t start;
 	int dir;
 
 	if (msg->chn->flags & CF_ISRESP)
@@ -285,6 +361,36 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 	else
 		dir = COMP_DIR_REQ;
 
+	/* The data of a pending job must be replaced by its result before
+	 * processing the next ones.
+	 */
+	if (st->job[dir] && HA_ATOMIC_LOAD(&st->job[dir]->state) != COMP_JOB_IDLE) {
+		struct comp_job *job = st->job[dir];
+
+		if (comp_job_state(job) != COMP_JOB_DONE)
+			return 0;
+
+		ret = comp_job_inject(job, htx, offset, len);
+		if (ret < 0)
+			goto error;
+		if (!ret) {
+			msg->chn->flags |= CF_WAKE_WRITE;
+			return 0;
+		}
+
+		consumed = b_data(&job->in);
+		to_forward = b_data(&job->out);
+		offset += to_forward;
+		len -= consumed;
+		if (job->last)
+			st->flags &= ~COMP_STATE_PROCESSING;
+		comp_lat_add(comp_lat[tid].wait, now_mono_time() - job->date);
+		b_free(&job->in);
+		b_free(&job->out);
+		HA_ATOMIC_STORE(&job->state, COMP_JOB_IDLE);
+	}
+
+	htxret = htx_find_offset(htx, offset);
 	blk = htxret.blk;
 	offset = htxret.ret;
 	for (next = NULL; blk && len; blk = next) {
@@ -306,6 +412,10 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 
 		switch (type) {
 			case HTX_BLK_DATA:
+				/* large payloads are compressed on another thread */
+				if (comp_async_min_size && comp_job_start(st, s, htx, blk, offset, len, dir))
+					goto end;
+
 				/* it is the last data block */
 				last = ((!next && (htx->flags & HTX_FL_EOM)) || (next && htx_get_blk_type(next) != HTX_BLK_DATA));
 				v = htx_get_blk_value(htx, blk);
@@ -315,10 +425,13 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 					v.len = len;
 				}
 
+				start = now_mono_time();
 				ret = htx_compression_buffer_add_data(st, v.ptr, v.len, &trash, dir);
 				if (ret < 0 || htx_compression_buffer_end(st, &trash, last, dir) < 0)
 					goto error;
 				BUG_ON(v.len != ret);
+				comp_lat_add(comp_lat[tid].run, now_mono_time() - start);
+				comp_lat[tid].inline_calls++;
 
 				if (ret == sz && !b_data(&trash))
 					next = htx_remove_blk(htx, blk);
@@ -371,14 +484,14 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 
 	if (st->comp_ctx[dir] && st->comp_ctx[dir]->cur_lvl > 0) {
 		update_freq_ctr(&global.comp_bps_in, consumed);
-		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.comp_in[dir], consumed);
-		_HA_ATOMIC_ADD(&s->be->be_counters.comp_in[dir], consumed);
+		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.shared.shard[ti->ctr_shard]->comp_in[dir], consumed);
+		_HA_ATOMIC_ADD(&s->be->be_counters.shared.shard[ti->ctr_shard]->comp_in[dir], consumed);
 		update_freq_ctr(&global.comp_bps_out, to_forward);
-		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.comp_out[dir], to_forward);
-		_HA_ATOMIC_ADD(&s->be->be_counters.comp_out[dir], to_forward);
+		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.shared.shard[ti->ctr_shard]->comp_out[dir], to_forward);
+		_HA_ATOMIC_ADD(&s->be->be_counters.shared.shard[ti->ctr_shard]->comp_out[dir], to_forward);
 	} else {
-		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.comp_byp[dir], consumed);
-		_HA_ATOMIC_ADD(&s->be->be_counters.comp_byp[dir], consumed);
+		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.shared.shard[ti->ctr_shard]->comp_byp[dir], consumed);
+		_HA_ATOMIC_ADD(&s->be->be_counters.shared.shard[ti->ctr_shard]->comp_byp[dir], consumed);
 	}
 	return to_forward;
 
@@ -397,9 +510,9 @@ comp_http_end(struct stream *s, struct filter *filter,
 		goto end;
 
 	if (strm_fe(s)->mode == PR_MODE_HTTP)
-		_HA_ATOMIC_INC(&strm_fe(s)->fe_counters.p.http.comp_rsp);
+		_HA_ATOMIC_INC(&strm_fe(s)->fe_counters.shared.shard[ti->ctr_shard]->p.http.comp_rsp);
 	if ((s->flags & SF_BE_ASSIGNED) && (s->be->mode == PR_MODE_HTTP))
-		_HA_ATOMIC_INC(&s->be->be_counters.p.http.comp_rsp);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->p.http.comp_rsp);
  end:
 	return 1;
 }
@@ -533,6 +646,8 @@ select_compression_request_header(struct comp_state *st, struct stream *s, struc
 	if ((s->be->comp && (comp_algo_back = s->be->comp->algos_res)) ||
 	    (strm_fe(s)->comp && (comp_algo_back = strm_fe(s)->comp->algos_res))) {
 		int best_q = 0;
+		int best_rank = -1;
+		int rank;
 
 		ctx.blk = NULL;
 		while (http_find_header(htx, ist("Accept-Encoding"), &ctx, 0)) {
@@ -573,15 +688,20 @@ select_compression_request_header(struct comp_state *st, struct stream *s, struc
 			/* here we have qval pointing to the first "q=" attribute or NULL if not found */
 			q = qval ? http_parse_qvalue(qval + 2, NULL) : 1000;
 
-			if (q <= best_q)
+			if (!q || q < best_q)
 				continue;
 
-			for (comp_algo = comp_algo_back; comp_algo; comp_algo = comp_algo->next) {
-				if (*(ctx.value.ptr) == '*' ||
-				    word_match(ctx.value.ptr, toklen, comp_algo->ua_name, comp_algo->ua_name_len)) {
+			/* The algorithms are listed in the reverse order of the
+			 * configuration. Among those accepted with the best q-value,
+			 * the first configured one is preferred.
+			 */
+			for (comp_algo = comp_algo_back, rank = 0; comp_algo; comp_algo = comp_algo->next, rank++) {
+				if ((*(ctx.value.ptr) == '*' ||
+				     word_match(ctx.value.ptr, toklen, comp_algo->ua_name, comp_algo->ua_name_len)) &&
+				    (q > best_q || rank > best_rank)) {
 					st->comp_algo[COMP_DIR_RES] = comp_algo;
 					best_q = q;
-					break;
+					best_rank = rank;
 				}
 			}
 		}
@@ -625,8 +745,9 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 	struct http_hdr_ctx ctx;
 	struct comp_type *comp_type;
 
-	/* no common compression algorithm was found in request header */
-	if (st->comp_algo[COMP_DIR_RES] == NULL)
+	/* response compression is not enabled */
+	if (!((s->be->comp && (s->be->comp->flags & COMP_FL_DIR_RES) && s->be->comp->algos_res) ||
+	      (strm_fe(s)->comp && (strm_fe(s)->comp->flags & COMP_FL_DIR_RES) && strm_fe(s)->comp->algos_res)))
 		goto fail;
 
 	/* compression already in progress */
@@ -705,26 +826,43 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 			goto fail; /* a content-type was required */
 	}
 
-	/* limit compression rate */
-	if (global.comp_rate_lim > 0)
-		if (read_freq_ctr(&global.comp_bps_in) > global.comp_rate_lim)
-			goto fail;
+	/* From there, the response would be compressed for a request accepting
+	 * one of the algorithms while the compression is not limited. This is
+	 * reported so that a cache placed after the compression stores it as a
+	 * variant of the compressed responses.
+	 */
 
-	/* limit cpu usage */
-	if (th_ctx->idle_pct < compress_min_idle)
-		goto fail;
+	/* no common compression algorithm was found in request header */
+	if (st->comp_algo[COMP_DIR_RES] == NULL)
+		goto compressible;
+
+	/* limit compression rate and cpu usage */
+	if (http_comp_limited())
+		goto compressible;
 
 	/* initialize compression */
 	if (st->comp_algo[COMP_DIR_RES]->init(&st->comp_ctx[COMP_DIR_RES], global.tune.comp_maxlevel) < 0)
-		goto fail;
+		goto compressible;
 	msg->flags |= HTTP_MSGF_COMPRESSING;
 	return 1;
 
+  compressible:
+	msg->flags |= HTTP_MSGF_COMPRESSIBLE;
   fail:
 	st->comp_algo[COMP_DIR_RES] = NULL;
 	return 0;
 }
 
+/* Returns non-zero if no response may currently be compressed because of the
+ * compression rate limit or of the CPU usage limit.
+ */
+int http_comp_limited(void)
+{
+	if (global.comp_rate_lim > 0 && read_freq_ctr(&global.comp_bps_in) > global.comp_rate_lim)
+		return 1;
+	return th_ctx->idle_pct < compress_min_idle;
+}
+
 /***********************************************************************/
 static int
 htx_compression_buffer_init(struct htx *htx, struct buffer *out)
@@ -757,6 +895,243 @@ htx_compression_buffer_end(struct comp_state *st, struct buffer *out, int end, i
 		return st->comp_algo[dir]->flush(st->comp_ctx[dir], out);
 }
 
+/***********************************************************************/
+/* Returns the thread to run the next compression job on. It is the least
+ * loaded of two random threads of the current group other than the calling
+ * one, or the calling one if it is alone in its group.
+ */
+static int comp_job_thread(void)
+{
+	uint thr1, thr2;
+
+	if (tg->count <= 1)
+		return tid;
+
+	thr1 = tg->base + statistical_prng_range(tg->count - 1);
+	if (thr1 >= tid)
+		thr1++;
+	thr2 = tg->base + statistical_prng_range(tg->count - 1);
+	if (thr2 >= tid)
+		thr2++;
+
+	if (HA_ATOMIC_LOAD(&ha_thread_ctx[thr2].rq_total) < HA_ATOMIC_LOAD(&ha_thread_ctx[thr1].rq_total))
+		thr1 = thr2;
+	return thr1;
+}
+
+/* Releases job <job> and its buffers. The compression context is left
+ * untouched.
+ */
+static void comp_job_free(struct comp_job *job)
+{
+	b_free(&job->in);
+	b_free(&job->out);
+	pool_free(pool_head_comp_job, job);
+}
+
+/* Returns the state of job <job> for the stream. The stream may not use the
+ * job while the tasklet is waking it up, this only lasts a few instructions.
+ */
+static unsigned int comp_job_state(struct comp_job *job)
+{
+	unsigned int state;
+
+	while ((state = HA_ATOMIC_LOAD(&job->state)) == COMP_JOB_WAKING)
+		__ha_cpu_relax();
+	return state;
+}
+
+/* Releases the job of <st> for direction <dir>, if any. A running job is left
+ * to its tasklet with the compression context of the stream, which are both
+ * released once it is done.
+ */
+static void comp_job_release(struct comp_state *st, int dir)
+{
+	struct comp_job *job = st->job[dir];
+	unsigned int state = COMP_JOB_RUNNING;
+
+	if (!job)
+		return;
+
+	st->job[dir] = NULL;
+	if (HA_ATOMIC_CAS(&job->state, &state, COMP_JOB_ORPHAN)) {
+		st->comp_algo[dir] = NULL;
+		st->comp_ctx[dir] = NULL;
+		return;
+	}
+	comp_job_state(job);
+	comp_job_free(job);
+}
+
+/* Tasklet compressing the data of the job in <context>. It is woken up from
+ * another thread, so it first moves itself to the heavy class of the current
+ * thread not to delay its other tasks. The stream is woken up once done.
+ */
+static struct task *comp_job_process(struct task *t, void *context, unsigned int state)
+{
+	struct comp_job *job = context;
+	unsigned int job_state = COMP_JOB_RUNNING;
+	uint64_t start;
+
+	if (!(state & TASK_HEAVY)) {
+		HA_ATOMIC_OR(&t->state, TASK_HEAVY);
+		tasklet_wakeup((struct tasklet *)t);
+		return t;
+	}
+	tasklet_free((struct tasklet *)t);
+
+	if (HA_ATOMIC_LOAD(&job->state) == COMP_JOB_RUNNING) {
+		start = now_mono_time();
+		if (job->algo->add_data(job->ctx, b_head(&job->in), b_data(&job->in), &job->out) != b_data(&job->in) ||
+		    (job->last ? job->algo->finish(job->ctx, &job->out) : job->algo->flush(job->ctx, &job->out)) < 0)
+			job->ret = -1;
+		comp_lat_add(comp_lat[tid].run, now_mono_time() - start);
+		comp_lat[tid].jobs_run++;
+	}
+
+	if (HA_ATOMIC_CAS(&job->state, &job_state, COMP_JOB_WAKING)) {
+		task_wakeup(job->owner, TASK_WOKEN_MSG);
+		HA_ATOMIC_STORE(&job->state, COMP_JOB_DONE);
+	}
+	else {
+		/* the stream is gone */
+		job->algo->end(&job->ctx);
+		comp_job_free(job);
+	}
+	return NULL;
+}
+
+/* Starts a job to compress the DATA blocks found from block <blk> at <offset>,
+ * up to <len> bytes, if there are at least tune.comp.async-min-size bytes.
+ * Returns 1 if the job was started, in which case the stream will be woken up
+ * once it is done. Otherwise 0 is returned and the data must be compressed
+ * in place.
+ */
+static int comp_job_start(struct comp_state *st, struct stream *s, struct htx *htx,
+			  struct htx_blk *blk, unsigned int offset, unsigned int len, int dir)
+{
+	struct comp_job *job = st->job[dir];
+	struct htx_blk *next = blk;
+	struct tasklet *tl;
+	unsigned int avail = 0;
+	struct ist v;
+
+	/* count the data of the consecutive DATA blocks */
+	while (next && htx_get_blk_type(next) == HTX_BLK_DATA && avail < len) {
+		avail += htx_get_blksz(next) - (next == blk ? offset : 0);
+		next = htx_get_next_blk(htx, next);
+		while (next && htx_get_blk_type(next) == HTX_BLK_UNUSED)
+			next = htx_get_next_blk(htx, next);
+	}
+	if (avail < comp_async_min_size || len < comp_async_min_size)
+		return 0;
+
+	if (!job) {
+		job = pool_zalloc(pool_head_comp_job);
+		if (!job)
+			return 0;
+		st->job[dir] = job;
+	}
+
+	if (!b_alloc(&job->in, DB_CHANNEL) || !b_alloc(&job->out, DB_CHANNEL))
+		goto fail;
+
+	tl = tasklet_new();
+	if (!tl)
+		goto fail;
+
+	/* the data are copied since the HTX message may be defragmented while
+	 * the job is running.
+	 */
+	for (; blk && b_data(&job->in) < len; blk = htx_get_next_blk(htx, blk), offset = 0) {
+		if (htx_get_blk_type(blk) == HTX_BLK_UNUSED)
+			continue;
+		if (htx_get_blk_type(blk) != HTX_BLK_DATA)
+			break;
+		v = istadv(htx_get_blk_value(htx, blk), offset);
+		if (v.len > len - b_data(&job->in))
+			v.len = len - b_data(&job->in);
+		b_putist(&job->in, v);
+	}
+
+	/* the message ends with these data */
+	job->last = (avail <= len &&
+		     ((!next && (htx->flags & HTX_FL_EOM)) || (next && htx_get_blk_type(next) != HTX_BLK_DATA)));
+	job->algo  = st->comp_algo[dir];
+	job->ctx   = st->comp_ctx[dir];
+	job->owner = s->task;
+	job->ret   = 0;
+	job->date  = now_mono_time();
+	HA_ATOMIC_STORE(&job->state, COMP_JOB_RUNNING);
+	comp_lat[tid].jobs_sent++;
+
+	tl->process = comp_job_process;
+	tl->context = job;
+	tasklet_wakeup_on(tl, comp_job_thread());
+	return 1;
+
+  fail:
+	b_free(&job->in);
+	b_free(&job->out);
+	job->in = job->out = BUF_NULL;
+	return 0;
+}
+
+/* Replaces the data of job <job>, found at <offset> in <htx> among the <len>
+ * bytes to process, with the compressed ones. Returns 1 on success, 0 if there
+ * is not enough room in the message yet, or -1 on error.
+ */
+static int comp_job_inject(struct comp_job *job, struct htx *htx, unsigned int offset, unsigned int len)
+{
+	struct htx_ret htxret = htx_find_offset(htx, offset);
+	struct htx_blk *first = htxret.blk;
+	struct htx_blk *blk, *next;
+	size_t in = b_data(&job->in);
+	struct ist v;
+
+	if (job->ret < 0 || !first || len < in)
+		return -1;
+
+	if (b_data(&job->out) > in + htx_free_space(htx))
+		return 0;
+
+	v = istadv(htx_get_blk_value(htx, first), htxret.ret);
+	if (v.len > in)
+		v.len = in;
+	in -= v.len;
+
+	/* the data of the next blocks are removed first to make room */
+	for (blk = htx_get_next_blk(htx, first); blk && in; blk = next) {
+		uint32_t sz = htx_get_blksz(blk);
+
+		next = htx_get_next_blk(htx, blk);
+		if (htx_get_blk_type(blk) == HTX_BLK_UNUSED)
+			continue;
+		if (htx_get_blk_type(blk) != HTX_BLK_DATA)
+			return -1;
+
+		if (sz <= in) {
+			in -= sz;
+			next = htx_remove_blk(htx, blk);
+		}
+		else {
+			struct ist w = htx_get_blk_value(htx, blk);
+
+			w.len = in;
+			htx_replace_blk_value(htx, blk, w, ist(""));
+			in = 0;
+		}
+	}
+	if (in)
+		return -1;
+
+	if (!b_data(&job->out) && v.len == htx_get_blksz(first))
+		htx_remove_blk(htx, first);
+	else if (!htx_replace_blk_value(htx, first, v, ist2(b_head(&job->out), b_data(&job->out))))
+		return -1;
+	return 1;
+}
+
 
 /***********************************************************************/
 struct flt_ops comp_ops = {
@@ -961,17 +1336,8 @@ check_implicit_http_comp_flt(struct proxy *proxy)
 		list_for_each_entry(fconf, &proxy->filter_configs, list) {
 			if (fconf->id == http_comp_flt_id)
 				comp = 1;
-			else if (fconf->id == cache_store_flt_id) {
-				if (comp) {
-					ha_alert("config: %s '%s': unable to enable the compression filter "
-						 "before any cache filter.\n",
-						 proxy_type_str(proxy), proxy->id);
-					err++;
-					goto end;
-				}
-			}
-			else if (fconf->id == fcgi_flt_id)
-				continue;
+			else if (fconf->id == cache_store_flt_id || fconf->id == fcgi_flt_id)
+				continue; /* the order with the cache is checked by the cache */
 			else
 				explicit = 1;
 		}
@@ -1047,9 +1413,100 @@ smp_fetch_res_comp_algo(const struct arg *args, struct sample *smp,
 	return 0;
 }
 
+/* config parser for global "tune.comp.async-min-size" */
+static int cfg_parse_comp_async_min_size(char **args, int section_type, struct proxy *curpx,
+					 const struct proxy *defpx, const char *file, int line,
+					 char **err)
+{
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (!*args[1]) {
+		memprintf(err, "'%s' expects a size.", args[0]);
+		return -1;
+	}
+
+	res = parse_size_err(args[1], &comp_async_min_size);
+	if (res) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'", res, args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* CLI context for the "show compression" command */
+struct show_comp_ctx {
+	int thr;        /* next thread to dump */
+};
+
+/* parses a "show compression" CLI request. Returns 0 if it needs to continue,
+ * 1 if it wants to stop here.
+ */
+static int cli_parse_show_compression(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct show_comp_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	ctx->thr = -1;
+	return 0;
+}
+
+/* dumps latency histogram <hist> of thread <thr> counting <count> events into
+ * the trash.
+ */
+static void cli_dump_comp_lat(int thr, const char *name, unsigned int count, const unsigned int *hist)
+{
+	int i;
+
+	chunk_appendf(&trash, "%-4d %-4s %8u", thr + 1, name, count);
+	for (i = 0; i < COMP_LAT_BUCKETS; i++)
+		chunk_appendf(&trash, " %7u", HA_ATOMIC_LOAD(&hist[i]));
+	chunk_appendf(&trash, "\n");
+}
+
+/* dumps the compression latency histograms of all threads. The "run" line of
+ * a thread counts its compression calls, either inline or for jobs offloaded
+ * by other threads, and the "wait" line counts the jobs it offloaded. Returns
+ * 0 if the output buffer is full and it needs to be called again, otherwise 1.
+ */
+static int cli_io_handler_show_compression(struct appctx *appctx)
+{
+	struct show_comp_ctx *ctx = appctx->svcctx;
+	const struct comp_lat *lat;
+	int i;
+
+	for (; ctx->thr < global.nbthread; ctx->thr++) {
+		chunk_reset(&trash);
+		if (ctx->thr < 0) {
+			chunk_appendf(&trash, "# async-min-size: %u\n", comp_async_min_size);
+			chunk_appendf(&trash, "#thr kind    count");
+			for (i = 0; i < COMP_LAT_BUCKETS - 1; i++) {
+				if (i < 10)
+					chunk_appendf(&trash, " <%4uus", 1U << i);
+				else
+					chunk_appendf(&trash, " <%4ums", 1U << (i - 10));
+			}
+			chunk_appendf(&trash, "  longer\n");
+		}
+		else {
+			lat = &comp_lat[ctx->thr];
+			cli_dump_comp_lat(ctx->thr, "run", HA_ATOMIC_LOAD(&lat->inline_calls) + HA_ATOMIC_LOAD(&lat->jobs_run), lat->run);
+			cli_dump_comp_lat(ctx->thr, "wait", HA_ATOMIC_LOAD(&lat->jobs_sent), lat->wait);
+		}
+		if (applet_putchk(appctx, &trash) == -1)
+			return 0;
+	}
+	return 1;
+}
+
 /* Declare the config parser for "compression" keyword */
 static struct cfg_kw_list cfg_kws = {ILH, {
 		{ CFG_LISTEN, "compression", parse_compression_options },
+		{ CFG_GLOBAL, "tune.comp.async-min-size", cfg_parse_comp_async_min_size },
 		{ 0, NULL, NULL },
 	}
 };
@@ -1074,3 +1531,11 @@ static struct sample_fetch_kw_list sample_fetch_keywords = {ILH, {
 };
 
 INITCALL1(STG_REGISTER, sample_register_fetches, &sample_fetch_keywords);
+
+/* register cli keywords */
+static struct cli_kw_list cli_kws = {{ },{
+	{ { "show", "compression", NULL }, "show compression                        : show the compression latency histograms per thread", cli_parse_show_compression, cli_io_handler_show_compression, NULL },
+	{{},}
+}};
+
+INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
@@ -12,6 +12,12 @@
 
 #include <ctype.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <import/sha1.h>
 
 #include <haproxy/api.h>
@@ -427,6 +433,144 @@ void h1_parse_upgrade_header(struct h1m *h1m, struct ist value)
 		}                                                         \
 	} while (0)
 
+/* Vector helpers used by the HTTP/1 parser to skip long runs of bytes which
+ * are known to be valid in the current state, 16 (SSE2) or 32 (AVX2) bytes at
+ * a time. They never decide whether a byte is invalid: they only report the
+ * first one which is not trivially valid, and the regular byte-wise parser
+ * takes over from there, so that all strictness checks are preserved. On
+ * other platforms, only the word-at-a-time tricks are used. The masks returned
+ * by the h1_vec_*() functions have one bit per byte, the lowest bit
+ * corresponding to the first byte.
+ */
+#if defined(__AVX2__)
+#define H1_VEC_SIZE 32
+typedef __m256i h1_vec_t;
+
+static forceinline h1_vec_t h1_vec_load(const char *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static forceinline void h1_vec_store(char *p, h1_vec_t v)
+{
+	_mm256_storeu_si256((__m256i *)p, v);
+}
+
+/* returns the mask of the bytes of <v> included between <min> and <max> */
+static forceinline uint h1_vec_in(h1_vec_t v, uchar min, uchar max)
+{
+	h1_vec_t d = _mm256_sub_epi8(v, _mm256_set1_epi8(min));
+
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(max - min)), d));
+}
+
+/* returns the mask of the bytes of <v> equal to <c> */
+static forceinline uint h1_vec_eq(h1_vec_t v, uchar c)
+{
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+/* turns the upper case letters among the first <n> bytes of <v> to lower case */
+static forceinline h1_vec_t h1_vec_tolower(h1_vec_t v, uint n)
+{
+	const h1_vec_t idx = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	                                      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+	h1_vec_t d = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+	h1_vec_t up = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8('Z' - 'A')), d);
+
+	up = _mm256_and_si256(up, _mm256_cmpgt_epi8(_mm256_set1_epi8(n), idx));
+	return _mm256_add_epi8(v, _mm256_and_si256(up, _mm256_set1_epi8(0x20)));
+}
+
+#elif defined(__SSE2__)
+#define H1_VEC_SIZE 16
+typedef __m128i h1_vec_t;
+
+static forceinline h1_vec_t h1_vec_load(const char *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+static forceinline void h1_vec_store(char *p, h1_vec_t v)
+{
+	_mm_storeu_si128((__m128i *)p, v);
+}
+
+/* returns the mask of the bytes of <v> included between <min> and <max> */
+static forceinline uint h1_vec_in(h1_vec_t v, uchar min, uchar max)
+{
+	h1_vec_t d = _mm_sub_epi8(v, _mm_set1_epi8(min));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(max - min)), d));
+}
+
+/* returns the mask of the bytes of <v> equal to <c> */
+static forceinline uint h1_vec_eq(h1_vec_t v, uchar c)
+{
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+/* turns the upper case letters among the first <n> bytes of <v> to lower case */
+static forceinline h1_vec_t h1_vec_tolower(h1_vec_t v, uint n)
+{
+	const h1_vec_t idx = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	h1_vec_t d = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+	h1_vec_t up = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8('Z' - 'A')), d);
+
+	up = _mm_and_si128(up, _mm_cmpgt_epi8(_mm_set1_epi8(n), idx));
+	return _mm_add_epi8(v, _mm_and_si128(up, _mm_set1_epi8(0x20)));
+}
+#endif
+
+#ifdef H1_VEC_SIZE
+/* all bits set for a full vector */
+#define H1_VEC_ALL ((uint)((1ULL << H1_VEC_SIZE) - 1))
+
+/* Returns the number of bytes at <ptr> which are made of letters, digits and
+ * dashes, which covers most header field names. Only full vectors before <end>
+ * are checked, so the result is exact only if it's lower than the distance to
+ * the last full vector. If <lower> is non-zero, the upper case letters found
+ * are turned to lower case.
+ */
+static forceinline size_t h1_vec_skip_name(char *ptr, const char *end, int lower)
+{
+	char *p = ptr;
+	h1_vec_t v;
+	uint up, m, n;
+
+	while (p <= end - H1_VEC_SIZE) {
+		v = h1_vec_load(p);
+		up = h1_vec_in(v, 'A', 'Z');
+		m = up | h1_vec_in(v, 'a', 'z') | h1_vec_in(v, '0', '9') | h1_vec_eq(v, '-');
+		n = (m == H1_VEC_ALL) ? H1_VEC_SIZE : __builtin_ctz(~m);
+		if (lower && (up & ~(~0ULL << n)))
+			h1_vec_store(p, h1_vec_tolower(v, n));
+		p += n;
+		if (n < H1_VEC_SIZE)
+			break;
+	}
+	return p - ptr;
+}
+
+/* Returns the number of bytes at <ptr> which are included between <min> and
+ * <max> by steps of full vectors stopping at <end>, then the offset of the
+ * first byte outside of this range.
+ */
+static forceinline size_t h1_vec_skip_in(const char *ptr, const char *end, uchar min, uchar max)
+{
+	const char *p = ptr;
+	uint m;
+
+	while (p <= end - H1_VEC_SIZE) {
+		m = h1_vec_in(h1_vec_load(p), min, max);
+		if (m != H1_VEC_ALL)
+			return p - ptr + __builtin_ctz(~m);
+		p += H1_VEC_SIZE;
+	}
+	return p - ptr;
+}
+#endif /* H1_VEC_SIZE */
+
 /* This function parses a contiguous HTTP/1 headers block starting at <start>
  * and ending before <stop>, at once, and converts it a list of (name,value)
  * pairs representing header fields into the array <hdr> of size <hdr_num>,
@@ -595,6 +739,10 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 
 	case H1_MSG_RQURI:
 	http_msg_rquri:
+#ifdef H1_VEC_SIZE
+		/* speedup: skip vectors of bytes between 0x24 and 0x7e inclusive */
+		ptr += h1_vec_skip_in(ptr, end, 0x24, 0x7e);
+#endif
 #ifdef HA_UNALIGNED_LE
 		/* speedup: skip bytes not between 0x24 and 0x7e inclusive */
 		while (ptr <= end - sizeof(int)) {
@@ -870,13 +1018,22 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 	case H1_MSG_HDR_NAME:
 	http_msg_hdr_name:
 		/* assumes sol points to the first char */
+#ifdef H1_VEC_SIZE
+		/* speedup: skip vectors of letters, digits and dashes */
+		ptr += h1_vec_skip_name(ptr, end, !skip_update && (h1m->flags & H1_MF_TOLOWER));
+		if (ptr >= end) {
+			state = H1_MSG_HDR_NAME;
+			goto http_msg_ood;
+		}
+#endif
+	http_msg_hdr_name2:
 		if (likely(HTTP_IS_TOKEN(*ptr))) {
 			if (!skip_update) {
 				/* turn it to lower case if needed */
 				if (isupper((unsigned char)*ptr) && h1m->flags & H1_MF_TOLOWER)
 					*ptr = tolower((unsigned char)*ptr);
 			}
-			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name, http_msg_ood, state, H1_MSG_HDR_NAME);
+			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name2, http_msg_ood, state, H1_MSG_HDR_NAME);
 		}
 
 		if (likely(*ptr == ':')) {
@@ -897,7 +1054,7 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 			h1m->err_pos = ptr - start + skip; /* >= 0 now */
 
 		/* and we still accept this non-token character */
-		EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name, http_msg_ood, state, H1_MSG_HDR_NAME);
+		EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name2, http_msg_ood, state, H1_MSG_HDR_NAME);
 
 	case H1_MSG_HDR_L1_SP:
 	http_msg_hdr_l1_sp:
@@ -945,7 +1102,12 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 		 * and lower. In fact since most of the time is spent in the loop, we
 		 * also remove the sign bit test so that bytes 0x8e..0x0d break the
 		 * loop, but we don't care since they're very rare in header values.
+		 * Vectors are checked first when supported, and they also skip
+		 * bytes 0x80 and above.
 		 */
+#ifdef H1_VEC_SIZE
+		ptr += h1_vec_skip_in(ptr, end, 0x0e, 0xff);
+#endif
 #ifdef HA_UNALIGNED_LE64
 		while (ptr <= end - sizeof(long)) {
 			if (is_char8_below_opt(*(ulong *)ptr, 0x0e))
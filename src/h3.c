@@ -20,9 +20,11 @@
 
 #include <haproxy/api.h>
 #include <haproxy/buf.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/chunk.h>
 #include <haproxy/connection.h>
 #include <haproxy/dynbuf.h>
+#include <haproxy/errors.h>
 #include <haproxy/h3.h>
 #include <haproxy/h3_stats.h>
 #include <haproxy/http.h>
@@ -36,6 +38,8 @@
 #include <haproxy/qmux_http.h>
 #include <haproxy/qpack-dec.h>
 #include <haproxy/qpack-enc.h>
+#include <haproxy/qpack-t.h>
+#include <haproxy/qpack-tbl.h>
 #include <haproxy/quic_enc.h>
 #include <haproxy/quic_fctl.h>
 #include <haproxy/quic_frame.h>
@@ -124,16 +128,21 @@ INITCALL1(STG_REGISTER, trace_register_source, TRACE_SOURCE);
 #define H3_CF_GOAWAY_SENT       0x00000020  /* GOAWAY sent on local control stream */
 
 /* Default settings */
-static uint64_t h3_settings_qpack_max_table_capacity = 0;
+static uint64_t h3_settings_qpack_max_table_capacity = 0; /* also limits the encoder */
 static uint64_t h3_settings_qpack_blocked_streams = 4096;
 static uint64_t h3_settings_max_field_section_size = QUIC_VARINT_8_BYTE_MAX; /* Unlimited */
 
 struct h3c {
 	struct qcc *qcc;
 	struct qcs *ctrl_strm; /* Control stream */
+	struct qcs *qpack_enc_strm; /* QPACK encoder stream */
+	struct qcs *qpack_dec_strm; /* QPACK decoder stream */
 	int err;
 	uint32_t flags;
 
+	struct qpack_enc qpack_enc; /* QPACK encoder state */
+	struct qpack_dec qpack_dec; /* QPACK decoder state */
+
 	/* Settings */
 	uint64_t qpack_max_table_capacity;
 	uint64_t qpack_blocked_streams;
@@ -151,6 +160,7 @@ DECLARE_STATIC_POOL(pool_head_h3c, "h3c", sizeof(struct h3c));
 #define H3_SF_UNI_INIT  0x00000001  /* stream type not parsed for unidirectional stream */
 #define H3_SF_UNI_NO_H3 0x00000002  /* unidirectional stream does not carry H3 frames */
 #define H3_SF_HAVE_CLEN 0x00000004  /* content-length header is present */
+#define H3_SF_QPACK_BLOCKED 0x00000008  /* HEADERS blocked on the QPACK encoder stream */
 
 struct h3s {
 	struct h3c *h3c;
@@ -169,6 +179,125 @@ struct h3s {
 
 DECLARE_STATIC_POOL(pool_head_h3s, "h3s", sizeof(struct h3s));
 
+/* Transfer the QPACK decoder instructions from <pos> to the decoder stream of
+ * <h3c>.
+ *
+ * Returns 0 on success else non-zero, in which case nothing was sent.
+ */
+static int h3_qpack_dec_send(struct h3c *h3c, struct buffer *pos)
+{
+	struct qcs *qcs = h3c->qpack_dec_strm;
+	struct buffer *res;
+	size_t xfer;
+	int err;
+
+	if (!qcs)
+		return 1;
+
+	res = qcc_get_stream_txbuf(qcs, &err, 0);
+	if (!res || b_room(res) < b_data(pos) ||
+	    qfctl_sblocked(&qcs->tx.fc) || qfctl_sblocked(&h3c->qcc->tx.fc)) {
+		TRACE_STATE("cannot send QPACK decoder instructions", H3_EV_TX_FRAME, h3c->qcc->conn, qcs);
+		return 1;
+	}
+
+	xfer = b_force_xfer(res, pos, b_data(pos));
+	qcc_send_stream(qcs, 1, xfer);
+	return 0;
+}
+
+/* Report the insertions received on the QPACK encoder stream of <h3c> which
+ * were not acknowledged yet, and acknowledge the field section decoded on
+ * stream <id> if its required insert count <ric> is not null. Failures are
+ * not fatal, the peer's encoder will only have to wait longer.
+ */
+static void h3_qpack_dec_ack(struct h3c *h3c, uint64_t id, uint64_t ric)
+{
+	struct qpack_dec *dec = &h3c->qpack_dec;
+	unsigned char data[2 * QUIC_VARINT_MAX_SIZE + 2];
+	struct buffer pos = b_make((char *)data, sizeof(data), 0, 0);
+	uint64_t krc = dec->krc;
+
+	if (ric) {
+		if (qpack_dec_encode_sack(dec, &pos, id, ric))
+			goto fail;
+	}
+	else if (qpack_dec_encode_ici(dec, &pos)) {
+		goto fail;
+	}
+
+	if (b_data(&pos) && h3_qpack_dec_send(h3c, &pos))
+		goto fail;
+	return;
+
+ fail:
+	dec->krc = krc;
+}
+
+/* Mark stream <h3s> as blocked on the QPACK encoder stream.
+ *
+ * Returns 0 on success else non-zero if too many streams are blocked.
+ */
+static int h3_qpack_block(struct h3s *h3s)
+{
+	struct h3c *h3c = h3s->h3c;
+
+	if (h3s->flags & H3_SF_QPACK_BLOCKED)
+		return 0;
+
+	/* RFC 9204 2.1.2. Blocked Streams
+	 *
+	 * If a decoder encounters more blocked streams than it promised to
+	 * support, it MUST treat this as a connection error of type
+	 * QPACK_DECOMPRESSION_FAILED.
+	 */
+	if (h3c->qpack_dec.blocked >= h3_settings_qpack_blocked_streams)
+		return 1;
+
+	h3c->qpack_dec.blocked++;
+	h3s->flags |= H3_SF_QPACK_BLOCKED;
+	return 0;
+}
+
+/* Remove the blocked state of stream <h3s> if set. */
+static void h3_qpack_unblock(struct h3s *h3s)
+{
+	if (h3s->flags & H3_SF_QPACK_BLOCKED) {
+		h3s->h3c->qpack_dec.blocked--;
+		h3s->flags &= ~H3_SF_QPACK_BLOCKED;
+	}
+}
+
+/* Encode header <n>:<v> into <out> for the field section being built by the
+ * QPACK encoder of <h3c>. Insertions into the dynamic table are emitted
+ * right away on the encoder stream.
+ *
+ * Returns 0 on success else non-zero.
+ */
+static int h3_qpack_enc_header(struct h3c *h3c, struct buffer *out,
+                               const struct ist n, const struct ist v)
+{
+	struct qcs *qcs = h3c->qpack_enc_strm;
+	struct buffer *ins = NULL;
+	size_t data = 0;
+	int err, ret;
+
+	if (qcs && h3c->qpack_enc.max_cap &&
+	    !qfctl_sblocked(&qcs->tx.fc) && !qfctl_sblocked(&h3c->qcc->tx.fc)) {
+		ins = qcc_get_stream_txbuf(qcs, &err, 0);
+		if (ins)
+			data = b_data(ins);
+	}
+
+	ret = qpack_enc_header(&h3c->qpack_enc, out, ins, n, v);
+
+	/* the insertions are sent even if the field section is not */
+	if (ins && b_data(ins) > data)
+		qcc_send_stream(qcs, 1, b_data(ins) - data);
+
+	return ret;
+}
+
 /* Initialize an uni-stream <qcs> by reading its type from <b>.
  *
  * Returns the count of consumed bytes or a negative error code.
@@ -265,18 +394,27 @@ static ssize_t h3_init_uni_stream(struct h3c *h3c, struct qcs *qcs,
 static ssize_t h3_parse_uni_stream_no_h3(struct qcs *qcs, struct buffer *b, int fin)
 {
 	struct h3s *h3s = qcs->ctx;
+	struct h3c *h3c = h3s->h3c;
+	uint64_t ic = h3c->qpack_dec.ic;
+	ssize_t ret;
 
 	/* Function reserved to non-HTTP/3 unidirectional streams. */
 	BUG_ON(!quic_stream_is_uni(qcs->id) || !(h3s->flags & H3_SF_UNI_NO_H3));
 
 	switch (h3s->type) {
 	case H3S_T_QPACK_DEC:
-		if (qpack_decode_dec(b, fin, qcs))
-			return -1;
+		ret = qpack_decode_dec(&h3c->qpack_enc, b, fin, qcs);
 		break;
 	case H3S_T_QPACK_ENC:
-		if (qpack_decode_enc(b, fin, qcs))
-			return -1;
+		ret = qpack_decode_enc(&h3c->qpack_dec, b, fin, qcs);
+		if (ret > 0 && h3c->qpack_dec.ic != ic) {
+			h3_qpack_dec_ack(h3c, 0, 0);
+			/* streams blocked on these insertions are decoded
+			 * again by the MUX.
+			 */
+			if (h3c->qpack_dec.blocked)
+				tasklet_wakeup(h3c->qcc->wait_event.tasklet);
+		}
 		break;
 	case H3S_T_UNKNOWN:
 	default:
@@ -284,8 +422,7 @@ static ssize_t h3_parse_uni_stream_no_h3(struct qcs *qcs, struct buffer *b, int
 		ABORT_NOW();
 	}
 
-	/* TODO adjust return code */
-	return 0;
+	return ret;
 }
 
 /* Decode a H3 frame header from <rxbuf> buffer. The frame type is stored in
@@ -534,6 +671,7 @@ static ssize_t h3_headers_to_htx(struct qcs *qcs, const struct buffer *buf,
 	const char *ctl;
 	int relaxed = !!(h3c->qcc->proxy->options2 & PR_O2_REQBUG_OK);
 	int qpack_err;
+	uint64_t ric;
 
 	/* RFC 9114 4.1.2. Malformed Requests and Responses
 	 *
@@ -561,8 +699,23 @@ static ssize_t h3_headers_to_htx(struct qcs *qcs, const struct buffer *buf,
 
 	/* TODO support buffer wrapping */
 	BUG_ON(b_head(buf) + len >= b_wrap(buf));
-	ret = qpack_decode_fs((const unsigned char *)b_head(buf), len, tmp,
-	                    list, sizeof(list) / sizeof(list[0]));
+	ret = qpack_decode_fs(&h3c->qpack_dec, (const unsigned char *)b_head(buf), len, tmp,
+	                      list, sizeof(list) / sizeof(list[0]), &ric);
+	if (ret == -QPACK_RET_BLOCKED) {
+		if (h3_qpack_block(h3s)) {
+			TRACE_ERROR("too many blocked streams", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
+			h3c->err = QPACK_ERR_DECOMPRESSION_FAILED;
+			qcc_report_glitch(qcs->qcc, 1);
+			len = -1;
+			goto out;
+		}
+
+		TRACE_STATE("blocked on QPACK encoder stream", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
+		len = 0;
+		goto out;
+	}
+
+	h3_qpack_unblock(h3s);
 	if (ret < 0) {
 		TRACE_ERROR("QPACK decoding error", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
 		if ((qpack_err = qpack_err_decode(ret)) >= 0) {
@@ -573,6 +726,9 @@ static ssize_t h3_headers_to_htx(struct qcs *qcs, const struct buffer *buf,
 		goto out;
 	}
 
+	if (ric)
+		h3_qpack_dec_ack(h3c, qcs->id, ric);
+
 	if (!b_alloc(&htx_buf, DB_SE_RX)) {
 		TRACE_ERROR("HTX buffer alloc failure", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
 		len = -1;
@@ -966,14 +1122,30 @@ static ssize_t h3_trailers_to_htx(struct qcs *qcs, const struct buffer *buf,
 	int hdr_idx, ret;
 	const char *ctl;
 	int qpack_err;
+	uint64_t ric;
 	int i;
 
 	TRACE_ENTER(H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
 
 	/* TODO support buffer wrapping */
 	BUG_ON(b_head(buf) + len >= b_wrap(buf));
-	ret = qpack_decode_fs((const unsigned char *)b_head(buf), len, tmp,
-	                    list, sizeof(list) / sizeof(list[0]));
+	ret = qpack_decode_fs(&h3c->qpack_dec, (const unsigned char *)b_head(buf), len, tmp,
+	                      list, sizeof(list) / sizeof(list[0]), &ric);
+	if (ret == -QPACK_RET_BLOCKED) {
+		if (h3_qpack_block(h3s)) {
+			TRACE_ERROR("too many blocked streams", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
+			h3c->err = QPACK_ERR_DECOMPRESSION_FAILED;
+			qcc_report_glitch(qcs->qcc, 1);
+			len = -1;
+			goto out;
+		}
+
+		TRACE_STATE("blocked on QPACK encoder stream", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
+		len = 0;
+		goto out;
+	}
+
+	h3_qpack_unblock(h3s);
 	if (ret < 0) {
 		TRACE_ERROR("QPACK decoding error", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
 		if ((qpack_err = qpack_err_decode(ret)) >= 0) {
@@ -984,6 +1156,9 @@ static ssize_t h3_trailers_to_htx(struct qcs *qcs, const struct buffer *buf,
 		goto out;
 	}
 
+	if (ric)
+		h3_qpack_dec_ack(h3c, qcs->id, ric);
+
 	if (!(appbuf = qcc_get_stream_rxbuf(qcs))) {
 		TRACE_ERROR("HTX buffer alloc failure", H3_EV_RX_FRAME|H3_EV_RX_HDR, qcs->qcc->conn, qcs);
 		len = -1;
@@ -1394,7 +1569,9 @@ static ssize_t h3_rcv_buf(struct qcs *qcs, struct buffer *b, int fin)
 		if (last_stream_frame && h3s->flags & H3_SF_HAVE_CLEN && h3_check_body_size(qcs, last_stream_frame))
 			break;
 
-		h3_inc_frame_type_cnt(h3c->prx_counters, ftype);
+		/* a blocked HEADERS frame was already accounted for */
+		if (!(h3s->flags & H3_SF_QPACK_BLOCKED))
+			h3_inc_frame_type_cnt(h3c->prx_counters, ftype);
 		switch (ftype) {
 		case H3_FT_DATA:
 			ret = h3_data_to_htx(qcs, b, flen, last_stream_frame);
@@ -1403,11 +1580,13 @@ static ssize_t h3_rcv_buf(struct qcs *qcs, struct buffer *b, int fin)
 		case H3_FT_HEADERS:
 			if (h3s->st_req == H3S_ST_REQ_BEFORE) {
 				ret = h3_headers_to_htx(qcs, b, flen, last_stream_frame);
-				h3s->st_req = H3S_ST_REQ_HEADERS;
+				if (!(h3s->flags & H3_SF_QPACK_BLOCKED))
+					h3s->st_req = H3S_ST_REQ_HEADERS;
 			}
 			else {
 				ret = h3_trailers_to_htx(qcs, b, flen, last_stream_frame);
-				h3s->st_req = H3S_ST_REQ_TRAILERS;
+				if (!(h3s->flags & H3_SF_QPACK_BLOCKED))
+					h3s->st_req = H3S_ST_REQ_TRAILERS;
 			}
 			break;
 		case H3_FT_CANCEL_PUSH:
@@ -1425,6 +1604,8 @@ static ssize_t h3_rcv_buf(struct qcs *qcs, struct buffer *b, int fin)
 				goto err;
 			}
 			h3c->flags |= H3_CF_SETTINGS_RECV;
+			qpack_enc_set_max(&h3c->qpack_enc, h3c->qpack_max_table_capacity,
+			                  h3c->qpack_blocked_streams);
 			break;
 		default:
 			/* draft-ietf-quic-http34 9. Extensions to HTTP/3
@@ -1442,6 +1623,11 @@ static ssize_t h3_rcv_buf(struct qcs *qcs, struct buffer *b, int fin)
 			b_del(b, ret);
 			total += ret;
 		}
+
+		if (h3s->flags & H3_SF_QPACK_BLOCKED) {
+			TRACE_STATE("pause parsing on QPACK blocked stream", H3_EV_RX_FRAME, qcs->qcc->conn, qcs);
+			break;
+		}
 	}
 
 	/* Reset demux frame type for traces. */
@@ -1553,15 +1739,19 @@ static int h3_control_send(struct qcs *qcs, void *ctx)
 
 static int h3_resp_headers_send(struct qcs *qcs, struct htx *htx)
 {
+	struct h3c *h3c = qcs->qcc->ctx;
 	int err;
 	struct buffer outbuf;
 	struct buffer headers_buf = BUF_NULL;
+	struct buffer pfx;
+	char pfx_area[QPACK_ENC_PFX_MAX_SZ];
 	struct buffer *res;
 	struct http_hdr list[global.tune.max_http_hdr];
 	struct htx_sl *sl;
 	struct htx_blk *blk;
 	enum htx_blk_type type;
 	int frame_length_size;  /* size in bytes of frame length varint field */
+	size_t len;
 	int smallbuf = 1;
 	int ret = 0;
 	int hdr;
@@ -1620,18 +1810,22 @@ static int h3_resp_headers_send(struct qcs *qcs, struct htx *htx)
 		goto end;
 	}
 
-	/* Buffer allocated just now : must be enough for frame type + length as a max varint size */
-	BUG_ON(b_room(res) < 5);
+	/* Buffer allocated just now : must be enough for frame type + length
+	 * as a max varint size and the field section prefix.
+	 */
+	BUG_ON(b_room(res) < 5 + QPACK_ENC_PFX_MAX_SZ);
 
 	b_reset(&outbuf);
 	outbuf = b_make(b_tail(res), b_contig_space(res), 0, 0);
-	/* Start the headers after frame type + length */
-	headers_buf = b_make(b_head(res) + 5, b_size(res) - 5, 0, 0);
+	/* Start the field lines after frame type + length + prefix, the
+	 * latter being only known once all lines are encoded.
+	 */
+	headers_buf = b_make(b_head(res) + 5 + QPACK_ENC_PFX_MAX_SZ,
+	                     b_size(res) - 5 - QPACK_ENC_PFX_MAX_SZ, 0, 0);
 
 	TRACE_DATA("encoding HEADERS frame", H3_EV_TX_FRAME|H3_EV_TX_HDR,
 	           qcs->qcc->conn, qcs);
-	if (qpack_encode_field_section_line(&headers_buf))
-		goto err_full;
+	qpack_enc_begin(&h3c->qpack_enc, qcs->id);
 	if (qpack_encode_int_status(&headers_buf, status)) {
 		/* TODO handle invalid status code VS no buf space left */
 		TRACE_ERROR("error during status code encoding", H3_EV_TX_FRAME|H3_EV_TX_HDR, qcs->qcc->conn, qcs);
@@ -1665,18 +1859,24 @@ static int h3_resp_headers_send(struct qcs *qcs, struct htx *htx)
 			list[hdr].v = ist("trailers");
 		}
 
-		if (qpack_encode_header(&headers_buf, list[hdr].n, list[hdr].v))
+		if (h3_qpack_enc_header(h3c, &headers_buf, list[hdr].n, list[hdr].v))
 			goto err_full;
 	}
 
+	pfx = b_make(pfx_area, sizeof(pfx_area), 0, 0);
+	if (qpack_enc_end(&h3c->qpack_enc, &pfx))
+		goto err;
+
 	/* Now that all headers are encoded, we are certain that res buffer is
-	 * big enough
+	 * big enough. The prefix is placed just before the field lines.
 	 */
-	frame_length_size = quic_int_getsize(b_data(&headers_buf));
-	res->head += 4 - frame_length_size;
+	memcpy(b_head(&headers_buf) - b_data(&pfx), b_orig(&pfx), b_data(&pfx));
+	len = b_data(&pfx) + b_data(&headers_buf);
+	frame_length_size = quic_int_getsize(len);
+	res->head += 4 + QPACK_ENC_PFX_MAX_SZ - b_data(&pfx) - frame_length_size;
 	b_putchr(res, 0x01); /* h3 HEADERS frame type */
-	b_quic_enc_int(res, b_data(&headers_buf), 0);
-	b_add(res, b_data(&headers_buf));
+	b_quic_enc_int(res, len, 0);
+	b_add(res, len);
 
 	ret = 0;
 	blk = htx_get_head_blk(htx);
@@ -1716,13 +1916,16 @@ static int h3_resp_headers_send(struct qcs *qcs, struct htx *htx)
  */
 static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 {
+	struct h3c *h3c = qcs->qcc->ctx;
 	int err;
 	struct buffer headers_buf = BUF_NULL;
+	struct buffer pfx;
+	char pfx_area[QPACK_ENC_PFX_MAX_SZ];
 	struct buffer *res;
 	struct http_hdr list[global.tune.max_http_hdr];
 	struct htx_blk *blk;
 	enum htx_blk_type type;
-	char *tail;
+	size_t len;
 	int ret = 0;
 	int hdr;
 
@@ -1784,8 +1987,10 @@ static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 		goto end;
 	}
 
-	/* At least 9 bytes to store frame type + length as a varint max size */
-	if (b_room(res) < 9) {
+	/* At least 9 bytes to store frame type + length as a varint max size
+	 * and the field section prefix.
+	 */
+	if (b_room(res) < 9 + QPACK_ENC_PFX_MAX_SZ) {
 		TRACE_STATE("not enough room for trailers frame", H3_EV_TX_FRAME|H3_EV_TX_HDR, qcs->qcc->conn, qcs);
 		if (qcc_release_stream_txbuf(qcs))
 			goto end;
@@ -1797,19 +2002,11 @@ static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 	/* Force buffer realignment as size required to encode headers is unknown. */
 	if (b_space_wraps(res))
 		b_slow_realign(res, trash.area, b_data(res));
-	/* Start the headers after frame type + length */
-	headers_buf = b_make(b_peek(res, b_data(res) + 9), b_contig_space(res) - 9, 0, 0);
+	/* Start the field lines after frame type + length + prefix */
+	headers_buf = b_make(b_peek(res, b_data(res) + 9 + QPACK_ENC_PFX_MAX_SZ),
+	                     b_contig_space(res) - 9 - QPACK_ENC_PFX_MAX_SZ, 0, 0);
 
-	if (qpack_encode_field_section_line(&headers_buf)) {
-		TRACE_STATE("not enough room for trailers section line", H3_EV_TX_FRAME|H3_EV_TX_HDR, qcs->qcc->conn, qcs);
-		if (qcc_release_stream_txbuf(qcs))
-			goto end;
-
-		/* Buffer released, restart processing. */
-		goto start;
-	}
-
-	tail = b_tail(&headers_buf);
+	qpack_enc_begin(&h3c->qpack_enc, qcs->id);
 	for (hdr = 0; hdr < sizeof(list) / sizeof(list[0]); ++hdr) {
 		if (isteq(list[hdr].n, ist("")))
 			break;
@@ -1825,7 +2022,7 @@ static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 			continue;
 		}
 
-		if (qpack_encode_header(&headers_buf, list[hdr].n, list[hdr].v)) {
+		if (h3_qpack_enc_header(h3c, &headers_buf, list[hdr].n, list[hdr].v)) {
 			TRACE_STATE("not enough room for all trailers", H3_EV_TX_FRAME|H3_EV_TX_HDR, qcs->qcc->conn, qcs);
 			if (qcc_release_stream_txbuf(qcs))
 				goto end;
@@ -1836,7 +2033,7 @@ static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 	}
 
 	/* Check that at least one header was encoded in buffer. */
-	if (b_tail(&headers_buf) == tail) {
+	if (!b_data(&headers_buf)) {
 		/* No headers encoded here so no need to generate a H3 HEADERS
 		 * frame. Mux will send an empty QUIC STREAM frame with FIN.
 		 */
@@ -1846,11 +2043,19 @@ static int h3_resp_trailers_send(struct qcs *qcs, struct htx *htx)
 		/* Now that all headers are encoded, we are certain that res
 		 * buffer is big enough.
 		 */
+		pfx = b_make(pfx_area, sizeof(pfx_area), 0, 0);
+		if (qpack_enc_end(&h3c->qpack_enc, &pfx))
+			goto err;
+
 		TRACE_DATA("encoding TRAILERS frame", H3_EV_TX_FRAME|H3_EV_TX_HDR,
 			   qcs->qcc->conn, qcs);
+		/* move the field lines just after the prefix */
+		memcpy(b_tail(res) + 9, b_orig(&pfx), b_data(&pfx));
+		memmove(b_tail(res) + 9 + b_data(&pfx), b_head(&headers_buf), b_data(&headers_buf));
+		len = b_data(&pfx) + b_data(&headers_buf);
 		b_putchr(res, 0x01); /* h3 HEADERS frame type */
-		b_quic_enc_int(res, b_data(&headers_buf), 8);
-		b_add(res, b_data(&headers_buf));
+		b_quic_enc_int(res, len, 8);
+		b_add(res, len);
 	}
 
 	/* Encoding success, truncate HTX blocks until EOT. */
@@ -2294,9 +2499,29 @@ static int h3_attach(struct qcs *qcs, void *conn_ctx)
 static void h3_detach(struct qcs *qcs)
 {
 	struct h3s *h3s = qcs->ctx;
+	struct h3c *h3c = h3s->h3c;
 
 	TRACE_ENTER(H3_EV_H3S_END, qcs->qcc->conn, qcs);
 
+	if (qcs == h3c->qpack_enc_strm)
+		h3c->qpack_enc_strm = NULL;
+	else if (qcs == h3c->qpack_dec_strm)
+		h3c->qpack_dec_strm = NULL;
+
+	if (h3s->flags & H3_SF_QPACK_BLOCKED) {
+		unsigned char data[QUIC_VARINT_MAX_SIZE + 1];
+		struct buffer pos = b_make((char *)data, sizeof(data), 0, 0);
+
+		/* RFC 9204 4.4.2. Stream Cancellation
+		 *
+		 * When a stream is reset or reading is abandoned, the decoder
+		 * emits a Stream Cancellation instruction.
+		 */
+		h3_qpack_unblock(h3s);
+		if (!qpack_dec_encode_sccl(&pos, qcs->id))
+			h3_qpack_dec_send(h3c, &pos);
+	}
+
 	pool_free(pool_head_h3s, h3s);
 	qcs->ctx = NULL;
 
@@ -2371,6 +2596,10 @@ static int h3_init(struct qcc *qcc)
 
 	h3c->qcc = qcc;
 	h3c->ctrl_strm = NULL;
+	h3c->qpack_enc_strm = NULL;
+	h3c->qpack_dec_strm = NULL;
+	qpack_enc_init(&h3c->qpack_enc, h3_settings_qpack_max_table_capacity);
+	qpack_dec_init(&h3c->qpack_dec, h3_settings_qpack_max_table_capacity);
 	h3c->err = 0;
 	h3c->flags = 0;
 	h3c->id_goaway = 0;
@@ -2390,6 +2619,39 @@ static int h3_init(struct qcc *qcc)
 	return 0;
 }
 
+/* Open a local QPACK stream of type <type> for <h3c> and emit its type.
+ *
+ * Returns the stream instance or NULL on error.
+ */
+static struct qcs *h3_qpack_stream_init(struct h3c *h3c, uint64_t type)
+{
+	struct qcc *qcc = h3c->qcc;
+	struct qcs *qcs;
+	struct buffer *res;
+	int err;
+
+	qcs = qcc_init_stream_local(qcc, 0);
+	if (!qcs) {
+		/* Error must be set by qcc_init_stream_local(). */
+		BUG_ON(!(qcc->flags & QC_CF_ERRL));
+		TRACE_ERROR("cannot init QPACK stream", H3_EV_H3C_NEW, qcc->conn);
+		return NULL;
+	}
+
+	qcs_send_metadata(qcs);
+
+	res = qcc_get_stream_txbuf(qcs, &err, 0);
+	if (!res || b_room(res) < QUIC_VARINT_MAX_SIZE) {
+		TRACE_ERROR("cannot allocate Tx buffer", H3_EV_H3C_NEW, qcc->conn, qcs);
+		qcc_set_error(qcc, H3_ERR_INTERNAL_ERROR, 1);
+		return NULL;
+	}
+
+	b_quic_enc_int(res, type, 0);
+	qcc_send_stream(qcs, 1, b_data(res));
+	return qcs;
+}
+
 /* Initialize H3 control stream and prepare SETTINGS emission.
  *
  * Returns 0 on success else non-zero.
@@ -2418,6 +2680,19 @@ static int h3_finalize(void *ctx)
 		goto err;
 	}
 
+	/* QPACK encoder and decoder streams are only useful with a dynamic
+	 * table. The encoder table is limited by the same setting.
+	 */
+	if (h3_settings_qpack_max_table_capacity) {
+		h3c->qpack_enc_strm = h3_qpack_stream_init(h3c, H3_UNI_S_T_QPACK_ENC);
+		if (!h3c->qpack_enc_strm)
+			goto err;
+
+		h3c->qpack_dec_strm = h3_qpack_stream_init(h3c, H3_UNI_S_T_QPACK_DEC);
+		if (!h3c->qpack_dec_strm)
+			goto err;
+	}
+
 	TRACE_LEAVE(H3_EV_H3C_NEW, qcc->conn);
 	return 0;
 
@@ -2456,6 +2731,9 @@ static void h3_shutdown(void *ctx)
 static void h3_release(void *ctx)
 {
 	struct h3c *h3c = ctx;
+
+	qpack_enc_release(&h3c->qpack_enc);
+	qpack_dec_release(&h3c->qpack_dec);
 	pool_free(pool_head_h3c, h3c);
 }
 
@@ -2516,6 +2794,84 @@ static void h3_trace(enum trace_level level, uint64_t mask,
 	}
 }
 
+/* config parser for global "tune.h3.qpack-table-size" */
+static int h3_parse_qpack_table_size(char **args, int section_type, struct proxy *curpx,
+                                     const struct proxy *defpx, const char *file, int line,
+                                     char **err)
+{
+	int size;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	size = atoi(args[1]);
+	if (size < 0 || size > 65536) {
+		memprintf(err, "'%s' expects a numeric value between 0 and 65536.", args[0]);
+		return -1;
+	}
+	h3_settings_qpack_max_table_capacity = size;
+	return 0;
+}
+
+/* config parser for global "tune.h3.qpack-blocked-streams" */
+static int h3_parse_qpack_blocked_streams(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	int nb;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	nb = atoi(args[1]);
+	if (nb < 0) {
+		memprintf(err, "'%s' expects a positive numeric value.", args[0]);
+		return -1;
+	}
+	h3_settings_qpack_blocked_streams = nb;
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.h3.qpack-blocked-streams", h3_parse_qpack_blocked_streams },
+	{ CFG_GLOBAL, "tune.h3.qpack-table-size",      h3_parse_qpack_table_size      },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
+/* initialize internal structs after the config is parsed.
+ * Returns zero on success, non-zero on error.
+ */
+static int init_h3()
+{
+	if (!h3_settings_qpack_max_table_capacity)
+		return ERR_NONE;
+
+	/* encoder stream instructions are only parsed once complete in the
+	 * stream's buffer, so the largest entry must fit there with room
+	 * left for the encoding.
+	 */
+	if (h3_settings_qpack_max_table_capacity > global.tune.bufsize / 2) {
+		ha_warning("'tune.h3.qpack-table-size' (%llu) is larger than half of "
+		           "'tune.bufsize', limiting it to %d.\n",
+		           (ull)h3_settings_qpack_max_table_capacity, global.tune.bufsize / 2);
+		h3_settings_qpack_max_table_capacity = global.tune.bufsize / 2;
+	}
+
+	/* the pool is shared by the decoders and encoders tables */
+	pool_head_qpack_tbl = create_pool("qpack_tbl", h3_settings_qpack_max_table_capacity,
+	                                  MEM_F_SHARED|MEM_F_EXACT);
+	if (!pool_head_qpack_tbl) {
+		ha_alert("failed to allocate qpack_tbl memory pool\n");
+		return (ERR_ALERT | ERR_FATAL);
+	}
+	return ERR_NONE;
+}
+
+REGISTER_POST_CHECK(init_h3);
+
 /* HTTP/3 application layer operations */
 const struct qcc_app_ops h3_ops = {
 	.init        = h3_init,
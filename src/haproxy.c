@@ -80,6 +80,7 @@
 #include <haproxy/cli.h>
 #include <haproxy/clock.h>
 #include <haproxy/connection.h>
+#include <haproxy/counters.h>
 #ifdef USE_CPU_AFFINITY
 #include <haproxy/cpuset.h>
 #endif
@@ -206,6 +207,7 @@ struct global global = {
 		.quic_reorder_ratio = QUIC_DFLT_REORDER_RATIO,
 		.quic_retry_threshold = QUIC_DFLT_RETRY_THRESHOLD,
 		.quic_max_frame_loss = QUIC_DFLT_MAX_FRAME_LOSS,
+		.quic_rx_batch = QUIC_DFLT_RX_BATCH,
 #endif /* USE_QUIC */
 	},
 #ifdef USE_OPENSSL
@@ -631,6 +633,9 @@ static void usage(char *name)
 #if defined(USE_EPOLL)
 		"        -de disables epoll() usage even when available\n"
 #endif
+#if defined(USE_URING)
+		"        -du disables io_uring usage even when available\n"
+#endif
 #if defined(USE_KQUEUE)
 		"        -dk disables kqueue() usage even when available\n"
 #endif
@@ -1006,7 +1011,7 @@ static void sig_dump_state(struct sig_handler *sh)
 			             "SIGHUP: Server %s/%s is %s. Conn: %d act, %d pend, %lld tot.",
 			             p->id, s->id,
 			             (s->cur_state != SRV_ST_STOPPED) ? "UP" : "DOWN",
-			             s->cur_sess, s->queue.length, s->counters.cum_sess);
+			             s->cur_sess, s->queue.length, COUNTERS_SHARED_TOTAL(s->counters.shared, cum_sess));
 			ha_warning("%s\n", trash.area);
 			send_log(p, LOG_NOTICE, "%s\n", trash.area);
 			s = s->next;
@@ -1017,19 +1022,25 @@ static void sig_dump_state(struct sig_handler *sh)
 			chunk_printf(&trash,
 			             "SIGHUP: Proxy %s has no servers. Conn: act(FE+BE): %d+%d, %d pend (%d unass), tot(FE+BE): %lld+%lld.",
 			             p->id,
-			             p->feconn, p->beconn, p->totpend, p->queue.length, p->fe_counters.cum_conn, p->be_counters.cum_sess);
+			             p->feconn, p->beconn, p->totpend, p->queue.length,
+			             COUNTERS_SHARED_TOTAL(p->fe_counters.shared, cum_conn),
+			             COUNTERS_SHARED_TOTAL(p->be_counters.shared, cum_sess));
 		} else if (p->srv_act == 0) {
 			chunk_printf(&trash,
 			             "SIGHUP: Proxy %s %s ! Conn: act(FE+BE): %d+%d, %d pend (%d unass), tot(FE+BE): %lld+%lld.",
 			             p->id,
 			             (p->srv_bck) ? "is running on backup servers" : "has no server available",
-			             p->feconn, p->beconn, p->totpend, p->queue.length, p->fe_counters.cum_conn, p->be_counters.cum_sess);
+			             p->feconn, p->beconn, p->totpend, p->queue.length,
+			             COUNTERS_SHARED_TOTAL(p->fe_counters.shared, cum_conn),
+			             COUNTERS_SHARED_TOTAL(p->be_counters.shared, cum_sess));
 		} else {
 			chunk_printf(&trash,
 			             "SIGHUP: Proxy %s has %d active servers and %d backup servers available."
 			             " Conn: act(FE+BE): %d+%d, %d pend (%d unass), tot(FE+BE): %lld+%lld.",
 			             p->id, p->srv_act, p->srv_bck,
-			             p->feconn, p->beconn, p->totpend, p->queue.length, p->fe_counters.cum_conn, p->be_counters.cum_sess);
+			             p->feconn, p->beconn, p->totpend, p->queue.length,
+			             COUNTERS_SHARED_TOTAL(p->fe_counters.shared, cum_conn),
+			             COUNTERS_SHARED_TOTAL(p->be_counters.shared, cum_sess));
 		}
 		ha_warning("%s\n", trash.area);
 		send_log(p, LOG_NOTICE, "%s\n", trash.area);
@@ -1604,6 +1615,9 @@ static void init_args(int argc, char **argv)
 #if defined(USE_EPOLL)
 	global.tune.options |= GTUNE_USE_EPOLL;
 #endif
+#if defined(USE_URING)
+	global.tune.options |= GTUNE_USE_URING;
+#endif
 #if defined(USE_KQUEUE)
 	global.tune.options |= GTUNE_USE_KQUEUE;
 #endif
@@ -1655,6 +1669,10 @@ static void init_args(int argc, char **argv)
 			else if (*flag == 'd' && flag[1] == 'e')
 				global.tune.options &= ~GTUNE_USE_EPOLL;
 #endif
+#if defined(USE_URING)
+			else if (*flag == 'd' && flag[1] == 'u')
+				global.tune.options &= ~GTUNE_USE_URING;
+#endif
 #if defined(USE_POLL)
 			else if (*flag == 'd' && flag[1] == 'p')
 				global.tune.options &= ~GTUNE_USE_POLL;
@@ -2556,6 +2574,9 @@ static void init(int argc, char **argv)
 	if (!(global.tune.options & GTUNE_USE_EPOLL))
 		disable_poller("epoll");
 
+	if (!(global.tune.options & GTUNE_USE_URING))
+		disable_poller("uring");
+
 	if (!(global.tune.options & GTUNE_USE_POLL))
 		disable_poller("poll");
 
@@ -2970,6 +2991,9 @@ void run_poll_loop()
 		/* If we have to sleep, measure how long */
 		next = wake ? TICK_ETERNITY : next_timer_expiry();
 
+		/* the logs emitted during this loop must not wait for the next one */
+		log_flush_batch();
+
 		/* The poller will ensure it returns around <next> */
 		cur_poller.poll(&cur_poller, next, wake);
 
@@ -3010,6 +3034,11 @@ static void *run_thread_poll_loop(void *data)
 			    global.tune.ring_queues :
 			    RING_DFLT_QUEUES))) % RING_WAIT_QUEUES;
 
+	/* Assign the counters shard. Here locality matters since the shards
+	 * are written to all the time, so neighbour threads share the same.
+	 */
+	ha_thread_info[tid].ctr_shard = counters_thread_shard(tid);
+
 	/* thread is started, from now on it is not idle nor harmless */
 	thread_harmless_end();
 	thread_idle_end();
@@ -8782,7 +8782,7 @@ __LJMP static int hlua_txn_done(lua_State *L)
 		/* let's log the request time */
 		s->logs.request_ts = now_ns;
 		if (s->sess->fe == s->be) /* report it if the request was intercepted by the frontend */
-			_HA_ATOMIC_INC(&s->sess->fe->fe_counters.intercepted_req);
+			_HA_ATOMIC_INC(&s->sess->fe->fe_counters.shared.shard[ti->ctr_shard]->intercepted_req);
 	}
 
   done:
@@ -32,8 +32,22 @@
 
 #include <import/ist.h>
 #include <haproxy/hpack-enc.h>
+#include <haproxy/hpack-tbl.h>
 #include <haproxy/http-hdr-t.h>
 
+/* Insertions decided while building the current header block. They are only
+ * applied to the dynamic table of encoder <enc> on commit. There is at most
+ * one header block being built at once per thread.
+ */
+struct hpack_enc_pend {
+	struct hpack_enc *enc;    /* encoder the block is built for */
+	uint32_t size;            /* sum of the pending entries sizes */
+	int count;                /* number of pending entries */
+	struct http_hdr list[HPACK_ENC_MAX_PEND];
+};
+
+static THREAD_LOCAL struct hpack_enc_pend hpack_enc_pend;
+
 /*
  * HPACK encoding: these tables were generated using gen-enc.c
  */
@@ -138,6 +152,34 @@ const signed short hpack_pos_len[32] = {
          /*   24: */   -1,  609,   -1,  636,   -1,   -1,   -1,   -1,
 };
 
+/* Returns the index of header field name <n> in the static table, or zero if
+ * it is not there.
+ */
+static inline int hpack_static_name_idx(const struct ist n)
+{
+	int pos;
+
+	if (n.len >= sizeof(hpack_pos_len) / sizeof(hpack_pos_len[0]))
+		return 0;
+
+	pos = hpack_pos_len[n.len];
+	if (pos < 0)
+		return 0;
+
+	/* At least one header field of this length exist */
+	do {
+		char idx;
+
+		pos++;
+		idx = hpack_enc_stream[pos++];
+		pos += n.len;
+		if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n))
+			return idx;
+	} while ((unsigned char)hpack_enc_stream[pos] == n.len);
+
+	return 0;
+}
+
 /* Tries to encode header whose name is <n> and value <v> into the chunk <out>.
  * Returns non-zero on success, 0 on failure (buffer full).
  */
@@ -146,35 +188,21 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 {
 	int len = out->data;
 	int size = out->size;
-	int pos;
+	int idx;
 
 	if (len >= size)
 		return 0;
 
 	/* look for the header field <n> in the static table */
-	if (n.len >= sizeof(hpack_pos_len) / sizeof(hpack_pos_len[0]))
-		goto make_literal;
-
-	pos = hpack_pos_len[n.len];
-	if (pos >= 0) {
-		/* At least one header field of this length exist */
-		do {
-			char idx;
-
-			pos++;
-			idx = hpack_enc_stream[pos++];
-			pos += n.len;
-			if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n)) {
-				/* emit literal with indexing (7541#6.2.1) :
-				 * [ 0 | 1 | Index (6+) ]
-				 */
-				out->area[len++] = idx | 0x40;
-				goto emit_value;
-			}
-		} while ((unsigned char)hpack_enc_stream[pos] == n.len);
+	idx = hpack_static_name_idx(n);
+	if (idx) {
+		/* emit literal with indexing (7541#6.2.1) :
+		 * [ 0 | 1 | Index (6+) ]
+		 */
+		out->area[len++] = idx | 0x40;
+		goto emit_value;
 	}
 
- make_literal:
 	if (likely(n.len < 127 && len + 2 + n.len <= size)) {
 		out->area[len++] = 0x00;      /* literal without indexing -- new name */
 		out->area[len++] = n.len;     /* single-byte length encoding */
@@ -208,3 +236,313 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 	out->data = len;
 	return 1;
 }
+
+/* Returns a non-zero hash of header field <n>:<v>, used to recognize the
+ * fields which are repeated.
+ */
+static inline uint32_t hpack_enc_hash(const struct ist n, const struct ist v)
+{
+	const struct ist str[2] = { n, v };
+	uint64_t hash = 0;
+	uint64_t word;
+	size_t i;
+	int s;
+
+	for (s = 0; s < 2; s++) {
+		for (i = 0; i + 8 <= str[s].len; i += 8) {
+			memcpy(&word, str[s].ptr + i, 8);
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+			hash ^= hash >> 29;
+		}
+		word = str[s].len;
+		memcpy(&word, str[s].ptr + i, str[s].len - i);
+		hash = (hash ^ word ^ ((uint64_t)str[s].len << 56)) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+	return (uint32_t)hash | 1;
+}
+
+/* Returns non-zero if header field <n>:<v> is worth being indexed by encoder
+ * <enc>, that is if it was recently missed already. Otherwise it is
+ * remembered for the next time.
+ */
+static inline int hpack_enc_frequent(struct hpack_enc *enc, const struct ist n, const struct ist v)
+{
+	uint32_t hash = hpack_enc_hash(n, v);
+	int i;
+
+	for (i = 0; i < HPACK_ENC_SEEN; i++) {
+		if (enc->seen[i] == hash)
+			return 1;
+	}
+
+	enc->seen[enc->seen_pos++ & (HPACK_ENC_SEEN - 1)] = hash;
+	return 0;
+}
+
+/* Returns non-zero if header field name <n> designates a sensitive field whose
+ * value must never be indexed (7541#7.1.3).
+ */
+static inline int hpack_enc_sensitive(const struct ist n)
+{
+	switch (n.len) {
+	case 6:  return isteq(n, ist("cookie"));
+	case 10: return isteq(n, ist("set-cookie"));
+	case 13: return isteq(n, ist("authorization"));
+	case 19: return isteq(n, ist("proxy-authorization"));
+	}
+	return 0;
+}
+
+/* Stops using the dynamic table of encoder <enc>, after a failure to keep it
+ * in sync with the peer's decoder. Fields already indexed by the peer are not
+ * referenced anymore so this is safe.
+ */
+static void hpack_enc_disable(struct hpack_enc *enc)
+{
+	if (enc->dht)
+		hpack_dht_free(enc->dht);
+	enc->dht = NULL;
+	enc->limit = 0;
+}
+
+/* Initializes encoder <enc> with a dynamic table limited to <limit> bytes. A
+ * zero limit disables the dynamic table. The table itself is only allocated
+ * once needed, from the hpack_tbl pool whose size must not be lower than
+ * <limit>.
+ */
+void hpack_enc_init(struct hpack_enc *enc, uint32_t limit)
+{
+	enc->dht = NULL;
+	enc->limit = limit;
+	enc->size = (limit < HPACK_DFLT_TABLE_SIZE) ? limit : HPACK_DFLT_TABLE_SIZE;
+	enc->dtsu = enc->dtsu_min = HPACK_ENC_NO_DTSU;
+	enc->seen_pos = 0;
+	memset(enc->seen, 0, sizeof(enc->seen));
+}
+
+/* Releases the resources allocated for encoder <enc>. */
+void hpack_enc_release(struct hpack_enc *enc)
+{
+	if (hpack_enc_pend.enc == enc)
+		hpack_enc_pend.enc = NULL;
+	if (enc->dht)
+		hpack_dht_free(enc->dht);
+	enc->dht = NULL;
+}
+
+/* Reports that the peer changed the maximum table size its decoder supports to
+ * <max> (SETTINGS_HEADER_TABLE_SIZE). The new size, capped to the local limit,
+ * will be announced at the beginning of the next header block, preceded by the
+ * smallest one if it was lowered in between (7541#4.2).
+ */
+void hpack_enc_set_max(struct hpack_enc *enc, uint32_t max)
+{
+	if (max > enc->limit)
+		max = enc->limit;
+
+	if (enc->dtsu_min == HPACK_ENC_NO_DTSU || max < enc->dtsu_min)
+		enc->dtsu_min = max;
+	enc->dtsu = max;
+}
+
+/* Starts a new header block for encoder <enc> in buffer <out>, emitting the
+ * pending dynamic table size updates if any. Any insertion decided for a
+ * previous uncommitted block is dropped, so this must also be called before
+ * restarting the encoding of a block. Returns non-zero on success, 0 on
+ * failure (buffer full).
+ */
+int hpack_enc_begin(struct hpack_enc *enc, struct buffer *out)
+{
+	int len = out->data;
+	int bytes;
+
+	hpack_enc_pend.enc = enc;
+	hpack_enc_pend.size = 0;
+	hpack_enc_pend.count = 0;
+
+	if (enc->dtsu == HPACK_ENC_NO_DTSU)
+		return 1;
+
+	bytes = hpack_int_to_bytes(enc->dtsu, 5);
+	if (enc->dtsu_min < enc->dtsu)
+		bytes += hpack_int_to_bytes(enc->dtsu_min, 5);
+	if (len + bytes > out->size)
+		return 0;
+
+	/* dynamic table size update (7541#6.3) :
+	 * [ 0 | 0 | 1 | Max size (5+) ]
+	 */
+	if (enc->dtsu_min < enc->dtsu)
+		len = hpack_encode_int(out->area, len, 0x20, 5, enc->dtsu_min);
+	len = hpack_encode_int(out->area, len, 0x20, 5, enc->dtsu);
+	out->data = len;
+
+	/* Shrinking the table may be done right now: if the block is aborted,
+	 * the decoder's table remains larger and still holds all our entries.
+	 * Growing it will be done on commit.
+	 */
+	if (enc->dtsu_min < enc->size) {
+		enc->size = enc->dtsu_min;
+		if (enc->dht && !hpack_dht_resize(enc->dht, enc->size))
+			hpack_enc_disable(enc);
+	}
+	return 1;
+}
+
+/* Commits the header block built for encoder <enc>, which was sent or is
+ * guaranteed to be. The fields indexed in this block are inserted into the
+ * dynamic table, in the same order as the peer's decoder will do.
+ */
+void hpack_enc_commit(struct hpack_enc *enc)
+{
+	struct hpack_enc_pend *pend = &hpack_enc_pend;
+	int i;
+
+	if (enc->dtsu != HPACK_ENC_NO_DTSU) {
+		if (enc->dtsu > enc->size) {
+			enc->size = enc->dtsu;
+			if (enc->dht && !hpack_dht_resize(enc->dht, enc->size))
+				hpack_enc_disable(enc);
+		}
+		enc->dtsu = enc->dtsu_min = HPACK_ENC_NO_DTSU;
+	}
+
+	if (pend->enc != enc || !pend->count)
+		return;
+
+	if (!enc->dht) {
+		enc->dht = hpack_dht_alloc();
+		if (!enc->dht)
+			goto fail;
+		hpack_dht_init(enc->dht, enc->size);
+	}
+
+	for (i = 0; i < pend->count; i++) {
+		if (hpack_dht_insert(enc->dht, pend->list[i].n, pend->list[i].v) < 0)
+			goto fail;
+	}
+ leave:
+	pend->count = 0;
+	pend->size = 0;
+	return;
+ fail:
+	hpack_enc_disable(enc);
+	goto leave;
+}
+
+/* Tries to encode header whose name is <n> and value <v> into the chunk <out>
+ * for the header block started by hpack_enc_begin() on encoder <enc>, making
+ * use of its dynamic table. Returns non-zero on success, 0 on failure (buffer
+ * full).
+ */
+int hpack_enc_header(struct hpack_enc *enc, struct buffer *out,
+		     const struct ist n, const struct ist v)
+{
+	struct hpack_enc_pend *pend = &hpack_enc_pend;
+	const struct hpack_dht *dht = enc->dht;
+	const struct hpack_dte *dte;
+	uint32_t idx, sidx, cum;
+	uint8_t code, bits;
+	int len = out->data;
+	int bytes;
+	int i;
+
+	if (!enc->limit)
+		return hpack_encode_header(out, n, v);
+
+	idx = 0;
+	if (dht) {
+		/* Look for the field in the dynamic table, newest first. Entries
+		 * that the insertions pending in this block will evict from the
+		 * decoder's table are not considered. The lookup is bounded so
+		 * that large tables remain cheap, frequent fields which are too
+		 * old will simply be inserted again.
+		 */
+		cum = pend->size;
+		for (i = 1; i <= dht->used && i <= HPACK_ENC_MAX_LOOKUP; i++) {
+			dte = hpack_get_dte(dht, i);
+			if (!dte)
+				break;
+			cum += dte->nlen + dte->vlen + 32;
+			if (cum > enc->size)
+				break;
+
+			if (dte->nlen != n.len ||
+			    memcmp((void *)dht + dte->addr, n.ptr, n.len) != 0)
+				continue;
+
+			if (dte->vlen == v.len &&
+			    memcmp((void *)dht + dte->addr + dte->nlen, v.ptr, v.len) == 0) {
+				/* indexed header field (7541#6.1) :
+				 * [ 1 | Index (7+) ]
+				 */
+				idx = HPACK_SHT_SIZE - 1 + i + pend->count;
+				if (len + hpack_int_to_bytes(idx, 7) > out->size)
+					return 0;
+				out->data = hpack_encode_int(out->area, len, 0x80, 7, idx);
+				return 1;
+			}
+
+			if (!idx)
+				idx = HPACK_SHT_SIZE - 1 + i + pend->count;
+		}
+	}
+
+	/* prefer the static table for the name, its index is smaller */
+	sidx = hpack_static_name_idx(n);
+	if (sidx)
+		idx = sidx;
+
+	if (hpack_enc_sensitive(n)) {
+		/* literal never indexed (7541#6.2.3) :
+		 * [ 0 | 0 | 0 | 1 | Index (4+) ]
+		 */
+		code = 0x10;
+		bits = 4;
+	}
+	else if (pend->count < HPACK_ENC_MAX_PEND &&
+		 n.len + v.len + 32 <= enc->size / 4 &&
+		 hpack_enc_frequent(enc, n, v)) {
+		/* literal with incremental indexing (7541#6.2.1) :
+		 * [ 0 | 1 | Index (6+) ]
+		 */
+		code = 0x40;
+		bits = 6;
+	}
+	else {
+		/* literal without indexing (7541#6.2.2) :
+		 * [ 0 | 0 | 0 | 0 | Index (4+) ]
+		 */
+		code = 0x00;
+		bits = 4;
+	}
+
+	if (!hpack_len_to_bytes(v.len) || (!idx && !hpack_len_to_bytes(n.len)))
+		return 0;
+
+	bytes = hpack_int_to_bytes(idx, bits) + hpack_len_to_bytes(v.len) + v.len;
+	if (!idx)
+		bytes += hpack_len_to_bytes(n.len) + n.len;
+	if (len + bytes > out->size)
+		return 0;
+
+	len = hpack_encode_int(out->area, len, code, bits, idx);
+	if (!idx) {
+		len = hpack_encode_len(out->area, len, n.len);
+		ist2bin(out->area + len, n);
+		len += n.len;
+	}
+	len = hpack_encode_len(out->area, len, v.len);
+	memcpy(out->area + len, v.ptr, v.len);
+	len += v.len;
+	out->data = len;
+
+	if (code == 0x40) {
+		pend->list[pend->count].n = n;
+		pend->list[pend->count].v = v;
+		pend->count++;
+		pend->size += n.len + v.len + 32;
+	}
+	return 1;
+}
@@ -169,6 +169,8 @@ static struct hpack_dht *hpack_dht_defrag(struct hpack_dht *dht)
 	if (!alt_dht)
 		return NULL;
 
+	/* the table may be smaller than the pool's entries */
+	hpack_dht_init(alt_dht, dht->size);
 	alt_dht->total = dht->total;
 	alt_dht->used = dht->used;
 	alt_dht->wrap = dht->used;
@@ -238,6 +240,30 @@ int __hpack_dht_make_room(struct hpack_dht *dht, unsigned int needed)
 	return needed + 32 <= dht->size;
 }
 
+/* Changes the maximum size of table <dht> to <size>, which must not be larger
+ * than the size of the area it was allocated with. The oldest entries which do
+ * not fit anymore are evicted (7541#4.3), and the remaining ones are moved to
+ * the end of the new area. Returns non-zero on success, zero on failure in
+ * which case the table must not be used anymore.
+ */
+int hpack_dht_resize(struct hpack_dht *dht, uint32_t size)
+{
+	unsigned int tail;
+
+	while (dht->used && dht->used * 32 + dht->total > size) {
+		tail = hpack_dht_get_tail(dht);
+		dht->total -= dht->dte[tail].nlen + dht->dte[tail].vlen;
+		dht->used--;
+	}
+
+	dht->size = size;
+	if (!dht->used) {
+		dht->front = dht->head = 0;
+		return 1;
+	}
+	return hpack_dht_defrag(dht) != NULL;
+}
+
 /* tries to insert a new header <name>:<value> in front of the current head. A
  * negative value is returned on error.
  */
@@ -232,7 +232,7 @@ int http_wait_for_request(struct stream *s, struct channel *req, int an_bit)
 			struct acl_cond *cond;
 
 			s->flags |= SF_MONITOR;
-			_HA_ATOMIC_INC(&sess->fe->fe_counters.intercepted_req);
+			_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->intercepted_req);
 
 			/* Check if we want to fail this monitor request or not */
 			list_for_each_entry(cond, &sess->fe->mon_fail_cond, list) {
@@ -331,16 +331,16 @@ int http_wait_for_request(struct stream *s, struct channel *req, int an_bit)
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	goto return_prx_cond;
 
  return_bad_req:
 	txn->status = 400;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 	/* fall through */
 
  return_prx_cond:
@@ -467,7 +467,7 @@ int http_process_req_common(struct stream *s, struct channel *req, int an_bit, s
 	/* Proceed with the applets now. */
 	if (unlikely(objt_applet(s->target))) {
 		if (sess->fe == s->be) /* report it if the request was intercepted by the frontend */
-			_HA_ATOMIC_INC(&sess->fe->fe_counters.intercepted_req);
+			_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->intercepted_req);
 
 		if (http_handle_expect_hdr(s, htx, msg) == -1)
 			goto return_int_err;
@@ -549,11 +549,11 @@ int http_process_req_common(struct stream *s, struct channel *req, int an_bit, s
 	if (!req->analyse_exp)
 		req->analyse_exp = tick_add(now_ms, 0);
 	stream_inc_http_err_ctr(s);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_req);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.denied_req);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->denied_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->denied_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_req);
 	goto done_without_exp;
 
  deny:	/* this request was blocked (denied) */
@@ -565,41 +565,41 @@ int http_process_req_common(struct stream *s, struct channel *req, int an_bit, s
 
 	s->logs.request_ts = now_ns;
 	stream_inc_http_err_ctr(s);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_req);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.denied_req);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->denied_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->denied_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_req);
 	goto return_prx_err;
 
  return_fail_rewrite:
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_PRXCOND;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_rewrites);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_rewrites);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_rewrites);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_rewrites);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	/* fall through */
 
  return_int_err:
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	goto return_prx_err;
 
  return_bad_req:
 	txn->status = 400;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 	/* fall through */
 
  return_prx_err:
@@ -726,24 +726,24 @@ int http_process_request(struct stream *s, struct channel *req, int an_bit)
  return_fail_rewrite:
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_PRXCOND;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_rewrites);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.failed_rewrites);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_rewrites);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_rewrites);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	/* fall through */
 
  return_int_err:
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 
 	http_set_term_flags(s);
 	http_reply_and_close(s, txn->status, http_error_message(s));
@@ -842,18 +842,18 @@ int http_wait_for_request_body(struct stream *s, struct channel *req, int an_bit
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (s->flags & SF_BE_ASSIGNED)
-		_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+		_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	goto return_prx_err;
 
  return_bad_req: /* let's centralize all bad requests */
 	txn->status = 400;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 	/* fall through */
 
  return_prx_err:
@@ -1065,24 +1065,24 @@ int http_request_forward_body(struct stream *s, struct channel *req, int an_bit)
 	return 0;
 
   return_cli_abort:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
-	_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.cli_aborts);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= ((req->flags & CF_READ_TIMEOUT) ? SF_ERR_CLITO : SF_ERR_CLICL);
 	status = 400;
 	goto return_prx_cond;
 
   return_srv_abort:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
-	_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.srv_aborts);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= ((req->flags & CF_WRITE_TIMEOUT) ? SF_ERR_SRVTO : SF_ERR_SRVCL);
 	status = 502;
@@ -1091,19 +1091,19 @@ int http_request_forward_body(struct stream *s, struct channel *req, int an_bit)
   return_int_err:
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
-	_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.internal_errors);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
 	status = 500;
 	goto return_prx_cond;
 
   return_bad_req:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 	status = 400;
 	/* fall through */
 
@@ -1136,9 +1136,9 @@ static __inline int do_l7_retry(struct stream *s, struct stconn *sc)
 			s->flags &= ~SF_CURR_SESS;
 			_HA_ATOMIC_DEC(&__objt_server(s->target)->cur_sess);
 		}
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.retries);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->retries);
 	}
-	_HA_ATOMIC_INC(&s->be->be_counters.retries);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->retries);
 
 	req = &s->req;
 	res = &s->res;
@@ -1250,9 +1250,9 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			if (s->flags & SF_SRV_REUSED)
 				goto abort_keep_alive;
 
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (objt_server(s->target)) {
-				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 				health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_READ_ERROR);
 			}
 
@@ -1286,9 +1286,9 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 					return 0;
 				}
 			}
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (objt_server(s->target)) {
-				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 				health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_READ_TIMEOUT);
 			}
 
@@ -1309,12 +1309,12 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 		/* 3: client abort with an abortonclose */
 		else if ((s->scb->flags & (SC_FL_EOS|SC_FL_ABRT_DONE)) && (s->scb->flags & SC_FL_SHUT_DONE) &&
 			 (s->scf->flags & (SC_FL_EOS|SC_FL_ABRT_DONE))) {
-			_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
-			_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
+			_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 			if (sess->listener && sess->listener->counters)
-				_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+				_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 			if (objt_server(s->target))
-				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.cli_aborts);
+				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 
 			txn->status = 400;
 
@@ -1344,9 +1344,9 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			if (s->flags & SF_SRV_REUSED)
 				goto abort_keep_alive;
 
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (objt_server(s->target)) {
-				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 				health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_BROKEN_PIPE);
 			}
 
@@ -1369,9 +1369,9 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			if (s->flags & SF_SRV_REUSED)
 				goto abort_keep_alive;
 
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (objt_server(s->target))
-				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+				_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 			rep->analysers &= AN_RES_FLT_END;
 
 			if (!(s->flags & SF_ERR_MASK))
@@ -1467,8 +1467,8 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 		if (n < 1 || n > 5)
 			n = 0;
 
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.p.http.rsp[n]);
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.p.http.cum_req);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->p.http.rsp[n]);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->p.http.cum_req);
 	}
 
 	/* Adjust server's health based on status code. Note: status codes 501
@@ -1617,21 +1617,21 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 	return 1;
 
  return_int_err:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
-	_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.internal_errors);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
 	goto return_prx_cond;
 
   return_bad_res:
-	_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 	if (objt_server(s->target)) {
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 		health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_HDRRSP);
 	}
 	if ((s->be->retry_type & PR_RE_JUNK_REQUEST) &&
@@ -1923,43 +1923,43 @@ int http_process_res_common(struct stream *s, struct channel *rep, int an_bit, s
 	return 1;
 
  deny:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_resp);
-	_HA_ATOMIC_INC(&s->be->be_counters.denied_resp);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->denied_resp);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->denied_resp);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_resp);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.denied_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->denied_resp);
 	goto return_prx_err;
 
  return_fail_rewrite:
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_PRXCOND;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_rewrites);
-	_HA_ATOMIC_INC(&s->be->be_counters.failed_rewrites);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_rewrites);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_rewrites);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_rewrites);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_rewrites);
 	/* fall through */
 
  return_int_err:
 	txn->status = 500;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
-	_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.internal_errors);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
 	goto return_prx_err;
 
  return_bad_res:
 	txn->status = 502;
 	stream_inc_http_fail_ctr(s);
-	_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 	if (objt_server(s->target)) {
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 		health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_RSP);
 	}
 	/* fall through */
@@ -2184,43 +2184,43 @@ int http_response_forward_body(struct stream *s, struct channel *res, int an_bit
 	return 0;
 
   return_srv_abort:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
-	_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.srv_aborts);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 	stream_inc_http_fail_ctr(s);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= ((res->flags & CF_READ_TIMEOUT) ? SF_ERR_SRVTO : SF_ERR_SRVCL);
 	goto return_error;
 
   return_cli_abort:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
-	_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.cli_aborts);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= ((res->flags & CF_WRITE_TIMEOUT) ? SF_ERR_CLITO : SF_ERR_CLICL);
 	goto return_error;
 
   return_int_err:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
-	_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.internal_errors);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
 	goto return_error;
 
   return_bad_res:
-	_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 	if (objt_server(s->target)) {
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 		health_adjust(__objt_server(s->target), HANA_STATUS_HTTP_RSP);
 	}
 	stream_inc_http_fail_ctr(s);
@@ -2468,7 +2468,7 @@ int http_apply_redirect_rule(struct redirect_rule *rule, struct stream *s, struc
 		req->analysers &= AN_REQ_FLT_END;
 
 		if (s->sess->fe == s->be) /* report it if the request was intercepted by the frontend */
-			_HA_ATOMIC_INC(&s->sess->fe->fe_counters.intercepted_req);
+			_HA_ATOMIC_INC(&s->sess->fe->fe_counters.shared.shard[ti->ctr_shard]->intercepted_req);
 	}
 
   out:
@@ -2967,7 +2967,7 @@ int http_eval_after_res_rules(struct stream *s)
 
 	/* prune the request variables if not already done and swap to the response variables. */
 	if (s->vars_reqres.scope != SCOPE_RES) {
-		if (!LIST_ISEMPTY(&s->vars_reqres.head))
+		if (!vars_is_empty(&s->vars_reqres))
 			vars_prune(&s->vars_reqres, s->sess, s);
 		vars_init_head(&s->vars_reqres, SCOPE_RES);
 	}
@@ -4139,9 +4139,9 @@ enum rule_result http_wait_for_msg_body(struct stream *s, struct channel *chn,
 	txn->status = 408;
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_CLITO;
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 	goto abort;
 
   abort_res:
@@ -5054,6 +5054,7 @@ struct http_txn *http_create_txn(struct stream *s)
 	txn->http_reply = NULL;
 	txn->l7_buffer = BUF_NULL;
 	write_u32(txn->cache_hash, 0);
+	txn->cache_wait_exp = TICK_ETERNITY;
 
 	txn->cookie_first_date = 0;
 	txn->cookie_last_date = 0;
@@ -5094,9 +5095,9 @@ void http_destroy_txn(struct stream *s)
 	txn->srv_cookie = NULL;
 	txn->cli_cookie = NULL;
 
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!vars_is_empty(&s->vars_txn))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!vars_is_empty(&s->vars_reqres))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	b_free(&txn->l7_buffer);
@@ -10,6 +10,7 @@
  *
  */
 
+#define _GNU_SOURCE /* required for sendmmsg() */
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -358,6 +359,26 @@ THREAD_LOCAL char *logline_rfc5424 = NULL;
  */
 THREAD_LOCAL char *logline_rfc5424_lpf = NULL;
 
+#ifdef LOG_HAVE_SENDMMSG
+/* Log messages waiting to be sent to datagram targets by a thread. They are
+ * all sent to the same socket by a single sendmmsg() call once the batch is
+ * full, or at the latest before the thread goes back to polling.
+ */
+struct log_batch {
+	int fd;                  /* socket the messages are sent on */
+	unsigned int count;      /* number of pending messages */
+	size_t used;             /* bytes used in <area> */
+	size_t size;             /* size of <area> */
+	char *area;              /* copies of the messages, final LF included */
+	struct mmsghdr msgs[LOG_MAX_BATCH];
+	struct iovec iov[LOG_MAX_BATCH];
+	struct sockaddr_storage addr[LOG_MAX_BATCH];
+};
+
+/* the thread's batch, NULL if messages are sent one at a time */
+static THREAD_LOCAL struct log_batch *log_batch = NULL;
+#endif
+
 struct logformat_node_args {
 	char *name;
 	int mask;
@@ -2650,6 +2671,108 @@ static char *lf_port(char *dst, const struct sockaddr *sockaddr, size_t size, st
 	return ret;
 }
 
+#ifdef LOG_HAVE_SENDMMSG
+/* Sends the log messages batched by the current thread. The messages which
+ * cannot be sent because the socket buffer is full are dropped, just like
+ * when they are sent one at a time.
+ */
+void log_flush_batch(void)
+{
+	struct log_batch *batch = log_batch;
+	unsigned int done = 0;
+	int ret;
+
+	if (!batch || !batch->count)
+		return;
+
+	while (done < batch->count) {
+		ret = sendmmsg(batch->fd, batch->msgs + done, batch->count - done,
+		               MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret > 0) {
+			done += ret;
+			continue;
+		}
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			static char once;
+
+			if (!once) {
+				once = 1; /* note: no need for atomic ops here */
+				ha_alert("sendmmsg() failed for a batch of logs: %s (errno=%d)\n",
+				         strerror(errno), errno);
+			}
+			/* only the first message was rejected, try the next ones */
+			done++;
+			continue;
+		}
+
+		/* no more room in the socket buffer */
+		_HA_ATOMIC_ADD(&dropped_logs, batch->count - done);
+		break;
+	}
+
+	activity[tid].log_batches++;
+	activity[tid].log_batched += batch->count;
+	batch->count = 0;
+	batch->used = 0;
+}
+
+/* Appends to the current thread's batch the log message made of the <nbvec>
+ * elements of <vec>, to be sent to <addr> on socket <fd>. The pending messages
+ * are sent first if they are for another socket or if there is no more room
+ * for this one, and the batch is sent once it is full. Returns 0 if the message
+ * does not fit in the batch and must be sent directly, otherwise non-zero.
+ */
+static int log_batch_add(int fd, const struct sockaddr_storage *addr,
+                         const struct iovec *vec, size_t nbvec)
+{
+	struct log_batch *batch = log_batch;
+	struct msghdr *hdr;
+	size_t len = 0;
+	char *dst;
+	int i;
+
+	for (i = 0; i < nbvec; i++)
+		len += vec[i].iov_len;
+
+	if (len > batch->size)
+		return 0;
+
+	if (batch->count && (batch->fd != fd || batch->used + len > batch->size))
+		log_flush_batch();
+
+	dst = batch->area + batch->used;
+	for (i = 0; i < nbvec; i++) {
+		memcpy(dst, vec[i].iov_base, vec[i].iov_len);
+		dst += vec[i].iov_len;
+	}
+
+	batch->iov[batch->count].iov_base = batch->area + batch->used;
+	batch->iov[batch->count].iov_len  = len;
+	memcpy(&batch->addr[batch->count], addr, get_addr_len(addr));
+
+	hdr = &batch->msgs[batch->count].msg_hdr;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->msg_name    = &batch->addr[batch->count];
+	hdr->msg_namelen = get_addr_len(addr);
+	hdr->msg_iov     = &batch->iov[batch->count];
+	hdr->msg_iovlen  = 1;
+
+	batch->fd = fd;
+	batch->used += len;
+	if (++batch->count >= global.tune.log_batch)
+		log_flush_batch();
+	return 1;
+}
+#else
+void log_flush_batch(void)
+{
+}
+#endif
+
 /*
  * This function sends a syslog message.
  * <target> is the actual log target where log will be sent,
@@ -2774,6 +2897,11 @@ static inline void __do_send_log(struct log_target *target, struct log_header hd
 		iovec[i].iov_len = 1;
 		i++;
 
+#ifdef LOG_HAVE_SENDMMSG
+		/* the message will be sent along with the next ones */
+		if (log_batch && log_batch_add(*plogfd, target->addr, iovec, i))
+			return;
+#endif
 		msghdr.msg_iovlen = i;
 		msghdr.msg_name = (struct sockaddr *)target->addr;
 		msghdr.msg_namelen = get_addr_len(target->addr);
@@ -3664,6 +3792,39 @@ void deinit_log_buffers()
 	logline_rfc5424_lpf = NULL;
 }
 
+/* Allocates the thread's batch of log messages if "tune.log.batch" is set */
+static int alloc_log_batch()
+{
+#ifdef LOG_HAVE_SENDMMSG
+	if (global.tune.log_batch <= 1)
+		return 1;
+
+	log_batch = calloc(1, sizeof(*log_batch));
+	if (!log_batch)
+		return 0;
+	log_batch->size = global.tune.bufsize;
+	log_batch->area = malloc(log_batch->size);
+	if (!log_batch->area) {
+		ha_free(&log_batch);
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+/* Sends the pending log messages of the thread and releases its batch */
+static void free_log_batch()
+{
+#ifdef LOG_HAVE_SENDMMSG
+	if (!log_batch)
+		return;
+
+	log_flush_batch();
+	free(log_batch->area);
+	ha_free(&log_batch);
+#endif
+}
+
 /* Deinitialize log forwarder proxies used for syslog messages */
 void deinit_log_forward()
 {
@@ -5761,15 +5922,15 @@ static void syslog_io_handler(struct appctx *appctx)
 
 parse_error:
 	if (l->counters)
-		_HA_ATOMIC_INC(&l->counters->failed_req);
-	_HA_ATOMIC_INC(&frontend->fe_counters.failed_req);
+		_HA_ATOMIC_INC(&l->counters->shared.shard[ti->ctr_shard]->failed_req);
+	_HA_ATOMIC_INC(&frontend->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 
 	goto error;
 
 cli_abort:
 	if (l->counters)
-		_HA_ATOMIC_INC(&l->counters->cli_aborts);
-	_HA_ATOMIC_INC(&frontend->fe_counters.cli_aborts);
+		_HA_ATOMIC_INC(&l->counters->shared.shard[ti->ctr_shard]->cli_aborts);
+	_HA_ATOMIC_INC(&frontend->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 
 error:
 	se_fl_set(appctx->sedesc, SE_FL_ERROR);
@@ -6424,8 +6585,37 @@ REGISTER_POST_CHECK(postresolve_loggers);
 REGISTER_POST_PROXY_CHECK(postcheck_log_backend);
 REGISTER_POST_PROXY_CHECK(postcheck_logformat_proxy);
 
+/* config parser for global "tune.log.batch" */
+static int cfg_parse_log_batch(char **args, int section_type, struct proxy *curpx,
+                               const struct proxy *defpx, const char *file, int line,
+                               char **err)
+{
+	int batch;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	batch = atoi(args[1]);
+	if (batch < 1 || batch > LOG_MAX_BATCH) {
+		memprintf(err, "'%s' expects an integer value between 1 and %d.", args[0], LOG_MAX_BATCH);
+		return -1;
+	}
+	global.tune.log_batch = batch;
+	return 0;
+}
+
+/* register "global" section keywords */
+static struct cfg_kw_list log_cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.log.batch", cfg_parse_log_batch },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &log_cfg_kws);
+
 REGISTER_PER_THREAD_ALLOC(init_log_buffers);
+REGISTER_PER_THREAD_ALLOC(alloc_log_batch);
 REGISTER_PER_THREAD_FREE(deinit_log_buffers);
+REGISTER_PER_THREAD_FREE(free_log_batch);
 
 REGISTER_POST_DEINIT(deinit_log_forward);
 REGISTER_POST_DEINIT(deinit_log_profiles);
@@ -744,6 +744,16 @@ static int cli_parse_show_map(char **args, char *payload, struct appctx *appctx,
 		else
 			ctx->curr_gen = ctx->ref->curr_gen;
 
+		/* the entries of precompiled map files cannot be listed, since
+		 * networks are only stored there as merged address ranges.
+		 */
+		HA_RWLOCK_RDLOCK(PATREF_LOCK, &ctx->ref->lock);
+		if (ctx->ref->img && ctx->ref->img_gen == ctx->curr_gen) {
+			HA_RWLOCK_RDUNLOCK(PATREF_LOCK, &ctx->ref->lock);
+			return cli_err(appctx, "Entries of precompiled map files cannot be listed, please use 'get map' or 'clear map'.\n");
+		}
+		HA_RWLOCK_RDUNLOCK(PATREF_LOCK, &ctx->ref->lock);
+
 		LIST_INIT(&ctx->bref.users);
 		appctx->io_handler = cli_io_handler_pat_list;
 		appctx->io_release = cli_release_show_map;
@@ -947,6 +957,14 @@ static int cli_parse_add_map(char **args, char *payload, struct appctx *appctx,
 			}
 		} while (payload && *payload);
 
+		/* the entries added to the current version are not covered by
+		 * the lookup structures until they are prepared again. This is
+		 * done without the reference's lock so as not to block updates
+		 * from the traffic meanwhile.
+		 */
+		if (!gen)
+			pat_ref_prepare(ctx->ref);
+
 		/* The add is done, send message. */
 		appctx->st0 = CLI_ST_PROMPT;
 		return 1;
@@ -958,6 +976,7 @@ static int cli_parse_add_map(char **args, char *payload, struct appctx *appctx,
 static int cli_parse_del_map(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct show_map_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	int img;
 
 	if (args[1][0] == 'm')
 		ctx->display_flags = PAT_REF_MAP;
@@ -998,9 +1017,12 @@ static int cli_parse_del_map(char **args, char *payload, struct appctx *appctx,
 
 		/* Try to delete the entry. */
 		HA_RWLOCK_WRLOCK(PATREF_LOCK, &ctx->ref->lock);
+		img = !!ctx->ref->img;
 		if (!pat_ref_delete_by_id(ctx->ref, ref)) {
 			HA_RWLOCK_WRUNLOCK(PATREF_LOCK, &ctx->ref->lock);
 			/* The entry is not found, send message. */
+			if (img)
+				return cli_err(appctx, "Key not found (entries of precompiled map files cannot be deleted).\n");
 			return cli_err(appctx, "Key not found.\n");
 		}
 		HA_RWLOCK_WRUNLOCK(PATREF_LOCK, &ctx->ref->lock);
@@ -1010,9 +1032,12 @@ static int cli_parse_del_map(char **args, char *payload, struct appctx *appctx,
 		 * string and try to delete the entry.
 		 */
 		HA_RWLOCK_WRLOCK(PATREF_LOCK, &ctx->ref->lock);
+		img = !!ctx->ref->img;
 		if (!pat_ref_delete(ctx->ref, args[3])) {
 			HA_RWLOCK_WRUNLOCK(PATREF_LOCK, &ctx->ref->lock);
 			/* The entry is not found, send message. */
+			if (img)
+				return cli_err(appctx, "Key not found (entries of precompiled map files cannot be deleted).\n");
 			return cli_err(appctx, "Key not found.\n");
 		}
 		HA_RWLOCK_WRUNLOCK(PATREF_LOCK, &ctx->ref->lock);
@@ -1042,6 +1067,9 @@ static int cli_io_handler_clear_map(struct appctx *appctx)
 		return 0;
 	}
 
+	/* rebuild the lookup structures of the remaining entries */
+	pat_ref_prepare(ctx->ref);
+
 	trim_all_pools();
 	return 1;
 }
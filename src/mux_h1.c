@@ -3612,10 +3612,10 @@ static int h1_handle_internal_err(struct h1c *h1c)
 	}
 	session_inc_http_req_ctr(sess);
 	proxy_inc_fe_req_ctr(sess->listener, sess->fe, 1);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.p.http.rsp[5]);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->p.http.rsp[5]);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 
 	h1c->errcode = 500;
 	ret = h1_send_error(h1c);
@@ -3648,10 +3648,10 @@ static int h1_handle_parsing_error(struct h1c *h1c)
 	session_inc_http_req_ctr(sess);
 	session_inc_http_err_ctr(sess);
 	proxy_inc_fe_req_ctr(sess->listener, sess->fe, 1);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.p.http.rsp[4]);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->p.http.rsp[4]);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 
 	if (!h1c->errcode)
 		h1c->errcode = 400;
@@ -3685,10 +3685,10 @@ static int h1_handle_not_impl_err(struct h1c *h1c)
 
 	session_inc_http_req_ctr(sess);
 	proxy_inc_fe_req_ctr(sess->listener, sess->fe, 1);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.p.http.rsp[4]);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->p.http.rsp[4]);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 
 	h1c->errcode = 501;
 	ret = h1_send_error(h1c);
@@ -3720,10 +3720,10 @@ static int h1_handle_req_tout(struct h1c *h1c)
 
 	session_inc_http_req_ctr(sess);
 	proxy_inc_fe_req_ctr(sess->listener, sess->fe, 1);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.p.http.rsp[4]);
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->p.http.rsp[4]);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 
 	h1c->errcode = 408;
 	ret = h1_send_error(h1c);
@@ -4719,7 +4719,7 @@ static size_t h1_nego_ff(struct stconn *sc, struct buffer *input, size_t count,
 	 */
 	if (!b_data(input) && !b_data(&h1c->obuf) && (flags & NEGO_FF_FL_MAY_SPLICE)) {
 #if defined(USE_LINUX_SPLICE)
-		if (h1c->conn->xprt->snd_pipe && (h1s->sd->iobuf.pipe || (pipes_used < global.maxpipes && (h1s->sd->iobuf.pipe = get_pipe())))) {
+		if (conn_xprt_can_snd_pipe(h1c->conn) && (h1s->sd->iobuf.pipe || (pipes_used < global.maxpipes && (h1s->sd->iobuf.pipe = get_pipe())))) {
 			h1s->sd->iobuf.offset = 0;
 			h1s->sd->iobuf.data = 0;
 			ret = count;
@@ -71,6 +71,7 @@ struct h2c {
 
 	/* states for the mux direction */
 	struct buffer mbuf[H2C_MBUF_CNT];   /* mux buffers (ring) */
+	struct hpack_enc henc; /* mux HPACK encoder */
 	int32_t miw; /* mux initial window size for all new streams */
 	int32_t mws; /* mux window size. Can be negative. */
 	int32_t mfs; /* mux's max frame size */
@@ -453,6 +454,7 @@ DECLARE_STATIC_POOL(pool_head_h2s, "h2s", sizeof(struct h2s));
 
 /* a few settings from the global section */
 static int h2_settings_header_table_size      =  4096; /* initial value */
+static int h2_settings_enc_header_table_size  =  4096; /* encoder's dynamic table size limit */
 static int h2_settings_initial_window_size    = 65536; /* default initial value */
 static int h2_be_settings_initial_window_size =     0; /* backend's default initial value */
 static int h2_fe_settings_initial_window_size =     0; /* frontend's default initial value */
@@ -1017,20 +1019,21 @@ static inline void h2_trace_header(const struct ist hn, const struct ist hv,
 		_h2_trace_header(hn, hv, mask, trc_loc, func, h2c, h2s);
 }
 
-/* hpack-encode header name <hn> and value <hv>, possibly emitting a trace if
- * currently enabled. This is done on behalf of function <func> at <trc_loc>
- * passed as ist(TRC_LOC), h2c <h2c>, and h2s <h2s>, all of which may be NULL.
- * The trace is only emitted if the header is emitted (in which case non-zero
- * is returned). The trash is modified. In the traces, the header's name will
- * be truncated to 256 chars and the header's value to 1024 chars.
+/* hpack-encode header name <hn> and value <hv> using the encoder of h2c <h2c>,
+ * possibly emitting a trace if currently enabled. This is done on behalf of
+ * function <func> at <trc_loc> passed as ist(TRC_LOC), h2c <h2c>, and h2s
+ * <h2s>, the latter of which may be NULL. The trace is only emitted if the
+ * header is emitted (in which case non-zero is returned). The trash is
+ * modified. In the traces, the header's name will be truncated to 256 chars
+ * and the header's value to 1024 chars.
  */
 static inline int h2_encode_header(struct buffer *buf, const struct ist hn, const struct ist hv,
 				   uint64_t mask, const struct ist trc_loc, const char *func,
-				   const struct h2c *h2c, const struct h2s *h2s)
+				   struct h2c *h2c, const struct h2s *h2s)
 {
 	int ret;
 
-	ret = hpack_encode_header(buf, hn, hv);
+	ret = hpack_enc_header(&h2c->henc, buf, hn, hv);
 	if (ret)
 		h2_trace_header(hn, hv, mask, trc_loc, func, h2c, h2s);
 
@@ -1112,6 +1115,8 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	h2c->ddht = hpack_dht_alloc();
 	if (!h2c->ddht)
 		goto fail;
+	hpack_dht_init(h2c->ddht, h2_settings_header_table_size);
+	hpack_enc_init(&h2c->henc, h2_settings_enc_header_table_size);
 
 	/* Initialise the context. */
 	h2c->st0 = H2_CS_PREFACE;
@@ -1225,6 +1230,7 @@ static void h2_release(struct h2c *h2c)
 	TRACE_ENTER(H2_EV_H2C_END);
 
 	hpack_dht_free(h2c->ddht);
+	hpack_enc_release(&h2c->henc);
 
 	b_dequeue(&h2c->buf_wait);
 
@@ -2447,6 +2453,7 @@ static int h2c_handle_settings(struct h2c *h2c)
 			break;
 		case H2_SETTINGS_HEADER_TABLE_SIZE:
 			h2c->flags |= H2_CF_SHTS_UPDATED;
+			hpack_enc_set_max(&h2c->henc, arg);
 			break;
 		case H2_SETTINGS_ENABLE_PUSH:
 			if (arg < 0 || arg > 1) { // RFC7540#6.5.2
@@ -5772,25 +5779,16 @@ static size_t h2s_snd_fhdrs(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
-	if ((h2c->flags & (H2_CF_SHTS_UPDATED|H2_CF_DTSU_EMITTED)) == H2_CF_SHTS_UPDATED) {
-		/* SETTINGS_HEADER_TABLE_SIZE changed, we must send an HPACK
-		 * dynamic table size update so that some clients are not
-		 * confused. In practice we only need to send the DTSU when the
-		 * advertised size is lower than the current one, and since we
-		 * don't use it and don't care about the default 4096 bytes,
-		 * we only ack it with a zero size thus we at most have to deal
-		 * with this once. See RFC7541#4.2 and #6.3 for the spec, and
-		 * below for the whole context and interoperability risks:
-		 * https://lists.w3.org/Archives/Public/ietf-http-wg/2021OctDec/0235.html
-		 */
-		if (b_room(&outbuf) < 1)
-			goto full;
-		outbuf.area[outbuf.data++] = 0x20; // HPACK DTSU 0 bytes
-
-		/* let's not update the flags now but only once the buffer is
-		 * really committed.
-		 */
-	}
+	/* Start the header block. If SETTINGS_HEADER_TABLE_SIZE changed, an
+	 * HPACK dynamic table size update is sent first so that some clients
+	 * are not confused, even when the size does not change. The encoder's
+	 * state is only updated once the buffer is really committed. See
+	 * RFC7541#4.2 and #6.3 for the spec, and below for the whole context
+	 * and interoperability risks:
+	 * https://lists.w3.org/Archives/Public/ietf-http-wg/2021OctDec/0235.html
+	 */
+	if (!hpack_enc_begin(&h2c->henc, &outbuf))
+		goto full;
 
 	/* encode status, which necessarily is the first one */
 	if (!hpack_encode_int_status(&outbuf, h2s->status)) {
@@ -5845,6 +5843,9 @@ static size_t h2s_snd_fhdrs(struct h2s *h2s, struct htx *htx)
 		}
 	}
 
+	/* nothing may fail past this point, the header block is complete */
+	hpack_enc_commit(&h2c->henc);
+
 	TRACE_USER("sent H2 response ", H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s, htx);
 
 	/* remove all header blocks including the EOH and compute the
@@ -5887,7 +5888,7 @@ static size_t h2s_snd_fhdrs(struct h2s *h2s, struct htx *htx)
 		h2s->flags |= H2_SF_HEADERS_SENT;
 
 	if (h2c->flags & H2_CF_SHTS_UPDATED) {
-		/* was sent above */
+		/* DTSU was sent above */
 		h2c->flags |= H2_CF_DTSU_EMITTED;
 		h2c->flags &= ~H2_CF_SHTS_UPDATED;
 	}
@@ -6079,6 +6080,9 @@ static size_t h2s_snd_bhdrs(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!hpack_enc_begin(&h2c->henc, &outbuf))
+		goto full;
+
 	/* encode the method, which necessarily is the first one */
 	if (!hpack_encode_method(&outbuf, sl->info.req.meth, meth)) {
 		if (b_space_wraps(mbuf))
@@ -6266,6 +6270,9 @@ static size_t h2s_snd_bhdrs(struct h2s *h2s, struct htx *htx)
 		}
 	}
 
+	/* nothing may fail past this point, the header block is complete */
+	hpack_enc_commit(&h2c->henc);
+
 	TRACE_USER("sent H2 request  ", H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s, htx);
 
 	/* remove all header blocks including the EOH and compute the
@@ -6786,6 +6793,9 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!hpack_enc_begin(&h2c->henc, &outbuf))
+		goto full;
+
 	/* encode all headers */
 	for (idx = 0; idx < hdr; idx++) {
 		/* these ones do not exist in H2 or must not appear in
@@ -6838,6 +6848,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	}
 
 	/* commit the H2 response */
+	hpack_enc_commit(&h2c->henc);
 	TRACE_PROTO("sent H2 trailers HEADERS frame", H2_EV_TX_FRAME|H2_EV_TX_HDR|H2_EV_TX_EOI, h2c->conn, h2s);
 	b_add(mbuf, outbuf.data);
 	h2c->flags |= H2_CF_MBUF_HAS_DATA;
@@ -7726,6 +7737,22 @@ static int h2_parse_header_table_size(char **args, int section_type, struct prox
 	return 0;
 }
 
+/* config parser for global "tune.h2.enc-header-table-size" */
+static int h2_parse_enc_header_table_size(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_settings_enc_header_table_size = atoi(args[1]);
+	if (h2_settings_enc_header_table_size < 0 || h2_settings_enc_header_table_size > 65536) {
+		memprintf(err, "'%s' expects a numeric value between 0 and 65536.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.{be.,fe.,}initial-window-size" */
 static int h2_parse_initial_window_size(char **args, int section_type, struct proxy *curpx,
                                         const struct proxy *defpx, const char *file, int line,
@@ -7874,6 +7901,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.h2.fe.initial-window-size", h2_parse_initial_window_size    },
 	{ CFG_GLOBAL, "tune.h2.fe.max-concurrent-streams", h2_parse_max_concurrent_streams },
 	{ CFG_GLOBAL, "tune.h2.fe.max-total-streams",   h2_parse_max_total_streams      },
+	{ CFG_GLOBAL, "tune.h2.enc-header-table-size",  h2_parse_enc_header_table_size  },
 	{ CFG_GLOBAL, "tune.h2.header-table-size",      h2_parse_header_table_size      },
 	{ CFG_GLOBAL, "tune.h2.initial-window-size",    h2_parse_initial_window_size    },
 	{ CFG_GLOBAL, "tune.h2.max-concurrent-streams", h2_parse_max_concurrent_streams },
@@ -7889,8 +7917,10 @@ INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
  */
 static int init_h2()
 {
+	/* the pool is shared by the decoders and encoders tables */
 	pool_head_hpack_tbl = create_pool("hpack_tbl",
-	                                  h2_settings_header_table_size,
+	                                  MAX(h2_settings_header_table_size,
+	                                      h2_settings_enc_header_table_size),
 	                                  MEM_F_SHARED|MEM_F_EXACT);
 	if (!pool_head_hpack_tbl) {
 		ha_alert("failed to allocate hpack_tbl memory pool\n");
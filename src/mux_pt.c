@@ -579,7 +579,7 @@ static size_t mux_pt_nego_ff(struct stconn *sc, struct buffer *input, size_t cou
 	 *       supported to mix data.
 	 */
 	if (!b_data(input) && (flags & NEGO_FF_FL_MAY_SPLICE)) {
-		if (conn->xprt->snd_pipe && (ctx->sd->iobuf.pipe || (pipes_used < global.maxpipes && (ctx->sd->iobuf.pipe = get_pipe())))) {
+		if (conn_xprt_can_snd_pipe(conn) && (ctx->sd->iobuf.pipe || (pipes_used < global.maxpipes && (ctx->sd->iobuf.pipe = get_pipe())))) {
 			ctx->sd->iobuf.offset = 0;
 			ctx->sd->iobuf.data = 0;
 			ret = count;
@@ -13,12 +13,17 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <import/ebistree.h>
 #include <import/ebpttree.h>
 #include <import/ebsttree.h>
 #include <import/lru.h>
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
@@ -26,6 +31,7 @@
 #include <haproxy/pattern.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 #include <haproxy/xxhash.h>
 
@@ -73,10 +79,10 @@ int (*const pat_index_fcts[PAT_MATCH_NUM])(struct pattern_expr *, struct pattern
 	[PAT_MATCH_LEN]   = pat_idx_list_val,
 	[PAT_MATCH_STR]   = pat_idx_tree_str,
 	[PAT_MATCH_BEG]   = pat_idx_tree_pfx,
-	[PAT_MATCH_SUB]   = pat_idx_list_str,
+	[PAT_MATCH_SUB]   = pat_idx_list_sub,
 	[PAT_MATCH_DIR]   = pat_idx_list_str,
-	[PAT_MATCH_DOM]   = pat_idx_list_str,
-	[PAT_MATCH_END]   = pat_idx_list_str,
+	[PAT_MATCH_DOM]   = pat_idx_tree_dom,
+	[PAT_MATCH_END]   = pat_idx_tree_sfx,
 	[PAT_MATCH_REG]   = pat_idx_list_reg,
 	[PAT_MATCH_REGM]  = pat_idx_list_regm,
 };
@@ -433,6 +439,116 @@ struct pattern *pat_match_nothing(struct sample *smp, struct pattern_expr *expr,
 }
 
 
+/* Thread-local reference element returned with the entries found in a
+ * precompiled map file, so that the callers can find the key and value there.
+ * Both are copied so that nothing refers to the file once the expression is
+ * unlocked, since it may be unmapped at any time by "clear map". The value
+ * follows the key, <bufsize> bytes after it. It is only allocated when such
+ * files are used.
+ */
+static THREAD_LOCAL struct pat_ref_elt *pat_img_elt;
+static int pat_img_used;
+
+/* Returns the pattern for the entry of <expr>'s precompiled map file whose key
+ * and value are at offsets <key> and <val>. The value is copied and parsed on
+ * the fly into the thread-local sample, which pattern_exec_match() does not
+ * need to duplicate.
+ */
+static struct pattern *pat_img_fill(struct pattern_expr *expr, uint32_t key, uint32_t val,
+                                    int type, int fill)
+{
+	const struct pat_img_hdr *img = expr->ref->img;
+	const char *keys = (const char *)img + img->ofs_keys;
+	char *pattern = (char *)pat_img_elt->pattern;
+	char *value = pattern + global.tune.bufsize;
+
+	if (!fill)
+		return &static_pattern;
+
+	strlcpy2(pattern, keys + key, global.tune.bufsize);
+	strlcpy2(value, (const char *)img + img->ofs_vals + val, global.tune.bufsize);
+
+	static_pattern.data = NULL;
+	if (expr->pat_head->parse_smp && expr->pat_head->parse_smp(value, &static_sample_data))
+		static_pattern.data = &static_sample_data;
+
+	pat_img_elt->sample = value;
+	static_pattern.ref = pat_img_elt;
+	static_pattern.sflags = PAT_SF_TREE;
+	static_pattern.type = type;
+	static_pattern.ptr.str = pattern;
+	return &static_pattern;
+}
+
+/* Looks up the string <str> of length <len> in <expr>'s precompiled map file
+ * and returns the matching pattern, or NULL if not found.
+ */
+static struct pattern *pat_img_match_str(struct pattern_expr *expr, const char *str, size_t len, int fill)
+{
+	const struct pat_img_hdr *img = expr->ref->img;
+	const struct pat_img_str *ent = (const void *)((const char *)img + img->ofs_str);
+	const char *keys = (const char *)img + img->ofs_keys;
+	uint32_t lo = 0, hi = img->nb_str, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = memcmp(keys + ent[mid].key, str, MIN(len, ent[mid].len));
+		if (!cmp)
+			cmp = (ent[mid].len > len) - (ent[mid].len < len);
+		if (!cmp)
+			return pat_img_fill(expr, ent[mid].key, ent[mid].val, SMP_T_STR, fill);
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/* Looks up the IPv4 address <addr> in <expr>'s precompiled map file and
+ * returns the pattern of the most specific network containing it, or NULL.
+ */
+static struct pattern *pat_img_match_ipv4(struct pattern_expr *expr, const struct in_addr *addr, int fill)
+{
+	const struct pat_img_hdr *img = expr->ref->img;
+	const struct pat_img_ipv4 *ent = (const void *)((const char *)img + img->ofs_ipv4);
+	uint32_t lo = 0, hi = img->nb_ipv4, mid;
+
+	/* find the last range starting at or before <addr> */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(ent[mid].from, addr, 4) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (!lo || memcmp(addr, ent[lo - 1].to, 4) > 0)
+		return NULL;
+	return pat_img_fill(expr, ent[lo - 1].key, ent[lo - 1].val, SMP_T_IPV4, fill);
+}
+
+/* Same as above for IPv6 address <addr> */
+static struct pattern *pat_img_match_ipv6(struct pattern_expr *expr, const struct in6_addr *addr, int fill)
+{
+	const struct pat_img_hdr *img = expr->ref->img;
+	const struct pat_img_ipv6 *ent = (const void *)((const char *)img + img->ofs_ipv6);
+	uint32_t lo = 0, hi = img->nb_ipv6, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(ent[mid].from, addr, 16) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (!lo || memcmp(addr, ent[lo - 1].to, 16) > 0)
+		return NULL;
+	return pat_img_fill(expr, ent[lo - 1].key, ent[lo - 1].val, SMP_T_IPV6, fill);
+}
+
 /* NB: For two strings to be identical, it is required that their length match */
 struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -482,7 +598,7 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 				continue;
 			}
 			if (fill) {
-				static_pattern.data = elt->data;
+				static_pattern.data = HA_ATOMIC_LOAD(&elt->data);
 				static_pattern.ref = elt->ref;
 				static_pattern.sflags = PAT_SF_TREE;
 				static_pattern.type = SMP_T_STR;
@@ -492,6 +608,13 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
+	/* entries added at run time take precedence over the precompiled ones */
+	if (expr->ref->img) {
+		pattern = pat_img_match_str(expr, smp->data.u.str.area, smp->data.u.str.data, fill);
+		if (pattern)
+			return pattern;
+	}
+
 	/* look in the list */
 	if (pat_lru_tree && !LIST_ISEMPTY(&expr->patterns)) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -568,6 +691,658 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	return ret;
 }
 
+/* Substring and regex lookups rely on an Aho-Corasick automaton built when the
+ * patterns are loaded or committed, from a literal key of each pattern of the
+ * expression, so that the input is parsed only once whatever the number of
+ * patterns. For substrings the key
+ * is the pattern itself, for regex it is a literal that any matching input
+ * must contain, and only the regex whose literal was found are executed. Very
+ * small sets are still looked up one pattern at a time.
+ */
+#define PAT_AC_MIN_PATTERNS 4
+
+/* Maximum length of a regex literal, any part of a literal is also one */
+#define PAT_AC_MAX_LIT 64
+
+/* Minimum length of a regex literal, to avoid executing most regex anyway */
+#define PAT_AC_MIN_LIT 3
+
+/* Number of patterns which may be indexed after the automaton was built before
+ * the next load or commit rebuilds it.
+ */
+#define PAT_AC_MAX_TAIL(ac) (16 + (ac)->nb_ents / 16)
+
+/* Number of attempts to build the lookup structures of an expression whose
+ * patterns keep changing during the build.
+ */
+#define PAT_PREPARE_TRIES 3
+
+/* Keys of the patterns of an expression, copied with the expression locked so
+ * that the automaton may then be built from them without any lock.
+ */
+struct pat_ac_snap {
+	struct {
+		struct pattern_list *patl;
+		size_t ofs;        /* key offset in <area> */
+		int len;           /* key length, -1 if none */
+	} *ents;
+	char *area;
+	uint32_t nb;
+	struct list *last;         /* last pattern_list element copied */
+};
+
+/* Frees automaton <ac>, which may be NULL. */
+static void pat_ac_free(struct pat_ac *ac)
+{
+	if (!ac)
+		return;
+	free(ac->nodes);
+	free(ac->ents);
+	free(ac);
+}
+
+/* entries whose literal was found by the last pat_ac_scan() of the thread */
+static THREAD_LOCAL unsigned long *pat_ac_hits;
+static THREAD_LOCAL uint32_t pat_ac_hits_sz;
+
+/* regex literal extracted by pat_ac_key_reg() */
+static THREAD_LOCAL char pat_ac_lit[PAT_AC_MAX_LIT];
+
+/* Returns the key of substring pattern <patl> into <key> and its length */
+static int pat_ac_key_sub(const struct pattern_list *patl, const char **key)
+{
+	*key = patl->pat.ptr.str;
+	return patl->pat.len;
+}
+
+/* Skips the bracket expression starting at <p>, and returns a pointer past
+ * it, or NULL if it is not terminated.
+ */
+static const char *pat_skip_class(const char *p)
+{
+	char d;
+
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	while (*p != ']') {
+		if (!*p)
+			return NULL;
+		if (*p == '\\' && p[1])
+			p += 2;
+		else if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			d = p[1];
+			for (p += 2; *p && !(*p == d && p[1] == ']'); p++)
+				;
+			if (!*p)
+				return NULL;
+			p += 2;
+		}
+		else
+			p++;
+	}
+	return p + 1;
+}
+
+/* Keeps the run of <len> characters at <cur> into <out> if it is longer than
+ * the <best> one.
+ */
+static inline void pat_regex_keep(const char *cur, int len, char *out, int *best)
+{
+	len = MIN(len, PAT_AC_MAX_LIT);
+	if (len > *best) {
+		memcpy(out, cur, len);
+		*best = len;
+	}
+}
+
+/* Extracts from regex <re> the longest literal which any matching input must
+ * contain, into <out> which must be at least PAT_AC_MAX_LIT bytes long. Only
+ * a conservative subset of the syntax shared by POSIX ERE and PCRE is
+ * understood: groups, bracket expressions, escaped letters and digits end the
+ * current literal, a quantifier allowing zero occurrence removes the last
+ * character, and alternations, inline options or unknown escapes prevent the
+ * extraction. Returns the literal's length, or -1 if none may be used.
+ */
+static int pat_regex_literal(const char *re, char *out)
+{
+	char cur[PAT_AC_MAX_LIT];
+	const char *p = re;
+	int run = 0, best = 0;
+	int lit = 0, cut = 0;
+	int depth, n;
+
+	while (*p) {
+		int was_lit = lit;
+
+		lit = 0;
+		switch (*p) {
+		case '\\':
+			p++;
+			if (!*p)
+				return -1;
+			if (isalnum((unsigned char)*p) || strchr("<>`'", *p)) {
+				/* classes, anchors and control characters end the
+				 * literal, other ones may take arguments.
+				 */
+				if (!strchr("dDwWsSbBAzZGhHvVRXntrfea<>`'", *p))
+					return -1;
+				p++;
+				goto end_run;
+			}
+			goto add_char;
+
+		case '[':
+			p = pat_skip_class(p);
+			if (!p)
+				return -1;
+			goto end_run;
+
+		case '(':
+			if (p[1] == '?')
+				return -1;
+			for (depth = 1, p++; *p && depth; ) {
+				if (*p == '\\' && p[1])
+					p += 2;
+				else if (*p == '[') {
+					p = pat_skip_class(p);
+					if (!p)
+						return -1;
+				}
+				else {
+					if (*p == '(')
+						depth++;
+					else if (*p == ')')
+						depth--;
+					p++;
+				}
+			}
+			if (depth)
+				return -1;
+			goto end_run;
+
+		case ')':
+		case '|':
+			return -1;
+
+		case '*':
+		case '?':
+			p++;
+			goto drop_char;
+
+		case '+':
+			p++;
+			goto keep_char;
+
+		case '{':
+			if (!isdigit((unsigned char)p[1]))
+				return -1;
+			for (n = 0, p++; isdigit((unsigned char)*p); p++)
+				n = n * 10 + *p - '0';
+			while (*p && *p != '}')
+				p++;
+			if (!*p)
+				return -1;
+			p++;
+			if (!n)
+				goto drop_char;
+			goto keep_char;
+
+		case '.':
+		case '^':
+		case '$':
+			p++;
+			goto end_run;
+
+		default:
+			goto add_char;
+		}
+
+	add_char:
+		if (cut) {
+			pat_regex_keep(cur, run, out, &best);
+			run = cut = 0;
+		}
+		/* the run may grow past what is kept */
+		if (run < PAT_AC_MAX_LIT)
+			cur[run] = *p;
+		run++;
+		lit = 1;
+		p++;
+		continue;
+
+	keep_char:
+		/* the character is repeated, the literal ends after it unless
+		 * another quantifier makes it optional.
+		 */
+		lit = was_lit;
+		cut = 1;
+		continue;
+
+	drop_char:
+		if (was_lit)
+			run--;
+	end_run:
+		pat_regex_keep(cur, run, out, &best);
+		run = cut = 0;
+	}
+
+	pat_regex_keep(cur, run, out, &best);
+	return best >= PAT_AC_MIN_LIT ? best : -1;
+}
+
+/* Returns the key of regex pattern <patl> into <key> and its length, or -1 if
+ * the regex has no usable literal. The key is extracted from the text of the
+ * reference element and remains valid until the next call.
+ */
+static int pat_ac_key_reg(const struct pattern_list *patl, const char **key)
+{
+	*key = pat_ac_lit;
+	return pat_regex_literal(patl->pat.ref->pattern, pat_ac_lit);
+}
+
+/* Returns the child of node <n> reached with byte <c>, or 0 if none. */
+static inline uint32_t pat_ac_child(const struct pat_ac *ac, uint32_t n, unsigned char c)
+{
+	const struct pat_ac_node *x, *end;
+
+	if (!n)
+		return ac->root[c];
+
+	x = &ac->nodes[ac->nodes[n].child];
+	end = x + ac->nodes[n].nb_child;
+	for (; x < end && x->c < c; x++)
+		;
+	return (x < end && x->c == c) ? x - ac->nodes : 0;
+}
+
+/* Copies into <snap> the keys of all the patterns of <expr>, using function
+ * <key> to retrieve them. The expression must be locked at least for reads.
+ * Returns 0 on memory allocation failure, in which case <snap> must still be
+ * released using pat_ac_snap_free().
+ */
+static int pat_ac_snap_take(struct pat_ac_snap *snap, struct pattern_expr *expr,
+                            int (*key)(const struct pattern_list *, const char **))
+{
+	struct pattern_list *lst;
+	size_t size = 0;
+	uint32_t nb = 0;
+	const char *k;
+	int len;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		len = key(lst, &k);
+		if (len > 0)
+			size += len;
+		nb++;
+	}
+
+	if (nb >= UINT32_MAX - 1)
+		return 0;
+
+	snap->ents = calloc(nb + 1, sizeof(*snap->ents));
+	snap->area = malloc(size + 1);
+	if (!snap->ents || !snap->area)
+		return 0;
+
+	snap->last = &expr->patterns;
+	size = 0;
+	list_for_each_entry(lst, &expr->patterns, list) {
+		len = key(lst, &k);
+		snap->ents[snap->nb].patl = lst;
+		snap->ents[snap->nb].ofs = size;
+		snap->ents[snap->nb].len = len;
+		if (len > 0) {
+			memcpy(snap->area + size, k, len);
+			size += len;
+		}
+		snap->nb++;
+		snap->last = &lst->list;
+	}
+	return 1;
+}
+
+/* Releases the contents of <snap> */
+static void pat_ac_snap_free(struct pat_ac_snap *snap)
+{
+	ha_free(&snap->ents);
+	ha_free(&snap->area);
+	snap->nb = 0;
+}
+
+/* Builds the automaton for all the patterns of snapshot <snap>, which were
+ * retrieved using <key>, ignoring case if <icase> is set. The patterns are
+ * first inserted into a temporary trie, whose nodes are then renumbered in
+ * breadth-first order so that the children of a node are contiguous. This is
+ * also the order in which the fail links have to be set. No lock is needed.
+ * Returns the automaton, or NULL on memory allocation failure.
+ */
+static struct pat_ac *pat_ac_build(const struct pat_ac_snap *snap, int icase,
+                                   int (*key)(const struct pattern_list *, const char **))
+{
+	struct pat_ac *ac;
+	struct pat_ac_node *nodes;
+	struct {
+		uint32_t child, sibling, ent;
+		unsigned char c;
+	} *trie = NULL;
+	uint32_t *pe, n, x, f, e, s, next;
+	size_t nb_nodes = 1, nb_ents = 1;
+	const char *k;
+	unsigned char c;
+	int i, len;
+
+	for (s = 0; s < snap->nb; s++) {
+		if (snap->ents[s].len > 0)
+			nb_nodes += snap->ents[s].len;
+		nb_ents++;
+	}
+
+	if (nb_nodes >= UINT32_MAX || nb_ents >= UINT32_MAX)
+		return NULL;
+
+	ac = calloc(1, sizeof(*ac));
+	if (!ac)
+		return NULL;
+
+	ac->ents = calloc(nb_ents, sizeof(*ac->ents));
+	trie = calloc(nb_nodes, sizeof(*trie));
+	if (!ac->ents || !trie)
+		goto fail;
+
+	ac->nb_nodes = 1;
+	ac->nb_ents = 1;
+	ac->icase = icase;
+	ac->key = key;
+	ac->last = snap->last;
+
+	/* build the trie, children are ordered on their byte and entries
+	 * allocated in the list order.
+	 */
+	for (s = 0; s < snap->nb; s++) {
+		e = ac->nb_ents++;
+		ac->ents[e].patl = snap->ents[s].patl;
+
+		len = snap->ents[s].len;
+		if (len < 0) {
+			ac->ents[e].nokey = 1;
+			continue;
+		}
+
+		k = snap->area + snap->ents[s].ofs;
+		n = 0;
+		for (i = 0; i < len; i++) {
+			c = k[i];
+			if (ac->icase)
+				c = tolower(c);
+			for (pe = &trie[n].child; *pe && trie[*pe].c < c; pe = &trie[*pe].sibling)
+				;
+			if (!*pe || trie[*pe].c != c) {
+				x = ac->nb_nodes++;
+				trie[x].c = c;
+				trie[x].sibling = *pe;
+				*pe = x;
+			}
+			n = *pe;
+		}
+
+		for (pe = &trie[n].ent; *pe; pe = &ac->ents[*pe].next)
+			;
+		*pe = e;
+	}
+
+	ac->nodes = nodes = calloc(ac->nb_nodes, sizeof(*nodes));
+	if (!nodes)
+		goto fail;
+
+	/* renumber the nodes, the fail link temporarily holds the trie's
+	 * index of each node.
+	 */
+	next = 1;
+	for (n = 0; n < next; n++) {
+		f = nodes[n].fail;
+		nodes[n].ent = trie[f].ent;
+		nodes[n].child = next;
+		for (x = trie[f].child; x; x = trie[x].sibling) {
+			nodes[next].c = trie[x].c;
+			nodes[next].fail = x;
+			next++;
+		}
+		nodes[n].nb_child = next - nodes[n].child;
+	}
+	free(trie);
+
+	/* the root's children fail to the root, which ends no pattern for
+	 * the output links since empty patterns are checked apart.
+	 */
+	for (x = nodes[0].child; x < nodes[0].child + nodes[0].nb_child; x++) {
+		ac->root[nodes[x].c] = x;
+		nodes[x].fail = 0;
+	}
+
+	for (n = 1; n < ac->nb_nodes; n++) {
+		for (x = nodes[n].child; x < nodes[n].child + nodes[n].nb_child; x++) {
+			c = nodes[x].c;
+			for (f = nodes[n].fail; f && !pat_ac_child(ac, f, c); f = nodes[f].fail)
+				;
+			f = pat_ac_child(ac, f, c);
+			nodes[x].fail = f;
+			nodes[x].out = (f && nodes[f].ent) ? f : nodes[f].out;
+		}
+	}
+	return ac;
+
+ fail:
+	free(trie);
+	pat_ac_free(ac);
+	return NULL;
+}
+
+/* Builds the automaton of <expr> if its match method uses one and it is
+ * missing or does not cover enough of the patterns. This is only done when
+ * patterns are loaded or committed, never during lookups. The keys are copied
+ * with the expression locked for reads, then the automaton is built without
+ * any lock, so that lookups and updates continue meanwhile, and it is only
+ * swapped with the expression locked for writes if no pattern was added or
+ * removed in the mean time. Otherwise the build is attempted again a few
+ * times. If it fails, the previous automaton is kept, or the patterns are
+ * looked up one at a time until the next update.
+ */
+static void pat_ac_prepare(struct pattern_expr *expr)
+{
+	int (*key)(const struct pattern_list *, const char **);
+	struct pat_ac_snap snap = { };
+	int tries = PAT_PREPARE_TRIES;
+	struct pat_ac *ac;
+	unsigned int rev;
+	int ret;
+
+	if (expr->pat_head->match == pat_match_sub)
+		key = pat_ac_key_sub;
+	else if (expr->pat_head->match == pat_match_reg || expr->pat_head->match == pat_match_regm)
+		key = pat_ac_key_reg;
+	else
+		return;
+
+	while (tries--) {
+		HA_RWLOCK_RDLOCK(PATEXP_LOCK, &expr->lock);
+		if (expr->ref->entry_cnt < PAT_AC_MIN_PATTERNS ||
+		    (expr->ac && expr->ac->nb_tail <= PAT_AC_MAX_TAIL(expr->ac))) {
+			HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
+			return;
+		}
+		rev = expr->rev;
+		ret = pat_ac_snap_take(&snap, expr, key);
+		HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
+
+		ac = ret ? pat_ac_build(&snap, !!(expr->mflags & PAT_MF_IGNORE_CASE), key) : NULL;
+		pat_ac_snap_free(&snap);
+		if (!ac)
+			return;
+
+		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		ret = (expr->rev == rev);
+		if (ret)
+			SWAP(ac, expr->ac);
+		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		pat_ac_free(ac);
+		if (ret)
+			return;
+	}
+}
+
+/* Removes pattern <patl> from automaton <ac>. The expression must be locked
+ * for writes, and <patl> still part of its list.
+ */
+static void pat_ac_delete(struct pat_ac *ac, struct pattern_list *patl)
+{
+	uint32_t *pe, n = 0, e;
+	const char *k;
+	unsigned char c;
+	int i, len;
+
+	if (ac->last == &patl->list)
+		ac->last = patl->list.p;
+
+	len = ac->key(patl, &k);
+	if (len < 0) {
+		/* not attached to any node */
+		for (e = 1; e < ac->nb_ents; e++) {
+			if (ac->ents[e].patl == patl) {
+				ac->ents[e].patl = NULL;
+				return;
+			}
+		}
+		goto tail;
+	}
+
+	for (i = 0; i < len; i++) {
+		c = k[i];
+		if (ac->icase)
+			c = tolower(c);
+		n = pat_ac_child(ac, n, c);
+		if (!n)
+			goto tail;
+	}
+
+	for (pe = &ac->nodes[n].ent; *pe; pe = &ac->ents[*pe].next) {
+		e = *pe;
+		if (ac->ents[e].patl == patl) {
+			*pe = ac->ents[e].next;
+			ac->ents[e].patl = NULL;
+			return;
+		}
+	}
+ tail:
+	/* indexed after the build */
+	ac->nb_tail--;
+}
+
+/* Accounts for a pattern appended to the list of <expr> after its automaton
+ * was built. Such patterns are looked up one at a time until the next load or
+ * commit rebuilds the automaton. The expression must be locked for writes.
+ */
+static void pat_ac_tail(struct pattern_expr *expr)
+{
+	if (expr->ac)
+		expr->ac->nb_tail++;
+}
+
+/* Parses <smp> with automaton <ac> and marks in the thread's pat_ac_hits
+ * the entries whose key was found. Returns 0 if the hits could not be
+ * allocated, otherwise non-zero.
+ */
+static int pat_ac_scan(const struct pat_ac *ac, const struct sample *smp)
+{
+	const unsigned char *p = (const unsigned char *)smp->data.u.str.area;
+	const unsigned char *end = p + smp->data.u.str.data;
+	uint32_t words = (ac->nb_ents + LONGBITS - 1) / LONGBITS;
+	uint32_t n = 0, o, e, x;
+	unsigned char c;
+
+	if (words > pat_ac_hits_sz) {
+		unsigned long *hits = realloc(pat_ac_hits, words * sizeof(*hits));
+
+		if (!hits)
+			return 0;
+		pat_ac_hits = hits;
+		pat_ac_hits_sz = words;
+	}
+	memset(pat_ac_hits, 0, words * sizeof(*pat_ac_hits));
+
+	for (; p < end; p++) {
+		c = ac->icase ? tolower(*p) : *p;
+		while (1) {
+			x = pat_ac_child(ac, n, c);
+			if (x || !n)
+				break;
+			n = ac->nodes[n].fail;
+		}
+		n = x;
+
+		for (o = ac->nodes[n].ent ? n : ac->nodes[n].out; o; o = ac->nodes[o].out) {
+			for (e = ac->nodes[o].ent; e; e = ac->ents[e].next)
+				pat_ac_hits[e / LONGBITS] |= 1UL << (e % LONGBITS);
+		}
+	}
+	return 1;
+}
+
+/* Returns non-zero if entry <e> of <ac> may match after pat_ac_scan() */
+static inline int pat_ac_hit(const struct pat_ac *ac, uint32_t e)
+{
+	return ac->ents[e].nokey || (pat_ac_hits[e / LONGBITS] & (1UL << (e % LONGBITS)));
+}
+
+/* Returns the first pattern of automaton <ac> in the list order which is
+ * found in <smp> and belongs to the current generation, or NULL if none.
+ */
+static struct pattern *pat_ac_match(const struct pat_ac *ac, const struct pattern_expr *expr,
+                                    const struct sample *smp)
+{
+	const unsigned char *p = (const unsigned char *)smp->data.u.str.area;
+	const unsigned char *end = p + smp->data.u.str.data;
+	unsigned int gen = expr->ref->curr_gen;
+	uint32_t best = 0, n = 0, o, e, x;
+	unsigned char c;
+
+	/* empty patterns are found in any string */
+	for (e = ac->nodes[0].ent; e; e = ac->ents[e].next) {
+		if (ac->ents[e].patl->pat.ref->gen_id == gen) {
+			best = e;
+			break;
+		}
+	}
+
+	for (; p < end; p++) {
+		c = ac->icase ? tolower(*p) : *p;
+		while (1) {
+			x = pat_ac_child(ac, n, c);
+			if (x || !n)
+				break;
+			n = ac->nodes[n].fail;
+		}
+		n = x;
+
+		/* entries of a node are ordered, the first valid one is the
+		 * best candidate there.
+		 */
+		for (o = ac->nodes[n].ent ? n : ac->nodes[n].out; o; o = ac->nodes[o].out) {
+			for (e = ac->nodes[o].ent; e && (!best || e < best); e = ac->ents[e].next) {
+				if (ac->ents[e].patl->pat.ref->gen_id == gen) {
+					best = e;
+					break;
+				}
+			}
+		}
+	}
+
+	return best ? &ac->ents[best].patl->pat : NULL;
+}
+
 /* Executes a regex. It temporarily changes the data to add a trailing zero,
  * and restores the previous character when leaving. This function fills
  * a matching array.
@@ -577,8 +1352,34 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
+	struct pat_ac *ac;
+	struct list *from;
+	uint32_t e;
+
+	/* only execute the regex whose literal is present */
+	from = &expr->patterns;
+	ac = expr->ac;
+	if (ac && pat_ac_scan(ac, smp)) {
+		for (e = 1; e < ac->nb_ents; e++) {
+			lst = ac->ents[e].patl;
+			if (!lst || !pat_ac_hit(ac, e))
+				continue;
 
-	list_for_each_entry(lst, &expr->patterns, list) {
+			pattern = &lst->pat;
+			if (pattern->ref->gen_id != expr->ref->curr_gen)
+				continue;
+
+			if (regex_exec_match2(pattern->ptr.reg, smp->data.u.str.area, smp->data.u.str.data,
+			                      MAX_MATCH, pmatch, 0)) {
+				smp->ctx.a[0] = pmatch;
+				return pattern;
+			}
+		}
+		from = ac->last;
+	}
+
+	lst = LIST_ELEM(from->n, typeof(lst), list);
+	list_for_each_entry_from(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
 		if (pattern->ref->gen_id != expr->ref->curr_gen)
@@ -604,6 +1405,9 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_ac *ac;
+	struct list *from;
+	uint32_t e;
 
 	if (pat_lru_tree && !LIST_ISEMPTY(&expr->patterns)) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -616,7 +1420,29 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
-	list_for_each_entry(lst, &expr->patterns, list) {
+	/* only execute the regex whose literal is present */
+	from = &expr->patterns;
+	ac = expr->ac;
+	if (ac && pat_ac_scan(ac, smp)) {
+		for (e = 1; e < ac->nb_ents; e++) {
+			lst = ac->ents[e].patl;
+			if (!lst || !pat_ac_hit(ac, e))
+				continue;
+
+			pattern = &lst->pat;
+			if (pattern->ref->gen_id != expr->ref->curr_gen)
+				continue;
+
+			if (regex_exec2(pattern->ptr.reg, smp->data.u.str.area, smp->data.u.str.data)) {
+				ret = pattern;
+				goto leave;
+			}
+		}
+		from = ac->last;
+	}
+
+	lst = LIST_ELEM(from->n, typeof(lst), list);
+	list_for_each_entry_from(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
 		if (pattern->ref->gen_id != expr->ref->curr_gen)
@@ -628,6 +1454,7 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
+ leave:
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
@@ -677,7 +1504,7 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 				continue;
 			}
 			if (fill) {
-				static_pattern.data = elt->data;
+				static_pattern.data = HA_ATOMIC_LOAD(&elt->data);
 				static_pattern.ref = elt->ref;
 				static_pattern.sflags = PAT_SF_TREE;
 				static_pattern.type = SMP_T_STR;
@@ -723,15 +1550,132 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	return ret;
 }
 
-/* Checks that the pattern matches the end of the tested string. */
+/* Copies the string of sample <smp> into a trash chunk to look it up in a tree
+ * built by pat_idx_tree_key(), reversing it if <rev> is set and lowering it if
+ * <expr> ignores case. Returns the chunk, zero-terminated, or NULL if the
+ * string does not fit.
+ */
+static struct buffer *pat_tree_key(const struct sample *smp, const struct pattern_expr *expr, int rev)
+{
+	struct buffer *key = get_trash_chunk();
+	const char *in = smp->data.u.str.area;
+	size_t len = smp->data.u.str.data;
+	size_t i;
+	unsigned char c;
+
+	if (len >= key->size)
+		return NULL;
+
+	for (i = 0; i < len; i++) {
+		c = in[rev ? len - 1 - i : i];
+		key->area[i] = (expr->mflags & PAT_MF_IGNORE_CASE) ? tolower(c) : c;
+	}
+	key->area[len] = 0;
+	key->data = len;
+	return key;
+}
+
+/* Returns the pattern's string stored after the key of tree node <elt> */
+static inline char *pat_tree_str(struct pattern_tree *elt)
+{
+	return (char *)elt->node.key + elt->node.node.pfx / 8 + 1;
+}
+
+/* Returns the pattern of tree node <elt> built by pat_idx_tree_key(), filled
+ * if <fill> is set.
+ */
+static struct pattern *pat_tree_found(struct pattern_tree *elt, int fill)
+{
+	if (fill) {
+		static_pattern.data = HA_ATOMIC_LOAD(&elt->data);
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_STR;
+		static_pattern.ptr.str = pat_tree_str(elt);
+	}
+	return &static_pattern;
+}
+
+static int match_word(struct sample *smp, struct pattern *pattern, int mflags, unsigned int delimiters);
+
+/* Compares sample <smp> with all patterns of the tree of <expr> built by
+ * pat_idx_tree_key() as the list would do, matching the end of the string, or
+ * words delimited by <delim> if not zero. This is only used when the sample
+ * is too long to be turned into a key. Returns the first matching pattern in
+ * the reference's order, or NULL if none matches.
+ */
+static struct pattern_tree *pat_tree_scan(struct sample *smp, struct pattern_expr *expr,
+                                          unsigned int delim)
+{
+	int icase = expr->mflags & PAT_MF_IGNORE_CASE;
+	struct pattern_tree *elt, *best = NULL;
+	struct ebmb_node *node;
+	struct pattern pat;
+	const char *end;
+
+	for (node = ebmb_first(&expr->pattern_tree); node; node = ebmb_next(node)) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id != expr->ref->curr_gen ||
+		    (best && elt->ref->rank > best->ref->rank))
+			continue;
+
+		memset(&pat, 0, sizeof(pat));
+		pat.ptr.str = pat_tree_str(elt);
+		pat.len = strlen(pat.ptr.str);
+		if (delim) {
+			if (!match_word(smp, &pat, expr->mflags, delim))
+				continue;
+		}
+		else {
+			if (pat.len > smp->data.u.str.data)
+				continue;
+			end = smp->data.u.str.area + smp->data.u.str.data - pat.len;
+			if ((icase && strncasecmp(pat.ptr.str, end, pat.len) != 0) ||
+			    (!icase && strncmp(pat.ptr.str, end, pat.len) != 0))
+				continue;
+		}
+		best = elt;
+	}
+	return best;
+}
+
+/* Checks that the pattern matches the end of the tested string. Patterns of
+ * the tree are indexed reversed, so that all those matching are found along
+ * the path of the reversed string. Like with the list, the first one in the
+ * reference's order is reported.
+ */
 struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	int icase;
+	struct ebmb_node *node;
+	struct pattern_tree *elt, *best = NULL;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
 
+	/* Lookup the reversed string in the expression's pattern tree. */
+	if (!eb_is_empty(&expr->pattern_tree)) {
+		struct buffer *key = pat_tree_key(smp, expr, 1);
+
+		if (key) {
+			node = ebmb_lookup_longest(&expr->pattern_tree, key->area);
+			for (; node; node = ebmb_lookup_shorter(node)) {
+				elt = ebmb_entry(node, struct pattern_tree, node);
+				if (elt->ref->gen_id != expr->ref->curr_gen)
+					continue;
+				if (!best || elt->ref->rank < best->ref->rank)
+					best = elt;
+			}
+		}
+		else
+			best = pat_tree_scan(smp, expr, 0);
+
+		if (best)
+			return pat_tree_found(best, fill);
+	}
+
+	/* look in the list */
 	if (pat_lru_tree && !LIST_ISEMPTY(&expr->patterns)) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
 
@@ -767,8 +1711,9 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	return ret;
 }
 
-/* Checks that the pattern is included inside the tested string.
- * NB: Suboptimal, should be rewritten using a Boyer-Moore method.
+/* Checks that the pattern is included inside the tested string. The patterns
+ * covered by the automaton are all looked up at once, the remaining ones, if
+ * any, one at a time.
  */
 struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -779,6 +1724,8 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_ac *ac;
+	struct list *from;
 
 	if (pat_lru_tree && !LIST_ISEMPTY(&expr->patterns)) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -791,7 +1738,17 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
-	list_for_each_entry(lst, &expr->patterns, list) {
+	from = &expr->patterns;
+	ac = expr->ac;
+	if (ac) {
+		ret = pat_ac_match(ac, expr, smp);
+		if (ret)
+			goto leave;
+		from = ac->last;
+	}
+
+	lst = LIST_ELEM(from->n, typeof(lst), list);
+	list_for_each_entry_from(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
 		if (pattern->ref->gen_id != expr->ref->curr_gen)
@@ -911,9 +1868,45 @@ struct pattern *pat_match_dir(struct sample *smp, struct pattern_expr *expr, int
  */
 struct pattern *pat_match_dom(struct sample *smp, struct pattern_expr *expr, int fill)
 {
+	unsigned int delim = make_4delim('/', '?', '.', ':');
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 
+	/* Lookup the patterns of the tree starting at each word of the string
+	 * and ending at the end of a word. Like with the list, the first one
+	 * in the reference's order matches.
+	 */
+	if (!eb_is_empty(&expr->pattern_tree)) {
+		struct buffer *key = pat_tree_key(smp, expr, 0);
+		struct pattern_tree *best = NULL;
+		size_t i, end;
+
+		for (i = 0; key && i < key->data; i++) {
+			if (is_delimiter(key->area[i], delim) ||
+			    (i && !is_delimiter(key->area[i - 1], delim)))
+				continue;
+
+			node = ebmb_lookup_longest(&expr->pattern_tree, key->area + i);
+			for (; node; node = ebmb_lookup_shorter(node)) {
+				elt = ebmb_entry(node, struct pattern_tree, node);
+				end = i + node->node.pfx / 8;
+				if (elt->ref->gen_id != expr->ref->curr_gen ||
+				    (end < key->data && !is_delimiter(key->area[end], delim)))
+					continue;
+				if (!best || elt->ref->rank < best->ref->rank)
+					best = elt;
+			}
+		}
+
+		if (!key)
+			best = pat_tree_scan(smp, expr, delim);
+
+		if (best)
+			return pat_tree_found(best, fill);
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -964,6 +1957,419 @@ struct pattern *pat_match_len(struct sample *smp, struct pattern_expr *expr, int
 	return NULL;
 }
 
+/* "ip" expressions having at least tune.pattern.ip-lpm-threshold entries are
+ * also looked up using LPM tables (see struct pat_lpm), which are built from
+ * their trees when the patterns are loaded or committed, and dropped by any
+ * change to the trees of the generation they cover. Updates of the values only
+ * do not affect them.
+ */
+
+/* a network collected from a tree to build LPM tables */
+struct pat_lpm_pfx {
+	uint8_t key[18];    /* address, padded with zeroes */
+	uint8_t len;        /* prefix length */
+	uint32_t rank;      /* position in the tree, to keep the first duplicate */
+	uint32_t elt;       /* index in the <elts> array */
+};
+
+/* Returns the <nb> bits (at most 16) of <key> starting at bit <ofs>. The key
+ * must be padded with two zeroes after the last bit that may be read.
+ */
+static inline uint pat_lpm_bits(const uint8_t *key, int ofs, int nb)
+{
+	const uint8_t *p = key + (ofs >> 3);
+	uint v = (p[0] << 16) | (p[1] << 8) | p[2];
+
+	return (v >> (24 - (ofs & 7) - nb)) & ((1U << nb) - 1);
+}
+
+/* Returns the index in the <elts> array of the longest network of <tab>
+ * matching <key>, or 0 if none does. <key> must be padded with two zeroes.
+ */
+static inline uint32_t pat_lpm_lookup(const struct pat_lpm_tab *tab, const uint8_t *key)
+{
+	const struct pat_lpm_node *node;
+	uint64_t bit;
+	uint32_t idx;
+	int ofs;
+
+	if (!tab->direct)
+		return 0;
+
+	idx = tab->direct[(key[0] << 8) | key[1]];
+	for (ofs = 16; !(idx & PAT_LPM_LEAF); ofs += 6) {
+		node = &tab->nodes[idx];
+		bit = 1ULL << pat_lpm_bits(key, ofs, 6);
+		if (!(node->vector & bit))
+			return tab->leaves[node->base0 + __builtin_popcountll(node->leafvec & ((bit << 1) - 1)) - 1];
+		idx = node->base1 + __builtin_popcountll(node->vector & (bit - 1));
+	}
+	return idx & ~PAT_LPM_LEAF;
+}
+
+/* Frees LPM tables <lpm>, which may be NULL */
+static void pat_lpm_free(struct pat_lpm *lpm)
+{
+	if (!lpm)
+		return;
+	free(lpm->v4.direct);
+	free(lpm->v4.nodes);
+	free(lpm->v4.leaves);
+	free(lpm->v6.direct);
+	free(lpm->v6.nodes);
+	free(lpm->v6.leaves);
+	free(lpm->elts);
+	free(lpm);
+}
+
+/* Drops the LPM tables of <expr> after a change of its trees affecting
+ * generation <gen>, if they cover it. The trees are used until the next load
+ * or commit builds them again. The expression must be locked for writes.
+ */
+static void pat_lpm_drop(struct pattern_expr *expr, unsigned int gen)
+{
+	if (!expr->lpm || expr->lpm->gen != gen)
+		return;
+	pat_lpm_free(expr->lpm);
+	expr->lpm = NULL;
+}
+
+/* sorts networks on their address, then on their length, then on their rank */
+static int pat_lpm_cmp(const void *a, const void *b)
+{
+	const struct pat_lpm_pfx *pa = a, *pb = b;
+	int ret = memcmp(pa->key, pb->key, sizeof(pa->key));
+
+	if (!ret)
+		ret = (int)pa->len - (int)pb->len;
+	return ret ? ret : (pa->rank > pb->rank) - (pa->rank < pb->rank);
+}
+
+/* Reserves <nb> consecutive entries of an array of <size>-byte elements. The
+ * array and its allocated size are in <arr> and <alloc>, its number of entries
+ * in <used>. Returns the index of the first one, or -1 on allocation failure.
+ */
+static int64_t pat_lpm_reserve(void **arr, uint32_t *used, uint32_t *alloc, size_t size, uint32_t nb)
+{
+	uint32_t new_alloc;
+	void *new_arr;
+
+	if (*used + nb > *alloc) {
+		new_alloc = (*alloc + nb) * 2;
+		if (new_alloc >= PAT_LPM_LEAF)
+			return -1;
+		new_arr = realloc(*arr, (size_t)new_alloc * size);
+		if (!new_arr)
+			return -1;
+		*arr = new_arr;
+		*alloc = new_alloc;
+	}
+	*used += nb;
+	return *used - nb;
+}
+
+/* context of the build of an LPM table */
+struct pat_lpm_build {
+	struct pat_lpm_tab *tab;
+	const struct pat_lpm_pfx *pfx;
+	uint32_t nodes_alloc;
+	uint32_t leaves_alloc;
+};
+
+/* Splits the block of addresses starting at bit <depth> which contains the
+ * sorted networks <lo> to <hi>, all longer than <depth>, into its 1 << <stride>
+ * children. <def> and <deflen> are the longest network covering the block and
+ * its length. For each child, <leaf> and <llen> receive the longest network
+ * covering it entirely, and <beg> and <end> the range of networks nested into
+ * it. Networks covering a child are sorted before those nested into it, since
+ * they all start at the first address of the child and are shorter.
+ */
+static void pat_lpm_split(const struct pat_lpm_pfx *pfx, uint32_t lo, uint32_t hi,
+                          uint32_t def, int deflen, int depth, int stride,
+                          uint32_t *leaf, uint8_t *llen, uint32_t *beg, uint32_t *end)
+{
+	uint32_t n = 1U << stride;
+	uint32_t c, j, span;
+
+	for (c = 0; c < n; c++) {
+		leaf[c] = def;
+		llen[c] = deflen;
+	}
+
+	for (c = 0; c < n; c++) {
+		while (lo < hi && pat_lpm_bits(pfx[lo].key, depth, stride) == c &&
+		       pfx[lo].len <= depth + stride) {
+			span = 1U << (depth + stride - pfx[lo].len);
+			for (j = c; j < c + span; j++) {
+				if (pfx[lo].len > llen[j]) {
+					leaf[j] = pfx[lo].elt;
+					llen[j] = pfx[lo].len;
+				}
+			}
+			lo++;
+		}
+		beg[c] = lo;
+		while (lo < hi && pat_lpm_bits(pfx[lo].key, depth, stride) == c)
+			lo++;
+		end[c] = lo;
+	}
+}
+
+/* Fills node <idx> of the table being built by <b> for the block of addresses
+ * starting at bit <depth>, then its children. See pat_lpm_split() for the
+ * other arguments. Returns 0 on allocation failure, otherwise non-zero.
+ */
+static int pat_lpm_fill(struct pat_lpm_build *b, uint32_t idx, uint32_t lo, uint32_t hi,
+                        uint32_t def, int deflen, int depth)
+{
+	struct pat_lpm_tab *tab = b->tab;
+	uint32_t leaf[64], beg[64], end[64];
+	uint8_t llen[64];
+	uint64_t vector = 0, leafvec = 0;
+	uint32_t c, prev = 0;
+	int64_t base0, base1, l;
+
+	pat_lpm_split(b->pfx, lo, hi, def, deflen, depth, 6, leaf, llen, beg, end);
+
+	base0 = tab->nb_leaves;
+	for (c = 0; c < 64; c++) {
+		if (end[c] > beg[c]) {
+			vector |= 1ULL << c;
+			continue;
+		}
+		if (!leafvec || leaf[c] != prev) {
+			l = pat_lpm_reserve((void **)&tab->leaves, &tab->nb_leaves, &b->leaves_alloc,
+			                    sizeof(*tab->leaves), 1);
+			if (l < 0)
+				return 0;
+			tab->leaves[l] = leaf[c];
+			leafvec |= 1ULL << c;
+			prev = leaf[c];
+		}
+	}
+
+	base1 = pat_lpm_reserve((void **)&tab->nodes, &tab->nb_nodes, &b->nodes_alloc,
+	                        sizeof(*tab->nodes), __builtin_popcountll(vector));
+	if (base1 < 0)
+		return 0;
+
+	tab->nodes[idx].vector  = vector;
+	tab->nodes[idx].leafvec = leafvec;
+	tab->nodes[idx].base0   = base0;
+	tab->nodes[idx].base1   = base1;
+
+	for (c = 0; c < 64; c++) {
+		if (end[c] > beg[c] &&
+		    !pat_lpm_fill(b, base1++, beg[c], end[c], leaf[c], llen[c], depth + 6))
+			return 0;
+	}
+	return 1;
+}
+
+/* Builds table <tab> from the <nb> sorted networks of <pfx>, which must not
+ * contain duplicates. Returns 0 on allocation failure, otherwise non-zero.
+ */
+static int pat_lpm_build_tab(struct pat_lpm_tab *tab, const struct pat_lpm_pfx *pfx, uint32_t nb)
+{
+	struct pat_lpm_build b = { .tab = tab, .pfx = pfx };
+	uint32_t *leaf = NULL, *beg = NULL, *end = NULL;
+	uint8_t *llen = NULL;
+	uint32_t c, lo = 0, def = 0;
+	int64_t idx;
+	int ret = 0;
+
+	if (!nb)
+		return 1;
+
+	/* a default route is the only network which may cover the whole space */
+	if (!pfx[0].len) {
+		def = pfx[0].elt;
+		lo = 1;
+	}
+
+	tab->direct = malloc(65536 * sizeof(*tab->direct));
+	leaf = malloc(65536 * sizeof(*leaf));
+	beg  = malloc(65536 * sizeof(*beg));
+	end  = malloc(65536 * sizeof(*end));
+	llen = malloc(65536 * sizeof(*llen));
+	if (!tab->direct || !leaf || !beg || !end || !llen)
+		goto out;
+
+	pat_lpm_split(pfx, lo, nb, def, 0, 0, 16, leaf, llen, beg, end);
+	for (c = 0; c < 65536; c++) {
+		if (end[c] == beg[c]) {
+			tab->direct[c] = leaf[c] | PAT_LPM_LEAF;
+			continue;
+		}
+		idx = pat_lpm_reserve((void **)&tab->nodes, &tab->nb_nodes, &b.nodes_alloc,
+		                      sizeof(*tab->nodes), 1);
+		if (idx < 0 || !pat_lpm_fill(&b, idx, beg[c], end[c], leaf[c], llen[c], 16))
+			goto out;
+		tab->direct[c] = idx;
+	}
+	ret = 1;
+ out:
+	free(leaf);
+	free(beg);
+	free(end);
+	free(llen);
+	return ret;
+}
+
+/* Collects the networks of the current generation of the trees of <expr> into
+ * the LPM tables it returns, and into a newly allocated array returned into
+ * <pfx>, IPv4 ones first, followed by IPv6 ones. Their numbers are returned
+ * into <nb>. The expression must be locked at least for reads. Returns NULL on
+ * allocation failure.
+ */
+static struct pat_lpm *pat_lpm_collect(struct pattern_expr *expr, struct pat_lpm_pfx **pfx, uint32_t *nb)
+{
+	unsigned int gen = expr->ref->curr_gen;
+	struct pattern_tree *elt;
+	struct ebmb_node *node;
+	struct pat_lpm_pfx *p;
+	struct pat_lpm *lpm;
+	uint32_t nb_elts = 0, i, n;
+	int family, alen, bits;
+
+	lpm = calloc(1, sizeof(*lpm));
+	if (!lpm)
+		return NULL;
+
+	n = 0;
+	for (node = ebmb_first(&expr->pattern_tree); node; node = ebmb_next(node))
+		n++;
+	for (node = ebmb_first(&expr->pattern_tree_2); node; node = ebmb_next(node))
+		n++;
+
+	lpm->elts = calloc(n + 1, sizeof(*lpm->elts));
+	*pfx = p = malloc((n + 1) * sizeof(*p));
+	if (!lpm->elts || !p)
+		goto fail;
+
+	for (family = 0; family < 2; family++) {
+		node = ebmb_first(family ? &expr->pattern_tree_2 : &expr->pattern_tree);
+		alen = family ? 16 : 4;
+		for (n = 0; node; node = ebmb_next(node)) {
+			elt = ebmb_entry(node, struct pattern_tree, node);
+			if (elt->ref->gen_id != gen)
+				continue;
+
+			memset(p[n].key, 0, sizeof(p[n].key));
+			memcpy(p[n].key, elt->node.key, alen);
+			p[n].len = node->node.pfx;
+			for (i = 0; i < alen; i++) {
+				bits = p[n].len - i * 8;
+				if (bits < 8)
+					p[n].key[i] &= bits <= 0 ? 0 : 0xff << (8 - bits);
+			}
+			p[n].rank = n;
+			p[n].elt = ++nb_elts;
+			lpm->elts[nb_elts] = elt;
+			n++;
+		}
+		nb[family] = n;
+		p += n;
+	}
+
+	lpm->gen = gen;
+	return lpm;
+
+ fail:
+	ha_free(pfx);
+	pat_lpm_free(lpm);
+	return NULL;
+}
+
+/* Builds the tables of <lpm> from the <nb> IPv4 then IPv6 networks of <pfx>
+ * collected by pat_lpm_collect(). <pfx> is reordered. No lock is needed.
+ * Returns 0 on allocation failure, otherwise non-zero.
+ */
+static int pat_lpm_build(struct pat_lpm *lpm, struct pat_lpm_pfx *pfx, const uint32_t *nb)
+{
+	uint32_t i, n;
+	int family;
+
+	for (family = 0; family < 2; family++) {
+		qsort(pfx, nb[family], sizeof(*pfx), pat_lpm_cmp);
+		for (i = n = 0; i < nb[family]; i++) {
+			if (n && pfx[i].len == pfx[n - 1].len &&
+			    memcmp(pfx[i].key, pfx[n - 1].key, sizeof(pfx[i].key)) == 0)
+				continue;
+			pfx[n++] = pfx[i];
+		}
+
+		if (!pat_lpm_build_tab(family ? &lpm->v6 : &lpm->v4, pfx, n))
+			return 0;
+		pfx += nb[family];
+	}
+	return 1;
+}
+
+/* Builds the LPM tables of <expr> if it is a large enough "ip" expression and
+ * they are missing or do not cover the current generation. This is only done
+ * when patterns are loaded or committed, never during lookups. The networks
+ * are collected with the expression locked for reads, then the tables are
+ * built without any lock, so that lookups and updates continue meanwhile on
+ * the trees, and they are only swapped with the expression locked for writes
+ * if no pattern was added or removed in the mean time. Otherwise the build is
+ * attempted again a few times. If it fails, the trees are used until the next
+ * update.
+ */
+static void pat_lpm_prepare(struct pattern_expr *expr)
+{
+	struct pat_lpm_pfx *pfx = NULL;
+	int tries = PAT_PREPARE_TRIES;
+	struct pat_lpm *lpm;
+	unsigned int rev;
+	uint32_t nb[2];
+	int ret;
+
+	if (expr->pat_head->match != pat_match_ip || !global.tune.pattern_lpm)
+		return;
+
+	while (tries--) {
+		HA_RWLOCK_RDLOCK(PATEXP_LOCK, &expr->lock);
+		if (expr->ref->entry_cnt < global.tune.pattern_lpm ||
+		    (expr->lpm && expr->lpm->gen == expr->ref->curr_gen)) {
+			HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
+			return;
+		}
+		rev = expr->rev;
+		lpm = pat_lpm_collect(expr, &pfx, nb);
+		HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
+
+		if (lpm && !pat_lpm_build(lpm, pfx, nb)) {
+			pat_lpm_free(lpm);
+			lpm = NULL;
+		}
+		ha_free(&pfx);
+		if (!lpm)
+			return;
+
+		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		ret = (expr->rev == rev);
+		if (ret)
+			SWAP(lpm, expr->lpm);
+		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		pat_lpm_free(lpm);
+		if (ret)
+			return;
+	}
+}
+
+/* Returns the LPM tables of <expr> if they cover the current generation, or
+ * NULL if the trees have to be used. The expression must be locked at least
+ * for reads.
+ */
+static inline struct pat_lpm *pat_lpm_get(const struct pattern_expr *expr)
+{
+	struct pat_lpm *lpm = expr->lpm;
+
+	/* tables built before a commit are only dropped by the next purge */
+	return lpm && lpm->gen == expr->ref->curr_gen ? lpm : NULL;
+}
+
 /* Performs ipv4 key lookup in <expr> ipv4 tree
  * Returns NULL on failure
  */
@@ -971,6 +2377,18 @@ static struct pattern *_pat_match_tree_ipv4(struct in_addr *key, struct pattern_
 {
 	struct ebmb_node *node;
 	struct pattern_tree *elt;
+	struct pat_lpm *lpm;
+	uint8_t k[4 + 2];
+
+	lpm = pat_lpm_get(expr);
+	if (lpm) {
+		memcpy(k, key, 4);
+		k[4] = k[5] = 0;
+		elt = lpm->elts[pat_lpm_lookup(&lpm->v4, k)];
+		if (!elt)
+			return NULL;
+		goto found;
+	}
 
 	/* Lookup an IPv4 address in the expression's pattern tree using
 	 * the longest match method.
@@ -982,18 +2400,21 @@ static struct pattern *_pat_match_tree_ipv4(struct in_addr *key, struct pattern_
 			node = ebmb_lookup_shorter(node);
 			continue;
 		}
-		if (fill) {
-			static_pattern.data = elt->data;
-			static_pattern.ref = elt->ref;
-			static_pattern.sflags = PAT_SF_TREE;
-			static_pattern.type = SMP_T_IPV4;
-			static_pattern.val.ipv4.addr.s_addr = read_u32(elt->node.key);
-			if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
-				return NULL;
-		}
-		return &static_pattern;
+		goto found;
 	}
 	return NULL;
+
+ found:
+	if (fill) {
+		static_pattern.data = HA_ATOMIC_LOAD(&elt->data);
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV4;
+		static_pattern.val.ipv4.addr.s_addr = read_u32(elt->node.key);
+		if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
+			return NULL;
+	}
+	return &static_pattern;
 }
 
 /* Performs ipv6 key lookup in <expr> ipv6 tree
@@ -1003,6 +2424,18 @@ static struct pattern *_pat_match_tree_ipv6(struct in6_addr *key, struct pattern
 {
 	struct ebmb_node *node;
 	struct pattern_tree *elt;
+	struct pat_lpm *lpm;
+	uint8_t k[16 + 2];
+
+	lpm = pat_lpm_get(expr);
+	if (lpm) {
+		memcpy(k, key, 16);
+		k[16] = k[17] = 0;
+		elt = lpm->elts[pat_lpm_lookup(&lpm->v6, k)];
+		if (!elt)
+			return NULL;
+		goto found;
+	}
 
 	/* Lookup an IPv6 address in the expression's pattern tree using
 	 * the longest match method.
@@ -1014,17 +2447,20 @@ static struct pattern *_pat_match_tree_ipv6(struct in6_addr *key, struct pattern
 			node = ebmb_lookup_shorter(node);
 			continue;
 		}
-		if (fill) {
-			static_pattern.data = elt->data;
-			static_pattern.ref = elt->ref;
-			static_pattern.sflags = PAT_SF_TREE;
-			static_pattern.type = SMP_T_IPV6;
-			memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
-			static_pattern.val.ipv6.mask = elt->node.node.pfx;
-		}
-		return &static_pattern;
+		goto found;
 	}
 	return NULL;
+
+ found:
+	if (fill) {
+		static_pattern.data = HA_ATOMIC_LOAD(&elt->data);
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV6;
+		memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
+		static_pattern.val.ipv6.mask = elt->node.node.pfx;
+	}
+	return &static_pattern;
 }
 
 struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int fill)
@@ -1046,6 +2482,14 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		pattern = _pat_match_tree_ipv6(&v6, expr, fill);
 		if (pattern)
 			return pattern;
+		/* Then in the precompiled map file, in the same order */
+		if (expr->ref->img) {
+			pattern = pat_img_match_ipv4(expr, &smp->data.u.ipv4, fill);
+			if (!pattern)
+				pattern = pat_img_match_ipv6(expr, &v6, fill);
+			if (pattern)
+				return pattern;
+		}
 		/* eligible for list lookup using IPv4 address */
 		v4 = smp->data.u.ipv4;
 		goto list_lookup;
@@ -1053,19 +2497,31 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 
 	/* The input sample is IPv6. Try to match in the trees. */
 	if (smp->data.type == SMP_T_IPV6) {
+		int is_v4;
+
 		pattern = _pat_match_tree_ipv6(&smp->data.u.ipv6, expr, fill);
 		if (pattern)
 			return pattern;
 		/* No match in the IPv6 tree. Try to convert 6 to 4 to lookup in
 		 * the IPv4 tree
 		 */
-		if (v6tov4(&v4, &smp->data.u.ipv6)) {
+		is_v4 = v6tov4(&v4, &smp->data.u.ipv6);
+		if (is_v4) {
 			pattern = _pat_match_tree_ipv4(&v4, expr, fill);
 			if (pattern)
 				return pattern;
-			/* eligible for list lookup using IPv4 address */
-			goto list_lookup;
 		}
+		/* Then in the precompiled map file, in the same order */
+		if (expr->ref->img) {
+			pattern = pat_img_match_ipv6(expr, &smp->data.u.ipv6, fill);
+			if (!pattern && is_v4)
+				pattern = pat_img_match_ipv4(expr, &v4, fill);
+			if (pattern)
+				return pattern;
+		}
+		/* eligible for list lookup using IPv4 address */
+		if (is_v4)
+			goto list_lookup;
 	}
 
  not_found:
@@ -1136,6 +2592,11 @@ void pat_prune_gen(struct pattern_expr *expr)
 
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
+	pat_ac_free(expr->ac);
+	expr->ac = NULL;
+	pat_lpm_free(expr->lpm);
+	expr->lpm = NULL;
+	expr->rev++;
 	LIST_INIT(&expr->patterns);
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt = 0;
@@ -1243,6 +2704,19 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	return 1;
 }
 
+/* Indexes a string pattern for substring lookups. It is appended to the list
+ * like with pat_idx_list_str(), and covered by the automaton once the next
+ * load or commit rebuilds it.
+ */
+int pat_idx_list_sub(struct pattern_expr *expr, struct pattern *pat, char **err)
+{
+	if (!pat_idx_list_str(expr, pat, err))
+		return 0;
+
+	pat_ac_tail(expr);
+	return 1;
+}
+
 int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap, char **err)
 {
 	struct pattern_list *patl;
@@ -1273,6 +2747,7 @@ int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap
 	pat->ref->list_head = &patl->from_ref;
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt++;
+	pat_ac_tail(expr);
 
 	/* that's ok */
 	return 1;
@@ -1321,6 +2796,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 			/* Insert the entry. */
 			ebmb_insert_prefix(&expr->pattern_tree, &node->node, 4);
+			pat_lpm_drop(expr, pat->ref->gen_id);
 
 			node->expr = expr;
 			node->from_ref = pat->ref->tree_head;
@@ -1354,6 +2830,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 		/* Insert the entry. */
 		ebmb_insert_prefix(&expr->pattern_tree_2, &node->node, 16);
+		pat_lpm_drop(expr, pat->ref->gen_id);
 
 		node->expr = expr;
 		node->from_ref = pat->ref->tree_head;
@@ -1461,6 +2938,98 @@ int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err)
 	return 1;
 }
 
+/* Indexes pattern <pat> into the prefix tree of <expr> under the <len> bytes
+ * at <key>, reversed if <rev> is set and lowered if the expression ignores
+ * case. The pattern's string is stored after the key to be reported on match.
+ */
+static int pat_idx_tree_key(struct pattern_expr *expr, struct pattern *pat,
+                            const char *key, int len, int rev, char **err)
+{
+	struct pattern_tree *node;
+	unsigned char c;
+	int slen, i;
+
+	/* Process the string len */
+	slen = strlen(pat->ptr.str);
+
+	/* node memory allocation, with the key's trailing zero */
+	node = calloc(1, sizeof(*node) + len + 1 + slen + 1);
+	if (!node) {
+		memprintf(err, "out of memory while loading pattern");
+		return 0;
+	}
+
+	/* copy the pointer to sample associated to this node */
+	node->data = pat->data;
+	node->ref = pat->ref;
+
+	/* copy the key then the string */
+	for (i = 0; i < len; i++) {
+		c = key[rev ? len - 1 - i : i];
+		node->node.key[i] = (expr->mflags & PAT_MF_IGNORE_CASE) ? tolower(c) : c;
+	}
+	memcpy(node->node.key + len + 1, pat->ptr.str, slen + 1);
+	node->node.node.pfx = len * 8;
+
+	/* index the new node */
+	ebmb_insert_prefix(&expr->pattern_tree, &node->node, len);
+
+	node->expr = expr;
+	node->from_ref = pat->ref->tree_head;
+	pat->ref->tree_head = &node->from_ref;
+	expr->ref->revision = rdtsc();
+	expr->ref->entry_cnt++;
+
+	/* that's ok */
+	return 1;
+}
+
+/* Indexes a string pattern for suffix lookups, reversed in the prefix tree */
+int pat_idx_tree_sfx(struct pattern_expr *expr, struct pattern *pat, char **err)
+{
+	/* Only string can be indexed */
+	if (pat->type != SMP_T_STR) {
+		memprintf(err, "internal error: string expected, but the type is '%s'",
+		          smp_to_type[pat->type]);
+		return 0;
+	}
+
+	return pat_idx_tree_key(expr, pat, pat->ptr.str, strlen(pat->ptr.str), 1, err);
+}
+
+/* Indexes a string pattern for domain lookups. Like with match_word(), the
+ * leading and trailing delimiters are not part of the key.
+ */
+int pat_idx_tree_dom(struct pattern_expr *expr, struct pattern *pat, char **err)
+{
+	unsigned int delim = make_4delim('/', '?', '.', ':');
+	const char *ps;
+	int pl;
+
+	/* Only string can be indexed */
+	if (pat->type != SMP_T_STR) {
+		memprintf(err, "internal error: string expected, but the type is '%s'",
+		          smp_to_type[pat->type]);
+		return 0;
+	}
+
+	ps = pat->ptr.str;
+	pl = strlen(ps);
+	while (pl > 0 && is_delimiter(*ps, delim)) {
+		pl--;
+		ps++;
+	}
+
+	while (pl > 0 && is_delimiter(ps[pl - 1], delim))
+		pl--;
+
+	/* patterns made only of delimiters keep their former behavior */
+	if (!pl)
+		return pat_idx_list_str(expr, pat, err);
+
+	return pat_idx_tree_key(expr, pat, ps, pl, 0, err);
+}
+
 /* Deletes all patterns from reference <elt>. Note that all of their
  * expressions must be locked, and the pattern lock must be held as well.
  */
@@ -1476,6 +3045,8 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 		node = *node;
 		BUG_ON(tree->ref != elt);
 
+		pat_lpm_drop(tree->expr, elt->gen_id);
+		tree->expr->rev++;
 		ebmb_delete(&tree->node);
 		free(tree->data);
 		free(tree);
@@ -1487,6 +3058,10 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 		node = *node;
 		BUG_ON(pat->pat.ref != elt);
 
+		if (pat->expr->ac)
+			pat_ac_delete(pat->expr->ac, pat);
+		pat->expr->rev++;
+
 		/* Delete and free entry. */
 		LIST_DELETE(&pat->list);
 		if (pat->pat.sflags & PAT_SF_REGFREE)
@@ -1509,6 +3084,9 @@ void pattern_init_expr(struct pattern_expr *expr)
 	LIST_INIT(&expr->patterns);
 	expr->pattern_tree = EB_ROOT;
 	expr->pattern_tree_2 = EB_ROOT;
+	expr->ac = NULL;
+	expr->lpm = NULL;
+	expr->rev = 0;
 }
 
 void pattern_init_head(struct pattern_head *head)
@@ -1666,20 +3244,145 @@ struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key)
 }
 
 
+/* Samples replaced at run time cannot be released immediately since other
+ * threads may be copying them in pattern_exec_match() without holding any lock
+ * that "set map" would take. They are first queued into the pending list. When
+ * the waiting list is empty, the pending entries are moved there and the loop
+ * counter of each thread is recorded. The waiting entries are released once
+ * each other thread has been seen harmless (i.e. in the poller) or has
+ * completed two loops, proving that it went through the barriers of the poller
+ * after the new values were published. This is checked at each update, and by
+ * the pat_gc_task as long as entries remain queued.
+ */
+static struct list pat_gc_pending = LIST_HEAD_INIT(pat_gc_pending);
+static struct list pat_gc_waiting = LIST_HEAD_INIT(pat_gc_waiting);
+static uint pat_gc_loops[MAX_THREADS];
+static struct task *pat_gc_task;
+__decl_spinlock(pat_gc_lock);
+
+/* releases all entries of list <head> */
+static void pat_gc_free(struct list *head)
+{
+	struct pat_gc *gc, *back;
+	int i;
+
+	list_for_each_entry_safe(gc, back, head, list) {
+		LIST_DELETE(&gc->list);
+		for (i = 0; i < gc->nb_data; i++)
+			free(gc->data[i]);
+		free(gc->sample);
+		free(gc);
+	}
+}
+
+/* Returns non-zero if all other threads went through a quiescent state since
+ * the loop counters were recorded into pat_gc_loops[]. Must be called with
+ * pat_gc_lock held.
+ */
+static int pat_gc_elapsed()
+{
+#ifdef USE_THREAD
+	const struct thread_info *thr;
+	int i;
+
+	for (i = 0; i < global.nbthread; i++) {
+		thr = &ha_thread_info[i];
+		if (i == tid)
+			continue;
+		if (!(_HA_ATOMIC_LOAD(&thr->tg->threads_enabled) & thr->ltid_bit))
+			continue;
+		if (HA_ATOMIC_LOAD(&thr->tg_ctx->threads_harmless) & thr->ltid_bit)
+			continue;
+		if (_HA_ATOMIC_LOAD(&activity[i].loops) - pat_gc_loops[i] >= 2)
+			continue;
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+/* Releases the waiting entries which are old enough, then starts the grace
+ * period of the pending ones if possible. Returns non-zero if some entries
+ * remain queued. Must be called with pat_gc_lock held.
+ */
+static int pat_gc_collect()
+{
+	int i;
+
+	if (!LIST_ISEMPTY(&pat_gc_waiting) && pat_gc_elapsed())
+		pat_gc_free(&pat_gc_waiting);
+
+	if (LIST_ISEMPTY(&pat_gc_waiting) && !LIST_ISEMPTY(&pat_gc_pending)) {
+		LIST_SPLICE(&pat_gc_waiting, &pat_gc_pending);
+		LIST_INIT(&pat_gc_pending);
+
+		/* the loop counters must be read after the new values are
+		 * visible to other threads.
+		 */
+		__ha_barrier_full();
+		for (i = 0; i < global.nbthread; i++)
+			pat_gc_loops[i] = _HA_ATOMIC_LOAD(&activity[i].loops);
+
+		if (pat_gc_elapsed())
+			pat_gc_free(&pat_gc_waiting);
+	}
+
+	return !LIST_ISEMPTY(&pat_gc_waiting);
+}
+
+/* Task releasing the queued entries once their grace period is over, so that
+ * they do not have to wait for the next update. It runs every few milliseconds
+ * as long as entries remain queued.
+ */
+static struct task *pat_gc_process(struct task *t, void *context, unsigned int state)
+{
+	int more;
+
+	HA_SPIN_LOCK(PATGC_LOCK, &pat_gc_lock);
+	more = pat_gc_collect();
+	HA_SPIN_UNLOCK(PATGC_LOCK, &pat_gc_lock);
+
+	t->expire = more ? tick_add(now_ms, MS_TO_TICKS(10)) : TICK_ETERNITY;
+	return t;
+}
+
+/* Queues <gc> for release once no other thread may access its contents
+ * anymore, and releases the entries which are old enough. The new values must
+ * already have been published.
+ */
+static void pat_gc_retire(struct pat_gc *gc)
+{
+	int more;
+
+	HA_SPIN_LOCK(PATGC_LOCK, &pat_gc_lock);
+	LIST_APPEND(&pat_gc_pending, &gc->list);
+	more = pat_gc_collect();
+	HA_SPIN_UNLOCK(PATGC_LOCK, &pat_gc_lock);
+
+	if (more && pat_gc_task)
+		task_schedule(pat_gc_task, tick_add(now_ms, MS_TO_TICKS(10)));
+}
+
 /* This function modifies the sample of pat_ref_elt <elt> in all expressions
  * found under <ref> to become <value>. It is assumed that the caller has
- * already verified that <elt> belongs to <ref>.
+ * already verified that <elt> belongs to <ref>. The new samples are atomically
+ * swapped with the former ones without locking the expressions, so that the
+ * lookups are never blocked by these updates. The former samples are released
+ * later by pat_gc_retire().
  */
 static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
                                   const char *value, char **err)
 {
 	struct pattern_expr *expr;
 	struct sample_data **data;
+	struct sample_data *new;
 	char *sample;
 	struct sample_data test;
 	struct pattern_tree *tree;
 	struct pattern_list *pat;
+	struct pat_gc *gc;
 	void **node;
+	int nb_data;
 
 
 	/* Try all needed converters. */
@@ -1693,14 +3396,34 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 		}
 	}
 
+	/* count the samples to replace */
+	nb_data = 0;
+	for (node = elt->tree_head; node; node = *node) {
+		tree = container_of(node, struct pattern_tree, from_ref);
+		if (tree->expr->pat_head->parse_smp && tree->data)
+			nb_data++;
+	}
+
+	for (node = elt->list_head; node; node = *node) {
+		pat = container_of(node, struct pattern_list, from_ref);
+		if (pat->expr->pat_head->parse_smp && pat->pat.data)
+			nb_data++;
+	}
+
 	/* Modify pattern from reference. */
 	sample = strdup(value);
-	if (!sample) {
+	gc = calloc(1, sizeof(*gc) + nb_data * sizeof(*gc->data));
+	if (!sample || !gc) {
+		free(sample);
+		free(gc);
 		memprintf(err, "out of memory error");
 		return 0;
 	}
+
 	/* Load sample in each reference. All the conversions are tested
-	 * below, normally these calls don't fail.
+	 * above, normally these calls don't fail. The samples are allocated
+	 * beforehand so that a failure does not leave a mix of old and new
+	 * values.
 	 */
 	for (node = elt->tree_head; node;) {
 		tree = container_of(node, struct pattern_tree, from_ref);
@@ -1711,11 +3434,13 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 			continue;
 
 		data = &tree->data;
-		if (data && *data) {
-			HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
-			if (!expr->pat_head->parse_smp(sample, *data))
-				*data = NULL;
-			HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		if (*data) {
+			new = malloc(sizeof(*new));
+			if (!new)
+				goto fail;
+			if (!expr->pat_head->parse_smp(sample, new))
+				ha_free(&new);
+			gc->data[gc->nb_data++] = new;
 		}
 	}
 
@@ -1728,20 +3453,48 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 			continue;
 
 		data = &pat->pat.data;
-		if (data && *data) {
-			HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
-			if (!expr->pat_head->parse_smp(sample, *data))
-				*data = NULL;
-			HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		if (*data) {
+			new = malloc(sizeof(*new));
+			if (!new)
+				goto fail;
+			if (!expr->pat_head->parse_smp(sample, new))
+				ha_free(&new);
+			gc->data[gc->nb_data++] = new;
 		}
 	}
 
-	/* free old sample only when all exprs are updated */
-	free(elt->sample);
-	elt->sample = sample;
+	/* now publish the new samples, keeping the former ones in <gc> */
+	nb_data = 0;
+	for (node = elt->tree_head; node; node = *node) {
+		tree = container_of(node, struct pattern_tree, from_ref);
+		if (tree->expr->pat_head->parse_smp && tree->data) {
+			gc->data[nb_data] = HA_ATOMIC_XCHG(&tree->data, gc->data[nb_data]);
+			nb_data++;
+		}
+	}
 
+	for (node = elt->list_head; node; node = *node) {
+		pat = container_of(node, struct pattern_list, from_ref);
+		if (pat->expr->pat_head->parse_smp && pat->pat.data) {
+			gc->data[nb_data] = HA_ATOMIC_XCHG(&pat->pat.data, gc->data[nb_data]);
+			nb_data++;
+		}
+	}
+
+	/* the former value may still be referenced by the former samples */
+	gc->sample = elt->sample;
+	elt->sample = sample;
+	pat_gc_retire(gc);
 
 	return 1;
+
+ fail:
+	while (gc->nb_data)
+		free(gc->data[--gc->nb_data]);
+	free(gc);
+	free(sample);
+	memprintf(err, "out of memory error");
+	return 0;
 }
 
 /* This function modifies the sample of pat_ref_elt <refelt> in all expressions
@@ -1764,7 +3517,10 @@ int pat_ref_set_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt, const cha
 		}
 	}
 
-	memprintf(err, "key or pattern not found");
+	if (ref->img)
+		memprintf(err, "key or pattern not found (entries of precompiled map files cannot be modified)");
+	else
+		memprintf(err, "key or pattern not found");
 	return 0;
 }
 
@@ -1798,7 +3554,10 @@ int pat_ref_set(struct pat_ref *ref, const char *key, const char *value, char **
 	}
 
 	if (!found) {
-		memprintf(err, "entry not found");
+		if (ref->img)
+			memprintf(err, "entry not found (entries of precompiled map files cannot be modified)");
+		else
+			memprintf(err, "entry not found");
 		return 0;
 	}
 	return 1;
@@ -1916,6 +3675,7 @@ struct pat_ref_elt *pat_ref_append(struct pat_ref *ref, const char *pattern, con
 
 	elt->gen_id = ref->curr_gen;
 	elt->line = line;
+	elt->rank = ref->next_rank++;
 
 	memcpy((char*)elt->pattern, pattern, len + 1);
 
@@ -1985,6 +3745,7 @@ int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
 		free(data);
 		return 0;
 	}
+	expr->rev++;
 	HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
 
 	return 1;
@@ -2059,17 +3820,30 @@ int pat_ref_add(struct pat_ref *ref,
  * The caller must already hold the PATREF_LOCK on <ref>. The function will
  * take the PATEXP_LOCK on all expressions of the pattern as needed. It returns
  * non-zero on completion, or zero if it had to stop before the end after
- * <budget> was depleted.
+ * <budget> was depleted. A precompiled map file whose entries belong to this
+ * range is unmapped at the first call. Once done, the caller should release
+ * the PATREF_LOCK and call pat_ref_prepare() to rebuild the lookup structures.
  */
 int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget)
 {
+	const struct pat_img_hdr *img = ref->img;
 	struct pat_ref_elt *elt, *elt_bck;
 	struct bref *bref, *bref_bck;
 	struct pattern_expr *expr;
 	int done;
 
-	list_for_each_entry(expr, &ref->pat, list)
+	list_for_each_entry(expr, &ref->pat, list) {
 		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		/* LPM tables built before a commit are not used anymore */
+		if (expr->lpm && expr->lpm->gen != ref->curr_gen)
+			pat_lpm_drop(expr, expr->lpm->gen);
+	}
+
+	/* all expr are locked, no lookup may be using the precompiled file */
+	if (img && ref->img_gen - from <= to - from)
+		ref->img = NULL;
+	else
+		img = NULL;
 
 	/* all expr are locked, we can safely remove all pat_ref */
 
@@ -2108,9 +3882,31 @@ int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget)
 	list_for_each_entry(expr, &ref->pat, list)
 		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
 
+	if (img) {
+		munmap((void *)img, ref->img_size);
+		ref->img_size = 0;
+	}
+
 	return done;
 }
 
+/* Prepares the lookup structures of all expressions of <ref> which are built
+ * from the whole set of patterns, once the patterns were loaded or updated.
+ * This may take some time on large sets, so it must not be called while
+ * processing traffic. The PATREF lock on <ref> must not be held, so that
+ * updates of the patterns are not blocked during the build. Each expression
+ * is locked as needed.
+ */
+void pat_ref_prepare(struct pat_ref *ref)
+{
+	struct pattern_expr *expr;
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		pat_ac_prepare(expr);
+		pat_lpm_prepare(expr);
+	}
+}
+
 /* This function prunes all entries of <ref> and all their associated
  * pattern_expr. It may return before the end of the list is reached,
  * returning 0, to yield, indicating to the caller that it must call it again.
@@ -2225,6 +4021,174 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
 	return expr;
 }
 
+/* Checks that the <size> bytes of the precompiled map file at <img> are
+ * consistent, so that lookups never access anything outside of it. Returns
+ * non-zero on success, otherwise zero with <err> filled.
+ */
+static int pat_img_valid(const struct pat_img_hdr *img, size_t size, char **err)
+{
+	const struct pat_img_str *str;
+	const struct pat_img_ipv4 *ipv4;
+	const struct pat_img_ipv6 *ipv6;
+	const char *keys, *vals;
+	uint32_t i;
+
+	if (img->bom != PAT_IMG_BOM) {
+		memprintf(err, "built for another byte order");
+		return 0;
+	}
+
+	if (img->type != PAT_IMG_STR && img->type != PAT_IMG_IP) {
+		memprintf(err, "unsupported type %u", img->type);
+		return 0;
+	}
+
+	if (img->ofs_str > size || img->ofs_str % 4 ||
+	    (size - img->ofs_str) / sizeof(*str) < img->nb_str ||
+	    img->ofs_ipv4 > size || img->ofs_ipv4 % 4 ||
+	    (size - img->ofs_ipv4) / sizeof(*ipv4) < img->nb_ipv4 ||
+	    img->ofs_ipv6 > size || img->ofs_ipv6 % 4 ||
+	    (size - img->ofs_ipv6) / sizeof(*ipv6) < img->nb_ipv6 ||
+	    img->ofs_keys > size || size - img->ofs_keys < img->len_keys ||
+	    img->ofs_vals > size || size - img->ofs_vals < img->len_vals) {
+		memprintf(err, "truncated file");
+		return 0;
+	}
+
+	/* all strings are zero-terminated if the areas are */
+	keys = (const char *)img + img->ofs_keys;
+	vals = (const char *)img + img->ofs_vals;
+	if ((img->len_keys && keys[img->len_keys - 1]) ||
+	    (img->len_vals && vals[img->len_vals - 1]))
+		goto corrupt;
+
+	str = (const void *)((const char *)img + img->ofs_str);
+	for (i = 0; i < img->nb_str; i++) {
+		if (str[i].key >= img->len_keys || str[i].len >= img->len_keys - str[i].key ||
+		    keys[str[i].key + str[i].len] || str[i].val >= img->len_vals)
+			goto corrupt;
+	}
+
+	ipv4 = (const void *)((const char *)img + img->ofs_ipv4);
+	for (i = 0; i < img->nb_ipv4; i++) {
+		if (ipv4[i].key >= img->len_keys || ipv4[i].val >= img->len_vals)
+			goto corrupt;
+	}
+
+	ipv6 = (const void *)((const char *)img + img->ofs_ipv6);
+	for (i = 0; i < img->nb_ipv6; i++) {
+		if (ipv6[i].key >= img->len_keys || ipv6[i].val >= img->len_vals)
+			goto corrupt;
+	}
+	return 1;
+
+ corrupt:
+	memprintf(err, "corrupted file");
+	return 0;
+}
+
+/* Maps read-only the precompiled map file designated by <ref>, which is then
+ * shared with the other processes through the page cache. Returns 1 on
+ * success, 0 with <err> filled on error, or -1 if the file is not a
+ * precompiled one and must be parsed as text.
+ */
+static int pat_ref_map_img(struct pat_ref *ref, char **err)
+{
+	struct pat_img_hdr hdr;
+	struct stat st;
+	void *area;
+	int fd;
+
+	fd = open(ref->reference, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    memcmp(hdr.magic, PAT_IMG_MAGIC, sizeof(hdr.magic)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		memprintf(err, "failed to stat precompiled map file <%s> : %s",
+		          ref->reference, strerror(errno));
+		close(fd);
+		return 0;
+	}
+
+	area = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (area == MAP_FAILED) {
+		memprintf(err, "failed to map precompiled map file <%s> : %s",
+		          ref->reference, strerror(errno));
+		return 0;
+	}
+
+	if (!pat_img_valid(area, st.st_size, err)) {
+		memprintf(err, "invalid precompiled map file <%s> : %s", ref->reference, *err);
+		munmap(area, st.st_size);
+		return 0;
+	}
+
+	ref->img = area;
+	ref->img_size = st.st_size;
+	ref->img_gen = ref->curr_gen;
+	pat_img_used = 1;
+	return 1;
+}
+
+/* Unmaps the precompiled map file of <ref> if any. It must not be used by any
+ * lookup anymore, which is the case before the expressions are indexed and
+ * after the processing stopped.
+ */
+static void pat_ref_unmap_img(struct pat_ref *ref)
+{
+	if (!ref->img)
+		return;
+	munmap((void *)ref->img, ref->img_size);
+	ref->img = NULL;
+	ref->img_size = 0;
+}
+
+/* Checks that expression <expr> may use the precompiled map file of its
+ * reference: only the "str" and "ip" match methods are supported, and all
+ * values must be valid for the map's output type. Returns non-zero on
+ * success, otherwise zero with <err> filled.
+ */
+static int pat_img_check_expr(struct pattern_expr *expr, char **err)
+{
+	const struct pat_img_hdr *img = expr->ref->img;
+	const char *vals = (const char *)img + img->ofs_vals;
+	const char *val;
+	struct sample_data data;
+
+	if ((img->type == PAT_IMG_STR && expr->pat_head->match != pat_match_str) ||
+	    (img->type == PAT_IMG_IP && expr->pat_head->match != pat_match_ip)) {
+		memprintf(err, "precompiled map file <%s> only supports the '%s' match method",
+		          expr->ref->reference, img->type == PAT_IMG_STR ? "str" : "ip");
+		return 0;
+	}
+
+	if (expr->mflags & PAT_MF_IGNORE_CASE) {
+		memprintf(err, "precompiled map file <%s> does not support case-insensitive matching",
+		          expr->ref->reference);
+		return 0;
+	}
+
+	if (!expr->pat_head->parse_smp)
+		return 1;
+
+	/* each distinct value is stored once */
+	for (val = vals; val < vals + img->len_vals; val += strlen(val) + 1) {
+		if (!expr->pat_head->parse_smp(val, &data)) {
+			memprintf(err, "unable to parse '%s' in precompiled map file <%s>",
+			          val, expr->ref->reference);
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /* Reads patterns from a file. If <err_msg> is non-NULL, an error message will
  * be returned there on errors and the caller will have to free it.
  *
@@ -2409,6 +4373,7 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 	struct pattern_expr *expr;
 	struct pat_ref_elt *elt;
 	int reuse = 0;
+	int ret;
 
 	/* Lookup for the existing reference. */
 	ref = pat_ref_lookup(filename);
@@ -2426,7 +4391,20 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 		}
 
 		if (ref->flags & PAT_REF_FILE) {
-			if (load_smp) {
+			ret = pat_ref_map_img(ref, err);
+			if (!ret)
+				return 0;
+
+			if (ret > 0) {
+				if (!load_smp) {
+					memprintf(err, "precompiled map file <%s> may only be used by maps",
+					          filename);
+					pat_ref_unmap_img(ref);
+					return 0;
+				}
+				ref->flags |= PAT_REF_SMP;
+			}
+			else if (load_smp) {
 				ref->flags |= PAT_REF_SMP;
 				if (!pat_ref_read_from_file_smp(ref, err))
 					return 0;
@@ -2498,6 +4476,9 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 	if (reuse)
 		return 1;
 
+	if (ref->img && !pat_img_check_expr(expr, err))
+		return 0;
+
 	/* Load reference content in the pattern expression.
 	 * We need to load elements in the same order they were seen in the
 	 * file. Indeed, some list-based matching types may rely on it as the
@@ -2543,6 +4524,10 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 	if (!sample_convert(smp, head->expect_type))
 		return NULL;
 
+	/* The expression's read lock protects the lookup against the structural
+	 * changes (add, del, commit, clear) which modify the trees and lists in
+	 * place. Value updates do not take the write lock, see pat_ref_set_elt().
+	 */
 	list_for_each_entry(list, &head->head, list) {
 		HA_RWLOCK_RDLOCK(PATEXP_LOCK, &list->expr->lock);
 		pat = head->match(smp, list->expr, fill);
@@ -2551,11 +4536,14 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 			   by another thread */
 			if (pat != &static_pattern) {
 				memcpy(&static_pattern, pat, sizeof(struct pattern));
+				static_pattern.data = HA_ATOMIC_LOAD(&pat->data);
 				pat = &static_pattern;
 			}
 
 			/* We also duplicate the sample data for
-			   same reason */
+			   same reason. It may be replaced at any time by
+			   pat_ref_set() but remains valid until we go back
+			   to the poller. */
 			if (pat->data && (pat->data != &static_sample_data)) {
 				switch(pat->data->type) {
 					case SMP_T_STR:
@@ -2637,8 +4625,11 @@ int pattern_finalize_config(void)
 
 	pat_lru_seed = ha_random();
 
-	/* Count pat_refs with user defined unique_id and totalt count */
+	/* Count pat_refs with user defined unique_id and totalt count, and
+	 * prepare their lookups now that they are loaded.
+	 */
 	list_for_each_entry(ref, &pattern_reference, list) {
+		pat_ref_prepare(ref);
 		len++;
 		if (ref->unique_id != -1)
 			unassigned_pos++;
@@ -2703,5 +4694,60 @@ static void pattern_per_thread_lru_free()
 	lru64_destroy(pat_lru_tree);
 }
 
+static void pattern_per_thread_ac_free()
+{
+	ha_free(&pat_ac_hits);
+	pat_ac_hits_sz = 0;
+}
+
+static int pattern_per_thread_img_alloc()
+{
+	if (!pat_img_used)
+		return 1;
+	pat_img_elt = calloc(1, sizeof(*pat_img_elt) + 2 * global.tune.bufsize);
+	return !!pat_img_elt;
+}
+
+static void pattern_per_thread_img_free()
+{
+	ha_free(&pat_img_elt);
+}
+
+/* unmaps the precompiled map files still in use */
+static void pattern_img_deinit()
+{
+	struct pat_ref *ref;
+
+	list_for_each_entry(ref, &pattern_reference, list)
+		pat_ref_unmap_img(ref);
+}
+
+/* allocates the task releasing the samples replaced at run time */
+static int pattern_gc_init()
+{
+	pat_gc_task = task_new_anywhere();
+	if (!pat_gc_task) {
+		ha_alert("Failed to allocate the pattern GC task.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+	pat_gc_task->process = pat_gc_process;
+	return ERR_NONE;
+}
+
+/* releases the samples replaced at run time that are still queued */
+static void pattern_gc_deinit()
+{
+	task_destroy(pat_gc_task);
+	pat_gc_task = NULL;
+	pat_gc_free(&pat_gc_pending);
+	pat_gc_free(&pat_gc_waiting);
+}
+
 REGISTER_PER_THREAD_ALLOC(pattern_per_thread_lru_alloc);
 REGISTER_PER_THREAD_FREE(pattern_per_thread_lru_free);
+REGISTER_PER_THREAD_FREE(pattern_per_thread_ac_free);
+REGISTER_PER_THREAD_ALLOC(pattern_per_thread_img_alloc);
+REGISTER_PER_THREAD_FREE(pattern_per_thread_img_free);
+REGISTER_POST_CHECK(pattern_gc_init);
+REGISTER_POST_DEINIT(pattern_gc_deinit);
+REGISTER_POST_DEINIT(pattern_img_deinit);
@@ -1863,7 +1863,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 					data_ptr = stktable_data_ptr_idx(table, ts, data_type, idx);
 					if (data_ptr && !ignore)
-						stktable_data_cast(data_ptr, std_t_uint) = decoded_int;
+						HA_ATOMIC_STORE(&stktable_data_cast(data_ptr, std_t_uint), decoded_int);
 				}
 				break;
 			case STD_T_ULL:
@@ -1876,7 +1876,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 					data_ptr = stktable_data_ptr_idx(table, ts, data_type, idx);
 					if (data_ptr && !ignore)
-						stktable_data_cast(data_ptr, std_t_ull) = decoded_int;
+						HA_ATOMIC_STORE(&stktable_data_cast(data_ptr, std_t_ull), decoded_int);
 				}
 				break;
 			case STD_T_FRQP:
@@ -1936,13 +1936,13 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		case STD_T_UINT:
 			data_ptr = stktable_data_ptr(table, ts, data_type);
 			if (data_ptr && !ignore)
-				stktable_data_cast(data_ptr, std_t_uint) = decoded_int;
+				HA_ATOMIC_STORE(&stktable_data_cast(data_ptr, std_t_uint), decoded_int);
 			break;
 
 		case STD_T_ULL:
 			data_ptr = stktable_data_ptr(table, ts, data_type);
 			if (data_ptr && !ignore)
-				stktable_data_cast(data_ptr, std_t_ull) = decoded_int;
+				HA_ATOMIC_STORE(&stktable_data_cast(data_ptr, std_t_ull), decoded_int);
 			break;
 
 		case STD_T_FRQP: {
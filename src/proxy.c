@@ -25,6 +25,7 @@
 #include <haproxy/capture-t.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/cli.h>
+#include <haproxy/counters.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/filters.h>
@@ -293,6 +294,8 @@ void free_proxy(struct proxy *p)
 
 	guid_remove(&p->guid);
 
+	counters_fe_shared_drop(&p->fe_counters.shared);
+	counters_be_shared_drop(&p->be_counters.shared);
 	EXTRA_COUNTERS_FREE(p->extra_counters_fe);
 	EXTRA_COUNTERS_FREE(p->extra_counters_be);
 
@@ -355,6 +358,8 @@ void free_proxy(struct proxy *p)
 		LIST_DELETE(&l->by_bind);
 		free(l->name);
 		free(l->per_thr);
+		if (l->counters)
+			counters_fe_shared_drop(&l->counters->shared);
 		free(l->counters);
 		task_destroy(l->rx.rhttp.task);
 
@@ -1425,6 +1430,8 @@ void init_new_proxy(struct proxy *p)
 
 	guid_init(&p->guid);
 
+	counters_fe_shared_init(&p->fe_counters.shared);
+	counters_be_shared_init(&p->be_counters.shared);
 	p->extra_counters_fe = NULL;
 	p->extra_counters_be = NULL;
 
@@ -1897,11 +1904,13 @@ void proxy_cond_disable(struct proxy *p)
 	 */
 	if ((p->mode == PR_MODE_TCP || p->mode == PR_MODE_HTTP || p->mode == PR_MODE_SYSLOG || p->mode == PR_MODE_SPOP) && !(p->cap & PR_CAP_INT))
 		ha_warning("Proxy %s stopped (cumulated conns: FE: %lld, BE: %lld).\n",
-			   p->id, p->fe_counters.cum_conn, p->be_counters.cum_sess);
+			   p->id, COUNTERS_SHARED_TOTAL(p->fe_counters.shared, cum_conn),
+			   COUNTERS_SHARED_TOTAL(p->be_counters.shared, cum_sess));
 
 	if ((p->mode == PR_MODE_TCP || p->mode == PR_MODE_HTTP || p->mode == PR_MODE_SPOP) && !(p->cap & PR_CAP_INT))
 		send_log(p, LOG_WARNING, "Proxy %s stopped (cumulated conns: FE: %lld, BE: %lld).\n",
-			 p->id, p->fe_counters.cum_conn, p->be_counters.cum_sess);
+			 p->id, COUNTERS_SHARED_TOTAL(p->fe_counters.shared, cum_conn),
+			 COUNTERS_SHARED_TOTAL(p->be_counters.shared, cum_sess));
 
 	if (p->table && p->table->size && p->table->sync_task)
 		task_wakeup(p->table->sync_task, TASK_WOKEN_MSG);
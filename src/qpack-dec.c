@@ -30,6 +30,7 @@
 #include <haproxy/mux_quic.h>
 #include <haproxy/qpack-t.h>
 #include <haproxy/qpack-dec.h>
+#include <haproxy/qpack-enc.h>
 #include <haproxy/qpack-tbl.h>
 #include <haproxy/hpack-huff.h>
 #include <haproxy/hpack-tbl.h>
@@ -52,6 +53,9 @@
 #define QPACK_LFL_WNR_BIT  0x40 // Literal field line with name reference
 #define QPACK_IFL_BIT      0x80 // Indexed field line
 
+/* Largest decoder instruction, made of a 62-bit prefix integer */
+#define QPACK_DEC_INST_MAX_SZ 10
+
 /* reads a varint from <raw>'s lowest <b> bits and <len> bytes max (raw included).
  * returns the 64-bit value on success after updating buf and len_in. Forces
  * len_in to (uint64_t)-1 on truncated input.
@@ -93,49 +97,172 @@ static uint64_t qpack_get_varint(const unsigned char **buf, uint64_t *len_in, in
 	return 0;
 }
 
-/* Decode an encoder stream.
+/* Decode a string literal from <raw> buffer of <len> bytes, its length being a
+ * <b>-bit prefix integer preceded by the Huffman flag. The string is stored in
+ * <str>, pointing either to <raw> or to <tmp> storage for Huffman encoded
+ * strings. <raw> and <len> are updated on success.
  *
- * Returns 0 on success else non-zero.
+ * Returns 0 on success else a negative QPACK_RET_* error code.
  */
-int qpack_decode_enc(struct buffer *buf, int fin, void *ctx)
+static int qpack_get_str(const unsigned char **raw, uint64_t *len, int b,
+                         struct buffer *tmp, struct ist *str)
 {
-	struct qcs *qcs = ctx;
-	size_t len;
-	unsigned char inst;
+	uint64_t str_len;
+	unsigned int h;
 
-	/* RFC 9204 4.2. Encoder and Decoder Streams
-	 *
-	 * The sender MUST NOT close either of these streams, and the receiver
-	 * MUST NOT request that the sender close either of these streams.
-	 * Closure of either unidirectional stream type MUST be treated as a
-	 * connection error of type H3_CLOSED_CRITICAL_STREAM.
-	 */
-	if (fin) {
-		qcc_set_error(qcs->qcc, H3_ERR_CLOSED_CRITICAL_STREAM, 1);
-		return -1;
-	}
+	if (!*len)
+		return -QPACK_RET_TRUNCATED;
 
-	len = b_data(buf);
-	qpack_debug_hexdump(stderr, "[QPACK-DEC-ENC] ", b_head(buf), 0, len);
+	h = **raw & (1 << b);
+	str_len = qpack_get_varint(raw, len, b);
+	if (*len == (uint64_t)-1 || *len < str_len)
+		return -QPACK_RET_TRUNCATED;
 
-	if (!len) {
-		qpack_debug_printf(stderr, "[QPACK-DEC-ENC] empty stream\n");
-		return 0;
-	}
+	if (h) {
+		char *trash;
+		int nlen;
 
-	inst = (unsigned char)*b_head(buf) & QPACK_ENC_INST_BITMASK;
-	if (inst == QPACK_ENC_INST_DUP) {
-		/* Duplicate */
+		trash = chunk_newstr(tmp);
+		if (!trash)
+			return -QPACK_RET_TOO_LARGE;
+
+		nlen = huff_dec(*raw, str_len, trash, tmp->size - tmp->data);
+		if (nlen == (uint32_t)-1) {
+			qpack_debug_printf(stderr, " can't decode huffman.\n");
+			return -QPACK_RET_HUFFMAN;
+		}
+
+		qpack_debug_printf(stderr, " [huff %d->%d '%s']", (int)str_len, (int)nlen, trash);
+		/* makes an ist from tmp storage */
+		b_add(tmp, nlen);
+		*str = ist2(trash, nlen);
 	}
-	else if (inst & QPACK_ENC_INST_IWNR_BIT) {
+	else {
+		*str = ist2(*raw, str_len);
+	}
+
+	*raw += str_len;
+	*len -= str_len;
+	return 0;
+}
+
+/* Copy string <str> into <tmp> storage so that it does not depend anymore on
+ * the dynamic table contents. Returns 0 on success else non-zero.
+ */
+static int qpack_dup_str(struct buffer *tmp, struct ist *str)
+{
+	char *trash;
+
+	trash = chunk_newstr(tmp);
+	if (!trash || tmp->size - tmp->data < str->len)
+		return 1;
+
+	memcpy(trash, str->ptr, str->len);
+	b_add(tmp, str->len);
+	*str = ist2(trash, str->len);
+	return 0;
+}
+
+/* Returns the entry of absolute index <abs> in the dynamic table of decoder
+ * <dec>, or NULL if it was not inserted yet or already evicted.
+ */
+static const struct qpack_dte *qpack_dec_get_dte(const struct qpack_dec *dec, uint64_t abs)
+{
+	if (!dec->dht || abs >= dec->ic || dec->ic - 1 - abs >= dec->dht->used)
+		return NULL;
+
+	return qpack_get_dte(dec->dht, dec->ic - 1 - abs);
+}
+
+/* Initialize decoder <dec>, its maximum table capacity <max_cap> being the one
+ * announced in SETTINGS. The table itself is only allocated once the encoder
+ * sets a non-null capacity, from the qpack_tbl pool whose size must not be
+ * lower than <max_cap>.
+ */
+void qpack_dec_init(struct qpack_dec *dec, uint64_t max_cap)
+{
+	dec->dht = NULL;
+	dec->max_cap = max_cap;
+	dec->ic = 0;
+	dec->krc = 0;
+	dec->blocked = 0;
+}
+
+/* Release the resources allocated for decoder <dec>. */
+void qpack_dec_release(struct qpack_dec *dec)
+{
+	if (dec->dht)
+		qpack_dht_free(dec->dht);
+	dec->dht = NULL;
+}
+
+/* Parse one encoder instruction for decoder <dec> from <raw> buffer of <len>
+ * bytes, using <tmp> as storage for strings.
+ *
+ * Returns the number of consumed bytes, 0 if the instruction is incomplete or
+ * a negative value on error.
+ */
+static int64_t qpack_parse_enc_inst(struct qpack_dec *dec, const unsigned char *raw,
+                                    uint64_t len, struct buffer *tmp)
+{
+	const unsigned char *start = raw;
+	const struct qpack_dte *dte;
+	struct ist name, value;
+	unsigned char inst;
+	uint64_t idx;
+	int ret;
+
+	chunk_reset(tmp);
+	inst = *raw & QPACK_ENC_INST_BITMASK;
+	if (inst & QPACK_ENC_INST_IWNR_BIT) {
 		/* Insert With Name Reference */
+		unsigned int static_tbl = *raw & 0x40;
+
+		idx = qpack_get_varint(&raw, &len, 6);
+		if (len == (uint64_t)-1)
+			return 0;
+
+		if (static_tbl) {
+			if (idx >= QPACK_SHT_SIZE)
+				return -1;
+			name = qpack_sht[idx].n;
+		}
+		else {
+			/* relative index, 0 being the newest entry */
+			if (!dec->dht || idx >= dec->dht->used ||
+			    !(dte = qpack_get_dte(dec->dht, idx)))
+				return -1;
+			name = qpack_get_name(dec->dht, dte);
+			if (qpack_dup_str(tmp, &name))
+				return -1;
+		}
+
+		ret = qpack_get_str(&raw, &len, 7, tmp, &value);
+		if (ret == -QPACK_RET_TRUNCATED)
+			return 0;
+		else if (ret < 0)
+			return -1;
+		qpack_debug_printf(stderr, "[QPACK-DEC-ENC] insert with name reference t=%d idx=%llu\n",
+		                   !!static_tbl, (unsigned long long)idx);
 	}
 	else if (inst & QPACK_ENC_INST_IWLN_BIT) {
 		/* Insert with literal name */
+		ret = qpack_get_str(&raw, &len, 5, tmp, &name);
+		if (!ret)
+			ret = qpack_get_str(&raw, &len, 7, tmp, &value);
+		if (ret == -QPACK_RET_TRUNCATED)
+			return 0;
+		else if (ret < 0)
+			return -1;
+		qpack_debug_printf(stderr, "[QPACK-DEC-ENC] insert with literal name\n");
 	}
 	else if (inst & QPACK_ENC_INST_SDTC_BIT) {
 		/* Set dynamic table capacity */
-		int capacity = *b_head(buf) & 0x1f;
+		uint64_t capacity;
+
+		capacity = qpack_get_varint(&raw, &len, 5);
+		if (len == (uint64_t)-1)
+			return 0;
 
 		/* RFC 9204 4.3.1. Set Dynamic Table Capacity
 		 *
@@ -143,25 +270,138 @@ int qpack_decode_enc(struct buffer *buf, int fin, void *ctx)
 		 * value that exceeds this limit as a connection error of type
 		 * QPACK_ENCODER_STREAM_ERROR.
 		 */
-		if (capacity) {
-			qcc_set_error(qcs->qcc, QPACK_ERR_ENCODER_STREAM_ERROR, 1);
+		if (capacity > dec->max_cap)
+			return -1;
+
+		qpack_debug_printf(stderr, "[QPACK-DEC-ENC] set capacity %llu\n",
+		                   (unsigned long long)capacity);
+		if (!dec->dht) {
+			if (capacity) {
+				dec->dht = qpack_dht_alloc();
+				if (!dec->dht)
+					return -1;
+				qpack_dht_init(dec->dht, capacity);
+			}
+		}
+		else if (!qpack_dht_resize(dec->dht, capacity)) {
 			return -1;
 		}
 
+		return raw - start;
+	}
+	else {
+		/* Duplicate */
+		idx = qpack_get_varint(&raw, &len, 5);
+		if (len == (uint64_t)-1)
+			return 0;
+
+		if (!dec->dht || idx >= dec->dht->used ||
+		    !(dte = qpack_get_dte(dec->dht, idx)))
+			return -1;
+
+		name = qpack_get_name(dec->dht, dte);
+		value = qpack_get_value(dec->dht, dte);
+		if (qpack_dup_str(tmp, &name) || qpack_dup_str(tmp, &value))
+			return -1;
+		qpack_debug_printf(stderr, "[QPACK-DEC-ENC] duplicate idx=%llu\n",
+		                   (unsigned long long)idx);
 	}
 
-	return 0;
+	/* RFC 9204 3.2.2. Dynamic Table Capacity and Eviction
+	 *
+	 * It is an error if the encoder attempts to add an entry that is
+	 * larger than the dynamic table capacity; the decoder MUST treat
+	 * this as a connection error of type QPACK_ENCODER_STREAM_ERROR.
+	 */
+	if (!dec->dht || name.len + value.len + 32 > dec->dht->size)
+		return -1;
+
+	if (qpack_dht_insert(dec->dht, name, value) < 0)
+		return -1;
+
+	dec->ic++;
+	return raw - start;
+}
+
+/* Returns the smallest length a string literal of <len> bytes may be decoded
+ * to, <h> being non-zero if it is Huffman encoded. The longest Huffman code
+ * being 30 bits long, each complete group of 30 bits produces at least one
+ * character.
+ */
+static inline uint64_t qpack_str_min_len(uint64_t len, int h)
+{
+	return h ? len * 8 / 30 : len;
 }
 
-/* Decode an decoder stream.
+/* Checks incomplete encoder instruction <raw> of <len> bytes for decoder <dec>
+ * and returns non-zero if the entry it inserts is already known to be larger
+ * than the dynamic table capacity, based on its name and the lengths of its
+ * string literals once decoded. Returns 0 if it may still be valid.
+ */
+static int qpack_enc_inst_too_large(const struct qpack_dec *dec,
+                                    const unsigned char *raw, uint64_t len)
+{
+	const struct qpack_dte *dte;
+	uint64_t size = 32, idx, str_len;
+	unsigned char inst;
+	int h;
+
+	inst = *raw & QPACK_ENC_INST_BITMASK;
+	if (inst & QPACK_ENC_INST_IWNR_BIT) {
+		/* Insert With Name Reference: the name is already known */
+		unsigned int static_tbl = *raw & 0x40;
+
+		idx = qpack_get_varint(&raw, &len, 6);
+		if (len == (uint64_t)-1)
+			return 0;
+
+		if (static_tbl)
+			size += idx < QPACK_SHT_SIZE ? qpack_sht[idx].n.len : 0;
+		else if (dec->dht && idx < dec->dht->used &&
+		         (dte = qpack_get_dte(dec->dht, idx)))
+			size += dte->nlen;
+	}
+	else if (inst & QPACK_ENC_INST_IWLN_BIT) {
+		/* Insert with literal name */
+		h = *raw & (1 << 5);
+		str_len = qpack_get_varint(&raw, &len, 5);
+		if (len == (uint64_t)-1)
+			return 0;
+
+		size += qpack_str_min_len(str_len, h);
+		if (len < str_len)
+			goto end;
+		raw += str_len;
+		len -= str_len;
+	}
+	else {
+		/* no string in other instructions */
+		return 0;
+	}
+
+	if (len) {
+		h = *raw & (1 << 7);
+		str_len = qpack_get_varint(&raw, &len, 7);
+		if (len != (uint64_t)-1)
+			size += qpack_str_min_len(str_len, h);
+	}
+
+ end:
+	return !dec->dht || size > dec->dht->size;
+}
+
+/* Decode an encoder stream for decoder <dec>.
  *
- * Returns 0 on success else non-zero.
+ * Returns the number of consumed bytes or a negative error code.
  */
-int qpack_decode_dec(struct buffer *buf, int fin, void *ctx)
+int qpack_decode_enc(struct qpack_dec *dec, struct buffer *buf, int fin, void *ctx)
 {
 	struct qcs *qcs = ctx;
-	size_t len;
-	unsigned char inst;
+	struct buffer *tmp, *lin;
+	const unsigned char *raw;
+	uint64_t len;
+	int64_t ret;
+	int total = 0;
 
 	/* RFC 9204 4.2. Encoder and Decoder Streams
 	 *
@@ -175,40 +415,175 @@ int qpack_decode_dec(struct buffer *buf, int fin, void *ctx)
 		return -1;
 	}
 
-	len = b_data(buf);
-	qpack_debug_hexdump(stderr, "[QPACK-DEC-DEC] ", b_head(buf), 0, len);
+	qpack_debug_hexdump(stderr, "[QPACK-DEC-ENC] ", b_head(buf), 0, b_contig_data(buf, 0));
+
+	tmp = get_trash_chunk();
+	while (b_data(buf)) {
+		raw = (const unsigned char *)b_head(buf);
+		len = b_contig_data(buf, 0);
+		if (len < b_data(buf)) {
+			/* instructions may span over the buffer wrapping */
+			lin = get_trash_chunk();
+			len = b_getblk(buf, lin->area, MIN(b_data(buf), lin->size), 0);
+			raw = (const unsigned char *)lin->area;
+		}
 
-	if (!len) {
-		qpack_debug_printf(stderr, "[QPACK-DEC-DEC] empty stream\n");
-		return 0;
+		ret = qpack_parse_enc_inst(dec, raw, len, tmp);
+		if (ret < 0)
+			goto err;
+		else if (!ret) {
+			/* incomplete instruction. It is rejected as soon as
+			 * the entry it inserts is known to be too large once
+			 * decoded. An instruction which does not fit in a
+			 * buffer could never be parsed either.
+			 */
+			if (b_data(buf) >= tmp->size ||
+			    qpack_enc_inst_too_large(dec, raw, len))
+				goto err;
+			break;
+		}
+
+		b_del(buf, ret);
+		total += ret;
 	}
 
-	inst = (unsigned char)*b_head(buf) & QPACK_DEC_INST_BITMASK;
-	if (inst == QPACK_DEC_INST_ICINC) {
-		/* Insert count increment */
+	return total;
 
-		/* RFC 9204 4.4.3. Insert Count Increment
-		 *
-		 * An encoder that receives an Increment field equal to zero, or one
-		 * that increases the Known Received Count beyond what the encoder has
-		 * sent, MUST treat this as a connection error of type
-		 * QPACK_DECODER_STREAM_ERROR.
-		 */
+ err:
+	qcc_set_error(qcs->qcc, QPACK_ERR_ENCODER_STREAM_ERROR, 1);
+	return -1;
+}
 
-		/* For the moment haproxy does not emit dynamic table insertion. */
-		qcc_set_error(qcs->qcc, QPACK_ERR_DECODER_STREAM_ERROR, 1);
+/* Decode a decoder stream for encoder <enc>.
+ *
+ * Returns the number of consumed bytes or a negative error code.
+ */
+int qpack_decode_dec(struct qpack_enc *enc, struct buffer *buf, int fin, void *ctx)
+{
+	struct qcs *qcs = ctx;
+	unsigned char data[QPACK_DEC_INST_MAX_SZ];
+	const unsigned char *raw;
+	unsigned char inst;
+	uint64_t len, value;
+	int total = 0;
+
+	/* RFC 9204 4.2. Encoder and Decoder Streams
+	 *
+	 * The sender MUST NOT close either of these streams, and the receiver
+	 * MUST NOT request that the sender close either of these streams.
+	 * Closure of either unidirectional stream type MUST be treated as a
+	 * connection error of type H3_CLOSED_CRITICAL_STREAM.
+	 */
+	if (fin) {
+		qcc_set_error(qcs->qcc, H3_ERR_CLOSED_CRITICAL_STREAM, 1);
 		return -1;
 	}
-	else if (inst & QPACK_DEC_INST_SACK) {
-		/* Section Acknowledgment */
-	}
-	else if (inst & QPACK_DEC_INST_SCCL) {
-		/* Stream cancellation */
+
+	qpack_debug_hexdump(stderr, "[QPACK-DEC-DEC] ", b_head(buf), 0, b_contig_data(buf, 0));
+
+	while (b_data(buf)) {
+		len = b_getblk(buf, (char *)data, MIN(b_data(buf), sizeof(data)), 0);
+		raw = data;
+
+		inst = *raw & QPACK_DEC_INST_BITMASK;
+		if (inst & QPACK_DEC_INST_SACK) {
+			/* Section Acknowledgment */
+			value = qpack_get_varint(&raw, &len, 7);
+			if (len == (uint64_t)-1)
+				goto trunc;
+
+			/* RFC 9204 4.4.1. Section Acknowledgment
+			 *
+			 * If an encoder receives a Section Acknowledgment
+			 * instruction referring to a stream on which every
+			 * encoded field section with a non-zero Required Insert
+			 * Count has already been acknowledged, this MUST be
+			 * treated as a connection error of type
+			 * QPACK_DECODER_STREAM_ERROR.
+			 */
+			if (qpack_enc_section_ack(enc, value))
+				goto err;
+		}
+		else if (inst & QPACK_DEC_INST_SCCL) {
+			/* Stream cancellation */
+			value = qpack_get_varint(&raw, &len, 6);
+			if (len == (uint64_t)-1)
+				goto trunc;
+
+			qpack_enc_stream_cancel(enc, value);
+		}
+		else {
+			/* Insert count increment */
+			value = qpack_get_varint(&raw, &len, 6);
+			if (len == (uint64_t)-1)
+				goto trunc;
+
+			if (qpack_enc_insert_count_inc(enc, value))
+				goto err;
+		}
+
+		b_del(buf, raw - data);
+		total += raw - data;
 	}
 
+	return total;
+
+ trunc:
+	/* no instruction may be larger than this */
+	if (b_data(buf) >= sizeof(data))
+		goto err;
+	return total;
+
+ err:
+	qcc_set_error(qcs->qcc, QPACK_ERR_DECODER_STREAM_ERROR, 1);
+	return -1;
+}
+
+/* Encode into <out> an Insert Count Increment for decoder <dec> if some
+ * insertions were not reported yet to the encoder.
+ *
+ * Returns 0 on success else non-zero.
+ */
+int qpack_dec_encode_ici(struct qpack_dec *dec, struct buffer *out)
+{
+	if (dec->ic == dec->krc)
+		return 0;
+
+	/* | 0 | 0 | Increment (6+) | */
+	if (qpack_encode_prefix_integer(out, dec->ic - dec->krc, 6, QPACK_DEC_INST_ICINC))
+		return 1;
+
+	dec->krc = dec->ic;
 	return 0;
 }
 
+/* Encode into <out> a Section Acknowledgment for a field section of required
+ * insert count <ric> decoded on stream <id> by decoder <dec>.
+ *
+ * Returns 0 on success else non-zero.
+ */
+int qpack_dec_encode_sack(struct qpack_dec *dec, struct buffer *out,
+                          uint64_t id, uint64_t ric)
+{
+	/* | 1 | Stream ID (7+) | */
+	if (qpack_encode_prefix_integer(out, id, 7, QPACK_DEC_INST_SACK))
+		return 1;
+
+	if (ric > dec->krc)
+		dec->krc = ric;
+	return 0;
+}
+
+/* Encode into <out> a Stream Cancellation for stream <id>.
+ *
+ * Returns 0 on success else non-zero.
+ */
+int qpack_dec_encode_sccl(struct buffer *out, uint64_t id)
+{
+	/* | 0 | 1 | Stream ID (6+) | */
+	return qpack_encode_prefix_integer(out, id, 6, QPACK_DEC_INST_SCCL);
+}
+
 /* Decode a field section prefix made of <enc_ric> and <db> two varints.
  * Also set the 'S' sign bit for <db>.
  * Return a negative error if failed, 0 if not.
@@ -216,11 +591,14 @@ int qpack_decode_dec(struct buffer *buf, int fin, void *ctx)
 static int qpack_decode_fs_pfx(uint64_t *enc_ric, uint64_t *db, int *sign_bit,
                                const unsigned char **raw, uint64_t *len)
 {
+	if (!*len)
+		return -QPACK_RET_RIC;
+
 	*enc_ric = qpack_get_varint(raw, len, 8);
-	if (*len == (uint64_t)-1)
+	if (*len == (uint64_t)-1 || !*len)
 		return -QPACK_RET_RIC;
 
-	*sign_bit = **raw & 0x8;
+	*sign_bit = **raw & 0x80;
 	*db = qpack_get_varint(raw, len, 7);
 	if (*len == (uint64_t)-1)
 		return -QPACK_RET_DB;
@@ -228,19 +606,61 @@ static int qpack_decode_fs_pfx(uint64_t *enc_ric, uint64_t *db, int *sign_bit,
 	return 0;
 }
 
-/* Decode a field section from the <raw> buffer of <len> bytes. Each parsed
- * header is inserted into <list> of <list_size> entries max and uses <tmp> as
- * a storage for some elements pointing into it. An end marker is inserted at
- * the end of the list with empty strings as name/value.
+/* Reconstruct the required insert count of a field section from its encoded
+ * value <enc_ric> for decoder <dec> (RFC 9204 4.5.1.1).
+ *
+ * Returns 0 on success with <ric> set else a negative error code.
+ */
+static int qpack_decode_ric(const struct qpack_dec *dec, uint64_t enc_ric, uint64_t *ric)
+{
+	const uint64_t max_entries = dec->max_cap / 32;
+	const uint64_t full_range = 2 * max_entries;
+	uint64_t max_value, max_wrapped, req_ic;
+
+	if (!enc_ric) {
+		*ric = 0;
+		return 0;
+	}
+
+	if (enc_ric > full_range)
+		return -QPACK_RET_DECOMP;
+
+	max_value = dec->ic + max_entries;
+	max_wrapped = (max_value / full_range) * full_range;
+	req_ic = max_wrapped + enc_ric - 1;
+
+	if (req_ic > max_value) {
+		if (req_ic <= full_range)
+			return -QPACK_RET_DECOMP;
+		req_ic -= full_range;
+	}
+
+	if (!req_ic)
+		return -QPACK_RET_DECOMP;
+
+	*ric = req_ic;
+	return 0;
+}
+
+/* Decode a field section from the <raw> buffer of <len> bytes with decoder
+ * <dec>. Each parsed header is inserted into <list> of <list_size> entries max
+ * and uses <tmp> as a storage for some elements pointing into it. An end
+ * marker is inserted at the end of the list with empty strings as name/value.
+ * The required insert count of the section is stored into <ric>, the caller
+ * having to acknowledge the section if it is not null.
  *
  * Returns the number of headers inserted into list excluding the end marker.
- * In case of error, a negative code QPACK_RET_* is returned.
+ * In case of error, a negative code QPACK_RET_* is returned. If the section
+ * references dynamic table entries not received yet, -QPACK_RET_BLOCKED is
+ * returned and decoding must be retried later.
  */
-int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
-                    struct http_hdr *list, int list_size)
+int qpack_decode_fs(struct qpack_dec *dec, const unsigned char *raw, uint64_t len,
+                    struct buffer *tmp, struct http_hdr *list, int list_size,
+                    uint64_t *ric)
 {
+	const struct qpack_dte *dte;
 	struct ist name, value;
-	uint64_t enc_ric, db;
+	uint64_t enc_ric, db, base;
 	int s;
 	unsigned int efl_type;
 	int ret;
@@ -255,9 +675,44 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 		goto out;
 	}
 
+	ret = qpack_decode_ric(dec, enc_ric, ric);
+	if (ret < 0) {
+		qpack_debug_printf(stderr, "##ERR@%d(%d)\n", __LINE__, ret);
+		goto out;
+	}
+
+	if (s) {
+		/* RFC 9204 4.5.1.2. Base
+		 *
+		 * A Base that is less than zero is a connection error of
+		 * type QPACK_DECOMPRESSION_FAILED.
+		 */
+		if (db >= *ric) {
+			ret = -QPACK_RET_DECOMP;
+			goto out;
+		}
+		base = *ric - db - 1;
+	}
+	else {
+		base = *ric + db;
+	}
+
+	qpack_debug_printf(stderr, "enc_ric: %llu ric: %llu db: %llu s=%d base: %llu\n",
+	                   (unsigned long long)enc_ric, (unsigned long long)*ric,
+	                   (unsigned long long)db, !!s, (unsigned long long)base);
+
+	/* RFC 9204 2.1.2. Blocked Streams
+	 *
+	 * If the decoder encounters a field section with a Required Insert
+	 * Count value larger than defined above, it MAY treat this as a
+	 * connection error of type QPACK_DECOMPRESSION_FAILED.
+	 */
+	if (*ric > dec->ic) {
+		ret = -QPACK_RET_BLOCKED;
+		goto out;
+	}
+
 	chunk_reset(tmp);
-	qpack_debug_printf(stderr, "enc_ric: %llu db: %llu s=%d\n", 
-	                   (unsigned long long)enc_ric, (unsigned long long)db, !!s);
 	/* Decode field lines */
 	while (len) {
 		if (hdr_idx >= list_size) {
@@ -270,13 +725,18 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 		efl_type = *raw & QPACK_EFL_BITMASK;
 		qpack_debug_printf(stderr, "efl_type=0x%02x\n", efl_type);
 
+		/* RFC9204 2.2.3 Invalid References
+		 *
+		 * If the decoder encounters a reference in a field line representation
+		 * to a dynamic table entry that has already been evicted or that has an
+		 * absolute index greater than or equal to the declared Required Insert
+		 * Count (Section 4.5.1), it MUST treat this as a connection error of
+		 * type QPACK_DECOMPRESSION_FAILED.
+		 */
 		if (efl_type == QPACK_LFL_WPBNM) {
-			/* Literal field line with post-base name reference
-			 * TODO adjust this when dynamic table support is implemented.
-			 */
-#if 0
-			uint64_t index __maybe_unused, length;
-			unsigned int n __maybe_unused, h __maybe_unused;
+			/* Literal field line with post-base name reference */
+			uint64_t index;
+			unsigned int n __maybe_unused;
 
 			qpack_debug_printf(stderr, "literal field line with post-base name reference:");
 			n = *raw & 0x08;
@@ -288,42 +748,21 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 			}
 
 			qpack_debug_printf(stderr, " n=%d index=%llu", !!n, (unsigned long long)index);
-			h = *raw & 0x80;
-			length = qpack_get_varint(&raw, &len, 7);
-			if (len == (uint64_t)-1) {
-				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
+			if (base + index >= *ric || !(dte = qpack_dec_get_dte(dec, base + index))) {
+				ret = -QPACK_RET_DECOMP;
 				goto out;
 			}
+			name = qpack_get_name(dec->dht, dte);
 
-			qpack_debug_printf(stderr, " h=%d length=%llu", !!h, (unsigned long long)length);
-
-			if (len < length) {
+			ret = qpack_get_str(&raw, &len, 7, tmp, &value);
+			if (ret < 0) {
 				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
 				goto out;
 			}
-
-			raw += length;
-			len -= length;
-#endif
-
-			/* RFC9204 2.2.3 Invalid References
-			 *
-			 * If the decoder encounters a reference in a field line representation
-			 * to a dynamic table entry that has already been evicted or that has an
-			 * absolute index greater than or equal to the declared Required Insert
-			 * Count (Section 4.5.1), it MUST treat this as a connection error of
-			 * type QPACK_DECOMPRESSION_FAILED.
-			 */
-			return -QPACK_RET_DECOMP;
 		}
 		else if (efl_type == QPACK_IFL_WPBI) {
-			/* Indexed field line with post-base index
-			 * TODO adjust this when dynamic table support is implemented.
-			 */
-#if 0
-			uint64_t index __maybe_unused;
+			/* Indexed field line with post-base index */
+			uint64_t index;
 
 			qpack_debug_printf(stderr, "indexed field line with post-base index:");
 			index = qpack_get_varint(&raw, &len, 4);
@@ -334,17 +773,12 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 			}
 
 			qpack_debug_printf(stderr, " index=%llu", (unsigned long long)index);
-#endif
-
-			/* RFC9204 2.2.3 Invalid References
-			 *
-			 * If the decoder encounters a reference in a field line representation
-			 * to a dynamic table entry that has already been evicted or that has an
-			 * absolute index greater than or equal to the declared Required Insert
-			 * Count (Section 4.5.1), it MUST treat this as a connection error of
-			 * type QPACK_DECOMPRESSION_FAILED.
-			 */
-			return -QPACK_RET_DECOMP;
+			if (base + index >= *ric || !(dte = qpack_dec_get_dte(dec, base + index))) {
+				ret = -QPACK_RET_DECOMP;
+				goto out;
+			}
+			name = qpack_get_name(dec->dht, dte);
+			value = qpack_get_value(dec->dht, dte);
 		}
 		else if (efl_type & QPACK_IFL_BIT) {
 			/* Indexed field line */
@@ -364,26 +798,23 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 				name = qpack_sht[index].n;
 				value = qpack_sht[index].v;
 			}
+			else if (!static_tbl && index < base &&
+			         base - 1 - index < *ric &&
+			         (dte = qpack_dec_get_dte(dec, base - 1 - index))) {
+				name = qpack_get_name(dec->dht, dte);
+				value = qpack_get_value(dec->dht, dte);
+			}
 			else {
-				/* RFC9204 2.2.3 Invalid References
-				 *
-				 * If the decoder encounters a reference in a field line representation
-				 * to a dynamic table entry that has already been evicted or that has an
-				 * absolute index greater than or equal to the declared Required Insert
-				 * Count (Section 4.5.1), it MUST treat this as a connection error of
-				 * type QPACK_DECOMPRESSION_FAILED.
-				 *
-				 * TODO adjust this when dynamic table support is implemented.
-				 */
-				return -QPACK_RET_DECOMP;
+				ret = -QPACK_RET_DECOMP;
+				goto out;
 			}
 
 			qpack_debug_printf(stderr,  " t=%d index=%llu", !!static_tbl, (unsigned long long)index);
 		}
 		else if (efl_type & QPACK_LFL_WNR_BIT) {
 			/* Literal field line with name reference */
-			uint64_t index, length;
-			unsigned int static_tbl, n __maybe_unused, h;
+			uint64_t index;
+			unsigned int static_tbl, n __maybe_unused;
 
 			qpack_debug_printf(stderr, "Literal field line with name reference:");
 			n = efl_type & 0x20;
@@ -398,162 +829,41 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 			if (static_tbl && index < QPACK_SHT_SIZE) {
 				name = qpack_sht[index].n;
 			}
-			else {
-				/* RFC9204 2.2.3 Invalid References
-				 *
-				 * If the decoder encounters a reference in a field line representation
-				 * to a dynamic table entry that has already been evicted or that has an
-				 * absolute index greater than or equal to the declared Required Insert
-				 * Count (Section 4.5.1), it MUST treat this as a connection error of
-				 * type QPACK_DECOMPRESSION_FAILED.
-				 *
-				 * TODO adjust this when dynamic table support is implemented.
-				 */
-				return -QPACK_RET_DECOMP;
-			}
-
-			qpack_debug_printf(stderr, " n=%d t=%d index=%llu", !!n, !!static_tbl, (unsigned long long)index);
-			h = *raw & 0x80;
-			length = qpack_get_varint(&raw, &len, 7);
-			if (len == (uint64_t)-1) {
-				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
-				goto out;
-			}
-
-			qpack_debug_printf(stderr, " h=%d length=%llu", !!h, (unsigned long long)length);
-			if (h) {
-				char *trash;
-				int nlen;
-
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_RET_TOO_LARGE;
-					goto out;
-				}
-				nlen = huff_dec(raw, length, trash, tmp->size - tmp->data);
-				if (nlen == (uint32_t)-1) {
-					qpack_debug_printf(stderr, " can't decode huffman.\n");
-					ret = -QPACK_RET_HUFFMAN;
-					goto out;
-				}
-
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)length, (int)nlen, trash);
-				/* makes an ist from tmp storage */
-				b_add(tmp, nlen);
-				value = ist2(trash, nlen);
+			else if (!static_tbl && index < base &&
+			         base - 1 - index < *ric &&
+			         (dte = qpack_dec_get_dte(dec, base - 1 - index))) {
+				name = qpack_get_name(dec->dht, dte);
 			}
 			else {
-				value = ist2(raw, length);
+				ret = -QPACK_RET_DECOMP;
+				goto out;
 			}
 
-			if (len < length) {
+			qpack_debug_printf(stderr, " n=%d t=%d index=%llu", !!n, !!static_tbl, (unsigned long long)index);
+			ret = qpack_get_str(&raw, &len, 7, tmp, &value);
+			if (ret < 0) {
 				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
 				goto out;
 			}
-
-			raw += length;
-			len -= length;
 		}
 		else if (efl_type & QPACK_LFL_WLN_BIT) {
 			/* Literal field line with literal name */
-			unsigned int n __maybe_unused, hname, hvalue;
-			uint64_t name_len, value_len;
+			unsigned int n __maybe_unused;
 
 			qpack_debug_printf(stderr, "Literal field line with literal name:");
 			n = *raw & 0x10;
-			hname = *raw & 0x08;
-			name_len = qpack_get_varint(&raw, &len, 3);
-			if (len == (uint64_t)-1) {
+			ret = qpack_get_str(&raw, &len, 3, tmp, &name);
+			if (ret < 0) {
 				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
 				goto out;
 			}
 
-			qpack_debug_printf(stderr, " n=%d hname=%d name_len=%llu", !!n, !!hname, (unsigned long long)name_len);
-			/* Name string */
-
-			if (len < name_len) {
+			ret = qpack_get_str(&raw, &len, 7, tmp, &value);
+			if (ret < 0) {
 				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
 				goto out;
 			}
-
-			if (hname) {
-				char *trash;
-				int nlen;
-
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_RET_TOO_LARGE;
-					goto out;
-				}
-				nlen = huff_dec(raw, name_len, trash, tmp->size - tmp->data);
-				if (nlen == (uint32_t)-1) {
-					qpack_debug_printf(stderr, " can't decode huffman.\n");
-					ret = -QPACK_RET_HUFFMAN;
-					goto out;
-				}
-
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)name_len, (int)nlen, trash);
-				/* makes an ist from tmp storage */
-				b_add(tmp, nlen);
-				name = ist2(trash, nlen);
-			}
-			else {
-				name = ist2(raw, name_len);
-			}
-
-			raw += name_len;
-			len -= name_len;
-
-			hvalue = *raw & 0x80;
-			value_len = qpack_get_varint(&raw, &len, 7);
-			if (len == (uint64_t)-1) {
-				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
-				goto out;
-			}
-
-			qpack_debug_printf(stderr, " hvalue=%d value_len=%llu", !!hvalue, (unsigned long long)value_len);
-
-			if (len < value_len) {
-				qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-				ret = -QPACK_RET_TRUNCATED;
-				goto out;
-			}
-
-			if (hvalue) {
-				char *trash;
-				int nlen;
-
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_RET_TOO_LARGE;
-					goto out;
-				}
-				nlen = huff_dec(raw, value_len, trash, tmp->size - tmp->data);
-				if (nlen == (uint32_t)-1) {
-					qpack_debug_printf(stderr, " can't decode huffman.\n");
-					ret = -QPACK_RET_HUFFMAN;
-					goto out;
-				}
-
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)value_len, (int)nlen, trash);
-				/* makes an ist from tmp storage */
-				b_add(tmp, nlen);
-				value = ist2(trash, nlen);
-			}
-			else {
-				value = ist2(raw, value_len);
-			}
-
-			raw += value_len;
-			len -= value_len;
+			qpack_debug_printf(stderr, " n=%d", !!n);
 		}
 
 		/* We must not accept empty header names (forbidden by the spec and used
@@ -1,52 +1,52 @@
 #include <haproxy/qpack-enc.h>
 
+#include <string.h>
+
+#include <import/ist.h>
 #include <haproxy/buf.h>
+#include <haproxy/chunk.h>
 #include <haproxy/intops.h>
+#include <haproxy/qpack-tbl.h>
 
 /* Returns the byte size required to encode <i> as a <prefix_size>-prefix
  * integer.
  */
-static size_t qpack_get_prefix_int_size(int i, int prefix_size)
+static size_t qpack_get_prefix_int_size(uint64_t i, int prefix_size)
 {
-	int n = (1 << prefix_size) - 1;
-	if (i < n) {
+	const uint64_t n = (1 << prefix_size) - 1;
+	size_t result = 1;
+
+	if (i < n)
 		return 1;
+
+	i -= n;
+	while (i >= 0x80) {
+		++result;
+		i >>= 7;
 	}
-	else {
-		size_t result = 0;
-		while (i) {
-			++result;
-			i >>= 7;
-		}
-		return 1 + result;
-	}
+	return 1 + result;
 }
 
 /* Encode the integer <i> in the buffer <out> in a <prefix_size>-bit prefix
- * integer. The caller must ensure there is enough size in the buffer. The
- * prefix is OR-ed with <before_prefix> byte.
+ * integer. The prefix is OR-ed with <before_prefix> byte.
  *
  * Returns 0 if success else non-zero.
  */
-static int qpack_encode_prefix_integer(struct buffer *out, int i,
-                                       int prefix_size,
-                                       unsigned char before_prefix)
+int qpack_encode_prefix_integer(struct buffer *out, uint64_t i,
+                                int prefix_size,
+                                unsigned char before_prefix)
 {
-	const int mod = (1 << prefix_size) - 1;
+	const uint64_t mod = (1 << prefix_size) - 1;
 	BUG_ON_HOT(!prefix_size);
 
-	if (i < mod) {
-		if (b_room(out) < 1)
-			return 1;
+	if (b_room(out) < qpack_get_prefix_int_size(i, prefix_size))
+		return 1;
 
+	if (i < mod) {
 		b_putchr(out, before_prefix | i);
 	}
 	else {
-		int to_encode = i - mod;
-		const size_t sz = to_encode / mod;
-
-		if (b_room(out) < sz)
-			return 1;
+		uint64_t to_encode = i - mod;
 
 		b_putchr(out, before_prefix | mod);
 		while (1) {
@@ -183,3 +183,542 @@ int qpack_encode_header(struct buffer *out, const struct ist n, const struct ist
 
 	return 0;
 }
+
+/* Looks up header field <n>:<v> in the static table. Returns the index of the
+ * entry matching both the name and the value if any, otherwise -1. <nidx> is
+ * set to the index of the first entry matching the name, or -1.
+ */
+static int qpack_static_idx(const struct ist n, const struct ist v, int *nidx)
+{
+	int i;
+
+	*nidx = -1;
+	for (i = 0; i < QPACK_SHT_SIZE; i++) {
+		if (qpack_sht[i].n.len != n.len || !isteq(qpack_sht[i].n, n))
+			continue;
+
+		if (*nidx < 0)
+			*nidx = i;
+		if (isteq(qpack_sht[i].v, v))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Encode string <str> without Huffman coding, its length being a
+ * <prefix_size>-bit prefix integer OR-ed with <before_prefix> byte.
+ *
+ * Returns 0 if success else non-zero, in which case <out> may have been
+ * partially filled.
+ */
+static int qpack_encode_str(struct buffer *out, const struct ist str,
+                            int prefix_size, unsigned char before_prefix)
+{
+	if (qpack_encode_prefix_integer(out, str.len, prefix_size, before_prefix))
+		return 1;
+
+	if (b_room(out) < str.len)
+		return 1;
+
+	b_putblk(out, str.ptr, str.len);
+	return 0;
+}
+
+/* Returns a non-zero hash of header field <n>:<v>, used to recognize the
+ * fields which are repeated.
+ */
+static inline uint32_t qpack_enc_hash(const struct ist n, const struct ist v)
+{
+	const struct ist str[2] = { n, v };
+	uint64_t hash = 0;
+	uint64_t word;
+	size_t i;
+	int s;
+
+	for (s = 0; s < 2; s++) {
+		for (i = 0; i + 8 <= str[s].len; i += 8) {
+			memcpy(&word, str[s].ptr + i, 8);
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+			hash ^= hash >> 29;
+		}
+		word = str[s].len;
+		memcpy(&word, str[s].ptr + i, str[s].len - i);
+		hash = (hash ^ word ^ ((uint64_t)str[s].len << 56)) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+	return (uint32_t)hash | 1;
+}
+
+/* Returns non-zero if header field <n>:<v> is worth being inserted by encoder
+ * <enc>, that is if it was recently missed already. Otherwise it is
+ * remembered for the next time.
+ */
+static inline int qpack_enc_frequent(struct qpack_enc *enc, const struct ist n, const struct ist v)
+{
+	uint32_t hash = qpack_enc_hash(n, v);
+	int i;
+
+	for (i = 0; i < QPACK_ENC_SEEN; i++) {
+		if (enc->seen[i] == hash)
+			return 1;
+	}
+
+	enc->seen[enc->seen_pos++ & (QPACK_ENC_SEEN - 1)] = hash;
+	return 0;
+}
+
+/* Returns non-zero if header field name <n> designates a sensitive field whose
+ * value must never be inserted into a dynamic table (RFC 9204 7.1.3).
+ */
+static inline int qpack_enc_sensitive(const struct ist n)
+{
+	switch (n.len) {
+	case 6:  return isteq(n, ist("cookie"));
+	case 10: return isteq(n, ist("set-cookie"));
+	case 13: return isteq(n, ist("authorization"));
+	case 19: return isteq(n, ist("proxy-authorization"));
+	}
+	return 0;
+}
+
+/* Initializes encoder <enc> with a dynamic table limited to <limit> bytes. A
+ * zero limit disables the dynamic table. The table itself is only allocated
+ * on the first insertion, from the qpack_tbl pool whose size must not be lower
+ * than <limit>. The table is not used until the peer's settings are known.
+ */
+void qpack_enc_init(struct qpack_enc *enc, uint64_t limit)
+{
+	memset(enc, 0, sizeof(*enc));
+	enc->limit = limit;
+}
+
+/* Releases the resources allocated for encoder <enc>. */
+void qpack_enc_release(struct qpack_enc *enc)
+{
+	if (enc->dht)
+		qpack_dht_free(enc->dht);
+	enc->dht = NULL;
+}
+
+/* Reports the peer's decoder settings to encoder <enc> : the maximum table
+ * capacity <max_cap> and the number of streams which may be blocked
+ * <max_blocked>.
+ */
+void qpack_enc_set_max(struct qpack_enc *enc, uint64_t max_cap, uint64_t max_blocked)
+{
+	enc->max_cap = max_cap;
+	enc->max_blocked = max_blocked;
+}
+
+/* Starts a new field section for stream <id> with encoder <enc>. This must
+ * also be called before restarting the encoding of a section. The dynamic
+ * table may only be referenced if the section can be tracked until its
+ * acknowledgment, and entries not acknowledged yet only if this does not
+ * block more streams than the peer accepts (RFC 9204 2.1.2).
+ */
+void qpack_enc_begin(struct qpack_enc *enc, uint64_t id)
+{
+	uint64_t blocked = 0;
+	int self = 0;
+	int i;
+
+	enc->id = id;
+	enc->base = enc->ic;
+	enc->ric = 0;
+	enc->min_ref = UINT64_MAX;
+	enc->pin = enc->krc;
+
+	for (i = 0; i < enc->nb_sect; i++) {
+		if (enc->sect[i].min_ref < enc->pin)
+			enc->pin = enc->sect[i].min_ref;
+
+		if (enc->sect[i].ric > enc->krc) {
+			if (enc->sect[i].id == id)
+				self = 1;
+			else
+				blocked++;
+		}
+	}
+
+	enc->may_ref = enc->dht && enc->nb_sect < QPACK_ENC_MAX_SECT;
+	enc->may_block = self || blocked < enc->max_blocked;
+}
+
+/* Encodes into <out> a reference to the dynamic table entry of absolute index
+ * <abs> for the current section of encoder <enc>.
+ *
+ * Returns 0 if success else non-zero.
+ */
+static int qpack_enc_ref(struct qpack_enc *enc, struct buffer *out, uint64_t abs)
+{
+	if (abs < enc->base) {
+		/* indexed field line, dynamic table (RFC 9204 4.5.2) :
+		 * | 1 | T=0 | Index (6+) |
+		 */
+		if (qpack_encode_prefix_integer(out, enc->base - 1 - abs, 6, 0x80))
+			return 1;
+	}
+	else {
+		/* indexed field line with post-base index (RFC 9204 4.5.3) :
+		 * | 0 | 0 | 0 | 1 | Index (4+) |
+		 */
+		if (qpack_encode_prefix_integer(out, abs - enc->base, 4, 0x10))
+			return 1;
+	}
+
+	if (abs + 1 > enc->ric)
+		enc->ric = abs + 1;
+	if (abs < enc->min_ref)
+		enc->min_ref = abs;
+	if (abs < enc->pin)
+		enc->pin = abs;
+	return 0;
+}
+
+/* Checks that <need> bytes may be made available in the dynamic table of
+ * encoder <enc> of capacity <cap> without evicting the entry of absolute index
+ * <keep> nor any more recent one. Only entries acknowledged and not referenced
+ * by any pending section may be evicted (RFC 9204 2.1.1).
+ *
+ * Returns 0 if success else non-zero.
+ */
+static int qpack_enc_room(const struct qpack_enc *enc, uint64_t cap, uint64_t need, uint64_t keep)
+{
+	const struct qpack_dte *dte;
+	uint64_t room;
+	int i;
+
+	room = cap - (enc->dht->used * 32 + enc->dht->total);
+	for (i = enc->dht->used - 1; room < need && i >= 0; i--) {
+		if (enc->ic - 1 - i >= keep)
+			return 1;
+		dte = qpack_get_dte(enc->dht, i);
+		if (!dte)
+			return 1;
+		room += dte->nlen + dte->vlen + 32;
+	}
+	return room < need;
+}
+
+/* Tries to insert header field <n>:<v> into the dynamic table of encoder <enc>
+ * by emitting the instruction into <ins>, which is the encoder stream buffer.
+ * <nidx> is the static table index of the name or -1. The insertion is not
+ * performed if it would evict entries which the decoder may still reference.
+ *
+ * Returns 0 if success else non-zero.
+ */
+static int qpack_enc_insert(struct qpack_enc *enc, struct buffer *ins,
+                            const struct ist n, const struct ist v, int nidx)
+{
+	uint64_t cap = enc->cap;
+	uint64_t need = n.len + v.len + 32;
+	size_t data = b_data(ins);
+
+	if (!cap)
+		cap = MIN(enc->limit, enc->max_cap);
+	if (need > cap)
+		return 1;
+
+	if (enc->dht) {
+		if (qpack_enc_room(enc, cap, need, enc->pin))
+			return 1;
+	}
+	else {
+		enc->dht = qpack_dht_alloc();
+		if (!enc->dht)
+			return 1;
+		qpack_dht_init(enc->dht, cap);
+	}
+
+	if (!enc->cap) {
+		/* set dynamic table capacity (RFC 9204 4.3.1) :
+		 * | 0 | 0 | 1 | Capacity (5+) |
+		 */
+		if (qpack_encode_prefix_integer(ins, cap, 5, 0x20))
+			goto fail;
+	}
+
+	if (nidx >= 0) {
+		/* insert with name reference (RFC 9204 4.3.2) :
+		 * | 1 | T=1 | Name Index (6+) |
+		 * | H | Value Length (7+) | Value String |
+		 */
+		if (qpack_encode_prefix_integer(ins, nidx, 6, 0xc0))
+			goto fail;
+	}
+	else {
+		/* insert with literal name (RFC 9204 4.3.3) :
+		 * | 0 | 1 | H | Name Length (5+) | Name String |
+		 * | H | Value Length (7+) | Value String |
+		 */
+		if (qpack_encode_str(ins, n, 5, 0x40))
+			goto fail;
+	}
+
+	if (qpack_encode_str(ins, v, 7, 0x00))
+		goto fail;
+
+	if (qpack_dht_insert(enc->dht, n, v) < 0)
+		goto fail;
+
+	enc->cap = cap;
+	enc->ic++;
+	return 0;
+
+ fail:
+	b_sub(ins, b_data(ins) - data);
+	return 1;
+}
+
+/* Tries to duplicate the entry <dte> of absolute index <abs> of the dynamic
+ * table of encoder <enc> by emitting the instruction into <ins>, so that the
+ * field remains available once the original entry gets evicted (RFC 9204
+ * 2.1.1.1). The original entry is never evicted by its own duplication.
+ *
+ * Returns 0 if success else non-zero.
+ */
+static int qpack_enc_dup(struct qpack_enc *enc, struct buffer *ins,
+                         const struct qpack_dte *dte, uint64_t abs)
+{
+	uint64_t need = dte->nlen + dte->vlen + 32;
+	size_t data = b_data(ins);
+	struct buffer *copy;
+	struct ist n, v;
+
+	/* the field must be copied first as the insertion may move entries */
+	copy = get_trash_chunk();
+	if (dte->nlen + dte->vlen > copy->size)
+		return 1;
+
+	if (qpack_enc_room(enc, enc->cap, need, MIN(enc->pin, abs)))
+		return 1;
+
+	/* duplicate (RFC 9204 4.3.4) :
+	 * | 0 | 0 | 0 | Index (5+) |
+	 */
+	if (qpack_encode_prefix_integer(ins, enc->ic - 1 - abs, 5, 0x00))
+		goto fail;
+
+	memcpy(copy->area, (void *)enc->dht + dte->addr, dte->nlen + dte->vlen);
+	n = ist2(copy->area, dte->nlen);
+	v = ist2(copy->area + dte->nlen, dte->vlen);
+	if (qpack_dht_insert(enc->dht, n, v) < 0)
+		goto fail;
+
+	enc->ic++;
+	return 0;
+
+ fail:
+	b_sub(ins, b_data(ins) - data);
+	return 1;
+}
+
+/* Encodes header field <n>:<v> into <out> for the field section started by
+ * qpack_enc_begin() on encoder <enc>, making use of the static table and of
+ * the dynamic table. Insertion instructions are emitted into <ins> if not
+ * NULL.
+ *
+ * Returns 0 if success else non-zero.
+ */
+int qpack_enc_header(struct qpack_enc *enc, struct buffer *out, struct buffer *ins,
+                     const struct ist n, const struct ist v)
+{
+	const struct qpack_dht *dht = enc->dht;
+	const struct qpack_dte *dte;
+	size_t data = b_data(out);
+	int sensitive = qpack_enc_sensitive(n);
+	int sidx, nidx;
+	int pending = 0;
+	uint64_t abs;
+	int i;
+
+	sidx = qpack_static_idx(n, v, &nidx);
+	if (sidx >= 0) {
+		/* indexed field line, static table (RFC 9204 4.5.2) :
+		 * | 1 | T=1 | Index (6+) |
+		 */
+		return qpack_encode_prefix_integer(out, sidx, 6, 0xc0);
+	}
+
+	if (!sensitive && dht) {
+		/* Look for the field in the dynamic table, newest first. The
+		 * lookup is bounded so that large tables remain cheap.
+		 */
+		for (i = 0; i < dht->used && i < QPACK_ENC_MAX_LOOKUP; i++) {
+			dte = qpack_get_dte(dht, i);
+			if (!dte)
+				break;
+
+			if (dte->nlen != n.len || dte->vlen != v.len ||
+			    memcmp((void *)dht + dte->addr, n.ptr, n.len) != 0 ||
+			    memcmp((void *)dht + dte->addr + dte->nlen, v.ptr, v.len) != 0)
+				continue;
+
+			/* the field is already there, even if it may not be
+			 * referenced yet, it must not be inserted again.
+			 */
+			abs = enc->ic - 1 - i;
+			if (!enc->may_ref || (abs >= enc->krc && !enc->may_block)) {
+				pending = 1;
+				continue;
+			}
+
+			/* Entries in the oldest quarter of an almost full
+			 * table will soon have to be evicted, which is not
+			 * possible as long as they are referenced. They are
+			 * duplicated instead, and the copy is referenced when
+			 * blocking is permitted, or once acknowledged.
+			 */
+			if (ins && !pending &&
+			    i >= dht->used - dht->used / 4 &&
+			    (dht->used * 32 + dht->total) * 4 > enc->cap * 3 &&
+			    !qpack_enc_dup(enc, ins, dte, abs) && enc->may_block)
+				return qpack_enc_ref(enc, out, enc->ic - 1);
+
+			return qpack_enc_ref(enc, out, abs);
+		}
+	}
+
+	if (!sensitive && !pending && ins && enc->limit && enc->max_cap &&
+	    n.len + v.len + 32 <= MIN(enc->limit, enc->max_cap) / 4 &&
+	    qpack_enc_frequent(enc, n, v) &&
+	    !qpack_enc_insert(enc, ins, n, v, nidx)) {
+		/* the entry may be referenced right away if blocking the
+		 * stream is permitted, otherwise once it is acknowledged.
+		 */
+		if (enc->nb_sect < QPACK_ENC_MAX_SECT && enc->may_block) {
+			enc->may_ref = 1;
+			return qpack_enc_ref(enc, out, enc->ic - 1);
+		}
+	}
+
+	if (nidx >= 0) {
+		/* literal field line with name reference (RFC 9204 4.5.4) :
+		 * | 0 | 1 | N | T=1 | Name Index (4+) |
+		 * | H | Value Length (7+) | Value String |
+		 */
+		if (qpack_encode_prefix_integer(out, nidx, 4, sensitive ? 0x70 : 0x50) ||
+		    qpack_encode_str(out, v, 7, 0x00))
+			goto fail;
+		return 0;
+	}
+
+	/* literal field line with literal name (RFC 9204 4.5.6) :
+	 * | 0 | 0 | 1 | N | H | Name Length (3+) | Name String |
+	 * | H | Value Length (7+) | Value String |
+	 */
+	if (qpack_encode_str(out, n, 3, sensitive ? 0x30 : 0x20) ||
+	    qpack_encode_str(out, v, 7, 0x00))
+		goto fail;
+	return 0;
+
+ fail:
+	b_sub(out, b_data(out) - data);
+	return 1;
+}
+
+/* Ends the field section started by qpack_enc_begin() on encoder <enc> by
+ * encoding its prefix into <pfx>. The section is then tracked until it is
+ * acknowledged if it references the dynamic table. Nothing may fail anymore
+ * on the section once this is called.
+ *
+ * Returns 0 if success else non-zero.
+ */
+int qpack_enc_end(struct qpack_enc *enc, struct buffer *pfx)
+{
+	const uint64_t max_entries = enc->max_cap / 32;
+	struct qpack_enc_sect *sect;
+
+	if (!enc->ric)
+		return qpack_encode_field_section_line(pfx);
+
+	/* encoded field section prefix (RFC 9204 4.5.1) :
+	 * | Required Insert Count (8+) |
+	 * | S | Delta Base (7+) |
+	 */
+	if (qpack_encode_prefix_integer(pfx, enc->ric % (2 * max_entries) + 1, 8, 0x00))
+		return 1;
+
+	if (enc->base >= enc->ric) {
+		if (qpack_encode_prefix_integer(pfx, enc->base - enc->ric, 7, 0x00))
+			return 1;
+	}
+	else {
+		if (qpack_encode_prefix_integer(pfx, enc->ric - enc->base - 1, 7, 0x80))
+			return 1;
+	}
+
+	BUG_ON(enc->nb_sect >= QPACK_ENC_MAX_SECT);
+	sect = &enc->sect[enc->nb_sect++];
+	sect->id = enc->id;
+	sect->ric = enc->ric;
+	sect->min_ref = enc->min_ref;
+	return 0;
+}
+
+/* Handles a Section Acknowledgment for stream <id> received by encoder <enc>.
+ * The oldest field section of this stream is acknowledged.
+ *
+ * Returns 0 if success else non-zero if no section was pending for this
+ * stream.
+ */
+int qpack_enc_section_ack(struct qpack_enc *enc, uint64_t id)
+{
+	int i;
+
+	for (i = 0; i < enc->nb_sect; i++) {
+		if (enc->sect[i].id == id)
+			break;
+	}
+
+	if (i == enc->nb_sect)
+		return 1;
+
+	/* RFC 9204 4.4.1. Section Acknowledgment
+	 *
+	 * If the encoder has not yet received an acknowledgment of the
+	 * dynamic table entries referenced by this field section, the
+	 * Known Received Count is updated to its Required Insert Count.
+	 */
+	if (enc->sect[i].ric > enc->krc)
+		enc->krc = enc->sect[i].ric;
+
+	enc->nb_sect--;
+	memmove(&enc->sect[i], &enc->sect[i + 1], (enc->nb_sect - i) * sizeof(enc->sect[0]));
+	return 0;
+}
+
+/* Handles a Stream Cancellation for stream <id> received by encoder <enc>. All
+ * the sections of this stream will never be acknowledged.
+ */
+void qpack_enc_stream_cancel(struct qpack_enc *enc, uint64_t id)
+{
+	int i, j;
+
+	for (i = j = 0; i < enc->nb_sect; i++) {
+		if (enc->sect[i].id != id)
+			enc->sect[j++] = enc->sect[i];
+	}
+	enc->nb_sect = j;
+}
+
+/* Handles an Insert Count Increment of <inc> received by encoder <enc>.
+ *
+ * Returns 0 if success else non-zero if the increment is invalid.
+ */
+int qpack_enc_insert_count_inc(struct qpack_enc *enc, uint64_t inc)
+{
+	/* RFC 9204 4.4.3. Insert Count Increment
+	 *
+	 * An encoder that receives an Increment field equal to zero, or one
+	 * that increases the Known Received Count beyond what the encoder has
+	 * sent, MUST treat this as a connection error of type
+	 * QPACK_DECODER_STREAM_ERROR.
+	 */
+	if (!inc || inc > enc->ic - enc->krc)
+		return 1;
+
+	enc->krc += inc;
+	return 0;
+}
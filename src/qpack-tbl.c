@@ -153,11 +153,11 @@ void qpack_dht_dump(FILE *out, const struct qpack_dht *dht)
 	char name[4096], value[4096];
 
 	for (i = QPACK_SHT_SIZE; i < QPACK_SHT_SIZE + dht->used; i++) {
-		slot = (qpack_get_dte(dht, i - QPACK_SHT_SIZE + 1) - dht->dte);
+		slot = (qpack_get_dte(dht, i - QPACK_SHT_SIZE) - dht->dte);
 		fprintf(out, "idx=%u slot=%u name=<%s> value=<%s> addr=%u-%u\n",
 			i, slot,
-			istpad(name, qpack_idx_to_name(dht, i)).ptr,
-			istpad(value, qpack_idx_to_value(dht, i)).ptr,
+			istpad(name, qpack_idx_to_name(dht, i - QPACK_SHT_SIZE)).ptr,
+			istpad(value, qpack_idx_to_value(dht, i - QPACK_SHT_SIZE)).ptr,
 			dht->dte[slot].addr, dht->dte[slot].addr+dht->dte[slot].nlen+dht->dte[slot].vlen-1);
 	}
 }
@@ -212,6 +212,8 @@ static struct qpack_dht *qpack_dht_defrag(struct qpack_dht *dht)
 	if (!alt_dht)
 		return NULL;
 
+	qpack_dht_init(alt_dht, dht->size);
+
 	alt_dht->total = dht->total;
 	alt_dht->used = dht->used;
 	alt_dht->wrap = dht->used;
@@ -281,6 +283,30 @@ int __qpack_dht_make_room(struct qpack_dht *dht, unsigned int needed)
 	return needed + 32 <= dht->size;
 }
 
+/* Changes the capacity of table <dht> to <size>, which must not be larger than
+ * the size of the area it was allocated with. The oldest entries which do not
+ * fit anymore are evicted (RFC 9204 3.2.3), and the remaining ones are moved
+ * to the end of the new area. Returns non-zero on success, zero on failure in
+ * which case the table must not be used anymore.
+ */
+int qpack_dht_resize(struct qpack_dht *dht, uint32_t size)
+{
+	unsigned int tail;
+
+	while (dht->used && dht->used * 32 + dht->total > size) {
+		tail = qpack_dht_get_tail(dht);
+		dht->total -= dht->dte[tail].nlen + dht->dte[tail].vlen;
+		dht->used--;
+	}
+
+	dht->size = size;
+	if (!dht->used) {
+		dht->front = dht->head = 0;
+		return 1;
+	}
+	return qpack_dht_defrag(dht) != NULL;
+}
+
 /* tries to insert a new header <name>:<value> in front of the current head. A
  * negative value is returned on error.
  */
@@ -20,7 +20,9 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <haproxy/clock.h>
 #include <haproxy/quic_cc.h>
+#include <haproxy/quic_tx-t.h>
 
 struct quic_cc_algo *default_quic_cc_algo = &quic_cc_algo_cubic;
 
@@ -47,3 +49,75 @@ void quic_cc_state_trace(struct buffer *buf, const struct quic_cc *cc)
 {
 	cc->algo->state_trace(buf, cc);
 }
+
+/* Record the delivery rate estimation state of <path> into <pkt> packet which
+ * is about to be sent. Must be called before accounting <pkt> as in flight.
+ */
+void quic_cc_path_on_sent(struct quic_cc_path *path, struct quic_tx_packet *pkt)
+{
+	if (!path->in_flight)
+		path->first_sent_ts = path->delivered_ts = now_ns;
+
+	pkt->delivered = path->delivered;
+	pkt->delivered_ts = path->delivered_ts;
+	pkt->first_sent_ts = path->first_sent_ts;
+	pkt->time_sent_ns = now_ns;
+	if (path->app_limited)
+		pkt->flags |= QUIC_FL_TX_PACKET_APP_LIMITED;
+}
+
+/* Update <path> delivery state upon <pkt> in flight packet acknowledgement and
+ * fill <rs> with the resulting delivery rate sample.
+ */
+void quic_cc_path_on_acked(struct quic_cc_path *path, struct quic_tx_packet *pkt,
+                           struct quic_cc_rs *rs)
+{
+	ullong send_elapsed, ack_elapsed;
+
+	path->delivered += pkt->in_flight_len;
+	path->delivered_ts = now_ns;
+	if (path->app_limited && path->delivered > path->app_limited)
+		path->app_limited = 0;
+
+	rs->prior_delivered = pkt->delivered;
+	rs->delivered = path->delivered - pkt->delivered;
+	rs->is_app_limited = !!(pkt->flags & QUIC_FL_TX_PACKET_APP_LIMITED);
+	rs->rtt = (now_ns - pkt->time_sent_ns) / 1000;
+
+	/* Use the longest of the send and ACK phases to avoid overestimating
+	 * the rate because of ACK compression.
+	 */
+	send_elapsed = pkt->time_sent_ns - pkt->first_sent_ts;
+	ack_elapsed = path->delivered_ts - pkt->delivered_ts;
+	rs->interval = QUIC_MAX(send_elapsed, ack_elapsed) / 1000;
+	path->first_sent_ts = pkt->time_sent_ns;
+}
+
+/* Returns true if <path> pacing allows to prepare more data, false if the
+ * emission must be delayed until <path> pacing_next tick. Each time a pacing
+ * slot starts, a credit of bytes is granted according to the rate reported by
+ * the congestion control algorithm. The slot duration is computed so that
+ * this credit matches the pacing rate, with a minimal duration of one tick.
+ */
+int quic_pacing_may_send(struct quic_cc_path *path)
+{
+	uint64_t rate, credit;
+
+	if (!path->cc.algo->pacing_rate || path->pacing_credit)
+		return 1;
+
+	if (tick_isset(path->pacing_next) && !tick_is_expired(path->pacing_next, now_ms))
+		return 0;
+
+	/* bytes per millisecond */
+	rate = path->cc.algo->pacing_rate(&path->cc) / 1000;
+	if (!rate) {
+		path->pacing_next = TICK_ETERNITY;
+		return 1;
+	}
+
+	credit = QUIC_MAX(rate, (uint64_t)(QUIC_PACING_MIN_BURST * path->mtu));
+	path->pacing_credit = credit;
+	path->pacing_next = tick_add(now_ms, MS_TO_TICKS((credit + rate - 1) / rate));
+	return 1;
+}
@@ -0,0 +1,538 @@
+/*
+ * BBR congestion control algorithm.
+ *
+ * This file contains definitions for QUIC congestion control.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <haproxy/api-t.h>
+#include <haproxy/buf.h>
+#include <haproxy/chunk.h>
+#include <haproxy/quic_cc.h>
+#include <haproxy/quic_conn-t.h>
+#include <haproxy/quic_trace.h>
+#include <haproxy/ticks.h>
+#include <haproxy/tools.h>
+#include <haproxy/trace.h>
+
+/* This implementation follows the BBR model described by
+ * draft-cardwell-iccrg-bbr-congestion-control: the congestion window and the
+ * pacing rate are derived from the maximum delivery rate and the minimum RTT
+ * observed on the path, not from packet losses. As with BBRv2, the amount of
+ * in flight data is however bounded each time the loss rate of a round trip
+ * exceeds BBR_LOSS_THRESH, this bound being slowly released when probing for
+ * more bandwidth.
+ *
+ * The delivery rate samples are computed by quic_cc_path_on_acked(). Bandwidth
+ * values are expressed in bytes per second, RTT in microseconds, timestamps
+ * in ticks. The gains are fixed point values, BBR_UNIT being 1.
+ */
+#define BBR_SCALE               8
+#define BBR_UNIT                (1 << BBR_SCALE)
+
+#define BBR_STARTUP_GAIN        739                 /* 2/ln(2) */
+#define BBR_DRAIN_GAIN          88                  /* ln(2)/2 */
+#define BBR_CWND_GAIN           (2 * BBR_UNIT)
+#define BBR_PROBE_UP_GAIN       (BBR_UNIT * 5 / 4)
+#define BBR_PROBE_DOWN_GAIN     (BBR_UNIT * 3 / 4)
+#define BBR_CYCLE_LEN           8                   /* PROBE_BW gain cycle length */
+#define BBR_FULL_BW_THRESH      (BBR_UNIT * 5 / 4)  /* bandwidth growth to keep on STARTUP */
+#define BBR_FULL_BW_ROUNDS      3                   /* rounds without growth to leave STARTUP */
+#define BBR_BW_WIN_ROUNDS       5                   /* half of the max bandwidth filter window */
+#define BBR_MIN_RTT_WIN         5000                /* min RTT validity (ms) */
+#define BBR_PROBE_RTT_TIME      200                 /* minimum PROBE_RTT duration (ms) */
+#define BBR_BETA                (BBR_UNIT * 7 / 10) /* in flight reduction on excessive loss */
+#define BBR_LOSS_THRESH         50                  /* 1/50: 2% of the bytes delivered in a round */
+#define BBR_MIN_CWND_PKTS       4
+#define BBR_RTT_UNKNOWN         UINT32_MAX
+
+enum bbr_state {
+	BBR_ST_STARTUP,
+	BBR_ST_DRAIN,
+	BBR_ST_PROBE_BW,
+	BBR_ST_PROBE_RTT,
+};
+
+#define BBR_FL_FILLED_PIPE      0x01 /* bandwidth estimation has reached a plateau */
+#define BBR_FL_ROUND_START      0x02 /* the current ACK starts a new round trip */
+#define BBR_FL_PROBE_RTT_ROUND  0x04 /* a round trip has elapsed with a low in flight on PROBE_RTT */
+#define BBR_FL_CYCLE_LOSS       0x08 /* losses were detected during the current PROBE_BW cycle */
+
+/* BBR state */
+struct bbr {
+	uint64_t bw[2];                /* max bandwidth for the current and previous windows */
+	uint64_t full_bw;              /* reference bandwidth to detect a full pipe */
+	uint64_t next_round_delivered; /* path <delivered> value marking the end of the round */
+	uint64_t inflight_hi;          /* upper bound for in flight data, set on excessive loss */
+	uint64_t prior_cwnd;           /* congestion window saved on PROBE_RTT entry */
+	uint64_t round_lost;           /* in flight bytes lost during the current round */
+	uint32_t min_rtt;              /* minimum RTT (us) */
+	uint32_t min_rtt_stamp;        /* last <min_rtt> update (tick) */
+	uint32_t probe_rtt_done_stamp; /* PROBE_RTT minimum end date (tick) */
+	uint32_t cycle_stamp;          /* PROBE_BW current phase start date (tick) */
+	uint32_t round_count;
+	uint16_t pacing_gain;
+	uint16_t cwnd_gain;
+	uint8_t state;
+	uint8_t cycle_idx;
+	uint8_t full_bw_cnt;
+	uint8_t flags;
+};
+
+static const uint16_t bbr_pacing_gain_cycle[BBR_CYCLE_LEN] = {
+	BBR_PROBE_UP_GAIN, BBR_PROBE_DOWN_GAIN,
+	BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT,
+};
+
+static inline const char *bbr_state_str(const struct bbr *bbr)
+{
+	switch (bbr->state) {
+	case BBR_ST_STARTUP:
+		return "startup";
+	case BBR_ST_DRAIN:
+		return "drain";
+	case BBR_ST_PROBE_BW:
+		return "probe_bw";
+	case BBR_ST_PROBE_RTT:
+		return "probe_rtt";
+	default:
+		return "unknown";
+	}
+}
+
+static inline uint64_t bbr_max_bw(const struct bbr *bbr)
+{
+	return QUIC_MAX(bbr->bw[0], bbr->bw[1]);
+}
+
+static inline uint64_t bbr_min_cwnd(const struct quic_cc_path *path)
+{
+	return QUIC_MAX(path->min_cwnd, (uint64_t)(BBR_MIN_CWND_PKTS * path->mtu));
+}
+
+/* Returns the bandwidth-delay product scaled by <gain>, or 0 if the model is
+ * not yet known.
+ */
+static uint64_t bbr_bdp(const struct bbr *bbr, unsigned int gain)
+{
+	uint64_t bw = bbr_max_bw(bbr);
+
+	if (!bw || bbr->min_rtt == BBR_RTT_UNKNOWN)
+		return 0;
+
+	return ((bw * bbr->min_rtt / 1000000) * gain) >> BBR_SCALE;
+}
+
+/* Returns the in flight data target for <gain>, or 0 if unknown. Some room is
+ * added for the delayed acknowledgements and the GSO bursts.
+ */
+static uint64_t bbr_inflight(const struct bbr *bbr, const struct quic_cc_path *path,
+                             unsigned int gain)
+{
+	uint64_t bdp = bbr_bdp(bbr, gain);
+
+	return bdp ? bdp + 3 * path->mtu : 0;
+}
+
+/* Returns the congestion window to use during PROBE_RTT. */
+static uint64_t bbr_probe_rtt_cwnd(const struct bbr *bbr, const struct quic_cc_path *path)
+{
+	return QUIC_MAX(bbr_bdp(bbr, BBR_UNIT) / 2, bbr_min_cwnd(path));
+}
+
+static int quic_cc_bbr_init(struct quic_cc *cc)
+{
+	struct bbr *bbr = quic_cc_priv(cc);
+
+	bbr->bw[0] = bbr->bw[1] = 0;
+	bbr->full_bw = 0;
+	bbr->next_round_delivered = 0;
+	bbr->inflight_hi = UINT64_MAX;
+	bbr->prior_cwnd = 0;
+	bbr->round_lost = 0;
+	bbr->min_rtt = BBR_RTT_UNKNOWN;
+	bbr->min_rtt_stamp = now_ms;
+	bbr->probe_rtt_done_stamp = TICK_ETERNITY;
+	bbr->cycle_stamp = now_ms;
+	bbr->round_count = 0;
+	bbr->pacing_gain = BBR_STARTUP_GAIN;
+	bbr->cwnd_gain = BBR_STARTUP_GAIN;
+	bbr->state = BBR_ST_STARTUP;
+	bbr->cycle_idx = 0;
+	bbr->full_bw_cnt = 0;
+	bbr->flags = 0;
+
+	return 1;
+}
+
+/* Move to the next phase of PROBE_BW gain cycle. */
+static void bbr_advance_cycle(struct bbr *bbr)
+{
+	bbr->cycle_idx = (bbr->cycle_idx + 1) % BBR_CYCLE_LEN;
+	bbr->cycle_stamp = now_ms;
+	bbr->pacing_gain = bbr_pacing_gain_cycle[bbr->cycle_idx];
+
+	if (!bbr->cycle_idx) {
+		/* Probing for more bandwidth: release the in flight bound
+		 * if the previous cycle was not lossy.
+		 */
+		if (!(bbr->flags & BBR_FL_CYCLE_LOSS) && bbr->inflight_hi != UINT64_MAX)
+			bbr->inflight_hi += bbr->inflight_hi >> 2;
+		bbr->flags &= ~BBR_FL_CYCLE_LOSS;
+	}
+}
+
+static void bbr_enter_probe_bw(struct bbr *bbr)
+{
+	uint idx;
+
+	bbr->state = BBR_ST_PROBE_BW;
+	bbr->cwnd_gain = BBR_CWND_GAIN;
+
+	/* Start at a random phase, excepted the draining one. */
+	idx = statistical_prng_range(BBR_CYCLE_LEN - 1);
+	if (idx)
+		idx++;
+	bbr->cycle_idx = idx;
+	bbr->cycle_stamp = now_ms;
+	bbr->pacing_gain = bbr_pacing_gain_cycle[idx];
+}
+
+static void bbr_enter_startup(struct bbr *bbr)
+{
+	bbr->state = BBR_ST_STARTUP;
+	bbr->pacing_gain = BBR_STARTUP_GAIN;
+	bbr->cwnd_gain = BBR_STARTUP_GAIN;
+}
+
+static void bbr_enter_drain(struct bbr *bbr)
+{
+	bbr->state = BBR_ST_DRAIN;
+	bbr->pacing_gain = BBR_DRAIN_GAIN;
+	bbr->cwnd_gain = BBR_STARTUP_GAIN;
+}
+
+/* Called at the end of a round trip which lost more than BBR_LOSS_THRESH of
+ * the delivered data. The in flight data are bounded below the current
+ * congestion window, and bandwidth probing is stopped.
+ */
+static void bbr_on_excessive_loss(struct bbr *bbr, struct quic_cc_path *path)
+{
+	uint64_t hi = (path->cwnd * BBR_BETA) >> BBR_SCALE;
+
+	bbr->inflight_hi = QUIC_MAX(hi, bbr_min_cwnd(path));
+	if (bbr->state == BBR_ST_STARTUP) {
+		bbr->flags |= BBR_FL_FILLED_PIPE;
+		bbr_enter_drain(bbr);
+	}
+}
+
+/* Detect the start of a new round trip. */
+static void bbr_update_round(struct bbr *bbr, struct quic_cc_path *path,
+                             const struct quic_cc_rs *rs)
+{
+	uint64_t delivered;
+
+	if (rs->prior_delivered < bbr->next_round_delivered) {
+		bbr->flags &= ~BBR_FL_ROUND_START;
+		return;
+	}
+
+	delivered = path->delivered - bbr->next_round_delivered;
+	if (bbr->round_lost && bbr->round_lost * BBR_LOSS_THRESH > delivered)
+		bbr_on_excessive_loss(bbr, path);
+
+	bbr->round_lost = 0;
+	bbr->next_round_delivered = path->delivered;
+	bbr->round_count++;
+	bbr->flags |= BBR_FL_ROUND_START;
+
+	/* Slide the max bandwidth filter window. */
+	if (!(bbr->round_count % BBR_BW_WIN_ROUNDS)) {
+		bbr->bw[1] = bbr->bw[0];
+		bbr->bw[0] = 0;
+	}
+}
+
+static void bbr_update_bw(struct bbr *bbr, const struct quic_cc_rs *rs)
+{
+	uint64_t bw;
+
+	/* Intervals shorter than the min RTT are the result of ACK
+	 * compression and would overestimate the bandwidth.
+	 */
+	if (!rs->interval || !rs->delivered ||
+	    (bbr->min_rtt != BBR_RTT_UNKNOWN && rs->interval < bbr->min_rtt))
+		return;
+
+	bw = rs->delivered * 1000000 / rs->interval;
+	/* App-limited samples are only a lower bound of the bandwidth. */
+	if (!rs->is_app_limited || bw >= bbr_max_bw(bbr))
+		bbr->bw[0] = QUIC_MAX(bbr->bw[0], bw);
+}
+
+static void bbr_update_cycle(struct bbr *bbr, const struct quic_cc_path *path)
+{
+	unsigned int min_rtt_ms;
+	int full_length;
+
+	if (bbr->state != BBR_ST_PROBE_BW)
+		return;
+
+	min_rtt_ms = bbr->min_rtt == BBR_RTT_UNKNOWN ? 1 :
+		QUIC_MAX(bbr->min_rtt / 1000, 1U);
+	full_length = tick_is_expired(tick_add(bbr->cycle_stamp, MS_TO_TICKS(min_rtt_ms)), now_ms);
+
+	if (bbr->pacing_gain > BBR_UNIT) {
+		if (full_length && path->in_flight >= bbr_inflight(bbr, path, bbr->pacing_gain))
+			bbr_advance_cycle(bbr);
+	}
+	else if (bbr->pacing_gain < BBR_UNIT) {
+		if (full_length || path->in_flight <= bbr_inflight(bbr, path, BBR_UNIT))
+			bbr_advance_cycle(bbr);
+	}
+	else if (full_length) {
+		bbr_advance_cycle(bbr);
+	}
+}
+
+static void bbr_check_full_pipe(struct bbr *bbr, const struct quic_cc_rs *rs)
+{
+	uint64_t bw;
+
+	if ((bbr->flags & BBR_FL_FILLED_PIPE) || !(bbr->flags & BBR_FL_ROUND_START) ||
+	    rs->is_app_limited)
+		return;
+
+	bw = bbr_max_bw(bbr);
+	if (bw >= (bbr->full_bw * BBR_FULL_BW_THRESH) >> BBR_SCALE) {
+		bbr->full_bw = bw;
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+
+	if (++bbr->full_bw_cnt >= BBR_FULL_BW_ROUNDS)
+		bbr->flags |= BBR_FL_FILLED_PIPE;
+}
+
+static void bbr_check_drain(struct bbr *bbr, const struct quic_cc_path *path)
+{
+	if (bbr->state == BBR_ST_STARTUP && (bbr->flags & BBR_FL_FILLED_PIPE))
+		bbr_enter_drain(bbr);
+
+	if (bbr->state == BBR_ST_DRAIN &&
+	    path->in_flight <= bbr_inflight(bbr, path, BBR_UNIT))
+		bbr_enter_probe_bw(bbr);
+}
+
+/* Update the minimum RTT and handle PROBE_RTT state which periodically drains
+ * the in flight data to refresh it.
+ */
+static void bbr_update_min_rtt(struct bbr *bbr, struct quic_cc_path *path,
+                               const struct quic_cc_rs *rs)
+{
+	uint32_t rtt = QUIC_MAX(rs->rtt, 1U);
+	int expired;
+
+	expired = tick_is_expired(tick_add(bbr->min_rtt_stamp, MS_TO_TICKS(BBR_MIN_RTT_WIN)), now_ms);
+	if (rtt <= bbr->min_rtt || expired) {
+		bbr->min_rtt = rtt;
+		bbr->min_rtt_stamp = now_ms;
+	}
+
+	if (expired && bbr->state != BBR_ST_PROBE_RTT) {
+		bbr->prior_cwnd = path->cwnd;
+		bbr->state = BBR_ST_PROBE_RTT;
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain = BBR_UNIT;
+		bbr->probe_rtt_done_stamp = TICK_ETERNITY;
+		bbr->flags &= ~BBR_FL_PROBE_RTT_ROUND;
+	}
+
+	if (bbr->state != BBR_ST_PROBE_RTT)
+		return;
+
+	if (!tick_isset(bbr->probe_rtt_done_stamp)) {
+		if (path->in_flight <= bbr_probe_rtt_cwnd(bbr, path)) {
+			bbr->probe_rtt_done_stamp = tick_add(now_ms, MS_TO_TICKS(BBR_PROBE_RTT_TIME));
+			bbr->flags &= ~BBR_FL_PROBE_RTT_ROUND;
+			bbr->next_round_delivered = path->delivered;
+		}
+		return;
+	}
+
+	if (bbr->flags & BBR_FL_ROUND_START)
+		bbr->flags |= BBR_FL_PROBE_RTT_ROUND;
+
+	if ((bbr->flags & BBR_FL_PROBE_RTT_ROUND) &&
+	    tick_is_expired(bbr->probe_rtt_done_stamp, now_ms)) {
+		bbr->min_rtt_stamp = now_ms;
+		bbr->probe_rtt_done_stamp = TICK_ETERNITY;
+		path->cwnd = QUIC_MAX(path->cwnd, bbr->prior_cwnd);
+		if (bbr->flags & BBR_FL_FILLED_PIPE)
+			bbr_enter_probe_bw(bbr);
+		else
+			bbr_enter_startup(bbr);
+	}
+}
+
+static void bbr_update_cwnd(struct bbr *bbr, struct quic_cc_path *path, uint64_t acked)
+{
+	uint64_t target = bbr_inflight(bbr, path, bbr->cwnd_gain);
+
+	if (!target) {
+		/* No model yet, grow as slow start does. */
+		if (!(bbr->flags & BBR_FL_FILLED_PIPE))
+			path->cwnd += acked;
+	}
+	else if (bbr->flags & BBR_FL_FILLED_PIPE)
+		path->cwnd = QUIC_MIN(path->cwnd + acked, target);
+	else if (path->cwnd < target)
+		path->cwnd += acked;
+
+	path->cwnd = QUIC_MIN(path->cwnd, bbr->inflight_hi);
+	if (bbr->state == BBR_ST_PROBE_RTT)
+		path->cwnd = QUIC_MIN(path->cwnd, bbr_probe_rtt_cwnd(bbr, path));
+	path->cwnd = QUIC_MAX(path->cwnd, bbr_min_cwnd(path));
+	path->cwnd = QUIC_MIN(path->cwnd, path->max_cwnd);
+	path->mcwnd = QUIC_MAX(path->cwnd, path->mcwnd);
+}
+
+/* Persistent congestion: restart from the minimal congestion window. The model
+ * is kept so that the window is quickly restored.
+ */
+static void quic_cc_bbr_slow_start(struct quic_cc *cc)
+{
+	struct quic_cc_path *path;
+
+	path = container_of(cc, struct quic_cc_path, cc);
+	path->cwnd = bbr_min_cwnd(path);
+}
+
+static void quic_cc_bbr_event(struct quic_cc *cc, struct quic_cc_event *ev)
+{
+	struct quic_cc_path *path;
+	struct bbr *bbr = quic_cc_priv(cc);
+	const struct quic_cc_rs *rs;
+
+	TRACE_ENTER(QUIC_EV_CONN_CC, cc->qc);
+	TRACE_PROTO("CC bbr", QUIC_EV_CONN_CC, cc->qc, ev);
+	path = container_of(cc, struct quic_cc_path, cc);
+	switch (ev->type) {
+	case QUIC_CC_EVT_ACK:
+		rs = ev->ack.rs;
+		if (!rs)
+			break;
+
+		bbr_update_round(bbr, path, rs);
+		bbr_update_bw(bbr, rs);
+		bbr_update_cycle(bbr, path);
+		bbr_check_full_pipe(bbr, rs);
+		bbr_check_drain(bbr, path);
+		bbr_update_min_rtt(bbr, path, rs);
+		bbr_update_cwnd(bbr, path, ev->ack.acked);
+		break;
+
+	case QUIC_CC_EVT_LOSS:
+		bbr->round_lost += ev->loss.lost_bytes;
+		bbr->flags |= BBR_FL_CYCLE_LOSS;
+		/* Stop probing for more bandwidth upon loss. */
+		if (bbr->state == BBR_ST_PROBE_BW && bbr->pacing_gain > BBR_UNIT)
+			bbr_advance_cycle(bbr);
+		break;
+
+	case QUIC_CC_EVT_ECN_CE:
+		/* XXX TO DO XXX */
+		break;
+	}
+	TRACE_PROTO("CC bbr", QUIC_EV_CONN_CC, cc->qc, NULL, cc);
+	TRACE_LEAVE(QUIC_EV_CONN_CC, cc->qc);
+}
+
+/* Returns the pacing rate in bytes per second. Before the first bandwidth
+ * sample, it is derived from the congestion window and the RTT.
+ */
+static uint64_t quic_cc_bbr_pacing_rate(const struct quic_cc *cc)
+{
+	const struct quic_cc_path *path;
+	const struct bbr *bbr = quic_cc_priv(cc);
+	uint64_t bw, rtt;
+
+	path = container_of(cc, struct quic_cc_path, cc);
+	bw = bbr_max_bw(bbr);
+	if (!bw) {
+		rtt = bbr->min_rtt != BBR_RTT_UNKNOWN ? bbr->min_rtt :
+			(uint64_t)QUIC_MAX(path->loss.srtt, 1U) * 1000;
+		bw = path->cwnd * 1000000 / rtt;
+	}
+
+	/* Keep a 1% margin below the estimated bandwidth. */
+	return ((bw * bbr->pacing_gain) >> BBR_SCALE) * 99 / 100;
+}
+
+static void quic_cc_bbr_hystart_start_round(struct quic_cc *cc, uint64_t pn)
+{
+}
+
+static void quic_cc_bbr_state_trace(struct buffer *buf, const struct quic_cc *cc)
+{
+	struct quic_cc_path *path;
+	struct bbr *bbr = quic_cc_priv(cc);
+
+	path = container_of(cc, struct quic_cc_path, cc);
+	chunk_appendf(buf, " state=%s cwnd=%llu mcwnd=%llu bw=%llu min_rtt=%dus"
+	              " pgain=%u cgain=%u inflight_hi=%lld rounds=%u pktloss=%llu",
+	              bbr_state_str(bbr),
+	              (unsigned long long)path->cwnd,
+	              (unsigned long long)path->mcwnd,
+	              (unsigned long long)bbr_max_bw(bbr),
+	              bbr->min_rtt == BBR_RTT_UNKNOWN ? -1 : (int)bbr->min_rtt,
+	              bbr->pacing_gain, bbr->cwnd_gain,
+	              bbr->inflight_hi == UINT64_MAX ? -1 : (long long)bbr->inflight_hi,
+	              bbr->round_count,
+	              (unsigned long long)path->loss.nb_lost_pkt);
+}
+
+static void quic_cc_bbr_state_cli(struct buffer *buf, const struct quic_cc_path *path)
+{
+	struct bbr *bbr = quic_cc_priv(&path->cc);
+
+	chunk_appendf(buf, "  cc: state=%s bw=%llu min_rtt=%dus pacing_gain=%u%% inflight_hi=%lld rounds=%u\n",
+	              bbr_state_str(bbr), (unsigned long long)bbr_max_bw(bbr),
+	              bbr->min_rtt == BBR_RTT_UNKNOWN ? -1 : (int)bbr->min_rtt,
+	              bbr->pacing_gain * 100 / BBR_UNIT,
+	              bbr->inflight_hi == UINT64_MAX ? -1 : (long long)bbr->inflight_hi,
+	              bbr->round_count);
+}
+
+struct quic_cc_algo quic_cc_algo_bbr = {
+	.type        = QUIC_CC_ALGO_TP_BBR,
+	.init        = quic_cc_bbr_init,
+	.event       = quic_cc_bbr_event,
+	.slow_start  = quic_cc_bbr_slow_start,
+	.hystart_start_round = quic_cc_bbr_hystart_start_round,
+	.pacing_rate = quic_cc_bbr_pacing_rate,
+	.state_trace = quic_cc_bbr_state_trace,
+	.state_cli   = quic_cc_bbr_state_cli,
+};
+
+void quic_cc_bbr_check(void)
+{
+	struct quic_cc *cc;
+	BUG_ON_HOT(sizeof(struct bbr) > sizeof(cc->priv));
+}
+
+INITCALL0(STG_REGISTER, quic_cc_bbr_check);
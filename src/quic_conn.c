@@ -177,7 +177,7 @@ void qc_kill_conn(struct quic_conn *qc)
 void qc_set_timer(struct quic_conn *qc)
 {
 	struct quic_pktns *pktns;
-	unsigned int pto;
+	unsigned int pto, expire;
 	int handshake_confirmed;
 
 	TRACE_ENTER(QUIC_EV_CONN_STIMER, qc);
@@ -217,16 +217,21 @@ void qc_set_timer(struct quic_conn *qc)
 	if (tick_isset(pto))
 		qc->timer = pto;
  out:
-	if (qc->timer == TICK_ETERNITY) {
+	/* The same task is used to resume an emission delayed by pacing. */
+	expire = qc->timer;
+	if (qc->flags & QUIC_FL_CONN_PACING_WAIT)
+		expire = tick_first(expire, qc->path->pacing_next);
+
+	if (expire == TICK_ETERNITY) {
 		qc->timer_task->expire = TICK_ETERNITY;
 	}
-	else  if (tick_is_expired(qc->timer, now_ms)) {
+	else  if (tick_is_expired(expire, now_ms)) {
 		TRACE_DEVEL("wakeup asap timer task", QUIC_EV_CONN_STIMER, qc);
 		task_wakeup(qc->timer_task, TASK_WOKEN_MSG);
 	}
 	else {
 		TRACE_DEVEL("timer task scheduling", QUIC_EV_CONN_STIMER, qc);
-		task_schedule(qc->timer_task, qc->timer);
+		task_schedule(qc->timer_task, expire);
 	}
  leave:
 	TRACE_PROTO("set timer", QUIC_EV_CONN_STIMER, qc, pktns);
@@ -890,6 +895,22 @@ struct task *qc_process_timer(struct task *task, void *ctx, unsigned int state)
 		goto out;
 	}
 
+	if (qc->flags & QUIC_FL_CONN_PACING_WAIT) {
+		if (!quic_pacing_blocked(qc->path)) {
+			TRACE_STATE("pacing delay elapsed", QUIC_EV_CONN_PTIMER, qc);
+			qc->flags &= ~QUIC_FL_CONN_PACING_WAIT;
+			if (qc->ael && !LIST_ISEMPTY(&qc->ael->pktns->tx.frms))
+				tasklet_wakeup(qc->wait_event.tasklet);
+			qc_notify_send(qc);
+		}
+
+		/* Nothing more to do if only woken up for pacing. */
+		if (!tick_is_expired(qc->timer, now_ms)) {
+			qc_set_timer(qc);
+			goto out;
+		}
+	}
+
 	if (tick_isset(pktns->tx.loss_time)) {
 		struct list lost_pkts = LIST_HEAD_INIT(lost_pkts);
 
@@ -1724,9 +1745,17 @@ int qc_notify_send(struct quic_conn *qc)
 		/* RFC 9002 7.5. Probe Timeout
 		 *
 		 * Probe packets MUST NOT be blocked by the congestion controller.
+		 * When delayed by pacing, the timer task will notify the MUX.
 		 */
-		if ((quic_cc_path_prep_data(qc->path) || pktns->tx.pto_probe) &&
-		    (!qc_test_fd(qc) || !fd_send_active(qc->fd))) {
+		if (!pktns->tx.pto_probe && quic_cc_path_prep_data(qc->path) &&
+		    quic_pacing_blocked(qc->path)) {
+			if (!(qc->flags & QUIC_FL_CONN_PACING_WAIT)) {
+				qc->flags |= QUIC_FL_CONN_PACING_WAIT;
+				qc_set_timer(qc);
+			}
+		}
+		else if ((quic_cc_path_prep_data(qc->path) || pktns->tx.pto_probe) &&
+		         (!qc_test_fd(qc) || !fd_send_active(qc->fd))) {
 			tasklet_wakeup(qc->subs->tasklet);
 			qc->subs->events &= ~SUB_RETRY_SEND;
 			if (!qc->subs->events)
@@ -243,6 +243,7 @@ int qc_release_lost_pkts(struct quic_conn *qc, struct quic_pktns *pktns,
 {
 	struct quic_tx_packet *pkt, *tmp, *oldest_lost, *newest_lost;
 	uint tot_lost = 0;
+	uint64_t lost_bytes = 0;
 	int close = 0;
 
 	TRACE_ENTER(QUIC_EV_CONN_PRSAFRM, qc);
@@ -257,6 +258,7 @@ int qc_release_lost_pkts(struct quic_conn *qc, struct quic_pktns *pktns,
 		pkt->pktns->tx.in_flight -= pkt->in_flight_len;
 		qc->path->prep_in_flight -= pkt->in_flight_len;
 		qc->path->in_flight -= pkt->in_flight_len;
+		lost_bytes += pkt->in_flight_len;
 		if (pkt->flags & QUIC_FL_TX_PACKET_ACK_ELICITING)
 			qc->path->ifae_pkts--;
 		/* Treat the frames of this lost packet. */
@@ -282,6 +284,7 @@ int qc_release_lost_pkts(struct quic_conn *qc, struct quic_pktns *pktns,
 			ev.type = QUIC_CC_EVT_LOSS;
 			ev.loss.time_sent = newest_lost->time_sent;
 			ev.loss.count = tot_lost;
+			ev.loss.lost_bytes = lost_bytes;
 
 			quic_cc_event(&qc->path->cc, &ev);
 		}
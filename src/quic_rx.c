@@ -469,10 +469,16 @@ static void qc_notify_cc_of_newly_acked_pkts(struct quic_conn *qc,
 {
 	struct quic_tx_packet *pkt, *tmp;
 	struct quic_cc_event ev = { .type = QUIC_CC_EVT_ACK, };
+	struct quic_cc_rs rs;
 
 	TRACE_ENTER(QUIC_EV_CONN_PRSAFRM, qc);
 
 	list_for_each_entry_safe(pkt, tmp, newly_acked_pkts, list) {
+		ev.ack.rs = NULL;
+		if (pkt->in_flight_len) {
+			quic_cc_path_on_acked(qc->path, pkt, &rs);
+			ev.ack.rs = &rs;
+		}
 		pkt->pktns->tx.in_flight -= pkt->in_flight_len;
 		qc->path->prep_in_flight -= pkt->in_flight_len;
 		qc->path->in_flight -= pkt->in_flight_len;
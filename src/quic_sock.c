@@ -342,6 +342,75 @@ static struct quic_dgram *quic_rxbuf_purge_dgrams(struct quic_receiver_buf *rbuf
 	return prev;
 }
 
+/* Ancillary data which may be attached to a received datagram. */
+union quic_pktinfo {
+#ifdef IP_PKTINFO
+	struct in_pktinfo in;
+#else /* !IP_PKTINFO */
+	struct in_addr addr;
+#endif
+#ifdef IPV6_RECVPKTINFO
+	struct in6_pktinfo in6;
+#endif
+};
+
+/* Extract the reception address of a datagram from <msg> ancillary data into
+ * <to> of length <to_len>. <to> must have been cleared by the caller. It is
+ * left untouched if no matching control message is found. <dst_port> is used
+ * to complete <to>.
+ */
+static void quic_recv_parse_cmsg(struct msghdr *msg,
+                                 struct sockaddr *to, socklen_t to_len,
+                                 uint16_t dst_port)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		switch (cmsg->cmsg_level) {
+		case IPPROTO_IP:
+#if defined(IP_PKTINFO)
+			if (cmsg->cmsg_type == IP_PKTINFO) {
+				struct sockaddr_in *in = (struct sockaddr_in *)to;
+				struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
+
+				if (to_len >= sizeof(struct sockaddr_in)) {
+					in->sin_family = AF_INET;
+					in->sin_addr = info->ipi_addr;
+					in->sin_port = dst_port;
+				}
+			}
+#elif defined(IP_RECVDSTADDR)
+			if (cmsg->cmsg_type == IP_RECVDSTADDR) {
+				struct sockaddr_in *in = (struct sockaddr_in *)to;
+				struct in_addr *info = (struct in_addr *)CMSG_DATA(cmsg);
+
+				if (to_len >= sizeof(struct sockaddr_in)) {
+					in->sin_family = AF_INET;
+					in->sin_addr.s_addr = info->s_addr;
+					in->sin_port = dst_port;
+				}
+			}
+#endif /* IP_PKTINFO || IP_RECVDSTADDR */
+			break;
+
+		case IPPROTO_IPV6:
+#ifdef IPV6_RECVPKTINFO
+			if (cmsg->cmsg_type == IPV6_PKTINFO) {
+				struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)to;
+				struct in6_pktinfo *info6 = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+
+				if (to_len >= sizeof(struct sockaddr_in6)) {
+					in6->sin6_family = AF_INET6;
+					memcpy(&in6->sin6_addr, &info6->ipi6_addr, sizeof(in6->sin6_addr));
+					in6->sin6_port = dst_port;
+				}
+			}
+#endif
+			break;
+		}
+	}
+}
+
 /* Receive a single message from datagram socket <fd>. Data are placed in <out>
  * buffer of length <len>.
  *
@@ -358,20 +427,9 @@ static ssize_t quic_recv(int fd, void *out, size_t len,
                          struct sockaddr *to, socklen_t to_len,
                          uint16_t dst_port)
 {
-	union pktinfo {
-#ifdef IP_PKTINFO
-		struct in_pktinfo in;
-#else /* !IP_PKTINFO */
-		struct in_addr addr;
-#endif
-#ifdef IPV6_RECVPKTINFO
-		struct in6_pktinfo in6;
-#endif
-	};
-	char cdata[CMSG_SPACE(sizeof(union pktinfo))];
+	char cdata[CMSG_SPACE(sizeof(union quic_pktinfo))];
 	struct msghdr msg;
 	struct iovec vec;
-	struct cmsghdr *cmsg;
 	ssize_t ret;
 
 	vec.iov_base = out;
@@ -403,55 +461,78 @@ static ssize_t quic_recv(int fd, void *out, size_t len,
 		goto end;
 	}
 
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-		switch (cmsg->cmsg_level) {
-		case IPPROTO_IP:
-#if defined(IP_PKTINFO)
-			if (cmsg->cmsg_type == IP_PKTINFO) {
-				struct sockaddr_in *in = (struct sockaddr_in *)to;
-				struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
+	quic_recv_parse_cmsg(&msg, to, to_len, dst_port);
 
-				if (to_len >= sizeof(struct sockaddr_in)) {
-					in->sin_family = AF_INET;
-					in->sin_addr = info->ipi_addr;
-					in->sin_port = dst_port;
-				}
-			}
-#elif defined(IP_RECVDSTADDR)
-			if (cmsg->cmsg_type == IP_RECVDSTADDR) {
-				struct sockaddr_in *in = (struct sockaddr_in *)to;
-				struct in_addr *info = (struct in_addr *)CMSG_DATA(cmsg);
+ end:
+	return ret;
+}
 
-				if (to_len >= sizeof(struct sockaddr_in)) {
-					in->sin_family = AF_INET;
-					in->sin_addr.s_addr = info->s_addr;
-					in->sin_port = dst_port;
-				}
-			}
-#endif /* IP_PKTINFO || IP_RECVDSTADDR */
-			break;
+#ifdef QUIC_HAVE_RECVMMSG
+/* Per-message state used by quic_recv_batch(). */
+struct quic_recv_slot {
+	struct sockaddr_storage saddr;
+	struct iovec vec;
+	char cdata[CMSG_SPACE(sizeof(union quic_pktinfo))];
+};
 
-		case IPPROTO_IPV6:
-#ifdef IPV6_RECVPKTINFO
-			if (cmsg->cmsg_type == IPV6_PKTINFO) {
-				struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)to;
-				struct in6_pktinfo *info6 = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+static THREAD_LOCAL struct mmsghdr quic_recv_mmsg[QUIC_MAX_RX_BATCH];
+static THREAD_LOCAL struct quic_recv_slot quic_recv_slots[QUIC_MAX_RX_BATCH];
 
-				if (to_len >= sizeof(struct sockaddr_in6)) {
-					in6->sin6_family = AF_INET6;
-					memcpy(&in6->sin6_addr, &info6->ipi6_addr, sizeof(in6->sin6_addr));
-					in6->sin6_port = dst_port;
-				}
-			}
-#endif
-			break;
-		}
+/* Receive up to <nb> datagrams from socket <fd> with a single recvmmsg()
+ * call. The datagram at index <i> is stored at <out> + <i> * <len>. Its size
+ * may then be retrieved with quic_recv_mmsg[i].msg_len and its addresses with
+ * quic_recv_batch_addr(). <nb> must not exceed QUIC_MAX_RX_BATCH.
+ *
+ * Returns the number of received datagrams or a negative value on error.
+ */
+static int quic_recv_batch(int fd, unsigned char *out, size_t len, int nb)
+{
+	int i, ret;
+
+	for (i = 0; i < nb; i++) {
+		struct quic_recv_slot *slot = &quic_recv_slots[i];
+		struct msghdr *msg = &quic_recv_mmsg[i].msg_hdr;
+
+		slot->vec.iov_base = out + i * len;
+		slot->vec.iov_len  = len;
+
+		msg->msg_name       = &slot->saddr;
+		msg->msg_namelen    = sizeof(slot->saddr);
+		msg->msg_iov        = &slot->vec;
+		msg->msg_iovlen     = 1;
+		msg->msg_control    = slot->cdata;
+		msg->msg_controllen = sizeof(slot->cdata);
+		msg->msg_flags      = 0;
+		quic_recv_mmsg[i].msg_len = 0;
 	}
 
- end:
+	do {
+		ret = recvmmsg(fd, quic_recv_mmsg, nb, 0, NULL);
+	} while (ret < 0 && errno == EINTR);
+
 	return ret;
 }
 
+/* Retrieve the peer address of the datagram received at index <i> by the last
+ * quic_recv_batch() call into <from> and its reception address into <to>.
+ *
+ * Returns 0 if the datagram must be ignored because of a restricted source
+ * port, 1 if not.
+ */
+static int quic_recv_batch_addr(int i, struct sockaddr_storage *from,
+                                struct sockaddr_storage *to, uint16_t dst_port)
+{
+	*from = quic_recv_slots[i].saddr;
+	if (unlikely(port_is_restricted(from, HA_PROTO_QUIC)))
+		return 0;
+
+	clear_addr(to);
+	quic_recv_parse_cmsg(&quic_recv_mmsg[i].msg_hdr,
+	                     (struct sockaddr *)to, sizeof(*to), dst_port);
+	return 1;
+}
+#endif /* QUIC_HAVE_RECVMMSG */
+
 /* Function called on a read event from a listening socket. It tries
  * to handle as many connections as possible.
  */
@@ -462,12 +543,16 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	struct buffer *buf;
 	struct listener *l = objt_listener(fdtab[fd].owner);
 	struct quic_transport_params *params;
+	struct quic_counters *prx_counters;
 	/* Source address */
 	struct sockaddr_storage saddr = {0}, daddr = {0};
 	size_t max_sz, cspace;
 	struct quic_dgram *new_dgram;
 	unsigned char *dgram_buf;
 	int max_dgrams;
+#ifdef QUIC_HAVE_RECVMMSG
+	int batch, nb, i;
+#endif
 
 	BUG_ON(!l);
 
@@ -483,6 +568,8 @@ void quic_lstnr_sock_fd_iocb(int fd)
 		goto out;
 
 	buf = &rxbuf->buf;
+	prx_counters = EXTRA_COUNTERS_GET(l->bind_conf->frontend->extra_counters_fe,
+	                                  &quic_stats_module);
 
 	max_dgrams = global.tune.maxpollevents;
  start:
@@ -496,8 +583,6 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	max_sz = params->max_udp_payload_size;
 	cspace = b_contig_space(buf);
 	if (cspace < max_sz) {
-		struct proxy *px = l->bind_conf->frontend;
-		struct quic_counters *prx_counters = EXTRA_COUNTERS_GET(px->extra_counters_fe, &quic_stats_module);
 		struct quic_dgram *dgram;
 
 		/* Do no mark <buf> as full, and do not try to consume it
@@ -532,6 +617,59 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	}
 
 	dgram_buf = (unsigned char *)b_tail(buf);
+
+#ifdef QUIC_HAVE_RECVMMSG
+	/* Retrieve as many datagrams as possible with a single syscall. Each
+	 * one is received in its own <max_sz> slot of the contiguous space,
+	 * then they are packed at the buffer tail and dispatched in order.
+	 */
+	batch = MIN(max_dgrams, global.tune.quic_rx_batch);
+	batch = MIN(batch, b_contig_space(buf) / max_sz);
+	if (batch > 1) {
+		nb = quic_recv_batch(fd, dgram_buf, max_sz, batch);
+		if (nb <= 0)
+			goto out;
+
+		HA_ATOMIC_INC(&prx_counters->rx_calls);
+		HA_ATOMIC_ADD(&prx_counters->rx_dgrams, nb);
+
+		for (i = 0; i < nb; i++) {
+			unsigned char *pos = dgram_buf + i * max_sz;
+
+			ret = quic_recv_mmsg[i].msg_len;
+			if (!ret || !quic_recv_batch_addr(i, &saddr, &daddr,
+			                                  get_net_port(&l->rx.addr)))
+				continue;
+
+			/* Only previous datagrams are located before <pos>,
+			 * the destination never overlaps a pending one.
+			 */
+			if (pos != (unsigned char *)b_tail(buf)) {
+				memmove(b_tail(buf), pos, ret);
+				pos = (unsigned char *)b_tail(buf);
+			}
+
+			b_add(buf, ret);
+			if (!quic_lstnr_dgram_dispatch(pos, ret, l, &saddr, &daddr,
+			                               new_dgram, &rxbuf->dgram_list)) {
+				/* If wrong, consume this datagram */
+				b_sub(buf, ret);
+			}
+			new_dgram = NULL;
+		}
+
+		/* Release the reused datagram if all were rejected. */
+		pool_free(pool_head_quic_dgram, new_dgram);
+		new_dgram = NULL;
+
+		/* A partial batch means that the socket queue was emptied. */
+		max_dgrams -= nb;
+		if (nb == batch && max_dgrams > 0)
+			goto start;
+		goto out;
+	}
+#endif /* QUIC_HAVE_RECVMMSG */
+
 	ret = quic_recv(fd, dgram_buf, max_sz,
 	                (struct sockaddr *)&saddr, sizeof(saddr),
 	                (struct sockaddr *)&daddr, sizeof(daddr),
@@ -539,6 +677,8 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	if (ret <= 0)
 		goto out;
 
+	HA_ATOMIC_INC(&prx_counters->rx_calls);
+	HA_ATOMIC_INC(&prx_counters->rx_dgrams);
 	b_add(buf, ret);
 	if (!quic_lstnr_dgram_dispatch(dgram_buf, ret, l, &saddr, &daddr,
 	                               new_dgram, &rxbuf->dgram_list)) {
@@ -86,6 +86,11 @@ static struct stat_col quic_stats[] = {
 	                                        .desc = "Total number of received STREAMS_BLOCKED_BIDI frames" },
 	[QUIC_ST_STREAMS_BLOCKED_UNI]       = { .name = "quic_streams_blocked_uni",
 	                                        .desc = "Total number of received STREAMS_BLOCKED_UNI frames" },
+	/* Reception syscalls on listener sockets */
+	[QUIC_ST_RX_CALLS]                  = { .name = "quic_rx_calls",
+	                                        .desc = "Total number of successful datagram reception system calls on listener sockets" },
+	[QUIC_ST_RX_DGRAMS]                 = { .name = "quic_rx_dgrams",
+	                                        .desc = "Total number of datagrams received on listener sockets" },
 };
 
 struct quic_counters quic_counters;
@@ -225,6 +230,14 @@ static int quic_fill_stats(void *data, struct field *stats, unsigned int *select
 		case QUIC_ST_STREAMS_BLOCKED_UNI:
 			metric = mkf_u64(FN_COUNTER, counters->streams_blocked_uni);
 			break;
+
+		/* Reception syscalls on listener sockets */
+		case QUIC_ST_RX_CALLS:
+			metric = mkf_u64(FN_COUNTER, counters->rx_calls);
+			break;
+		case QUIC_ST_RX_DGRAMS:
+			metric = mkf_u64(FN_COUNTER, counters->rx_dgrams);
+			break;
 		default:
 			/* not used for frontends. If a specific metric
 			 * is requested, return an error. Otherwise continue.
@@ -214,6 +214,16 @@ static int qc_may_build_pkt(struct quic_conn *qc, struct list *frms,
 		return 0;
 	}
 
+	/* Application data are paced if supported by the congestion control
+	 * algorithm. Probing, acknowledgements and CONNECTION_CLOSE are never
+	 * delayed.
+	 */
+	if (qel == qc->ael && !cc && !probe && !*must_ack &&
+	    !quic_pacing_may_send(qc->path)) {
+		TRACE_PROTO("emission delayed by pacing", QUIC_EV_CONN_PHPKTS, qc);
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -414,6 +424,8 @@ static int qc_send_ppkts(struct buffer *buf, struct ssl_sock_ctx *ctx)
 					qc->timer_task = NULL;
 				}
 			}
+			if (pkt->in_flight_len)
+				quic_cc_path_on_sent(qc->path, pkt);
 			qc->path->in_flight += pkt->in_flight_len;
 			pkt->pktns->tx.in_flight += pkt->in_flight_len;
 			if ((global.tune.options & GTUNE_QUIC_CC_HYSTART) && pkt->pktns == qc->apktns)
@@ -495,6 +507,10 @@ int qc_send_mux(struct quic_conn *qc, struct list *frms)
 	ret = qc_send(qc, 0, &send_list);
 	qc->flags &= ~QUIC_FL_CONN_TX_MUX_CONTEXT;
 
+	/* All the MUX data were sent without filling the congestion window. */
+	if (ret && LIST_ISEMPTY(frms) && quic_cc_path_prep_data(qc->path))
+		quic_cc_path_set_app_limited(qc->path);
+
 	TRACE_LEAVE(QUIC_EV_CONN_TXPKT, qc);
 	return ret;
 }
@@ -686,6 +702,8 @@ static int qc_prep_pkts(struct quic_conn *qc, struct buffer *buf,
 			total += cur_pkt->len;
 			dglen += cur_pkt->len;
 			wrlen += cur_pkt->len;
+			if (qel == qc->ael)
+				quic_pacing_consume(qc->path, cur_pkt->len);
 
 			/* Reset padding if datagram is big enough. */
 			if (dglen >= QUIC_INITIAL_PACKET_MINLEN)
@@ -835,8 +853,15 @@ int qc_send(struct quic_conn *qc, int old_data, struct list *send_list)
 		qc->flags &= ~QUIC_FL_CONN_RETRANS_OLD_DATA;
 	}
 
-	/* Always reset QEL sending list. */
+	/* Always reset QEL sending list. Arm the connection timer if some
+	 * application data are left because of pacing.
+	 */
 	list_for_each_entry_safe(qel, tmp_qel, send_list, el_send) {
+		if (qel == qc->ael && !LIST_ISEMPTY(qel->send_frms) &&
+		    quic_pacing_blocked(qc->path) && !(qc->flags & QUIC_FL_CONN_PACING_WAIT)) {
+			qc->flags |= QUIC_FL_CONN_PACING_WAIT;
+			qc_set_timer(qc);
+		}
 		LIST_DEL_INIT(&qel->el_send);
 		qel->send_frms = NULL;
 	}
@@ -25,6 +25,7 @@
 #include <haproxy/check.h>
 #include <haproxy/cli.h>
 #include <haproxy/connection.h>
+#include <haproxy/counters.h>
 #include <haproxy/dict-t.h>
 #include <haproxy/errors.h>
 #include <haproxy/global.h>
@@ -2906,6 +2907,7 @@ struct server *new_server(struct proxy *proxy)
 	srv->rid = 0; /* rid defaults to 0 */
 
 	srv->next_state = SRV_ST_RUNNING; /* early server setup */
+	counters_be_shared_init(&srv->counters.shared);
 	srv->counters.last_change = ns_to_sec(now_ns);
 
 	srv->check.obj_type = OBJ_TYPE_CHECK;
@@ -3026,6 +3028,7 @@ struct server *srv_drop(struct server *srv)
 	LIST_DELETE(&srv->global_list);
 	event_hdl_sub_list_destroy(&srv->e_subs);
 
+	counters_be_shared_drop(&srv->counters.shared);
 	EXTRA_COUNTERS_FREE(srv->extra_counters);
 
 	ha_free(&srv);
@@ -5763,6 +5766,11 @@ static int cli_parse_add_server(char **args, char *payload, struct appctx *appct
 		goto out;
 	}
 
+	if (!counters_be_shared_prepare(&srv->counters.shared)) {
+		ha_alert("failed to allocate sharded counters for server.\n");
+		goto out;
+	}
+
 	if (!stats_allocate_proxy_counters_internal(&srv->extra_counters,
 	                                            COUNTERS_SV,
 	                                            STATS_PX_CAP_SRV)) {
@@ -6771,7 +6779,7 @@ static void srv_update_status(struct server *s, int type, int cause)
 		}
 		else if (s->cur_state == SRV_ST_STOPPED) {
 			/* server was up and is currently down */
-			s->counters.down_trans++;
+			s->counters.shared.shard[ti->ctr_shard]->down_trans++;
 			_srv_event_hdl_publish(EVENT_HDL_SUB_SERVER_DOWN, cb_data.common, s);
 		}
 		s->counters.last_change = ns_to_sec(now_ns);
@@ -24,13 +24,19 @@
  *
  * Reserve blocks in the avail list and put them in the hot list
  * Return the first block put in the hot list or NULL if not enough blocks available
+ *
+ * New rows are taken from the arena of the current thread group, or from the
+ * next ones if it does not have enough blocks. Blocks appended to a row are
+ * taken from the arena of the row.
  */
 struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
                                            struct shared_block *first, int data_len)
 {
 	struct shared_block *last = NULL, *block, *sblock;
 	struct shared_block *ret = first;
+	struct shctx_arena *arena;
 	int remain = 1;
+	int tries;
 
 	BUG_ON(data_len < 0);
 
@@ -61,22 +67,37 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 		}
 	}
 
-	shctx_wrlock(shctx);
-
-	/* not enough usable blocks */
-	if (data_len > shctx->nbav * shctx->block_size) {
-		shctx_wrunlock(shctx);
-		goto out;
+	if (first) {
+		arena = shctx_block_arena(shctx, first);
+		tries = 1;
+	}
+	else {
+		arena = &shctx->arenas[(tgid - 1) % shctx->nb_arenas];
+		tries = shctx->nb_arenas;
 	}
 
+	while (1) {
+		HA_RWLOCK_WRLOCK(SHCTX_LOCK, &arena->lock);
+
+		if (data_len <= arena->nbav * shctx->block_size)
+			break;
+
+		/* not enough usable blocks */
+		HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &arena->lock);
+		if (!--tries)
+			goto out;
 
-	if (data_len <= 0 || LIST_ISEMPTY(&shctx->avail)) {
+		if (++arena == &shctx->arenas[shctx->nb_arenas])
+			arena = &shctx->arenas[0];
+	}
+
+	if (data_len <= 0 || LIST_ISEMPTY(&arena->avail)) {
 		ret = NULL;
-		shctx_wrunlock(shctx);
+		HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &arena->lock);
 		goto out;
 	}
 
-	list_for_each_entry_safe(block, sblock, &shctx->avail, list) {
+	list_for_each_entry_safe(block, sblock, &arena->avail, list) {
 
 		/* release callback */
 		if (block->len && shctx->free_block)
@@ -84,13 +105,13 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 		block->len = 0;
 
 		if (ret) {
-			shctx_block_append_hot(shctx, ret, block);
+			shctx_block_append_hot(arena, ret, block);
 			if (!remain) {
 				first->last_append = block;
 				remain = 1;
 			}
 		} else {
-			ret = shctx_block_detach(shctx, block);
+			ret = shctx_block_detach(arena, block);
 			ret->len = 0;
 			ret->block_count = 0;
 			ret->last_append = NULL;
@@ -107,7 +128,7 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 		}
 	}
 
-	shctx_wrunlock(shctx);
+	HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &arena->lock);
 
 	if (shctx->reserve_finish)
 		shctx->reserve_finish(shctx);
@@ -118,10 +139,12 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 
 /*
  * if the refcount is 0 move the row to the hot list. Increment the refcount
+ * The arena of the row must be locked.
  */
 void shctx_row_detach(struct shared_context *shctx, struct shared_block *first)
 {
 	if (first->refcount <= 0) {
+		struct shctx_arena *arena = shctx_block_arena(shctx, first);
 
 		BUG_ON(!first->last_reserved);
 
@@ -134,7 +157,7 @@ void shctx_row_detach(struct shared_context *shctx, struct shared_block *first)
 		first->list.p = &first->last_reserved->list;
 		first->last_reserved->list.n = &first->list;
 
-		shctx->nbav -= first->block_count;
+		arena->nbav -= first->block_count;
 	}
 
 	first->refcount++;
@@ -142,20 +165,22 @@ void shctx_row_detach(struct shared_context *shctx, struct shared_block *first)
 
 /*
  * decrement the refcount and move the row at the end of the avail list if it reaches 0.
+ * The arena of the row must be locked.
  */
 void shctx_row_reattach(struct shared_context *shctx, struct shared_block *first)
 {
 	first->refcount--;
 
 	if (first->refcount <= 0) {
+		struct shctx_arena *arena = shctx_block_arena(shctx, first);
 
 		BUG_ON(!first->last_reserved);
 
 		/* Reattach to avail list */
 		first->list.p = &first->last_reserved->list;
-		LIST_SPLICE_END_DETACHED(&shctx->avail, &first->list);
+		LIST_SPLICE_END_DETACHED(&arena->avail, &first->list);
 
-		shctx->nbav += first->block_count;
+		arena->nbav += first->block_count;
 	}
 }
 
@@ -266,14 +291,19 @@ int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
 /* Allocate shared memory context.
  * <maxblocks> is maximum blocks.
  * If <maxblocks> is set to less or equal to 0, ssl cache is disabled.
+ * The blocks are split into up to <arenas> arenas, as long as each of them
+ * can hold at least 4 objects of the maximum size. Users relying on the
+ * context-wide lock to protect their own data from the free_block callback
+ * must only use one.
  * Returns: -1 on alloc failure, <maxblocks> if it performs context alloc,
  * and 0 if cache is already allocated.
  */
 int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
-               unsigned int maxobjsz, int extra, const char *name)
+               unsigned int maxobjsz, int extra, int arenas, const char *name)
 {
 	int i;
 	struct shared_context *shctx;
+	struct shctx_arena *arena;
 	int ret;
 	void *cur;
 	int maptype = MAP_SHARED;
@@ -295,23 +325,34 @@ int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
 
 	vma_set_name(shctx, totalsize, "shctx", name);
 
-	shctx->nbav = 0;
-
-	LIST_INIT(&shctx->avail);
-	HA_RWLOCK_INIT(&shctx->lock);
-
 	shctx->block_size = blocksize;
 	shctx->max_obj_size = maxobjsz == (unsigned int)-1 ? 0 : maxobjsz;
 
+	arenas = MIN(arenas, MAX_TGROUPS);
+	while (arenas > 1 && (maxblocks / arenas < 4 ||
+	       (unsigned long long)maxblocks / arenas * blocksize < 4ULL * shctx->max_obj_size))
+		arenas--;
+	shctx->nb_arenas = MAX(arenas, 1);
+	shctx->arena_blocks = maxblocks / shctx->nb_arenas;
+
+	for (i = 0; i < shctx->nb_arenas; i++) {
+		shctx->arenas[i].nbav = 0;
+		LIST_INIT(&shctx->arenas[i].avail);
+		HA_RWLOCK_INIT(&shctx->arenas[i].lock);
+	}
+
 	/* init the free blocks after the shared context struct */
 	cur = (void *)shctx + sizeof(struct shared_context) + extra;
+	shctx->blocks = cur;
 	for (i = 0; i < maxblocks; i++) {
 		struct shared_block *cur_block = (struct shared_block *)cur;
+
+		arena = shctx_block_arena(shctx, cur_block);
 		cur_block->len = 0;
 		cur_block->refcount = 0;
 		cur_block->block_count = 1;
-		LIST_APPEND(&shctx->avail, &cur_block->list);
-		shctx->nbav++;
+		LIST_APPEND(&arena->avail, &cur_block->list);
+		arena->nbav++;
 		cur += sizeof(struct shared_block) + blocksize;
 	}
 	ret = maxblocks;
@@ -320,4 +361,3 @@ int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
 	*orig_shctx = shctx;
 	return ret;
 }
-
@@ -28,6 +28,31 @@
 #include <import/slz.h>
 #include <import/slz-tables.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__ARM_ARCH_ISA_A64)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* CRC32 folding with carry-less multiplies. The instruction is only enabled
+ * for the functions which need it, and is checked at run time unless the
+ * compiler already relies on it.
+ */
+#include <immintrin.h>
+#define SLZ_CRC32_CLMUL
+#if defined(__PCLMUL__)
+#define slz_have_clmul 1
+#else
+static int slz_have_clmul;
+#endif
+#endif
+
+/* Log2 of the smallest hash table used for small blocks */
+#define HASH_BITS_MIN 9
+
 /* First, RFC1951-specific declarations and extracts from the RFC.
  *
  * RFC1951 - deflate stream format
@@ -371,7 +396,7 @@ static void copy_lit_huff(struct slz_stream *strm, const unsigned char *buf, uin
 /* This hash provides good average results on HTML contents, and is among the
  * few which provide almost optimal results on various different pages.
  */
-static inline uint32_t slz_hash(uint32_t a)
+static inline uint32_t slz_hash(uint32_t a, uint32_t shift)
 {
 #if defined(__ARM_FEATURE_CRC32)
 #  if defined(__ARM_ARCH_ISA_A64)
@@ -381,9 +406,9 @@ static inline uint32_t slz_hash(uint32_t a)
 	// 32 bit mode (e.g. armv7 compiler building for armv8
 	__asm__ volatile("crc32w %0,%0,%1" : "+r"(a) : "r"(0));
 #  endif
-	return a >> (32 - HASH_BITS);
+	return a >> shift;
 #else
-	return ((a << 19) + (a << 6) - a) >> (32 - HASH_BITS);
+	return ((a << 19) + (a << 6) - a) >> shift;
 #endif
 }
 
@@ -400,6 +425,42 @@ static inline long memmatch(const unsigned char *a, const unsigned char *b, long
 #ifdef UNALIGNED_LE_OK
 	unsigned long xor;
 
+#if defined(__AVX2__)
+	while (len + 32 <= max) {
+		uint32_t neq;
+
+		neq = ~(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&a[len]),
+			                  _mm256_loadu_si256((const __m256i *)&b[len])));
+		if (neq)
+			return len + __builtin_ctz(neq);
+		len += 32;
+	}
+#elif defined(__SSE2__)
+	while (len + 16 <= max) {
+		uint32_t neq;
+
+		neq = 0xffff ^ _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&a[len]),
+			               _mm_loadu_si128((const __m128i *)&b[len])));
+		if (neq)
+			return len + __builtin_ctz(neq);
+		len += 16;
+	}
+#elif defined(__ARM_NEON) && defined(__ARM_ARCH_ISA_A64)
+	while (len + 16 <= max) {
+		uint64_t neq;
+
+		/* narrowing the 16 compare bytes gives 4 bits per byte */
+		neq = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+			vceqq_u8(vld1q_u8(&a[len]), vld1q_u8(&b[len]))), 4)), 0);
+		if (neq)
+			return len + __builtin_ctzll(neq) / 4;
+		len += 16;
+	}
+#endif
+
+	/* finish with words, it also covers short matches */
 	while (1) {
 		if ((long)(len + 2 * sizeof(long)) > max) {
 			while (len < max) {
@@ -518,6 +579,7 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 	uint32_t plit = 0;
 	uint32_t bit9 = 0;
 	uint32_t dist, code;
+	uint32_t hbits;
 	union ref refs[1 << HASH_BITS];
 
 	if (!strm->level) {
@@ -528,7 +590,13 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 		goto final_lit_dump;
 	}
 
-	reset_refs(refs, sizeof(refs));
+	/* Small blocks only use the beginning of the hash table, sized to
+	 * about two entries per input byte, so that resetting it does not cost
+	 * more than compressing them.
+	 */
+	for (hbits = HASH_BITS_MIN; hbits < HASH_BITS && (1L << hbits) < 2 * ilen; hbits++)
+		;
+	reset_refs(refs, sizeof(refs[0]) << hbits);
 
 	strm->outbuf = out;
 
@@ -541,7 +609,7 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 #else
 		word = *(uint32_t *)&in[pos];
 #endif
-		h = slz_hash(word);
+		h = slz_hash(word, 32 - hbits);
 		asm volatile ("" ::); // prevent gcc from trying to be smart with the prefetch
 
 		if (sizeof(long) >= 8) {
@@ -1038,9 +1106,106 @@ uint32_t slz_crc32_by4(uint32_t crc, const unsigned char *buf, int len)
 	return crc;
 }
 
+#ifdef SLZ_CRC32_CLMUL
+/* This version computes the crc32 of <buf> over <len> bytes by folding 64
+ * then 16 bytes at a time using carry-less multiplies, followed by a Barrett
+ * reduction, as described in Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction". <len> must be at least 64 and the
+ * last (len % 16) bytes are left to the caller. The CPU must support PCLMULQDQ.
+ */
+__attribute__((target("pclmul")))
+static uint32_t slz_crc32_clmul(uint32_t crc, const unsigned char *buf, long len)
+{
+	/* bit-reflected constants x^(n) mod P(x) for the folding distances,
+	 * then P(x) and floor(x^64 / P(x)) for the final reduction.
+	 */
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_set_epi32(0, ~0, 0, ~0);
+	__m128i x1, x2, x3, x4, y1, y2, y3, y4;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf +  0));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 32));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(~crc));
+	buf += 64;
+	len -= 64;
+
+	/* fold 4 lanes in parallel, 64 bytes per round */
+	while (len >= 64) {
+		y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128((const __m128i *)(buf +  0)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, y2), _mm_loadu_si128((const __m128i *)(buf + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, y3), _mm_loadu_si128((const __m128i *)(buf + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, y4), _mm_loadu_si128((const __m128i *)(buf + 48)));
+		buf += 64;
+		len -= 64;
+	}
+
+	/* fold the 4 lanes into one */
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x2);
+
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x3);
+
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x4);
+
+	/* fold the remaining 16-byte blocks */
+	while (len >= 16) {
+		y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128((const __m128i *)buf));
+		buf += 16;
+		len -= 16;
+	}
+
+	/* reduce 128 to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return ~(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
 /* uses the most suitable crc32 function to update crc on <buf, len> */
-static inline uint32_t update_crc(uint32_t crc, const void *buf, int len)
+static inline uint32_t update_crc(uint32_t crc, const void *buf, long len)
 {
+#ifdef SLZ_CRC32_CLMUL
+	if (len >= 64 && slz_have_clmul) {
+		crc = slz_crc32_clmul(crc, buf, len);
+		buf += len & -16L;
+		len &= 15;
+	}
+#endif
 	return slz_crc32_by4(crc, buf, len);
 }
 
@@ -1414,6 +1579,10 @@ int slz_rfc1950_finish(struct slz_stream *strm, unsigned char *buf)
 __attribute__((constructor))
 static void __slz_initialize(void)
 {
+#if defined(SLZ_CRC32_CLMUL) && !defined(__PCLMUL__)
+	__builtin_cpu_init();
+	slz_have_clmul = !!__builtin_cpu_supports("pclmul");
+#endif
 #if !defined(__ARM_FEATURE_CRC32)
 	__slz_make_crc_table();
 #endif
@@ -38,6 +38,9 @@
 #include <sys/types.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
 
 #include <import/ebpttree.h>
 #include <import/ebsttree.h>
@@ -238,6 +241,125 @@ struct show_keys_ctx {
 struct task *ssl_sock_io_cb(struct task *, void *, unsigned int);
 static int ssl_sock_handshake(struct connection *conn, unsigned int flag);
 
+#ifdef HAVE_SSL_KTLS
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+/* Called by OpenSSL through the BIO once the keys of one direction are known,
+ * to pass them to the kernel. Only the emission is offloaded: the reception
+ * remains in userland, which is also where the handshake messages and alerts
+ * are processed. This requires that the SSL layer directly runs over the
+ * socket. Returns 1 if the kernel now encrypts the data sent on the
+ * connection, otherwise 0, in which case OpenSSL continues to do it itself.
+ */
+static int ssl_sock_ktls_start(struct ssl_sock_ctx *ctx, int is_tx, const struct tls_crypto_info *info)
+{
+	struct connection *conn = ctx->conn;
+	socklen_t len;
+
+	if (!is_tx || !info)
+		return 0;
+
+	if (ctx->xprt != xprt_get(XPRT_RAW) || !conn_ctrl_ready(conn) || (conn->flags & CO_FL_FDLESS))
+		return 0;
+
+	switch (info->cipher_type) {
+	case TLS_CIPHER_AES_GCM_128:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+		break;
+#ifdef TLS_CIPHER_AES_GCM_256
+	case TLS_CIPHER_AES_GCM_256:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+		break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case TLS_CIPHER_CHACHA20_POLY1305:
+		len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+		break;
+#endif
+	default:
+		return 0;
+	}
+
+	if (ctx->xprt_st & SSL_SOCK_KTLS_SEND) {
+		/* TLS 1.3 key update: the kernel must switch to the new key,
+		 * otherwise the next records would leave under the old one.
+		 * The socket cannot leave kTLS mode anymore, so OpenSSL must
+		 * not take over the encryption either, and the connection has
+		 * to be closed.
+		 */
+		if (setsockopt(conn->handle.fd, SOL_TLS, TLS_TX, info, len) == 0)
+			return 1;
+		ctx->xprt_st &= ~SSL_SOCK_KTLS_SEND;
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_WR_SH;
+		return 0;
+	}
+
+	if (setsockopt(conn->handle.fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0 && errno != EEXIST)
+		return 0;
+
+	if (setsockopt(conn->handle.fd, SOL_TLS, TLS_TX, info, len) != 0)
+		return 0;
+
+	ctx->xprt_st |= SSL_SOCK_KTLS_SEND;
+	return 1;
+}
+
+/* Once kTLS is enabled, OpenSSL passes plain records to the BIO. Those which
+ * are not application data (alerts, post-handshake messages) are announced
+ * by a BIO control and must be sent with their record type so that the
+ * kernel encrypts them as such. Returns the number of bytes sent, or -1 with
+ * the BIO retry flag set if the socket is full, or -1 on error.
+ */
+static int ssl_sock_ktls_send_ctrl_msg(BIO *h, struct ssl_sock_ctx *ctx, const char *buf, int num)
+{
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	struct connection *conn = ctx->conn;
+	struct msghdr msg = { };
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int ret;
+
+	memset(cbuf, 0, sizeof(cbuf));
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*CMSG_DATA(cmsg) = ctx->ktls_ctrl_msg;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = num;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	BIO_clear_retry_flags(h);
+	ret = sendmsg(conn->handle.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (ret >= 0) {
+		/* the record is always sent as a whole */
+		ctx->ktls_ctrl_msg = 0;
+		return num;
+	}
+
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN) {
+		fd_cant_send(conn->handle.fd);
+		BIO_set_retry_write(h);
+	}
+	else if (errno != EINTR)
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_WR_SH;
+	else
+		BIO_set_retry_write(h);
+	return -1;
+}
+#endif /* HAVE_SSL_KTLS */
+
 /* Methods to implement OpenSSL BIO */
 static int ha_ssl_write(BIO *h, const char *buf, int num)
 {
@@ -247,6 +369,10 @@ static int ha_ssl_write(BIO *h, const char *buf, int num)
 	int ret;
 
 	ctx = BIO_get_data(h);
+#ifdef HAVE_SSL_KTLS
+	if (ctx->ktls_ctrl_msg)
+		return ssl_sock_ktls_send_ctrl_msg(h, ctx, buf, num);
+#endif
 	tmpbuf.size = num;
 	tmpbuf.area = (void *)(uintptr_t)buf;
 	tmpbuf.data = num;
@@ -296,12 +422,31 @@ static int ha_ssl_read(BIO *h, char *buf, int size)
 
 static long ha_ssl_ctrl(BIO *h, int cmd, long arg1, void *arg2)
 {
+#ifdef HAVE_SSL_KTLS
+	struct ssl_sock_ctx *ctx = BIO_get_data(h);
+#endif
 	int ret = 0;
 	switch (cmd) {
 	case BIO_CTRL_DUP:
 	case BIO_CTRL_FLUSH:
 		ret = 1;
 		break;
+#ifdef HAVE_SSL_KTLS
+	case BIO_CTRL_SET_KTLS:
+		ret = ssl_sock_ktls_start(ctx, arg1, arg2);
+		break;
+	case BIO_CTRL_GET_KTLS_SEND:
+		ret = !!(ctx->xprt_st & SSL_SOCK_KTLS_SEND);
+		break;
+	case BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+		ctx->ktls_ctrl_msg = arg1;
+		ret = 1;
+		break;
+	case BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+		ctx->ktls_ctrl_msg = 0;
+		ret = 1;
+		break;
+#endif
 	}
 	return ret;
 }
@@ -3422,6 +3567,10 @@ ssl_sock_initial_ctx(struct bind_conf *bind_conf)
 		options |= SSL_OP_NO_TICKET;
 	if (bind_conf->ssl_options & BC_SSL_O_PREF_CLIE_CIPH)
 		options &= ~SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef HAVE_SSL_KTLS
+	if (bind_conf->ssl_options & BC_SSL_O_KTLS)
+		options |= SSL_OP_ENABLE_KTLS;
+#endif
 
 #ifdef SSL_OP_NO_RENEGOTIATION
 	options |= SSL_OP_NO_RENEGOTIATION;
@@ -4436,6 +4585,10 @@ static int ssl_sock_prepare_srv_ssl_ctx(const struct server *srv, SSL_CTX *ctx)
 
 	if (srv->ssl_ctx.options & SRV_SSL_O_NO_TLS_TICKETS)
 		options |= SSL_OP_NO_TICKET;
+#ifdef HAVE_SSL_KTLS
+	if (srv->ssl_ctx.options & SRV_SSL_O_KTLS)
+		options |= SSL_OP_ENABLE_KTLS;
+#endif
 	SSL_CTX_set_options(ctx, options);
 
 #ifdef SSL_MODE_ASYNC
@@ -4704,7 +4857,7 @@ int ssl_sock_prepare_bind_conf(struct bind_conf *bind_conf)
 	if (!ssl_shctx && global.tune.sslcachesize) {
 		alloc_ctx = shctx_init(&ssl_shctx, global.tune.sslcachesize,
 		                       sizeof(struct sh_ssl_sess_hdr) + SHSESS_BLOCK_MIN_SIZE, -1,
-		                       sizeof(*sh_ssl_sess_tree), "ssl cache");
+		                       sizeof(*sh_ssl_sess_tree), 1, "ssl cache");
 		if (alloc_ctx <= 0) {
 			if (alloc_ctx == SHCTX_E_INIT_LOCK)
 				ha_alert("Unable to initialize the lock for the shared SSL session cache. You can retry using the global statement 'tune.ssl.force-private-cache' but it could increase CPU usage due to renegotiations if nbproc > 1.\n");
@@ -4960,6 +5113,7 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 	ctx->wait_event.tasklet->state  |= TASK_HEAVY; // assign it to the bulk queue during handshake
 	ctx->wait_event.events = 0;
 	ctx->sent_early_data = 0;
+	ctx->ktls_ctrl_msg = 0;
 	ctx->early_buf = BUF_NULL;
 	ctx->conn = conn;
 	ctx->subs = NULL;
@@ -5851,6 +6005,15 @@ static size_t ssl_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		/* a handshake was requested */
 		return 0;
 
+#ifdef HAVE_SSL_KTLS
+	/* the kernel encrypts the data, which may then be sent as-is. This
+	 * also spares OpenSSL from keeping a reference to a buffer it could
+	 * not write, since it doesn't copy the data in this mode.
+	 */
+	if (ctx->xprt_st & SSL_SOCK_KTLS_SEND)
+		return ctx->xprt->snd_buf(conn, ctx->xprt_ctx, buf, count, flags);
+#endif
+
 	/* send the largest possible block. For this we perform only one call
 	 * to send() unless the buffer wraps and we exactly fill the first hunk,
 	 * in which case we accept to do it once again.
@@ -5986,6 +6149,42 @@ static size_t ssl_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 	goto leave;
 }
 
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+/* Send up to <count> pending bytes from pipe <pipe> to the connection. This
+ * is only possible once the kernel encrypts the data (kTLS), which is checked
+ * by ssl_get_capability() before the pipe is used. Returns the number of
+ * bytes sent.
+ */
+static int ssl_sock_from_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe, unsigned int count)
+{
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	if (!ctx || !(ctx->xprt_st & SSL_SOCK_KTLS_SEND) || !ctx->xprt->snd_pipe)
+		return 0;
+
+	return ctx->xprt->snd_pipe(conn, ctx->xprt_ctx, pipe, count);
+}
+#endif
+
+/* Returns non-zero if the connection currently supports capability <cap> */
+static int ssl_get_capability(const struct connection *conn, void *xprt_ctx, enum xprt_capabilities cap)
+{
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+#endif
+
+	switch (cap) {
+	case XPRT_CAN_SPLICE:
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+		return ctx && (ctx->xprt_st & SSL_SOCK_KTLS_SEND) &&
+			!(conn->flags & (CO_FL_WAIT_XPRT | CO_FL_SSL_WAIT_HS | CO_FL_EARLY_SSL_HS));
+#else
+		return 0;
+#endif
+	}
+	return 0;
+}
+
 void ssl_sock_close(struct connection *conn, void *xprt_ctx) {
 
 	struct ssl_sock_ctx *ctx = xprt_ctx;
@@ -6765,7 +6964,11 @@ struct xprt_ops ssl_sock = {
 	.remove_xprt = ssl_remove_xprt,
 	.add_xprt = ssl_add_xprt,
 	.rcv_pipe = NULL,
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+	.snd_pipe = ssl_sock_from_pipe,
+#else
 	.snd_pipe = NULL,
+#endif
 	.shutr    = NULL,
 	.shutw    = ssl_sock_shutw,
 	.close    = ssl_sock_close,
@@ -6782,6 +6985,7 @@ struct xprt_ops ssl_sock = {
 	.get_ssl_sock_ctx = ssl_sock_get_ctx,
 	.name     = "SSL",
 	.show_fd  = ssl_sock_show_fd,
+	.get_capability = ssl_get_capability,
 };
 
 enum act_return ssl_action_wait_for_hs(struct act_rule *rule, struct proxy *px,
@@ -258,7 +258,7 @@ static int parse_stat_line(struct ist line,
 	struct server *srv;
 	struct proxy *px;
 	struct ist token;
-	char *base_off;
+	char *base_off, *shared_off;
 	char *guid;
 	int i, off;
 
@@ -281,12 +281,14 @@ static int parse_stat_line(struct ist line,
 			if (!(px->cap & PR_CAP_FE))
 				goto err;
 			base_off = (char *)&px->fe_counters;
+			shared_off = (char *)px->fe_counters.shared.shard[0];
 			off = 0;
 		}
 		else if (domain == STFILE_DOMAIN_PX_BE) {
 			if (!(px->cap & PR_CAP_BE))
 				goto err;
 			base_off = (char *)&px->be_counters;
+			shared_off = (char *)px->be_counters.shared.shard[0];
 			off = 1;
 		}
 		else {
@@ -305,6 +307,7 @@ static int parse_stat_line(struct ist line,
 			return 0;
 
 		base_off = (char *)li->counters;
+		shared_off = (char *)li->counters->shared.shard[0];
 		off = 0;
 		break;
 
@@ -314,6 +317,7 @@ static int parse_stat_line(struct ist line,
 
 		srv = __objt_server(node->obj_type);
 		base_off = (char *)&srv->counters;
+		shared_off = (char *)srv->counters.shared.shard[0];
 		off = 1;
 		break;
 
@@ -332,7 +336,11 @@ static int parse_stat_line(struct ist line,
 		if (!col)
 			continue;
 
-		load_ctr(col, token, base_off + col->metric.offset[off]);
+		/* cumulated counters are loaded into the first shard */
+		if (stcol_nature(col) == FN_COUNTER)
+			load_ctr(col, token, shared_off + col->metric.offset[off]);
+		else
+			load_ctr(col, token, base_off + col->metric.offset[off]);
 	}
 
 	return 0;
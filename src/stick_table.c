@@ -68,6 +68,9 @@ struct eb_root stktable_by_name = EB_ROOT;
 
 #define round_ptr_size(i) (((i) + (sizeof(void *) - 1)) &~ (sizeof(void *) - 1))
 
+/* max number of entries unlinked at once under a shard's write lock */
+#define STKTABLE_PURGE_BATCH 32
+
 /* This function inserts stktable <t> into the tree of known stick-table.
  * The stick-table ID is used as the storing key so it must already have
  * been initialized.
@@ -257,6 +260,76 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 	return ts;
 }
 
+/*
+ * Unlinks from shard <shard> of table <t> then frees the <nb> entries of
+ * <batch>, which were found unreferenced and expired or oldest while walking
+ * the shard's expiration tree under its seek lock. The entries were already
+ * detached from the expiration tree when batched so that the walk cannot meet
+ * them twice. The lock is only upgraded to a write lock for the time needed
+ * to unlink them from the other trees, and the entries are freed once it is
+ * back to a seek lock, so that lookups are never blocked during the tree walk
+ * nor while releasing the memory. Entries which were grabbed again or whose
+ * expiration date changed in the mean time are requeued, the next walk will
+ * handle them. Returns the number of entries freed.
+ */
+static int stktable_purge_batch(struct stktable *t, uint shard, struct stksess **batch, int nb)
+{
+	struct stksess *ts;
+	int updt_locked = 0;
+	int done = 0;
+	int i;
+
+	HA_RWLOCK_SKTOWR(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+
+	for (i = 0; i < nb; i++) {
+		ts = batch[i];
+
+		/* we were not yet write-locked when this entry was picked */
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt) != 0 ||
+		    HA_ATOMIC_LOAD(&ts->expire) != ts->exp.key)
+			goto requeue;
+
+		/* if the entry is in the update list, we must be extremely careful
+		 * because peers can see it at any moment and start to use it. Peers
+		 * will take the table's updt_lock for reading when doing that, and
+		 * with that lock held, will grab a ref_cnt before releasing the
+		 * lock. So we must take this lock as well and check the ref_cnt.
+		 */
+		if (ts->upd.node.leaf_p) {
+			if (!updt_locked) {
+				updt_locked = 1;
+				HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->updt_lock);
+			}
+			/* now we're locked, new peers can't grab it anymore,
+			 * existing ones already have the ref_cnt.
+			 */
+			if (HA_ATOMIC_LOAD(&ts->ref_cnt))
+				goto requeue;
+		}
+
+		ebmb_delete(&ts->key);
+		eb32_delete(&ts->upd);
+		batch[done++] = ts;
+		continue;
+
+	requeue:
+		ts->exp.key = HA_ATOMIC_LOAD(&ts->expire);
+		if (tick_isset(ts->exp.key))
+			eb32_insert(&t->shards[shard].exps, &ts->exp);
+	}
+
+	if (updt_locked)
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->updt_lock);
+
+	HA_RWLOCK_WRTOSK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+
+	/* nobody may reach these entries anymore */
+	for (i = 0; i < done; i++)
+		__stksess_free(t, batch[i]);
+
+	return done;
+}
+
 /*
  * Trash oldest <to_batch> sticky sessions from table <t>
  * Returns number of trashed sticky sessions. It may actually trash less
@@ -265,39 +338,48 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
  */
 int stktable_trash_oldest(struct stktable *t, int to_batch)
 {
+	struct stksess *batch[STKTABLE_PURGE_BATCH];
 	struct stksess *ts;
 	struct eb32_node *eb;
 	int max_search = to_batch * 2; // no more than 50% misses
 	int max_per_shard = (to_batch + CONFIG_HAP_TBL_BUCKETS - 1) / CONFIG_HAP_TBL_BUCKETS;
 	int done_per_shard;
 	int batched = 0;
-	int updt_locked;
 	int looped;
 	int shard;
+	int nb;
 
 	shard = 0;
 
 	while (batched < to_batch) {
 		done_per_shard = 0;
 		looped = 0;
-		updt_locked = 0;
+		nb = 0;
 
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+		HA_RWLOCK_SKLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
 
 		eb = eb32_lookup_ge(&t->shards[shard].exps, now_ms - TIMER_LOOK_BACK);
-		while (batched < to_batch && done_per_shard < max_per_shard) {
+		while (batched + nb < to_batch && done_per_shard + nb < max_per_shard) {
 			if (unlikely(!eb)) {
 				/* we might have reached the end of the tree, typically because
 				 * <now_ms> is in the first half and we're first scanning the last
 				 * half. Let's loop back to the beginning of the tree now if we
-				 * have not yet visited it.
+				 * have not yet visited it. The pending entries are purged
+				 * first so that we don't meet them again.
 				 */
 				if (looped)
 					break;
 				looped = 1;
+				if (nb) {
+					nb = stktable_purge_batch(t, shard, batch, nb);
+					done_per_shard += nb;
+					batched += nb;
+					nb = 0;
+				}
 				eb = eb32_first(&t->shards[shard].exps);
 				if (likely(!eb))
 					break;
+				continue;
 			}
 
 			if (--max_search < 0)
@@ -311,9 +393,8 @@ int stktable_trash_oldest(struct stktable *t, int to_batch)
 			if (HA_ATOMIC_LOAD(&ts->ref_cnt) != 0)
 				continue;
 
-			eb32_delete(&ts->exp);
-
 			if (ts->expire != ts->exp.key) {
+				eb32_delete(&ts->exp);
 				if (!tick_isset(ts->expire))
 					continue;
 
@@ -337,36 +418,24 @@ int stktable_trash_oldest(struct stktable *t, int to_batch)
 				continue;
 			}
 
-			/* if the entry is in the update list, we must be extremely careful
-			 * because peers can see it at any moment and start to use it. Peers
-			 * will take the table's updt_lock for reading when doing that, and
-			 * with that lock held, will grab a ref_cnt before releasing the
-			 * lock. So we must take this lock as well and check the ref_cnt.
-			 */
-			if (ts->upd.node.leaf_p) {
-				if (!updt_locked) {
-					updt_locked = 1;
-					HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->updt_lock);
-				}
-				/* now we're locked, new peers can't grab it anymore,
-				 * existing ones already have the ref_cnt.
-				 */
-				if (HA_ATOMIC_LOAD(&ts->ref_cnt))
-					continue;
+			/* session is old enough, it will be trashed with the next ones */
+			eb32_delete(&ts->exp);
+			batch[nb++] = ts;
+			if (nb == STKTABLE_PURGE_BATCH) {
+				nb = stktable_purge_batch(t, shard, batch, nb);
+				done_per_shard += nb;
+				batched += nb;
+				nb = 0;
 			}
-
-			/* session expired, trash it */
-			ebmb_delete(&ts->key);
-			eb32_delete(&ts->upd);
-			__stksess_free(t, ts);
-			batched++;
-			done_per_shard++;
 		}
 
-		if (updt_locked)
-			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->updt_lock);
+		if (nb) {
+			nb = stktable_purge_batch(t, shard, batch, nb);
+			done_per_shard += nb;
+			batched += nb;
+		}
 
-		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+		HA_RWLOCK_SKUNLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
 
 		if (max_search <= 0)
 			break;
@@ -835,21 +904,26 @@ struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
  */
 struct task *process_table_expire(struct task *task, void *context, unsigned int state)
 {
+	struct stksess *batch[STKTABLE_PURGE_BATCH];
 	struct stktable *t = context;
 	struct stksess *ts;
 	struct eb32_node *eb;
-	int updt_locked;
 	int looped;
 	int exp_next;
 	int task_exp;
 	int shard;
+	int nb;
 
 	task_exp = TICK_ETERNITY;
 
 	for (shard = 0; shard < CONFIG_HAP_TBL_BUCKETS; shard++) {
-		updt_locked = 0;
 		looped = 0;
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+		nb = 0;
+
+		/* lookups may still proceed while we're walking the tree, we
+		 * only need to block them when unlinking entries.
+		 */
+		HA_RWLOCK_SKLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
 		eb = eb32_lookup_ge(&t->shards[shard].exps, now_ms - TIMER_LOOK_BACK);
 
 		while (1) {
@@ -857,11 +931,16 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 				/* we might have reached the end of the tree, typically because
 				 * <now_ms> is in the first half and we're first scanning the last
 				 * half. Let's loop back to the beginning of the tree now if we
-				 * have not yet visited it.
+				 * have not yet visited it. The pending entries are purged
+				 * first so that we don't meet them again.
 				 */
 				if (looped)
 					break;
 				looped = 1;
+				if (nb) {
+					stktable_purge_batch(t, shard, batch, nb);
+					nb = 0;
+				}
 				eb = eb32_first(&t->shards[shard].exps);
 				if (likely(!eb))
 					break;
@@ -881,9 +960,8 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 			if (HA_ATOMIC_LOAD(&ts->ref_cnt) != 0)
 				continue;
 
-			eb32_delete(&ts->exp);
-
-			if (!tick_is_expired(ts->expire, now_ms)) {
+			if (ts->expire != ts->exp.key) {
+				eb32_delete(&ts->exp);
 				if (!tick_isset(ts->expire))
 					continue;
 
@@ -906,39 +984,24 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 				continue;
 			}
 
-			/* if the entry is in the update list, we must be extremely careful
-			 * because peers can see it at any moment and start to use it. Peers
-			 * will take the table's updt_lock for reading when doing that, and
-			 * with that lock held, will grab a ref_cnt before releasing the
-			 * lock. So we must take this lock as well and check the ref_cnt.
-			 */
-			if (ts->upd.node.leaf_p) {
-				if (!updt_locked) {
-					updt_locked = 1;
-					HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->updt_lock);
-				}
-				/* now we're locked, new peers can't grab it anymore,
-				 * existing ones already have the ref_cnt.
-				 */
-				if (HA_ATOMIC_LOAD(&ts->ref_cnt))
-					continue;
+			/* session expired, it will be trashed with the next ones */
+			eb32_delete(&ts->exp);
+			batch[nb++] = ts;
+			if (nb == STKTABLE_PURGE_BATCH) {
+				stktable_purge_batch(t, shard, batch, nb);
+				nb = 0;
 			}
-
-			/* session expired, trash it */
-			ebmb_delete(&ts->key);
-			eb32_delete(&ts->upd);
-			__stksess_free(t, ts);
 		}
 
 		/* We have found no task to expire in any tree */
 		exp_next = TICK_ETERNITY;
 
 	out_unlock:
-		if (updt_locked)
-			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->updt_lock);
+		if (nb)
+			stktable_purge_batch(t, shard, batch, nb);
 
 		task_exp = tick_first(task_exp, exp_next);
-		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
+		HA_RWLOCK_SKUNLOCK(STK_TABLE_LOCK, &t->shards[shard].sh_lock);
 	}
 
 	/* Reset the task's expiration. We do this under the lock so as not
@@ -2773,7 +2836,7 @@ static enum act_return action_inc_gpc(struct act_rule *rule, struct proxy *px,
 					       stkctr->table->data_arg[STKTABLE_DT_GPC_RATE].u, 1);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, std_t_uint)++;
+				HA_ATOMIC_INC(&stktable_data_cast(ptr2, std_t_uint));
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -2828,7 +2891,7 @@ static enum act_return action_inc_gpc0(struct act_rule *rule, struct proxy *px,
 				                       period, 1);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, std_t_uint)++;
+				HA_ATOMIC_INC(&stktable_data_cast(ptr2, std_t_uint));
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -2885,7 +2948,7 @@ static enum act_return action_inc_gpc1(struct act_rule *rule, struct proxy *px,
 				                       period, 1);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, std_t_uint)++;
+				HA_ATOMIC_INC(&stktable_data_cast(ptr2, std_t_uint));
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -3045,7 +3108,7 @@ static enum act_return action_set_gpt(struct act_rule *rule, struct proxy *px,
 
 		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 
-		stktable_data_cast(ptr, std_t_uint) = value;
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), value);
 
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -3114,7 +3177,7 @@ static enum act_return action_set_gpt0(struct act_rule *rule, struct proxy *px,
 
 		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 
-		stktable_data_cast(ptr, std_t_uint) = value;
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), value);
 
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -3309,7 +3372,7 @@ static enum act_return action_add_gpc(struct act_rule *rule, struct proxy *px,
 					       stkctr->table->data_arg[STKTABLE_DT_GPC_RATE].u, value);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, std_t_uint) += value;
+				HA_ATOMIC_ADD(&stktable_data_cast(ptr2, std_t_uint), value);
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 		}
@@ -3987,7 +4050,7 @@ smp_fetch_sc_inc_gpc(const struct arg *args, struct sample *smp, const char *kw,
 			}
 
 			if (ptr2)
-				smp->data.u.sint = ++stktable_data_cast(ptr2, std_t_uint);
+				smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr2, std_t_uint), 1);
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4056,7 +4119,7 @@ smp_fetch_sc_inc_gpc0(const struct arg *args, struct sample *smp, const char *kw
 			}
 
 			if (ptr2)
-				smp->data.u.sint = ++stktable_data_cast(ptr2, std_t_uint);
+				smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr2, std_t_uint), 1);
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4125,7 +4188,7 @@ smp_fetch_sc_inc_gpc1(const struct arg *args, struct sample *smp, const char *kw
 			}
 
 			if (ptr2)
-				smp->data.u.sint = ++stktable_data_cast(ptr2, std_t_uint);
+				smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr2, std_t_uint), 1);
 
 			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4176,7 +4239,7 @@ smp_fetch_sc_clr_gpc(const struct arg *args, struct sample *smp, const char *kw,
 		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-		stktable_data_cast(ptr, std_t_uint) = 0;
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), 0);
 
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4225,7 +4288,7 @@ smp_fetch_sc_clr_gpc0(const struct arg *args, struct sample *smp, const char *kw
 		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-		stktable_data_cast(ptr, std_t_uint) = 0;
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), 0);
 
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4274,7 +4337,7 @@ smp_fetch_sc_clr_gpc1(const struct arg *args, struct sample *smp, const char *kw
 		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-		stktable_data_cast(ptr, std_t_uint) = 0;
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), 0);
 
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
@@ -4405,7 +4468,7 @@ smp_fetch_src_updt_conn_cnt(const struct arg *args, struct sample *smp, const ch
 
 	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 
-	smp->data.u.sint = ++stktable_data_cast(ptr, std_t_uint);
+	smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr, std_t_uint), 1);
 
 	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -5316,10 +5379,10 @@ static int table_process_entry(struct appctx *appctx, struct stksess *ts, char *
 				stktable_data_cast(ptr, std_t_sint) = value;
 				break;
 			case STD_T_UINT:
-				stktable_data_cast(ptr, std_t_uint) = value;
+				HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_uint), value);
 				break;
 			case STD_T_ULL:
-				stktable_data_cast(ptr, std_t_ull) = value;
+				HA_ATOMIC_STORE(&stktable_data_cast(ptr, std_t_ull), value);
 				break;
 			case STD_T_FRQP:
 				/* We set both the current and previous values. That way
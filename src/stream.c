@@ -695,9 +695,9 @@ void stream_free(struct stream *s)
 	}
 
 	/* Cleanup all variable contexts. */
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!vars_is_empty(&s->vars_txn))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!vars_is_empty(&s->vars_reqres))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	stream_store_counters(s);
@@ -793,14 +793,14 @@ void stream_process_counters(struct stream *s)
 	bytes = s->req.total - s->logs.bytes_in;
 	s->logs.bytes_in = s->req.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_in, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_in,    bytes);
+		_HA_ATOMIC_ADD(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->bytes_in, bytes);
+		_HA_ATOMIC_ADD(&s->be->be_counters.shared.shard[ti->ctr_shard]->bytes_in,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.bytes_in, bytes);
+			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->bytes_in, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_in, bytes);
+			_HA_ATOMIC_ADD(&sess->listener->counters->shared.shard[ti->ctr_shard]->bytes_in, bytes);
 
 		for (i = 0; i < global.tune.nb_stk_ctr; i++) {
 			if (!stkctr_inc_bytes_in_ctr(&s->stkctr[i], bytes))
@@ -811,14 +811,14 @@ void stream_process_counters(struct stream *s)
 	bytes = s->res.total - s->logs.bytes_out;
 	s->logs.bytes_out = s->res.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_out, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_out,    bytes);
+		_HA_ATOMIC_ADD(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->bytes_out, bytes);
+		_HA_ATOMIC_ADD(&s->be->be_counters.shared.shard[ti->ctr_shard]->bytes_out,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.bytes_out, bytes);
+			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->bytes_out, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_out, bytes);
+			_HA_ATOMIC_ADD(&sess->listener->counters->shared.shard[ti->ctr_shard]->bytes_out, bytes);
 
 		for (i = 0; i < global.tune.nb_stk_ctr; i++) {
 			if (!stkctr_inc_bytes_out_ctr(&s->stkctr[i], bytes))
@@ -972,9 +972,9 @@ void sess_set_term_flags(struct stream *s)
 	if (!(s->flags & SF_FINST_MASK)) {
 		if (s->scb->state == SC_ST_INI) {
 			/* anything before REQ in fact */
-			_HA_ATOMIC_INC(&strm_fe(s)->fe_counters.failed_req);
+			_HA_ATOMIC_INC(&strm_fe(s)->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 			if (strm_li(s) && strm_li(s)->counters)
-				_HA_ATOMIC_INC(&strm_li(s)->counters->failed_req);
+				_HA_ATOMIC_INC(&strm_li(s)->counters->shared.shard[ti->ctr_shard]->failed_req);
 
 			s->flags |= SF_FINST_R;
 		}
@@ -1020,7 +1020,7 @@ enum act_return process_use_service(struct act_rule *rule, struct proxy *px,
 
 	if (rule->from != ACT_F_HTTP_REQ) {
 		if (sess->fe == s->be) /* report it if the request was intercepted by the frontend */
-			_HA_ATOMIC_INC(&sess->fe->fe_counters.intercepted_req);
+			_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->intercepted_req);
 
 		/* The flag SF_ASSIGNED prevent from server assignment. */
 		s->flags |= SF_ASSIGNED;
@@ -1817,12 +1817,12 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			sc_shutdown(scf);
 			//sc_report_error(scf); TODO: Be sure it is useless
 			if (!(req->analysers) && !(res->analysers)) {
-				_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.cli_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				if (!(s->flags & SF_ERR_MASK))
 					s->flags |= SF_ERR_CLICL;
 				if (!(s->flags & SF_FINST_MASK))
@@ -1836,16 +1836,16 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			sc_abort(scb);
 			sc_shutdown(scb);
 			//sc_report_error(scb); TODO: Be sure it is useless
-			_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+			_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (srv)
-				_HA_ATOMIC_INC(&srv->counters.failed_resp);
+				_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->failed_resp);
 			if (!(req->analysers) && !(res->analysers)) {
-				_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.srv_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				if (!(s->flags & SF_ERR_MASK))
 					s->flags |= SF_ERR_SRVCL;
 				if (!(s->flags & SF_FINST_MASK))
@@ -2138,30 +2138,30 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			req->analysers &= AN_REQ_FLT_END;
 			channel_auto_close(req);
 			if (scf->flags & SC_FL_ERROR) {
-				_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.cli_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				s->flags |= SF_ERR_CLICL;
 			}
 			else if (req->flags & CF_READ_TIMEOUT) {
-				_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.cli_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				s->flags |= SF_ERR_CLITO;
 			}
 			else {
-				_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.srv_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				s->flags |= SF_ERR_SRVTO;
 			}
 			sess_set_term_flags(s);
@@ -2184,30 +2184,30 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			res->analysers &= AN_RES_FLT_END;
 			channel_auto_close(res);
 			if (scb->flags & SC_FL_ERROR) {
-				_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.srv_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				s->flags |= SF_ERR_SRVCL;
 			}
 			else if (res->flags & CF_READ_TIMEOUT) {
-				_HA_ATOMIC_INC(&s->be->be_counters.srv_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.srv_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->srv_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->srv_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->srv_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.srv_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->srv_aborts);
 				s->flags |= SF_ERR_SRVTO;
 			}
 			else {
-				_HA_ATOMIC_INC(&s->be->be_counters.cli_aborts);
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.cli_aborts);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->cli_aborts);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->cli_aborts);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->cli_aborts);
 				if (srv)
-					_HA_ATOMIC_INC(&srv->counters.cli_aborts);
+					_HA_ATOMIC_INC(&srv->counters.shared.shard[ti->ctr_shard]->cli_aborts);
 				s->flags |= SF_ERR_CLITO;
 			}
 			sess_set_term_flags(s);
@@ -2305,7 +2305,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	if (sc_state_in(scb->state, SC_SB_REQ|SC_SB_QUE|SC_SB_TAR|SC_SB_ASS)) {
 		/* prune the request variables and swap to the response variables. */
 		if (s->vars_reqres.scope != SCOPE_RES) {
-			if (!LIST_ISEMPTY(&s->vars_reqres.head))
+			if (!vars_is_empty(&s->vars_reqres))
 				vars_prune(&s->vars_reqres, s->sess, s);
 			vars_init_head(&s->vars_reqres, SCOPE_RES);
 		}
@@ -2575,12 +2575,12 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 				n = 0;
 
 			if (sess->fe->mode == PR_MODE_HTTP) {
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.p.http.rsp[n]);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->p.http.rsp[n]);
 			}
 			if ((s->flags & SF_BE_ASSIGNED) &&
 			    (s->be->mode == PR_MODE_HTTP)) {
-				_HA_ATOMIC_INC(&s->be->be_counters.p.http.rsp[n]);
-				_HA_ATOMIC_INC(&s->be->be_counters.p.http.cum_req);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->p.http.rsp[n]);
+				_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->p.http.cum_req);
 			}
 		}
 
@@ -2635,10 +2635,14 @@ void stream_update_time_stats(struct stream *s)
 	t_connect -= t_queue;
 	t_queue   -= t_request;
 
+	/* Note: only the current thread group's number of requests is
+	 * considered here to decide on the samples window, which avoids
+	 * touching other groups' cache lines for a mere approximation.
+	 */
 	srv = objt_server(s->target);
 	if (srv) {
 		samples_window = (((s->be->mode == PR_MODE_HTTP) ?
-			srv->counters.p.http.cum_req : srv->counters.cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
+			srv->counters.shared.shard[ti->ctr_shard]->p.http.cum_req : srv->counters.shared.shard[ti->ctr_shard]->cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
 		swrate_add_dynamic(&srv->counters.q_time, samples_window, t_queue);
 		swrate_add_dynamic(&srv->counters.c_time, samples_window, t_connect);
 		swrate_add_dynamic(&srv->counters.d_time, samples_window, t_data);
@@ -2649,7 +2653,7 @@ void stream_update_time_stats(struct stream *s)
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ttime_max, t_close);
 	}
 	samples_window = (((s->be->mode == PR_MODE_HTTP) ?
-		s->be->be_counters.p.http.cum_req : s->be->be_counters.cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
+		s->be->be_counters.shared.shard[ti->ctr_shard]->p.http.cum_req : s->be->be_counters.shared.shard[ti->ctr_shard]->cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
 	swrate_add_dynamic(&s->be->be_counters.q_time, samples_window, t_queue);
 	swrate_add_dynamic(&s->be->be_counters.c_time, samples_window, t_connect);
 	swrate_add_dynamic(&s->be->be_counters.d_time, samples_window, t_data);
@@ -237,23 +237,23 @@ int tcp_inspect_request(struct stream *s, struct channel *req, int an_bit)
 	return 0;
 
  deny:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->denied_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_req);
 	goto reject;
 
  internal:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.internal_errors);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
 	goto reject;
 
  invalid:
-	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_req);
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->failed_req);
 	if (sess->listener && sess->listener->counters)
-		_HA_ATOMIC_INC(&sess->listener->counters->failed_req);
+		_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->failed_req);
 
  reject:
 	sc_must_kill_conn(s->scf);
@@ -428,29 +428,29 @@ int tcp_inspect_response(struct stream *s, struct channel *rep, int an_bit)
 	return 0;
 
   deny:
-	_HA_ATOMIC_INC(&s->sess->fe->fe_counters.denied_resp);
-	_HA_ATOMIC_INC(&s->be->be_counters.denied_resp);
+	_HA_ATOMIC_INC(&s->sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->denied_resp);
 	if (s->sess->listener && s->sess->listener->counters)
-		_HA_ATOMIC_INC(&s->sess->listener->counters->denied_resp);
+		_HA_ATOMIC_INC(&s->sess->listener->counters->shared.shard[ti->ctr_shard]->denied_resp);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.denied_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->denied_resp);
 	goto reject;
 
  internal:
-	_HA_ATOMIC_INC(&s->sess->fe->fe_counters.internal_errors);
-	_HA_ATOMIC_INC(&s->be->be_counters.internal_errors);
+	_HA_ATOMIC_INC(&s->sess->fe->fe_counters.shared.shard[ti->ctr_shard]->internal_errors);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (s->sess->listener && s->sess->listener->counters)
-		_HA_ATOMIC_INC(&s->sess->listener->counters->internal_errors);
+		_HA_ATOMIC_INC(&s->sess->listener->counters->shared.shard[ti->ctr_shard]->internal_errors);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.internal_errors);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->internal_errors);
 	if (!(s->flags & SF_ERR_MASK))
 		s->flags |= SF_ERR_INTERNAL;
 	goto reject;
 
  invalid:
-	_HA_ATOMIC_INC(&s->be->be_counters.failed_resp);
+	_HA_ATOMIC_INC(&s->be->be_counters.shared.shard[ti->ctr_shard]->failed_resp);
 	if (objt_server(s->target))
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_resp);
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.shared.shard[ti->ctr_shard]->failed_resp);
 
  reject:
 	sc_must_kill_conn(s->scb);
@@ -531,9 +531,9 @@ int tcp_exec_l4_rules(struct session *sess)
 				goto end;
 			}
 			else if (rule->action == ACT_ACTION_DENY) {
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_conn);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_conn);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->denied_conn);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_conn);
 
 				result = 0;
 				goto end;
@@ -626,9 +626,9 @@ int tcp_exec_l5_rules(struct session *sess)
 				goto end;
 			}
 			else if (rule->action == ACT_ACTION_DENY) {
-				_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_sess);
+				_HA_ATOMIC_INC(&sess->fe->fe_counters.shared.shard[ti->ctr_shard]->denied_sess);
 				if (sess->listener && sess->listener->counters)
-					_HA_ATOMIC_INC(&sess->listener->counters->denied_sess);
+					_HA_ATOMIC_INC(&sess->listener->counters->shared.shard[ti->ctr_shard]->denied_sess);
 
 				result = 0;
 				goto end;
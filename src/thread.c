@@ -439,6 +439,7 @@ static const char *lock_label(enum lock_label label)
 	case SSL_GEN_CERTS_LOCK:   return "SSL_GEN_CERTS";
 	case PATREF_LOCK:          return "PATREF";
 	case PATEXP_LOCK:          return "PATEXP";
+	case PATGC_LOCK:           return "PATGC";
 	case VARS_LOCK:            return "VARS";
 	case COMP_POOL_LOCK:       return "COMP_POOL";
 	case LUA_LOCK:             return "LUA";
@@ -188,25 +188,43 @@ unsigned int var_clear(struct var *var, int force)
 	var->data.type = SMP_T_ANY;
 
 	if (!(var->flags & VF_PERMANENT) || force) {
-		LIST_DELETE(&var->l);
+		eb64_delete(&var->node);
 		pool_free(var_pool, var);
 		size += sizeof(struct var);
 	}
 	return size;
 }
 
+/* Removes and frees all variables stored in <vars>, which must be locked if
+ * needed. Returns the freed size.
+ */
+static unsigned int vars_clear_all(struct vars *vars)
+{
+	struct eb64_node *node;
+	struct var *var;
+	unsigned int size = 0;
+	int i;
+
+	for (i = 0; i < VAR_NAME_ROOTS; i++) {
+		node = eb64_first(&vars->name_root[i]);
+		while (node) {
+			var = eb64_entry(node, struct var, node);
+			node = eb64_next(node);
+			size += var_clear(var, 1);
+		}
+	}
+	return size;
+}
+
 /* This function free all the memory used by all the variables
  * in the list.
  */
 void vars_prune(struct vars *vars, struct session *sess, struct stream *strm)
 {
-	struct var *var, *tmp;
-	unsigned int size = 0;
+	unsigned int size;
 
 	vars_wrlock(vars);
-	list_for_each_entry_safe(var, tmp, &vars->head, l) {
-		size += var_clear(var, 1);
-	}
+	size = vars_clear_all(vars);
 	vars_wrunlock(vars);
 	var_accounting_diff(vars, sess, strm, -size);
 }
@@ -216,13 +234,10 @@ void vars_prune(struct vars *vars, struct session *sess, struct stream *strm)
  */
 void vars_prune_per_sess(struct vars *vars)
 {
-	struct var *var, *tmp;
-	unsigned int size = 0;
+	unsigned int size;
 
 	vars_wrlock(vars);
-	list_for_each_entry_safe(var, tmp, &vars->head, l) {
-		size += var_clear(var, 1);
-	}
+	size = vars_clear_all(vars);
 	vars_wrunlock(vars);
 
 	if (var_sess_limit)
@@ -234,7 +249,10 @@ void vars_prune_per_sess(struct vars *vars)
 /* This function initializes a variables list head */
 void vars_init_head(struct vars *vars, enum vars_scope scope)
 {
-	LIST_INIT(&vars->head);
+	int i;
+
+	for (i = 0; i < VAR_NAME_ROOTS; i++)
+		vars->name_root[i] = EB_ROOT;
 	vars->scope = scope;
 	vars->size = 0;
 	HA_RWLOCK_INIT(&vars->rwlock);
@@ -336,18 +354,20 @@ static int vars_fill_desc(const char *name, int len, struct var_desc *desc, char
 }
 
 /* This function returns the variable from the given list that matches
- * <name_hash> or returns NULL if not found. It's only a linked list since it
- * is not expected to have many variables per scope (a few tens at best).
- * The caller is responsible for ensuring that <vars> is properly locked.
+ * <name_hash> or returns NULL if not found. The variables are spread over a
+ * few trees indexed on the name hash, whose lowest bits select the tree, so
+ * that configurations setting many variables per scope do not suffer from a
+ * linear lookup. The caller is responsible for ensuring that <vars> is
+ * properly locked.
  */
 static struct var *var_get(struct vars *vars, uint64_t name_hash)
 {
-	struct var *var;
+	struct eb64_node *node;
 
-	list_for_each_entry(var, &vars->head, l)
-		if (var->name_hash == name_hash)
-			return var;
-	return NULL;
+	node = eb64_lookup(&vars->name_root[name_hash % VAR_NAME_ROOTS], name_hash);
+	if (!node)
+		return NULL;
+	return eb64_entry(node, struct var, node);
 }
 
 /* Returns 0 if fails, else returns 1. */
@@ -443,8 +463,8 @@ int var_set(const struct var_desc *desc, struct sample *smp, uint flags)
 		var = pool_alloc(var_pool);
 		if (!var)
 			goto unlock;
-		LIST_APPEND(&vars->head, &var->l);
-		var->name_hash = desc->name_hash;
+		var->node.key = desc->name_hash;
+		eb64_insert(&vars->name_root[desc->name_hash % VAR_NAME_ROOTS], &var->node);
 		var->flags = flags & VF_PERMANENT;
 		var->data.type = SMP_T_ANY;
 	}